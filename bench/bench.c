@@ -0,0 +1,547 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_LOCALE_H
+#include <locale.h>
+#endif
+
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+
+/* Each operation runs in a child of its own, so its peak RSS is its own */
+#if defined(HAVE_FORK) && defined(HAVE_UNISTD_H) && defined(HAVE_SYS_WAIT_H)
+#include <sys/wait.h>
+#define BENCH_FORK 1
+#endif
+
+#include "libpolyhedra.h"
+
+/* Times each public operation on each model and reports the results as JSON */
+
+#define MAX_TARGETS 3
+
+static const size_t target_div[MAX_TARGETS] = {2, 4, 10};
+
+struct bench {
+  FILE *out;
+  size_t iterations;
+  float threshold;
+  const char *tmp_name;
+  double *times;
+  int first_op;
+};
+
+/* The arg of each operation is whatever it needs beyond the model */
+typedef int (*bench_func_t)(struct bench *bench, struct lp_vl_list *data, const void *arg);
+
+void help(FILE *out) {
+  fprintf(out, "%s: benchmark libpolyhedra operations\n", PACKAGE_STRING);
+  fprintf(out, "  polyhedra_bench [-d t] [-h] [-j threads] [-n iterations] [-o <outfile>]\n");
+  fprintf(out, "    [-t <tmpfile>] <model>...\n\n");
+  fprintf(out, "  Reads each model and times read, simplify, convex hull, plane cut, mass\n");
+  fprintf(out, "  properties, convex decomposition and write.  For each operation the\n");
+  fprintf(out, "  median and 95th percentile wall time, the peak resident set size and the\n");
+  fprintf(out, "  throughput in input faces per second are written as JSON.  Where fork is\n");
+  fprintf(out, "  available each operation runs in a child process, so its peak RSS covers\n");
+  fprintf(out, "  the loaded model and that operation only.  Otherwise it is the peak of the\n");
+  fprintf(out, "  whole process so far.  Exits with status 1 if any operation failed.\n\n");
+  fprintf(out, "  -d threshold\n");
+  fprintf(out, "    Convex decomposition threshold.  Default: 0.05\n\n");
+  fprintf(out, "  -h\n");
+  fprintf(out, "    Print this help screen and exit\n\n");
+  fprintf(out, "  -j threads\n");
+  fprintf(out, "    Number of worker threads.  Default: 1\n\n");
+  fprintf(out, "  -n iterations\n");
+  fprintf(out, "    Number of times each operation is run.  Default: 5\n\n");
+  fprintf(out, "  -o <outfile>\n");
+  fprintf(out, "    Write the JSON report to <outfile>.  Default: standard output\n\n");
+  fprintf(out, "  -t <tmpfile>\n");
+  fprintf(out, "    Scratch file used by the write benchmarks, the extension is replaced.\n");
+  fprintf(out, "    Default: polyhedra_bench.tmp\n\n");
+}
+
+static double Now(void) {
+  struct timespec ts;
+  
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long PeakRss(void) {
+#ifdef HAVE_GETRUSAGE
+  struct rusage usage;
+  
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+    return usage.ru_maxrss;
+#endif
+  
+  return -1;
+}
+
+static int CompareDouble(const void *a, const void *b) {
+  double da = *(const double *) a, db = *(const double *) b;
+  
+  return (da > db) - (da < db);
+}
+
+static size_t NumFaces(const struct lp_vl_list *list) {
+  size_t faces = 0;
+  
+  for (; list != NULL; list = list->next)
+    faces += LP_VertexList_NumInd(list->vl) / 3;
+  
+  return faces;
+}
+
+static const char *BaseName(const char *filename) {
+  const char *base;
+  
+  if ((base = strrchr(filename, '/')) != NULL)
+    return base + 1;
+  
+  return filename;
+}
+
+#ifdef BENCH_FORK
+static int PipeWrite(int fd, const void *buf, size_t len) {
+  const char *cur = (const char *) buf;
+  ssize_t ret;
+  
+  for (; len > 0; len -= (size_t) ret, cur += ret)
+    if ((ret = write(fd, cur, len)) <= 0)
+      return -1;
+  
+  return 0;
+}
+
+static int PipeRead(int fd, void *buf, size_t len) {
+  char *cur = (char *) buf;
+  ssize_t ret;
+  
+  for (; len > 0; len -= (size_t) ret, cur += ret)
+    if ((ret = read(fd, cur, len)) <= 0)
+      return -1;
+  
+  return 0;
+}
+
+/* The child sends back its status, peak RSS and timings.  A child that
+ * crashes or dies early counts as a failed operation. */
+static int Measure(struct bench *bench, bench_func_t func, struct lp_vl_list *data, const void *arg, long *rss) {
+  int fds[2], status, ret = -1;
+  pid_t pid;
+  
+  fflush(bench->out);
+  if (pipe(fds) < 0) {
+    fprintf(stderr, "Error: Could not create pipe for benchmark\n");
+    return -1;
+  }
+  if ((pid = fork()) < 0) {
+    fprintf(stderr, "Error: Could not fork benchmark\n");
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+  }
+  
+  if (pid == 0) {
+    close(fds[0]);
+    ret = func(bench, data, arg);
+    *rss = PeakRss();
+    if (PipeWrite(fds[1], &ret, sizeof(ret)) < 0 ||
+	PipeWrite(fds[1], rss, sizeof(*rss)) < 0 ||
+	(ret >= 0 && PipeWrite(fds[1], bench->times, bench->iterations * sizeof(*bench->times)) < 0))
+      _exit(1);
+    _exit(0);
+  }
+  
+  close(fds[1]);
+  if (PipeRead(fds[0], &ret, sizeof(ret)) < 0 ||
+      PipeRead(fds[0], rss, sizeof(*rss)) < 0 ||
+      (ret >= 0 && PipeRead(fds[0], bench->times, bench->iterations * sizeof(*bench->times)) < 0))
+    ret = -1;
+  close(fds[0]);
+  
+  while (waitpid(pid, &status, 0) < 0)
+    ;
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    ret = -1;
+  
+  return ret;
+}
+#else
+static int Measure(struct bench *bench, bench_func_t func, struct lp_vl_list *data, const void *arg, long *rss) {
+  int ret;
+  
+  ret = func(bench, data, arg);
+  *rss = PeakRss();
+  
+  return ret;
+}
+#endif
+
+/* A failed operation is reported, but does not stop the benchmark */
+static int Report(struct bench *bench, const char *name, size_t target, size_t faces, bench_func_t func, struct lp_vl_list *data, const void *arg) {
+  double median, p95;
+  size_t num = bench->iterations;
+  long rss;
+  int status;
+  
+  status = Measure(bench, func, data, arg, &rss);
+  
+  fprintf(bench->out, "%s\n        {\"name\": \"%s\"", bench->first_op ? "" : ",", name);
+  if (target)
+    fprintf(bench->out, ", \"target_faces\": %zu", target);
+  bench->first_op = 0;
+  
+  if (status < 0) {
+    fprintf(bench->out, ", \"failed\": true}");
+    fprintf(stderr, "Error: %s failed\n", name);
+    return -1;
+  }
+  
+  qsort(bench->times, num, sizeof(*bench->times), CompareDouble);
+  median = num % 2 ? bench->times[num / 2] : 0.5 * (bench->times[num / 2 - 1] + bench->times[num / 2]);
+  p95 = bench->times[(num * 95 + 99) / 100 - 1];
+  
+  fprintf(bench->out, ", \"median_s\": %.9f, \"p95_s\": %.9f", median, p95);
+  if (rss >= 0)
+    fprintf(bench->out, ", \"peak_rss_kb\": %ld", rss);
+  else
+    fprintf(bench->out, ", \"peak_rss_kb\": null");
+  if (median > 0)
+    fprintf(bench->out, ", \"faces_per_s\": %.1f}", faces / median);
+  else
+    fprintf(bench->out, ", \"faces_per_s\": null}");
+  
+  return 0;
+}
+
+static int BenchRead(struct bench *bench, struct lp_vl_list *data, const void *arg) {
+  const char *filename = (const char *) arg;
+  struct lp_vl_list *list;
+  double start;
+  size_t count;
+  
+  for (count = 0; count < bench->iterations; count++) {
+    start = Now();
+    if ((list = LP_VertexList_Read(filename, 1.0)) == NULL)
+      return -1;
+    bench->times[count] = Now() - start;
+    LP_VertexList_ListFree(list);
+  }
+  
+  return 0;
+}
+
+static int BenchSimplify(struct bench *bench, struct lp_vl_list *data, const void *arg) {
+  size_t target = *(const size_t *) arg;
+  const struct lp_vl_list *list;
+  struct lp_vertex_list *vl;
+  double start;
+  size_t count;
+  
+  for (count = 0; count < bench->iterations; count++) {
+    start = Now();
+    for (list = data; list != NULL; list = list->next) {
+      if ((vl = LP_Simplify(list->vl, target, 0)) == NULL)
+	return -1;
+      LP_VertexList_Free(vl);
+    }
+    bench->times[count] = Now() - start;
+  }
+  
+  return 0;
+}
+
+static int BenchConvexHull(struct bench *bench, struct lp_vl_list *data, const void *arg) {
+  const struct lp_vl_list *list;
+  struct lp_vertex_list *vl;
+  double start;
+  size_t count;
+  
+  for (count = 0; count < bench->iterations; count++) {
+    start = Now();
+    for (list = data; list != NULL; list = list->next) {
+      if ((vl = LP_ConvexHull(list->vl)) == NULL)
+	return -1;
+      LP_VertexList_Free(vl);
+    }
+    bench->times[count] = Now() - start;
+  }
+  
+  return 0;
+}
+
+/* Cuts each polyhedron through its center of mass, normal to z */
+static int BenchPlaneCut(struct bench *bench, struct lp_vl_list *data, const void *arg) {
+  const float norm[3] = {0, 0, 1};
+  const struct lp_vl_list *list;
+  struct lp_vl_list *pieces;
+  struct lp_mass_properties mp;
+  double start;
+  size_t count;
+  
+  for (count = 0; count < bench->iterations; count++) {
+    start = Now();
+    for (list = data; list != NULL; list = list->next) {
+      LP_MassProperties(list->vl, &mp);
+      if ((pieces = LP_PlaneCut(list->vl, norm, mp.center_of_mass[2])) == NULL)
+	return -1;
+      LP_VertexList_ListFree(pieces);
+    }
+    bench->times[count] = Now() - start;
+  }
+  
+  return 0;
+}
+
+static int BenchMassProperties(struct bench *bench, struct lp_vl_list *data, const void *arg) {
+  const struct lp_vl_list *list;
+  struct lp_mass_properties mp;
+  double start;
+  size_t count;
+  
+  for (count = 0; count < bench->iterations; count++) {
+    start = Now();
+    for (list = data; list != NULL; list = list->next)
+      LP_MassProperties(list->vl, &mp);
+    bench->times[count] = Now() - start;
+  }
+  
+  return 0;
+}
+
+static int BenchConvexDecomp(struct bench *bench, struct lp_vl_list *data, const void *arg) {
+  const struct lp_vl_list *list;
+  struct lp_vl_list *pieces;
+  double start;
+  size_t count;
+  
+  for (count = 0; count < bench->iterations; count++) {
+    start = Now();
+    for (list = data; list != NULL; list = list->next) {
+      if ((pieces = LP_ConvexDecomp(list->vl, bench->threshold)) == NULL)
+	return -1;
+      LP_VertexList_ListFree(pieces);
+    }
+    bench->times[count] = Now() - start;
+  }
+  
+  return 0;
+}
+
+static int BenchWrite(struct bench *bench, struct lp_vl_list *data, const void *arg) {
+  const char *ext = (const char *) arg;
+  char *filename;
+  const char *dot;
+  double start;
+  size_t count, len;
+  int ret = -1;
+  
+  dot = strrchr(bench->tmp_name, '.');
+  len = dot && dot > BaseName(bench->tmp_name) ? (size_t) (dot - bench->tmp_name) : strlen(bench->tmp_name);
+  if ((filename = malloc(len + strlen(ext) + 1)) == NULL) {
+    fprintf(stderr, "Error: Allocating memory for scratch file name\n");
+    return -1;
+  }
+  memcpy(filename, bench->tmp_name, len);
+  strcpy(filename + len, ext);
+  
+  for (count = 0; count < bench->iterations; count++) {
+    start = Now();
+    if (LP_VertexList_Write(filename, data, 1.0) < 0)
+      goto err;
+    bench->times[count] = Now() - start;
+  }
+  ret = 0;
+  
+ err:
+  remove(filename);
+  free(filename);
+  return ret;
+}
+
+static int BenchModel(struct bench *bench, const char *filename) {
+  struct lp_vl_list *data;
+  size_t faces, target, last, count;
+  int failed = 0;
+  
+  if ((data = LP_VertexList_Read(filename, 1.0)) == NULL)
+    return -1;
+  faces = NumFaces(data);
+  
+  fprintf(bench->out, "    {\"model\": \"%s\", \"polyhedra\": %zu, \"faces\": %zu, \"operations\": [",
+	  BaseName(filename), LP_VertexList_ListLength(data), faces);
+  bench->first_op = 1;
+  
+  failed |= Report(bench, "read", 0, faces, BenchRead, data, filename);
+  
+  for (count = 0, last = 0; count < MAX_TARGETS; count++) {
+    target = faces / target_div[count];
+    if (target < 4 || target == last)
+      continue;
+    failed |= Report(bench, "simplify", target, faces, BenchSimplify, data, &target);
+    last = target;
+  }
+  
+  failed |= Report(bench, "convex_hull", 0, faces, BenchConvexHull, data, NULL);
+  failed |= Report(bench, "plane_cut", 0, faces, BenchPlaneCut, data, NULL);
+  failed |= Report(bench, "mass_properties", 0, faces, BenchMassProperties, data, NULL);
+  failed |= Report(bench, "convex_decomp", 0, faces, BenchConvexDecomp, data, NULL);
+  failed |= Report(bench, "write_obj", 0, faces, BenchWrite, data, ".obj");
+  failed |= Report(bench, "write_stl", 0, faces, BenchWrite, data, ".stl");
+  failed |= Report(bench, "write_ply", 0, faces, BenchWrite, data, ".ply");
+  failed |= Report(bench, "write_lpm", 0, faces, BenchWrite, data, ".lpm");
+  
+  fprintf(bench->out, "\n      ]}");
+  LP_VertexList_ListFree(data);
+  return failed ? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+  struct bench bench;
+  const char *outfile = NULL;
+  unsigned long long val;
+  size_t threads = 1;
+  char *end;
+  int opt, status = 0, ret = 0;
+
+#ifdef HAVE_SETLOCALE
+  setlocale(LC_NUMERIC, "C");
+#endif
+  
+  bench.out = stdout;
+  bench.iterations = 5;
+  bench.threshold = 0.05;
+  bench.tmp_name = "polyhedra_bench.tmp";
+  
+  while ((opt = getopt(argc, argv, "d:hj:n:o:t:")) >= 0) {
+    switch (opt) {
+    case 'd':
+      bench.threshold = strtof(optarg, &end);
+      if (*end != '\0' || bench.threshold <= 0) {
+	fprintf(stderr, "Error: expected positive floating point number for -d argument: %s\n", optarg);
+	help(stderr);
+	exit(1);
+      }
+      break;
+      
+    case 'h':
+      help(stdout);
+      exit(0);
+      
+    case 'j':
+    case 'n':
+      val = strtoull(optarg, &end, 0);
+      if (*end != '\0' || val == 0) {
+	fprintf(stderr, "Error: expected positive integer for -%c argument: %s\n", (char) opt, optarg);
+	help(stderr);
+	exit(1);
+      }
+      if (opt == 'j')
+	threads = val;
+      else
+	bench.iterations = val;
+      break;
+      
+    case 'o':
+      outfile = optarg;
+      break;
+      
+    case 't':
+      bench.tmp_name = optarg;
+      break;
+      
+    default:
+      fprintf(stderr, "Error unknown option '%c'\n", (char) opt);
+      help(stderr);
+      exit(1);
+    }
+  }
+  
+  if (optind >= argc) {
+    fprintf(stderr, "Error: At least one model expected\n");
+    help(stderr);
+    exit(1);
+  }
+  
+  if ((bench.times = malloc(sizeof(*bench.times) * bench.iterations)) == NULL) {
+    fprintf(stderr, "Error: Allocating memory for timings\n");
+    exit(1);
+  }
+  
+  if (outfile && (bench.out = fopen(outfile, "w")) == NULL) {
+    fprintf(stderr, "Error: Could not open '%s' for writing\n", outfile);
+    exit(1);
+  }
+  
+  LP_SetNumThreads(threads);
+  
+  fprintf(bench.out, "{\n  \"library\": \"%s\",\n", PACKAGE_STRING);
+  fprintf(bench.out, "  \"iterations\": %zu,\n  \"threads\": %zu,\n", bench.iterations, LP_GetNumThreads());
+  fprintf(bench.out, "  \"decomp_threshold\": %g,\n  \"models\": [\n", bench.threshold);
+  
+  for (; optind < argc; optind++) {
+    if ((status = BenchModel(&bench, argv[optind])) < 0) {
+      fprintf(stderr, "Error: Benchmark failed for '%s'\n", argv[optind]);
+      ret = 1;
+      break;
+    }
+    if (status > 0) {
+      fprintf(stderr, "Error: Some operations failed for '%s'\n", argv[optind]);
+      ret = 1;
+    }
+    fprintf(bench.out, "%s\n", optind + 1 < argc ? "," : "");
+  }
+  
+  fprintf(bench.out, "%s  ]\n}\n", status < 0 ? "\n" : "");
+  
+  if (outfile)
+    fclose(bench.out);
+  free(bench.times);
+  
+  return ret;
+}
@@ -31,6 +31,9 @@
 #ifndef LIBPOLYHEDRA_H
 #define LIBPOLYHEDRA_H
 
+#include "libpolyhedra_config.h"
+#include <limits.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -48,26 +51,53 @@ enum primative_type {
 
 struct lp_vertex_list;
 
+/* Vertex index, 64 bits wide when configured with --enable-large-mesh */
+#if LP_LARGE_MESH
+typedef unsigned long long lp_index_t;
+#define LP_INDEX_MAX ULLONG_MAX
+#else
+typedef unsigned int lp_index_t;
+#define LP_INDEX_MAX UINT_MAX
+#endif
+
 struct lp_vertex_list *LP_VertexList_New(size_t floats_per_vert, enum primative_type pt);
+/* Every added vertex is kept, even if it repeats an earlier one */
+#define LP_VERTEX_LIST_NO_DEDUP 1
+struct lp_vertex_list *LP_VertexList_NewEx(size_t floats_per_vert, enum primative_type pt, int flags);
 void LP_VertexList_Free(struct lp_vertex_list *vl);
 void LP_VertexList_Clear(struct lp_vertex_list *vl);
 struct lp_vertex_list *LP_VertexList_Copy(const struct lp_vertex_list *vl, size_t new_floats_per_vert);
 
-/* Return index, UINT_MAX from limits.h on error */
-unsigned int LP_VertexList_Add(struct lp_vertex_list *vl, const float *vert);
-unsigned int LP_VertexList_AddIndex(struct lp_vertex_list *vl, unsigned int index);
+/* Returns a copy with vertices merged when every compared float is within
+ * tol, chaining through shared neighbours.  With LP_WELD_POSITION only the
+ * first 3 floats are compared and kept. */
+#define LP_WELD_POSITION 1
+struct lp_vertex_list *LP_VertexList_Weld(const struct lp_vertex_list *vl, float tol, int options);
+
+/* Return index, LP_INDEX_MAX on error */
+lp_index_t LP_VertexList_Add(struct lp_vertex_list *vl, const float *vert);
+lp_index_t LP_VertexList_AddIndex(struct lp_vertex_list *vl, lp_index_t index);
+
+/* Makes room for num_vert more vertices and num_ind more indices; returns -1 on error */
+int LP_VertexList_Reserve(struct lp_vertex_list *vl, lp_index_t num_vert, size_t num_ind);
+/* Same as calling LP_VertexList_Add on each of num vertices; returns -1 on error */
+int LP_VertexList_AddMany(struct lp_vertex_list *vl, const float *verts, size_t num);
+/* Same as calling LP_VertexList_Add on verts[ind[i]] for each index; returns -1 on error */
+int LP_VertexList_AddIndexed(struct lp_vertex_list *vl, const float *verts, lp_index_t num_vert,
+			     const lp_index_t *ind, size_t num_ind);
 
 /* Optional: No more vertices will be added, free extra memory */
 void LP_VertexList_Finalize(struct lp_vertex_list *vl);
 
 size_t LP_VertexList_FloatsPerVert(const struct lp_vertex_list *vl);
 enum primative_type LP_VertexList_PrimativeType(const struct lp_vertex_list *vl);
-unsigned int LP_VertexList_NumVert(const struct lp_vertex_list *vl);
+lp_index_t LP_VertexList_NumVert(const struct lp_vertex_list *vl);
 size_t LP_VertexList_NumInd(const struct lp_vertex_list *vl);
 float *LP_VertexList_GetVert(const struct lp_vertex_list *vl);
-unsigned int *LP_VertexList_GetInd(const struct lp_vertex_list *vl);
+lp_index_t *LP_VertexList_GetInd(const struct lp_vertex_list *vl);
 
-float *LP_VertexList_LookupVert(const struct lp_vertex_list *vl, unsigned int index);
+/* Vertex at position index of the index list */
+float *LP_VertexList_LookupVert(const struct lp_vertex_list *vl, size_t index);
 
 struct lp_vl_list {
   struct lp_vertex_list *vl;
@@ -82,15 +112,29 @@ void LP_VertexList_ListFree(struct lp_vl_list *list); /* Also frees the vertex l
 /*         |      3D      |      2D      |
  * Format  | Read | Write | Read | Write |
  * --------|------|-------|------|-------|
+ * .lpm**  |  x   |   x   |  x   |   x   |
  * .obj    |  x   |   x   |      |       |
+ * .ply*** |  x   |   x   |      |       |
  * .stl*   |  x   |   x   |      |       |
  * .svg    |      |       |      |   x   |
  * 
- * *binary stl only, ascii stl not supported
+ * *reads binary and ascii stl, writes binary stl
+ * **native binary format for any vertex list, including the indices.  The
+ *   lists read point straight into a private mapping of the file: nothing
+ *   is parsed or deduplicated, and pages are only copied when written.
+ *   The lists are not deduplicated on later adds either.
+ * ***reads ascii and binary ply, writes binary little endian ply.  One
+ *   indexed mesh per file, read without dedup.  Normals and uvs are kept,
+ *   other properties and elements are skipped.  Without faces the
+ *   vertices are read as a point list.
  */
 struct lp_vl_list *LP_VertexList_Read(const char *filename, float scale);
 int LP_VertexList_Write(const char *filename, struct lp_vl_list *list, float scale);
 
+/* Same as LP_VertexList_Write, but .obj, .ply and .stl output is batched
+ * through buf, which the caller owns and must be at least 64 bytes */
+int LP_VertexList_WriteBuffered(const char *filename, struct lp_vl_list *list, float scale, void *buf, size_t buf_size);
+
 /****************** Triangulate 2D polygons w/ holes ****************/
 /* Input:  a list of 2D line segments in any order. Polygons can share
  *         points and edges, but must not intersect or overlap.
@@ -107,6 +151,10 @@ struct lp_mass_properties {
 };
 
 void LP_MassProperties(const struct lp_vertex_list *in, struct lp_mass_properties *properties);
+/* Same volume as LP_MassProperties, without the moments */
+double LP_Volume(const struct lp_vertex_list *in);
+/* properties must have room for one result per list entry */
+int LP_MassProperties_List(const struct lp_vl_list *in, struct lp_mass_properties *properties, size_t num_threads);
 
 /*********************** Transform *********************************/
 struct lp_transform;
@@ -134,6 +182,11 @@ void LP_Transform_GetTranslation(const struct lp_transform *trans, float *xyz);
 void LP_Transform_GetAsMatrix4x4(const struct lp_transform *trans, float *m, int options);
 void LP_Transform_Point(const struct lp_transform *trans, float *dest, const float *src, int options);
 struct lp_vertex_list *LP_Transform_VertexList(const struct lp_transform *trans, const struct lp_vertex_list *src, int options);
+/* Transforms num points of xyz in place, each starting stride floats after the last */
+void LP_Transform_Points(const struct lp_transform *trans, float *xyz, size_t stride, size_t num, int options);
+/* Transforms every vertex of vl in place.  With 6 or more floats per vertex,
+ * floats 3 to 5 are taken as the normal and only rotated. */
+int LP_Transform_VertexListInPlace(const struct lp_transform *trans, struct lp_vertex_list *vl, int options);
 
 /*********************** Primatives ********************************/
 struct lp_vertex_list *LP_Cube(float x, float y, float z);
@@ -144,18 +197,164 @@ struct lp_vertex_list *LP_IcoSphere(float radius, int num_subdiv);
   
 /*********************** Simplify **********************************/
 struct lp_vertex_list *LP_Simplify(const struct lp_vertex_list *in, size_t num_faces_out, float aggregation_thresh);
+struct lp_vl_list *LP_Simplify_List(const struct lp_vl_list *in, size_t num_faces_out, float aggregation_thresh, size_t num_threads);
+/* Simplifies once, down to the smallest target, keeping a copy of the
+ * polyhedron as it reaches each of the targets.  The returned list is in
+ * the same order as targets. */
+struct lp_vl_list *LP_SimplifyLOD(const struct lp_vertex_list *in, const size_t *targets, size_t num_targets, float aggregation_thresh);
 
 /*********************** Convex Hull *******************************/
 struct lp_vertex_list *LP_ConvexHull(const struct lp_vertex_list *in);
+struct lp_vl_list *LP_ConvexHull_List(const struct lp_vl_list *in, size_t num_threads);
 
 /*********************** Plane Cut *********************************/
 /* Cut a polyhedron into two pieces along a plane */
 struct lp_vl_list *LP_PlaneCut(const struct lp_vertex_list *in, const float *norm, float dist);
+/* Cut into the slabs between num parallel planes Dot(norm, x) = dists[i]
+ * in one pass.  dists can be in any order, the pieces come out slab by
+ * slab starting below the lowest plane. */
+struct lp_vl_list *LP_PlaneCutMulti(const struct lp_vertex_list *in, const float *norm, const float *dists, size_t num);
 
 /*************** Approx Convex Decompisition ***********************/
 /* Decomposes a polyhedron into convex polyhedra */
 struct lp_vl_list *LP_ConvexDecomp(const struct lp_vertex_list *in, float threshold);
 
+/* Called after every cut with the number of parts and the remaining error
+ * as a fraction of the input volume.  A nonzero return stops early. */
+typedef int (*lp_decomp_progress_t)(void *user, size_t num_parts, float err);
+
+/* Refines the connected components concurrently on the worker threads, each
+ * down to threshold times its own volume.  The parts can differ from the
+ * serial refinement, which always cuts the worst part of the whole mesh.
+ * Progress is then called from the workers, one call at a time. */
+#define LP_DECOMP_COMPONENTS 1
+
+/* Zero means no limit for the other fields.  Limits are checked between
+ * cuts, and stopping early returns the hulls of the parts so far. */
+struct lp_decomp_options {
+  float threshold;                /* Same as for LP_ConvexDecomp */
+  double time_limit;              /* Seconds of wall time */
+  size_t max_parts;               /* Stops cutting at this many parts or more */
+  lp_decomp_progress_t progress;
+  void *user;                     /* Passed to progress */
+  const volatile int *cancel;     /* Set nonzero from any thread to stop */
+  int flags;                      /* LP_DECOMP_* */
+};
+
+struct lp_vl_list *LP_ConvexDecompEx(const struct lp_vertex_list *in, const struct lp_decomp_options *opts);
+
+/******************** Convex Shape Export **************************/
+/* Convex parts, such as the output of LP_ConvexDecomp, packed into one
+ * block for GJK style collision runtimes.  Each part keeps its distinct
+ * vertices, its face planes with coplanar triangles merged, and the
+ * neighbours of every vertex along the hull edges for hill climbing
+ * support queries.  Every field is 4 bytes in native byte order and the
+ * arrays are found by byte offsets from the start of the block, so it can
+ * be written out as is and loaded back with a single read. */
+#define LP_CONVEX_SHAPES_VERSION 1
+
+struct lp_convex_part {
+  unsigned int first_vert;   /* Into verts */
+  unsigned int num_verts;
+  unsigned int first_plane;  /* Into planes */
+  unsigned int num_planes;
+  float center[3];           /* Bounding sphere */
+  float radius;
+};
+
+struct lp_convex_shapes {
+  unsigned int version;
+  unsigned int size;         /* Bytes in the whole block */
+  unsigned int num_parts;
+  unsigned int num_verts;
+  unsigned int num_planes;
+  unsigned int num_adj;
+  unsigned int parts;        /* struct lp_convex_part[num_parts] */
+  unsigned int verts;        /* float[3 * num_verts] */
+  unsigned int planes;       /* float[4 * num_planes], Dot(p, (x, y, z)) = w, normals pointing out */
+  unsigned int adj_start;    /* unsigned int[num_verts + 1] */
+  unsigned int adj;          /* unsigned int[num_adj] */
+};
+
+/* Neighbours of vertex v of a part are adj[adj_start[first_vert + v]] up
+ * to adj_start[first_vert + v + 1], numbered within the part like v */
+#define LP_CONVEX_SHAPES_ARRAY(shapes, type, field) \
+  ((const type *) ((const char *) (shapes) + (shapes)->field))
+
+struct lp_convex_shapes *LP_ConvexShapes_New(const struct lp_vl_list *parts);
+void LP_ConvexShapes_Free(struct lp_convex_shapes *shapes);
+
+/* Vertex of part furthest along dir, numbered within the part.  Climbs
+ * from start, such as the last result for the same part, so coherent
+ * queries take a step or two. */
+unsigned int LP_ConvexShapes_Support(const struct lp_convex_shapes *shapes, unsigned int part, const float *dir, unsigned int start);
+
+/*********************** Threads ***********************************/
+/* Number of worker threads used by the parallel algorithms.  Default is 1.
+ * Setting 0 uses one thread per online processor.
+ *
+ * The _List functions process the entries of a list concurrently on up to
+ * num_threads threads, 0 for LP_GetNumThreads().  Results are in input
+ * order.  They return NULL (or -1) if any entry fails. */
+void LP_SetNumThreads(size_t num_threads);
+size_t LP_GetNumThreads(void);
+
+/*********************** Logging ***********************************/
+/* All library messages go to a single process wide callback, which may be
+ * called from worker threads.  The default callback writes each message
+ * with a newline to stderr.  Messages above the log level are dropped
+ * before being formatted.  Default level: lp_log_error. */
+enum lp_log_level {
+  lp_log_none,
+  lp_log_error,
+  lp_log_warning,
+  lp_log_info,
+  lp_log_debug
+};
+
+typedef void (*lp_log_func_t)(void *user, enum lp_log_level level, const char *msg);
+
+/* Pass NULL to restore the default callback */
+void LP_SetLogCallback(lp_log_func_t func, void *user);
+void LP_SetLogLevel(enum lp_log_level level);
+enum lp_log_level LP_GetLogLevel(void);
+
+/*********************** Result Cache ******************************/
+/* Memoizes LP_ConvexHull, LP_Simplify and LP_ConvexDecompEx (when there is
+ * no time limit, cancel flag or progress callback) on a hash of the input
+ * vertices, indices and parameters.  Hits return copies the caller owns.
+ * 
+ * Up to mem_bytes of results are kept in memory, dropping the least
+ * recently used first.  dir, if not NULL or empty, is an existing
+ * directory of .lpm files checked on a memory miss and written on every
+ * store.  It can be shared by concurrent processes.  Call these only while
+ * no other library call is running; returns -1 on error. */
+int LP_Cache_Enable(size_t mem_bytes, const char *dir);
+void LP_Cache_Disable(void);
+
+/*********************** Statistics ********************************/
+/* Counters and timers for the inner loops of the algorithms.  Disabled by
+ * default, enable before starting the work to be measured.  Totals are
+ * process wide and accumulate until reset. */
+struct lp_stat {
+  unsigned long long count;
+  double seconds;
+};
+
+struct lp_stats {
+  struct lp_stat hull_iterations;    /* seconds: total time in hull search */
+  struct lp_stat points_categorized; /* count only */
+  struct lp_stat pair_contractions;  /* seconds: time contracting pairs */
+  struct lp_stat cuts_tried;         /* seconds: total time choosing and making cuts */
+  struct lp_stat rehashes;           /* seconds: time growing hash tables */
+  struct lp_stat cache_hits;         /* count only */
+  struct lp_stat cache_misses;       /* count only */
+};
+
+void LP_Stats_Enable(int enable);
+void LP_Stats_Reset(void);
+void LP_Stats_Get(struct lp_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,131 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include <string.h>
+
+#include "arena.h"
+#include "log.h"
+
+#define DEFAULT_BLOCK_SIZE 65536
+#define ALIGN 16
+
+struct block {
+  struct block *next;
+  size_t used;
+  size_t size;
+};
+
+struct arena {
+  struct block *head;
+  size_t block_size;
+};
+
+#define BLOCK_HEADER ((sizeof(struct block) + ALIGN - 1) & ~((size_t) ALIGN - 1))
+
+static struct block *Block_New(size_t size) {
+  struct block *block;
+  
+  if (size > SIZE_MAX - BLOCK_HEADER || (block = malloc(BLOCK_HEADER + size)) == NULL) {
+    Log_Error("Error: Could not allocate memory for arena block\n");
+    return NULL;
+  }
+  block->next = NULL;
+  block->used = 0;
+  block->size = size;
+  
+  return block;
+}
+
+struct arena *Arena_New(size_t block_size) {
+  struct arena *arena;
+  
+  if ((arena = malloc(sizeof(*arena))) == NULL) {
+    Log_Error("Error: Could not allocate memory for arena\n");
+    goto err;
+  }
+  memset(arena, 0, sizeof(*arena));
+  
+  arena->block_size = block_size ? (block_size + ALIGN - 1) & ~((size_t) ALIGN - 1) : DEFAULT_BLOCK_SIZE;
+  
+  return arena;
+  
+ err:
+  return NULL;
+}
+
+void Arena_Free(struct arena *arena) {
+  struct block *cur, *next;
+  
+  if (arena == NULL)
+    return;
+  
+  for (cur = arena->head; cur; cur = next) {
+    next = cur->next;
+    free(cur);
+  }
+  free(arena);
+}
+
+void *Arena_Alloc(struct arena *arena, size_t size) {
+  struct block *block;
+  
+  if (size > SIZE_MAX - ALIGN)
+    return NULL;
+  size = (size + ALIGN - 1) & ~((size_t) ALIGN - 1);
+  
+  block = arena->head;
+  if (block == NULL || block->size - block->used < size) {
+    if (size > arena->block_size / 4) {
+      /* Large allocations get their own block, behind the current one */
+      if ((block = Block_New(size)) == NULL)
+	return NULL;
+      if (arena->head) {
+	block->next = arena->head->next;
+	arena->head->next = block;
+      } else {
+	arena->head = block;
+      }
+    } else {
+      if ((block = Block_New(arena->block_size)) == NULL)
+	return NULL;
+      block->next = arena->head;
+      arena->head = block;
+    }
+  }
+  
+  block->used += size;
+  
+  return (char *) block + BLOCK_HEADER + block->used - size;
+}
@@ -1,5 +1,5 @@
 /*
-  Copyright (C) 2020 Paul Maurer
+  Copyright (C) 2026 Paul Maurer
 
   Redistribution and use in source and binary forms, with or without
   modification, are permitted provided that the following conditions are met:
@@ -28,19 +28,19 @@
   POSSIBILITY OF SUCH DAMAGE.
 */
 
-#ifndef UNIQUE_QUEUE_H
-#define UNIQUE_QUEUE_H
 
-struct unique_queue;
+#ifndef LP_ARENA_H
+#define LP_ARENA_H
 
-struct unique_queue *UniqueQueue_New(void);
-void UniqueQueue_Free(struct unique_queue *uq);
-void UniqueQueue_Clear(struct unique_queue *uq);
+#include <stddef.h>
 
-size_t UniqueQueue_NumEntries(const struct unique_queue *uq);
+/* Bump allocator, everything allocated from an arena is released at once
+ * by Arena_Free.  Not thread safe. */
+struct arena;
 
-int UniqueQueue_Push(struct unique_queue *uq, void *value);
-int UniqueQueue_PushBack(struct unique_queue *uq, void *value);
-void *UniqueQueue_Pop(struct unique_queue *uq);
+struct arena *Arena_New(size_t block_size); /* 0 for the default block size */
+void Arena_Free(struct arena *arena);
+
+void *Arena_Alloc(struct arena *arena, size_t size);
 
 #endif
@@ -0,0 +1,197 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "libpolyhedra.h"
+
+#include "log.h"
+#include "parallel.h"
+
+/* Runs one operation on every entry of a list, with the entries spread
+ * over a Parallel_ForThreads pool.  Nested parallel loops inside the
+ * operations run serially. */
+
+struct batch {
+  const struct lp_vertex_list **in;
+  struct lp_vertex_list **out;
+  struct lp_mass_properties *properties;
+  size_t num_faces_out;
+  float aggregation_thresh;
+};
+
+static size_t Batch_Threads(size_t num_threads) {
+  return num_threads ? num_threads : LP_GetNumThreads();
+}
+
+static int Batch_Init(struct batch *batch, const struct lp_vl_list *in, size_t *num) {
+  const struct lp_vl_list *cur;
+  size_t count;
+  
+  memset(batch, 0, sizeof(*batch));
+  *num = LP_VertexList_ListLength((struct lp_vl_list *) in);
+  if (*num == 0)
+    return 0;
+  
+  if ((batch->in = malloc(*num * sizeof(*batch->in))) == NULL) {
+    Log_Error("Error: Could not allocate memory for batch\n");
+    goto err;
+  }
+  
+  for (count = 0, cur = in; cur != NULL; cur = cur->next, count++)
+    batch->in[count] = cur->vl;
+  
+  return 0;
+  
+ err:
+  return -1;
+}
+
+/* Joins the results into a list in input order, frees them all on failure */
+static struct lp_vl_list *Batch_Finish(struct batch *batch, size_t num, int ret) {
+  struct lp_vl_list *list = NULL, **tail = &list;
+  size_t count;
+  
+  for (count = 0; ret >= 0 && count < num; count++) {
+    if (batch->out[count] == NULL) {
+      ret = -1;
+      break;
+    }
+    if ((*tail = malloc(sizeof(**tail))) == NULL) {
+      Log_Error("Error: Could not allocate memory for batch result\n");
+      ret = -1;
+      break;
+    }
+    (*tail)->vl = batch->out[count];
+    (*tail)->next = NULL;
+    tail = &(*tail)->next;
+  }
+  
+  if (ret < 0) {
+    for (; count < num; count++)
+      LP_VertexList_Free(batch->out[count]);
+    LP_VertexList_ListFree(list);
+    list = NULL;
+  }
+  
+  free(batch->out);
+  free(batch->in);
+  return list;
+}
+
+static int Batch_ConvexHull(void *user, size_t idx, size_t thread) {
+  struct batch *batch = (struct batch *) user;
+  
+  batch->out[idx] = LP_ConvexHull(batch->in[idx]);
+  
+  return batch->out[idx] ? 0 : -1;
+}
+
+static int Batch_Simplify(void *user, size_t idx, size_t thread) {
+  struct batch *batch = (struct batch *) user;
+  
+  batch->out[idx] = LP_Simplify(batch->in[idx], batch->num_faces_out, batch->aggregation_thresh);
+  
+  return batch->out[idx] ? 0 : -1;
+}
+
+static int Batch_MassProperties(void *user, size_t idx, size_t thread) {
+  struct batch *batch = (struct batch *) user;
+  
+  LP_MassProperties(batch->in[idx], &batch->properties[idx]);
+  
+  return 0;
+}
+
+static struct lp_vl_list *Batch_Run(const struct lp_vl_list *in, size_t num_threads,
+				    parallel_func_t func, struct batch *proto) {
+  struct batch batch;
+  size_t num;
+  int ret;
+  
+  if (Batch_Init(&batch, in, &num) < 0)
+    return NULL;
+  if (num == 0)
+    return NULL;
+  
+  batch.num_faces_out = proto->num_faces_out;
+  batch.aggregation_thresh = proto->aggregation_thresh;
+  
+  if ((batch.out = calloc(num, sizeof(*batch.out))) == NULL) {
+    Log_Error("Error: Could not allocate memory for batch results\n");
+    free(batch.in);
+    return NULL;
+  }
+  
+  ret = Parallel_ForThreads(num, Batch_Threads(num_threads), func, &batch);
+  
+  return Batch_Finish(&batch, num, ret);
+}
+
+struct lp_vl_list *LP_ConvexHull_List(const struct lp_vl_list *in, size_t num_threads) {
+  struct batch proto;
+  
+  memset(&proto, 0, sizeof(proto));
+  
+  return Batch_Run(in, num_threads, Batch_ConvexHull, &proto);
+}
+
+struct lp_vl_list *LP_Simplify_List(const struct lp_vl_list *in, size_t num_faces_out,
+				    float aggregation_thresh, size_t num_threads) {
+  struct batch proto;
+  
+  memset(&proto, 0, sizeof(proto));
+  proto.num_faces_out = num_faces_out;
+  proto.aggregation_thresh = aggregation_thresh;
+  
+  return Batch_Run(in, num_threads, Batch_Simplify, &proto);
+}
+
+int LP_MassProperties_List(const struct lp_vl_list *in, struct lp_mass_properties *properties, size_t num_threads) {
+  struct batch batch;
+  size_t num;
+  int ret;
+  
+  if (Batch_Init(&batch, in, &num) < 0)
+    return -1;
+  
+  batch.properties = properties;
+  ret = Parallel_ForThreads(num, Batch_Threads(num_threads), Batch_MassProperties, &batch);
+  free(batch.in);
+  
+  return ret;
+}
@@ -0,0 +1,539 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include <math.h>
+#include <string.h>
+
+#include "bvh_tri.h"
+#include "log.h"
+#include "util.h"
+
+/* Built top down with the binned surface area heuristic.  Nodes are
+ * stored depth first, the first child of a node directly follows it. */
+
+#define NUM_BINS  12
+#define LEAF_SIZE 2  /* Always a leaf at or below this many triangles */
+#define MAX_LEAF  16 /* Never a leaf above this many, unless too deep */
+#define MAX_DEPTH 48 /* Also bounds the traversal stacks */
+#define COST_NODE 1  /* Cost of visiting a node relative to a triangle test */
+
+struct tri_node {
+  float min[3];
+  float max[3];
+  size_t start;  /* First triangle of a leaf */
+  size_t num;    /* Triangles in a leaf, 0 for inner nodes */
+  size_t second; /* Second child of an inner node */
+};
+
+struct bvh_tri {
+  float *tri;     /* Three corners per triangle, in leaf order */
+  size_t *face;   /* Face index of each triangle */
+  size_t num_tris;
+  struct tri_node *nodes;
+  size_t num_nodes;
+};
+
+struct tri_bin {
+  float min[3];
+  float max[3];
+  size_t num;
+};
+
+struct build {
+  struct bvh_tri *bvh;
+  const float *corner;   /* Triangles in face order */
+  float *centroid;
+  size_t *idx;
+};
+
+static void Sub(float *out, const float *a, const float *b) {
+  out[0] = a[0] - b[0];
+  out[1] = a[1] - b[1];
+  out[2] = a[2] - b[2];
+}
+
+static void Box_Reset(float *min, float *max) {
+  min[0] = min[1] = min[2] =  INFINITY;
+  max[0] = max[1] = max[2] = -INFINITY;
+}
+
+static void Box_Add(float *min, float *max, const float *pt) {
+  int axis;
+  
+  for (axis = 0; axis < 3; axis++) {
+    if (pt[axis] < min[axis])
+      min[axis] = pt[axis];
+    if (pt[axis] > max[axis])
+      max[axis] = pt[axis];
+  }
+}
+
+static void Box_Join(float *min, float *max, const float *other_min, const float *other_max) {
+  Box_Add(min, max, other_min);
+  Box_Add(min, max, other_max);
+}
+
+static float Box_Area(const float *min, const float *max) {
+  float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+  
+  if (!(dx >= 0))
+    return 0;
+  return dx * dy + dy * dz + dz * dx;
+}
+
+static size_t Bin(const float *centroid, int axis, float lo, float scale) {
+  size_t bin = (size_t) ((centroid[axis] - lo) * scale);
+  
+  return bin < NUM_BINS ? bin : NUM_BINS - 1;
+}
+
+/* Returns the number of triangles on the low side of the best split, or 0
+ * to make a leaf */
+static size_t Split(struct build *build, size_t start, size_t num, const struct tri_node *node, const float *cmin, const float *cmax) {
+  struct tri_bin bins[NUM_BINS], sweep, *bin;
+  float area_low[NUM_BINS], cost, best_cost, scale, lo;
+  size_t count, num_low, best, tri, *idx, *end, temp;
+  const float *corner;
+  int axis, side;
+  
+  axis = 0;
+  if (cmax[1] - cmin[1] > cmax[axis] - cmin[axis])
+    axis = 1;
+  if (cmax[2] - cmin[2] > cmax[axis] - cmin[axis])
+    axis = 2;
+  if (!(cmax[axis] > cmin[axis]))
+    return 0;
+  
+  lo = cmin[axis];
+  scale = NUM_BINS / (cmax[axis] - lo);
+  for (count = 0; count < NUM_BINS; count++) {
+    Box_Reset(bins[count].min, bins[count].max);
+    bins[count].num = 0;
+  }
+  for (count = start; count < start + num; count++) {
+    tri = build->idx[count];
+    bin = &bins[Bin(build->centroid + 3 * tri, axis, lo, scale)];
+    bin->num++;
+    corner = build->corner + 9 * tri;
+    for (side = 0; side < 3; side++)
+      Box_Add(bin->min, bin->max, corner + 3 * side);
+  }
+  
+  /* Sweep from the low end, then score each split from the high end */
+  Box_Reset(sweep.min, sweep.max);
+  for (count = 0; count < NUM_BINS; count++) {
+    Box_Join(sweep.min, sweep.max, bins[count].min, bins[count].max);
+    area_low[count] = Box_Area(sweep.min, sweep.max);
+  }
+  
+  best = NUM_BINS;
+  best_cost = INFINITY;
+  Box_Reset(sweep.min, sweep.max);
+  num_low = num;
+  for (count = NUM_BINS - 1; count > 0; count--) {
+    Box_Join(sweep.min, sweep.max, bins[count].min, bins[count].max);
+    num_low -= bins[count].num;
+    if (num_low == 0 || num_low == num)
+      continue;
+    cost = area_low[count - 1] * num_low + Box_Area(sweep.min, sweep.max) * (num - num_low);
+    if (cost < best_cost) {
+      best_cost = cost;
+      best = count;
+    }
+  }
+  if (best == NUM_BINS)
+    return 0;
+  
+  if (num <= MAX_LEAF && COST_NODE * Box_Area(node->min, node->max) + best_cost >= num * Box_Area(node->min, node->max))
+    return 0;
+  
+  idx = build->idx + start;
+  end = idx + num;
+  while (idx < end) {
+    if (Bin(build->centroid + 3 * *idx, axis, lo, scale) < best) {
+      idx++;
+    } else {
+      temp = *--end;
+      *end = *idx;
+      *idx = temp;
+    }
+  }
+  
+  return idx - (build->idx + start);
+}
+
+static size_t Build(struct build *build, size_t start, size_t num, int depth) {
+  struct bvh_tri *bvh = build->bvh;
+  struct tri_node *node;
+  float cmin[3], cmax[3];
+  size_t node_idx, count, num_low;
+  const float *corner;
+  
+  node_idx = bvh->num_nodes++;
+  node = &bvh->nodes[node_idx];
+  node->start  = start;
+  node->num    = num;
+  node->second = 0;
+  
+  Box_Reset(node->min, node->max);
+  Box_Reset(cmin, cmax);
+  for (count = start; count < start + num; count++) {
+    corner = build->corner + 9 * build->idx[count];
+    Box_Add(node->min, node->max, corner);
+    Box_Add(node->min, node->max, corner + 3);
+    Box_Add(node->min, node->max, corner + 6);
+    Box_Add(cmin, cmax, build->centroid + 3 * build->idx[count]);
+  }
+  
+  if (num <= LEAF_SIZE || depth >= MAX_DEPTH)
+    return node_idx;
+  
+  if ((num_low = Split(build, start, num, node, cmin, cmax)) == 0)
+    return node_idx;
+  
+  node->num = 0;
+  Build(build, start, num_low, depth + 1);
+  count = Build(build, start + num_low, num - num_low, depth + 1);
+  bvh->nodes[node_idx].second = count;
+  
+  return node_idx;
+}
+
+struct bvh_tri *BvhTri_New(const struct lp_vertex_list *vl) {
+  struct bvh_tri *bvh;
+  struct build build;
+  float *corner, *centroid;
+  const float *vert, *src;
+  lp_index_t *ind;
+  size_t fpv, num, count, side, axis;
+  
+  if (LP_VertexList_FloatsPerVert(vl) < 3) {
+    Log_Error("Error: Need at least 3 floats per vertex for triangle hierarchy\n");
+    goto err;
+  }
+  
+  if ((bvh = malloc(sizeof(*bvh))) == NULL) {
+    Log_Error("Error: Could not allocate memory for triangle hierarchy\n");
+    goto err;
+  }
+  memset(bvh, 0, sizeof(*bvh));
+  memset(&build, 0, sizeof(build));
+  
+  fpv  = LP_VertexList_FloatsPerVert(vl);
+  vert = LP_VertexList_GetVert(vl);
+  ind  = LP_VertexList_GetInd(vl);
+  num  = LP_VertexList_NumInd(vl) / 3;
+  bvh->num_tris = num;
+  
+  if ((bvh->tri = malloc((9 * num + 1) * sizeof(*bvh->tri))) == NULL ||
+      (bvh->face = malloc((num + 1) * sizeof(*bvh->face))) == NULL ||
+      (bvh->nodes = malloc((2 * num + 1) * sizeof(*bvh->nodes))) == NULL ||
+      (build.idx = malloc((num + 1) * sizeof(*build.idx))) == NULL ||
+      (build.centroid = malloc((3 * num + 1) * sizeof(*build.centroid))) == NULL ||
+      (corner = malloc((9 * num + 1) * sizeof(*corner))) == NULL) {
+    Log_Error("Error: Could not allocate memory for triangle hierarchy\n");
+    goto err2;
+  }
+  
+  centroid = build.centroid;
+  for (count = 0; count < num; count++) {
+    for (side = 0; side < 3; side++) {
+      src = vert + fpv * ind[3 * count + side];
+      memcpy(corner + 9 * count + 3 * side, src, 3 * sizeof(*corner));
+    }
+    for (axis = 0; axis < 3; axis++)
+      centroid[3 * count + axis] = (corner[9 * count + axis] +
+				    corner[9 * count + 3 + axis] +
+				    corner[9 * count + 6 + axis]) / 3;
+    build.idx[count] = count;
+  }
+  build.bvh = bvh;
+  build.corner = corner;
+  
+  Build(&build, 0, num, 0);
+  
+  /* Store the triangles in leaf order */
+  for (count = 0; count < num; count++) {
+    memcpy(bvh->tri + 9 * count, corner + 9 * build.idx[count], 9 * sizeof(*corner));
+    bvh->face[count] = build.idx[count];
+  }
+  
+  free(corner);
+  free(build.centroid);
+  free(build.idx);
+  return bvh;
+  
+ err2:
+  free(build.centroid);
+  free(build.idx);
+  BvhTri_Free(bvh);
+ err:
+  return NULL;
+}
+
+void BvhTri_Free(struct bvh_tri *bvh) {
+  if (bvh == NULL)
+    return;
+  
+  free(bvh->nodes);
+  free(bvh->face);
+  free(bvh->tri);
+  free(bvh);
+}
+
+/* Entry distance of the ray into the box, INFINITY on a miss */
+static float Ray_Box(const struct tri_node *node, const float *origin, const float *inv_dir, float max_t) {
+  float t_min = 0, t_max = max_t, t1, t2;
+  int axis;
+  
+  for (axis = 0; axis < 3; axis++) {
+    t1 = (node->min[axis] - origin[axis]) * inv_dir[axis];
+    t2 = (node->max[axis] - origin[axis]) * inv_dir[axis];
+    t_min = fmaxf(t_min, fminf(t1, t2));
+    t_max = fminf(t_max, fmaxf(t1, t2));
+  }
+  
+  return t_min <= t_max ? t_min : INFINITY;
+}
+
+/* Moller-Trumbore, both sides of the triangle count */
+static int Ray_Tri(const float *tri, const float *origin, const float *dir, float max_t, float *t) {
+  float e1[3], e2[3], pp[3], ss[3], qq[3], det, inv, uu, vv, tt;
+  
+  Sub(e1, tri + 3, tri);
+  Sub(e2, tri + 6, tri);
+  Cross(pp, dir, e2);
+  if ((det = Dot(e1, pp)) == 0)
+    return 0;
+  inv = 1 / det;
+  
+  Sub(ss, origin, tri);
+  uu = Dot(ss, pp) * inv;
+  if (uu < 0 || uu > 1)
+    return 0;
+  
+  Cross(qq, ss, e1);
+  vv = Dot(dir, qq) * inv;
+  if (vv < 0 || uu + vv > 1)
+    return 0;
+  
+  tt = Dot(e2, qq) * inv;
+  if (tt < 0 || tt > max_t)
+    return 0;
+  
+  *t = tt;
+  return 1;
+}
+
+int BvhTri_Ray(const struct bvh_tri *bvh, const float *origin, const float *dir, float max_t, float *t, size_t *face) {
+  size_t stack[MAX_DEPTH + 2], depth, count, near, far;
+  const struct tri_node *node;
+  float inv_dir[3], best = max_t, tt, t_near, t_far;
+  int axis, hit = 0;
+  
+  if (bvh->num_tris == 0)
+    return 0;
+  
+  for (axis = 0; axis < 3; axis++)
+    inv_dir[axis] = 1 / dir[axis];
+  
+  depth = 0;
+  if (Ray_Box(&bvh->nodes[0], origin, inv_dir, best) < INFINITY)
+    stack[depth++] = 0;
+  while (depth > 0) {
+    node = &bvh->nodes[stack[--depth]];
+    if (node->num) {
+      for (count = node->start; count < node->start + node->num; count++) {
+	if (Ray_Tri(bvh->tri + 9 * count, origin, dir, best, &tt)) {
+	  best = tt;
+	  *face = bvh->face[count];
+	  hit = 1;
+	}
+      }
+      continue;
+    }
+    
+    near = node - bvh->nodes + 1;
+    far = node->second;
+    t_near = Ray_Box(&bvh->nodes[near], origin, inv_dir, best);
+    t_far = Ray_Box(&bvh->nodes[far], origin, inv_dir, best);
+    if (t_far < t_near) {
+      count = near;
+      near = far;
+      far = count;
+      tt = t_near;
+      t_near = t_far;
+      t_far = tt;
+    }
+    if (t_far < INFINITY)
+      stack[depth++] = far;
+    if (t_near < INFINITY)
+      stack[depth++] = near;
+  }
+  
+  if (hit)
+    *t = best;
+  return hit;
+}
+
+static float Box_Dist2(const struct tri_node *node, const float *pt) {
+  float delta[3];
+  int axis;
+  
+  for (axis = 0; axis < 3; axis++) {
+    if (pt[axis] < node->min[axis])
+      delta[axis] = node->min[axis] - pt[axis];
+    else if (pt[axis] > node->max[axis])
+      delta[axis] = pt[axis] - node->max[axis];
+    else
+      delta[axis] = 0;
+  }
+  
+  return Norm2(delta);
+}
+
+/* Reference: Real-Time Collision Detection, Christer Ericson, 5.1.5 */
+static void Closest_Tri(float *out, const float *pt, const float *tri) {
+  const float *a = tri, *b = tri + 3, *c = tri + 6;
+  float ab[3], ac[3], ap[3], bp[3], cp[3], d1, d2, d3, d4, d5, d6, va, vb, vc, vv, ww;
+  int axis;
+  
+  Sub(ab, b, a);
+  Sub(ac, c, a);
+  Sub(ap, pt, a);
+  d1 = Dot(ab, ap);
+  d2 = Dot(ac, ap);
+  if (d1 <= 0 && d2 <= 0) {
+    memcpy(out, a, 3 * sizeof(*out));
+    return;
+  }
+  
+  Sub(bp, pt, b);
+  d3 = Dot(ab, bp);
+  d4 = Dot(ac, bp);
+  if (d3 >= 0 && d4 <= d3) {
+    memcpy(out, b, 3 * sizeof(*out));
+    return;
+  }
+  
+  vc = d1 * d4 - d3 * d2;
+  if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+    vv = d1 / (d1 - d3);
+    for (axis = 0; axis < 3; axis++)
+      out[axis] = a[axis] + vv * ab[axis];
+    return;
+  }
+  
+  Sub(cp, pt, c);
+  d5 = Dot(ab, cp);
+  d6 = Dot(ac, cp);
+  if (d6 >= 0 && d5 <= d6) {
+    memcpy(out, c, 3 * sizeof(*out));
+    return;
+  }
+  
+  vb = d5 * d2 - d1 * d6;
+  if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+    ww = d2 / (d2 - d6);
+    for (axis = 0; axis < 3; axis++)
+      out[axis] = a[axis] + ww * ac[axis];
+    return;
+  }
+  
+  va = d3 * d6 - d5 * d4;
+  if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) {
+    ww = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+    for (axis = 0; axis < 3; axis++)
+      out[axis] = b[axis] + ww * (c[axis] - b[axis]);
+    return;
+  }
+  
+  /* Inside the face, degenerate triangles are handled above */
+  if (!(va + vb + vc != 0)) {
+    memcpy(out, a, 3 * sizeof(*out));
+    return;
+  }
+  vv = vb / (va + vb + vc);
+  ww = vc / (va + vb + vc);
+  for (axis = 0; axis < 3; axis++)
+    out[axis] = a[axis] + ab[axis] * vv + ac[axis] * ww;
+}
+
+float BvhTri_Closest(const struct bvh_tri *bvh, const float *pt, float *closest, size_t *face) {
+  size_t stack[MAX_DEPTH + 2], depth, count, near, far;
+  const struct tri_node *node;
+  float best = INFINITY, dd, d_near, d_far, cand[3];
+  
+  if (bvh->num_tris == 0)
+    return INFINITY;
+  
+  depth = 0;
+  stack[depth++] = 0;
+  while (depth > 0) {
+    node = &bvh->nodes[stack[--depth]];
+    if (Box_Dist2(node, pt) >= best)
+      continue;
+    
+    if (node->num) {
+      for (count = node->start; count < node->start + node->num; count++) {
+	Closest_Tri(cand, pt, bvh->tri + 9 * count);
+	if ((dd = Dist2(cand, pt)) < best) {
+	  best = dd;
+	  memcpy(closest, cand, sizeof(cand));
+	  *face = bvh->face[count];
+	}
+      }
+      continue;
+    }
+    
+    near = node - bvh->nodes + 1;
+    far = node->second;
+    d_near = Box_Dist2(&bvh->nodes[near], pt);
+    d_far = Box_Dist2(&bvh->nodes[far], pt);
+    if (d_far < d_near) {
+      count = near;
+      near = far;
+      far = count;
+      dd = d_near;
+      d_near = d_far;
+      d_far = dd;
+    }
+    if (d_far < best)
+      stack[depth++] = far;
+    if (d_near < best)
+      stack[depth++] = near;
+  }
+  
+  return best;
+}
@@ -0,0 +1,53 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef LP_BVH_TRI_H
+#define LP_BVH_TRI_H
+
+#include "libpolyhedra.h"
+
+/* Bounding volume hierarchy over the triangles of a vertex list, for ray
+ * and closest point queries.  The triangles are copied, so the vertex
+ * list may change or be freed afterwards.  Faces are numbered as in the
+ * index list: face n uses indices 3 * n to 3 * n + 2. */
+struct bvh_tri;
+
+struct bvh_tri *BvhTri_New(const struct lp_vertex_list *vl);
+void BvhTri_Free(struct bvh_tri *bvh);
+
+/* Finds the first hit of origin + t * dir for t in [0, max_t].  Returns 1
+ * and sets *t and *face on a hit, 0 on a miss. */
+int BvhTri_Ray(const struct bvh_tri *bvh, const float *origin, const float *dir, float max_t, float *t, size_t *face);
+
+/* Returns the squared distance from pt to the closest triangle and sets
+ * closest and *face, or INFINITY if there are no triangles */
+float BvhTri_Closest(const struct bvh_tri *bvh, const float *pt, float *closest, size_t *face);
+
+#endif
@@ -36,171 +36,144 @@
 #include <math.h>
 #include <string.h>
 
-#include "array.h"
 #include "bvh_vl.h"
-#include "ftree.h"
+#include "log.h"
+#include "parallel.h"
 #include "util.h"
 
-enum bvh_axis {
-  x_axis,
-  y_axis,
-  z_axis
-};
+/* Nodes are stored depth first in one array: the first child of a node
+ * directly follows it, and leaves own a range of the index array. */
+
+#define LEAF_SIZE 4 /* Nodes with fewer points are not split */
 
 struct bvh_node {
-  enum bvh_axis axis;
   float min[3];
   float max[3];
-  struct bvh_node *a;
-  struct bvh_node *b;
-  struct array *points;
+  size_t start;  /* First entry of idx in the node */
+  size_t num;    /* Number of entries of idx in the node */
+  size_t second; /* Second child, 0 for leaves */
 };
 
 struct bvh_vl {
   struct lp_vertex_list *vl;
-  struct bvh_node *root;
+  const float *vert;
+  size_t fpv;
+  size_t *idx;
+  struct bvh_node *nodes;
+  size_t num_nodes;
 };
 
-static struct bvh_node *BNode_New(size_t init_alloc) {
-  struct bvh_node *node;
-
-  if ((node = malloc(sizeof(*node))) == NULL)
-    goto err;
-  memset(node, 0, sizeof(*node));
-
-  node->min[0] = node->min[1] = node->min[2] =  INFINITY;
-  node->max[0] = node->max[1] = node->max[2] = -INFINITY;
-  
-  if ((node->points = Array_New(init_alloc, NULL)) == NULL)
-    goto err2;
-  
-  return node;
-
- err2:
-  free(node);
- err:
-  return NULL;
+static float Key(const struct bvh_vl *bvh, size_t idx, int axis) {
+  return bvh->vert[bvh->fpv * idx + axis];
 }
 
-static void BNode_Free(struct bvh_node *node) {
-  if (node == NULL)
-    return;
-  
-  BNode_Free(node->a);
-  BNode_Free(node->b);
-  Array_Free(node->points);
+/* Partially sorts idx so idx[nth] has the nth smallest key along axis, with
+ * no larger keys before it and no smaller keys after it */
+static void Select(const struct bvh_vl *bvh, size_t *idx, size_t num, size_t nth, int axis) {
+  size_t lo = 0, hi = num - 1, ii, jj, temp;
+  float pivot;
+  
+  while (lo < hi) {
+    pivot = Key(bvh, idx[lo + (hi - lo) / 2], axis);
+    ii = lo;
+    jj = hi;
+    while (ii <= jj) {
+      while (Key(bvh, idx[ii], axis) < pivot)
+	ii++;
+      while (Key(bvh, idx[jj], axis) > pivot)
+	jj--;
+      if (ii <= jj) {
+	temp = idx[ii];
+	idx[ii++] = idx[jj];
+	idx[jj] = temp;
+	if (jj == 0)
+	  break;
+	jj--;
+      }
+    }
+    
+    if (nth <= jj)
+      hi = jj;
+    else if (nth >= ii)
+      lo = ii;
+    else
+      break;
+  }
 }
 
-static int Split_BNode(struct bvh_node *node, float dist) {
-  size_t len;
-  enum bvh_axis axis;
-  float range[3], median;
-  struct ftree *ftree;
-  float **data, **stop, *vert;
-  struct bvh_node *nn;
-  int count;
+static size_t Build(struct bvh_vl *bvh, size_t start, size_t num, float dist) {
+  struct bvh_node *node;
+  size_t node_idx, count, mid;
+  const float *vert;
+  float range[3];
+  int axis;
   
-  if ((len = Array_Length(node->points)) < 4)
-    return 0;
+  node_idx = bvh->num_nodes++;
+  node = &bvh->nodes[node_idx];
+  node->start  = start;
+  node->num    = num;
+  node->second = 0;
+  
+  node->min[0] = node->min[1] = node->min[2] =  INFINITY;
+  node->max[0] = node->max[1] = node->max[2] = -INFINITY;
+  for (count = start; count < start + num; count++) {
+    vert = bvh->vert + bvh->fpv * bvh->idx[count];
+    for (axis = 0; axis < 3; axis++) {
+      if (vert[axis] < node->min[axis])
+	node->min[axis] = vert[axis];
+      if (vert[axis] > node->max[axis])
+	node->max[axis] = vert[axis];
+    }
+  }
   
-  range[0] = node->max[0] - node->min[0];
-  range[1] = node->max[1] - node->min[1];
-  range[2] = node->max[2] - node->min[2];
+  if (num < LEAF_SIZE)
+    return node_idx;
   
+  for (axis = 0; axis < 3; axis++)
+    range[axis] = node->max[axis] - node->min[axis];
   if (range[0] >= range[1] && range[0] >= range[2])
-    axis = x_axis;
+    axis = 0;
   else
-    axis = range[1] >= range[2] ? y_axis : z_axis;
-  node->axis = axis;
+    axis = range[1] >= range[2] ? 1 : 2;
   
   if (range[axis] < dist)
-    return 0;
-  
-  if ((ftree = FTree_New(NULL, NULL, NULL)) == NULL)
-    goto err;
-  
-  data = (float **) Array_Data(node->points);
-  stop = data + len;
-  for (; data < stop; data++)
-    if (FTree_Insert(ftree, (*data)[axis], *data, NULL) == NULL)
-      goto err2;
+    return node_idx;
   
-  median = FTree_GetKey(FTree_Median(ftree));
+  mid = num / 2;
+  Select(bvh, bvh->idx + start, num, mid, axis);
   
-  if (median == node->max[axis] || median == node->min[axis])
-    median = 0.5 * (node->max[axis] + node->min[axis]);
+  Build(bvh, start, mid, dist);
+  mid = Build(bvh, start + mid, num - mid, dist);
+  bvh->nodes[node_idx].second = mid;
   
-  if ((node->a = BNode_New(len)) == NULL)
-    goto err2;
-  if ((node->b = BNode_New(len)) == NULL)
-    goto err3;
-  
-  data = (float **) Array_Data(node->points);
-  for (; data < stop; data++) {
-    vert = *data;
-    nn = vert[axis] <= median ? node->a : node->b;
-    Array_Add(nn->points, vert);
-
-    for (count = 0; count < 3; count++) {
-      if (vert[count] < nn->min[count])
-	nn->min[count] = vert[count];
-      
-      if (vert[axis] > nn->max[count])
-	nn->max[count] = vert[count];
-    }
-  }
-  
-  FTree_Free(ftree);
-  Array_Free(node->points);
-  node->points = NULL;
-  
-  Split_BNode(node->a, dist);
-  Split_BNode(node->b, dist);
-  
-  return 0;
-  
- err3:
-  BNode_Free(node->a);
- err2:
-  FTree_Free(ftree);
- err:
-  return -1;
+  return node_idx;
 }
 
 struct bvh_vl *BvhVl_New(struct lp_vertex_list *vl, float dist) {
   struct bvh_vl *bvh;
-  struct bvh_node *node;
-  size_t fpv;
-  float *vert, *stop;
-  int count;
+  size_t num, count;
 
-  if ((bvh = malloc(sizeof(*bvh))) == NULL)
+  if ((bvh = malloc(sizeof(*bvh))) == NULL) {
+    Log_Error("Error: Could not allocate memory for bounding volume hierarchy\n");
     goto err;
+  }
   memset(bvh, 0, sizeof(*bvh));
 
-  bvh->vl = vl;
-  
-  if ((bvh->root = node = BNode_New(LP_VertexList_NumVert(vl))) == NULL)
+  bvh->vl   = vl;
+  bvh->vert = LP_VertexList_GetVert(vl);
+  bvh->fpv  = LP_VertexList_FloatsPerVert(vl);
+  num = LP_VertexList_NumVert(vl);
+  
+  /* Leaves other than the root hold at least LEAF_SIZE / 2 points */
+  if ((bvh->idx = malloc((num + 1) * sizeof(*bvh->idx))) == NULL ||
+      (bvh->nodes = malloc((num + 1) * sizeof(*bvh->nodes))) == NULL) {
+    Log_Error("Error: Could not allocate memory for bounding volume hierarchy\n");
     goto err2;
-  
-  fpv = LP_VertexList_FloatsPerVert(vl);
-  vert = LP_VertexList_GetVert(vl);
-  stop = vert + fpv * LP_VertexList_NumVert(vl);
-  
-  for (; vert < stop; vert += fpv) {
-    for (count = 0; count < 3; count++) {
-      if (vert[count] < node->min[count])
-	node->min[count] = vert[count];
-      
-      if (vert[count] > node->max[count])
-	node->max[count] = vert[count];
-    }
-    
-    Array_Add(node->points, vert);
   }
+  for (count = 0; count < num; count++)
+    bvh->idx[count] = count;
   
-  if (Split_BNode(node, dist) < 0)
-    goto err2;
+  Build(bvh, 0, num, dist);
   
   return bvh;
 
@@ -214,12 +187,12 @@ void BvhVl_Free(struct bvh_vl *bvh) {
   if (bvh == NULL)
     return;
   
-  BNode_Free(bvh->root);
-  
+  free(bvh->nodes);
+  free(bvh->idx);
   free(bvh);
 }
 
-static float BDist2(struct bvh_node *a, struct bvh_node *b) {
+static float BDist2(const struct bvh_node *a, const struct bvh_node *b) {
   int count;
   float range[3];
   
@@ -240,66 +213,178 @@ static float BDist2(struct bvh_node *a, struct bvh_node *b) {
   return Norm2(range);
 }
 
+/* Large searches are split into tasks at TASK_DEPTH levels of the node
+ * pair recursion.  Each task buffers its pairs, and the buffers are
+ * passed to the callback in task order once all tasks are done. */
+#define TASK_DEPTH 8
+
+struct pair_buf {
+  float **pts; /* Two per pair */
+  size_t num;
+  size_t alloc;
+  int err;
+};
+
+struct pair_task {
+  size_t a;
+  size_t b;
+  struct pair_buf buf;
+};
+
+struct pair_tasks {
+  struct pair_task *task;
+  size_t num;
+  size_t alloc;
+  int err;
+};
+
 struct pair_data {
   float dist2;
   struct bvh_vl *bvh;
   bvh_vl_pair_func_t func;
   void *user;
+  struct pair_tasks *tasks; /* Collect tasks instead of pairs when set */
 };
 
-static void BNode_Pair_Search(struct bvh_node *node, struct bvh_node *base, const struct pair_data *pd) {
-  if (node == NULL || node == base || BDist2(node, base) > pd->dist2)
-    return;
-  
-  BNode_Pair_Search(node->a, base, pd);
-  BNode_Pair_Search(node->b, base, pd);
-  
-  if (node->points) {
-    float **data1, **start2, **data2, **stop1, **stop2;
-    
-    data1 = (float **) Array_Data(node->points);
-    stop1 = data1 + Array_Length(node->points);
-    start2 = (float **) Array_Data(base->points);
-    stop2  = start2 + Array_Length(base->points);
-    for (; data1 < stop1; data1++) {
-      for (data2 = start2; data2 < stop2; data2++) {
-	if (Dist2(*data1, *data2) < pd->dist2)
-	  pd->func(pd->user, pd->bvh->vl, *data1, *data2);
-      }
+static void Leaf_Pairs(const struct bvh_node *a, const struct bvh_node *b, const struct pair_data *pd) {
+  const struct bvh_vl *bvh = pd->bvh;
+  size_t *idx1, *idx2, *stop1, *stop2;
+  float *vert, *v1, *v2;
+  
+  vert  = LP_VertexList_GetVert(bvh->vl);
+  idx1  = bvh->idx + a->start;
+  stop1 = idx1 + a->num;
+  stop2 = bvh->idx + b->start + b->num;
+  for (; idx1 < stop1; idx1++) {
+    v1 = vert + bvh->fpv * *idx1;
+    idx2 = a == b ? idx1 + 1 : bvh->idx + b->start;
+    for (; idx2 < stop2; idx2++) {
+      v2 = vert + bvh->fpv * *idx2;
+      if (Dist2(v1, v2) < pd->dist2)
+	pd->func(pd->user, bvh->vl, v1, v2);
     }
   }
 }
 
-static void BNode_Pair(struct bvh_node *node, const struct pair_data *pd) {
-  if (node == NULL)
+static void Tasks_Add(struct pair_tasks *tasks, size_t a, size_t b) {
+  struct pair_task *task;
+  size_t alloc;
+  
+  if (tasks->num == tasks->alloc) {
+    alloc = tasks->alloc ? 2 * tasks->alloc : 64;
+    if ((task = realloc(tasks->task, alloc * sizeof(*task))) == NULL) {
+      Log_Error("Error: Could not allocate memory for pair search tasks\n");
+      tasks->err = 1;
+      return;
+    }
+    tasks->task = task;
+    tasks->alloc = alloc;
+  }
+  
+  task = &tasks->task[tasks->num++];
+  memset(task, 0, sizeof(*task));
+  task->a = a;
+  task->b = b;
+}
+
+/* Reports every pair of points from nodes a and b once */
+static void Node_Pairs(size_t a, size_t b, const struct pair_data *pd, int depth) {
+  const struct bvh_node *na = &pd->bvh->nodes[a], *nb = &pd->bvh->nodes[b];
+  
+  if (a != b && BDist2(na, nb) > pd->dist2)
     return;
   
-  BNode_Pair(node->a, pd);
-  BNode_Pair(node->b, pd);
+  if (pd->tasks && (depth == 0 || (na->second == 0 && nb->second == 0))) {
+    Tasks_Add(pd->tasks, a, b);
+  } else if (na->second == 0 && nb->second == 0) {
+    Leaf_Pairs(na, nb, pd);
+  } else if (a == b) {
+    Node_Pairs(a + 1, a + 1, pd, depth - 1);
+    Node_Pairs(a + 1, na->second, pd, depth - 1);
+    Node_Pairs(na->second, na->second, pd, depth - 1);
+  } else if (nb->second == 0 || (na->second && na->num >= nb->num)) {
+    Node_Pairs(a + 1, b, pd, depth - 1);
+    Node_Pairs(na->second, b, pd, depth - 1);
+  } else {
+    Node_Pairs(a, b + 1, pd, depth - 1);
+    Node_Pairs(a, nb->second, pd, depth - 1);
+  }
+}
 
-  if (node->points) {
-    float **data1, **data2, **stop;
-    
-    data1 = (float **) Array_Data(node->points);
-    stop  = data1 + Array_Length(node->points);
-    for (; data1 < stop; data1++) {
-      for (data2 = data1 + 1; data2 < stop; data2++) {
-	if (Dist2(*data1, *data2) < pd->dist2)
-	  pd->func(pd->user, pd->bvh->vl, *data1, *data2);
-      }
+static void Buf_Add(void *user, struct lp_vertex_list *vl, float *a, float *b) {
+  struct pair_buf *buf = (struct pair_buf *) user;
+  float **pts;
+  size_t alloc;
+  
+  if (buf->err)
+    return;
+  
+  if (buf->num == buf->alloc) {
+    alloc = buf->alloc ? 2 * buf->alloc : 64;
+    if ((pts = realloc(buf->pts, 2 * alloc * sizeof(*pts))) == NULL) {
+      Log_Error("Error: Could not allocate memory for close pairs\n");
+      buf->err = 1;
+      return;
     }
-    
-    BNode_Pair_Search(pd->bvh->root, node, pd);
+    buf->pts = pts;
+    buf->alloc = alloc;
   }
+  
+  buf->pts[2 * buf->num] = a;
+  buf->pts[2 * buf->num + 1] = b;
+  buf->num++;
 }
 
-void BvhVl_Pairs(struct bvh_vl *bvh, float dist, bvh_vl_pair_func_t func, void *user) {
+static int Run_Task(void *user, size_t idx, size_t thread) {
+  const struct pair_data *pd = (const struct pair_data *) user;
+  struct pair_task *task = &pd->tasks->task[idx];
+  struct pair_data task_pd;
+  
+  task_pd.dist2 = pd->dist2;
+  task_pd.bvh   = pd->bvh;
+  task_pd.func  = Buf_Add;
+  task_pd.user  = &task->buf;
+  task_pd.tasks = NULL;
+  
+  Node_Pairs(task->a, task->b, &task_pd, -1);
+  
+  return task->buf.err ? -1 : 0;
+}
+
+int BvhVl_Pairs(struct bvh_vl *bvh, float dist, bvh_vl_pair_func_t func, void *user) {
   struct pair_data pd;
+  struct pair_tasks tasks;
+  struct pair_task *task;
+  size_t count, pair;
+  int ret = 0;
 
+  if (bvh->num_nodes == 0)
+    return 0;
+  
   pd.dist2 = dist * dist;
   pd.bvh   = bvh;
   pd.func  = func;
   pd.user  = user;
+  pd.tasks = NULL;
 
-  BNode_Pair(bvh->root, &pd);
+  if (Parallel_Available() <= 1) {
+    Node_Pairs(0, 0, &pd, -1);
+    return 0;
+  }
+  
+  memset(&tasks, 0, sizeof(tasks));
+  pd.tasks = &tasks;
+  Node_Pairs(0, 0, &pd, TASK_DEPTH);
+  if (tasks.err || Parallel_For(tasks.num, Run_Task, &pd) < 0)
+    ret = -1;
+  
+  for (count = 0; count < tasks.num; count++) {
+    task = &tasks.task[count];
+    for (pair = 0; ret == 0 && pair < task->buf.num; pair++)
+      func(user, bvh->vl, task->buf.pts[2 * pair], task->buf.pts[2 * pair + 1]);
+    free(task->buf.pts);
+  }
+  free(tasks.task);
+  
+  return ret;
 }
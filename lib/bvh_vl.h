@@ -40,6 +40,9 @@ void BvhVl_Free(struct bvh_vl *bvh);
 
 typedef void (*bvh_vl_pair_func_t)(void *, struct lp_vertex_list *, float *, float *);
 
-void BvhVl_Pairs(struct bvh_vl *bvh, float dist, bvh_vl_pair_func_t func, void *user);
+/* Calls func once for each pair of vertices closer than dist.  The search
+ * runs on worker threads, but func is only called from the calling
+ * thread.  Returns -1 if the search failed. */
+int BvhVl_Pairs(struct bvh_vl *bvh, float dist, bvh_vl_pair_func_t func, void *user);
 
 #endif
@@ -0,0 +1,462 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_PTHREADS
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#endif
+
+#include "libpolyhedra.h"
+
+#include "cache.h"
+#include "file_lpm.h"
+#include "hash.h"
+#include "log.h"
+#include "SipHash/siphash.h"
+#include "stats.h"
+#include "vertex_list.h"
+#include "write_buf.h"
+
+/* Bump when an algorithm changes its output, so that entries left in cache
+ * directories stop matching */
+#define CACHE_FORMAT 1
+
+#ifdef PACKAGE_VERSION
+#define CACHE_VERSION PACKAGE_VERSION
+#else
+#define CACHE_VERSION ""
+#endif
+
+#define KEY_PARTS 5
+
+/* Fixed, so keys match across processes */
+static const unsigned char key_secret[2][16] = {
+  {'l', 'p', ' ', 'c', 'a', 'c', 'h', 'e', ' ', 'k', 'e', 'y', ' ', 'o', 'n', 'e'},
+  {'l', 'p', ' ', 'c', 'a', 'c', 'h', 'e', ' ', 'k', 'e', 'y', ' ', 't', 'w', 'o'}
+};
+
+struct key_head {
+  uint64_t format;
+  uint64_t op;
+  uint64_t floats_per_vert;
+  uint64_t primative_type;
+  uint64_t num_vert;
+  uint64_t num_ind;
+  uint64_t index_size;
+  uint64_t params_size;
+};
+
+struct cache_entry {
+  uint64_t hash[2];
+  struct lp_vl_list *result;
+  size_t size;
+  struct cache_entry *prev;  /* More recently used */
+  struct cache_entry *next;
+};
+
+/* Set up and torn down only while no cached operation is running */
+static struct {
+  int enabled;
+  char *dir;
+  size_t max_size;
+  size_t size;
+  struct hash *entries;
+  struct cache_entry *head;
+  struct cache_entry *tail;
+  unsigned long num_tmp;
+} cache;
+
+#ifdef HAVE_PTHREADS
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void Lock(void) {
+#ifdef HAVE_PTHREADS
+  pthread_mutex_lock(&mutex);
+#endif
+}
+
+static void Unlock(void) {
+#ifdef HAVE_PTHREADS
+  pthread_mutex_unlock(&mutex);
+#endif
+}
+
+void Cache_Key(struct cache_key *key, enum cache_op op, const struct lp_vertex_list *in, const void *params, size_t params_size) {
+  const unsigned char *data[KEY_PARTS];
+  uint64_t part[KEY_PARTS];
+  size_t len[KEY_PARTS];
+  struct key_head head;
+  int count, side;
+  
+  key->valid = 0;
+  if (!cache.enabled)
+    return;
+  
+  memset(&head, 0, sizeof(head));
+  head.format = CACHE_FORMAT;
+  head.op = op;
+  head.floats_per_vert = LP_VertexList_FloatsPerVert(in);
+  head.primative_type = LP_VertexList_PrimativeType(in);
+  head.num_vert = LP_VertexList_NumVert(in);
+  head.num_ind = LP_VertexList_NumInd(in);
+  head.index_size = sizeof(lp_index_t);
+  head.params_size = params_size;
+  
+  data[0] = (const unsigned char *) &head;
+  len[0] = sizeof(head);
+  data[1] = (const unsigned char *) CACHE_VERSION;
+  len[1] = strlen(CACHE_VERSION);
+  data[2] = (const unsigned char *) LP_VertexList_GetVert(in);
+  len[2] = head.num_vert * head.floats_per_vert * sizeof(float);
+  data[3] = (const unsigned char *) LP_VertexList_GetInd(in);
+  len[3] = head.num_ind * sizeof(lp_index_t);
+  data[4] = (const unsigned char *) params;
+  len[4] = params_size;
+  
+  /* Two independent 64 bit hashes, collisions are never checked for */
+  for (side = 0; side < 2; side++) {
+    for (count = 0; count < KEY_PARTS; count++)
+      part[count] = siphash(key_secret[side], data[count], len[count]);
+    key->hash[side] = siphash(key_secret[side], (const unsigned char *) part, sizeof(part));
+  }
+  key->valid = 1;
+}
+
+static struct lp_vl_list *CloneList(const struct lp_vl_list *list) {
+  struct lp_vl_list *out = NULL, *new_out;
+  struct lp_vertex_list *vl;
+  
+  for (; list != NULL; list = list->next) {
+    if ((vl = VertexList_Clone(list->vl)) == NULL)
+      goto err;
+    if ((new_out = LP_VertexList_ListAppend(out, vl)) == NULL) {
+      LP_VertexList_Free(vl);
+      goto err;
+    }
+    out = new_out;
+  }
+  
+  return out;
+  
+ err:
+  Log_Error("Error: Could not copy cached result\n");
+  LP_VertexList_ListFree(out);
+  return NULL;
+}
+
+static size_t EntrySize(const struct lp_vl_list *list) {
+  size_t size = sizeof(struct cache_entry);
+  
+  for (; list != NULL; list = list->next) {
+    size += sizeof(*list) + 128;
+    size += (size_t) LP_VertexList_NumVert(list->vl) * LP_VertexList_FloatsPerVert(list->vl) * sizeof(float);
+    size += LP_VertexList_NumInd(list->vl) * sizeof(lp_index_t);
+  }
+  
+  return size;
+}
+
+/********************** Memory tier *********************************/
+static void Unlink(struct cache_entry *entry) {
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else
+    cache.head = entry->next;
+  
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  else
+    cache.tail = entry->prev;
+}
+
+static void PushFront(struct cache_entry *entry) {
+  entry->prev = NULL;
+  entry->next = cache.head;
+  if (cache.head)
+    cache.head->prev = entry;
+  else
+    cache.tail = entry;
+  cache.head = entry;
+}
+
+static void Evict(struct cache_entry *entry) {
+  Unlink(entry);
+  Hash_Remove(cache.entries, entry->hash);
+  cache.size -= entry->size;
+  LP_VertexList_ListFree(entry->result);
+  free(entry);
+}
+
+static struct lp_vl_list *LookupMem(const struct cache_key *key) {
+  struct cache_entry *entry;
+  struct lp_vl_list *out = NULL;
+  
+  Lock();
+  if (cache.entries && (entry = (struct cache_entry *) Hash_Lookup(cache.entries, key->hash, NULL)) != NULL) {
+    Unlink(entry);
+    PushFront(entry);
+    out = CloneList(entry->result);
+  }
+  Unlock();
+  
+  return out;
+}
+
+static void StoreMem(const struct cache_key *key, const struct lp_vl_list *result) {
+  struct cache_entry *entry;
+  size_t size;
+  
+  if (cache.entries == NULL || (size = EntrySize(result)) > cache.max_size)
+    return;
+  
+  if ((entry = malloc(sizeof(*entry))) == NULL)
+    goto err;
+  memset(entry, 0, sizeof(*entry));
+  memcpy(entry->hash, key->hash, sizeof(entry->hash));
+  entry->size = size;
+  if ((entry->result = CloneList(result)) == NULL)
+    goto err2;
+  
+  Lock();
+  if (Hash_Lookup(cache.entries, entry->hash, NULL) != NULL) {
+    Unlock();
+    goto err3;
+  }
+  
+  while (cache.tail && cache.size + size > cache.max_size)
+    Evict(cache.tail);
+  
+  if (Hash_Insert(cache.entries, entry->hash, entry, NULL) < 0) {
+    Unlock();
+    goto err3;
+  }
+  PushFront(entry);
+  cache.size += size;
+  Unlock();
+  return;
+  
+ err3:
+  LP_VertexList_ListFree(entry->result);
+ err2:
+  free(entry);
+ err:
+  return;
+}
+
+/********************** Directory tier ******************************/
+static char *EntryPath(const struct cache_key *key, const char *suffix, unsigned long pid, unsigned long num) {
+  size_t len;
+  char *path;
+  
+  len = strlen(cache.dir) + 32 + strlen(suffix) + 64;
+  if ((path = malloc(len)) == NULL) {
+    Log_Error("Error: Could not allocate cache file name\n");
+    return NULL;
+  }
+  
+  if (*suffix)
+    snprintf(path, len, "%s/%016llx%016llx.lpm.%lu.%lu%s", cache.dir,
+	     (unsigned long long) key->hash[0], (unsigned long long) key->hash[1], pid, num, suffix);
+  else
+    snprintf(path, len, "%s/%016llx%016llx.lpm", cache.dir,
+	     (unsigned long long) key->hash[0], (unsigned long long) key->hash[1]);
+  return path;
+}
+
+static struct lp_vl_list *LookupDisk(const struct cache_key *key) {
+  struct lp_vl_list *list;
+  char *path;
+  FILE *in;
+  
+  if ((path = EntryPath(key, "", 0, 0)) == NULL)
+    return NULL;
+  
+  /* A missing file is just a miss */
+  if ((in = fopen(path, "r")) == NULL) {
+    free(path);
+    return NULL;
+  }
+  
+  if ((list = FileLpm_Read(in, 1.0)) == NULL)
+    Log_Warning("Warning: Ignoring unreadable cache entry '%s'\n", path);
+  
+  fclose(in);
+  free(path);
+  return list;
+}
+
+/* Written under a temporary name and renamed, so readers in other
+ * processes never see part of a file */
+static void StoreDisk(const struct cache_key *key, const struct lp_vl_list *result) {
+  struct write_buf wb;
+  char *path, *tmp;
+  unsigned long pid = 0, num;
+  FILE *out;
+  int ret;
+  
+#ifdef HAVE_UNISTD_H
+  pid = (unsigned long) getpid();
+#endif
+  Lock();
+  num = cache.num_tmp++;
+  Unlock();
+  
+  if ((path = EntryPath(key, "", 0, 0)) == NULL)
+    goto err;
+  if ((tmp = EntryPath(key, ".tmp", pid, num)) == NULL)
+    goto err2;
+  
+  if ((out = fopen(tmp, "w")) == NULL) {
+    Log_Perror("Error: Could not open cache file for writing");
+    goto err3;
+  }
+  
+  if (WriteBuf_Init(&wb, out, NULL, 0) < 0) {
+    fclose(out);
+    goto err4;
+  }
+  ret = FileLpm_Write(&wb, result, 1.0);
+  if (WriteBuf_Finish(&wb) < 0)
+    ret = -1;
+  if (fclose(out) != 0)
+    ret = -1;
+  
+  if (ret < 0 || rename(tmp, path) != 0) {
+    Log_Warning("Warning: Could not write cache entry '%s'\n", path);
+    goto err4;
+  }
+  
+  free(tmp);
+  free(path);
+  return;
+  
+ err4:
+  remove(tmp);
+ err3:
+  free(tmp);
+ err2:
+  free(path);
+ err:
+  return;
+}
+
+/********************** Lookup & Store ******************************/
+struct lp_vl_list *Cache_Lookup(const struct cache_key *key) {
+  struct lp_vl_list *list;
+  
+  if (!key->valid)
+    return NULL;
+  
+  if ((list = LookupMem(key)) == NULL && cache.dir && (list = LookupDisk(key)) != NULL)
+    StoreMem(key, list);
+  
+  if (stats_enabled)
+    Stats_Add(list ? STAT_CACHE_HITS : STAT_CACHE_MISSES, 1, 0);
+  return list;
+}
+
+void Cache_Store(const struct cache_key *key, const struct lp_vl_list *result) {
+  if (!key->valid || result == NULL)
+    return;
+  
+  StoreMem(key, result);
+  if (cache.dir)
+    StoreDisk(key, result);
+}
+
+struct lp_vertex_list *Cache_LookupVl(const struct cache_key *key) {
+  struct lp_vertex_list *vl;
+  struct lp_vl_list *list;
+  
+  if ((list = Cache_Lookup(key)) == NULL)
+    return NULL;
+  
+  vl = list->vl;
+  list->vl = NULL;
+  LP_VertexList_ListFree(list);
+  return vl;
+}
+
+void Cache_StoreVl(const struct cache_key *key, const struct lp_vertex_list *result) {
+  struct lp_vl_list list;
+  
+  if (result == NULL)
+    return;
+  
+  list.vl = (struct lp_vertex_list *) result;
+  list.next = NULL;
+  Cache_Store(key, &list);
+}
+
+int LP_Cache_Enable(size_t mem_bytes, const char *dir) {
+  LP_Cache_Disable();
+  
+  if (mem_bytes > 0 && (cache.entries = Hash_NewFixed(sizeof(cache.head->hash), NULL, NULL, NULL, NULL)) == NULL)
+    goto err;
+  
+  if (dir && *dir && (cache.dir = strdup(dir)) == NULL)
+    goto err2;
+  
+  cache.max_size = mem_bytes;
+  cache.enabled = 1;
+  return 0;
+  
+ err2:
+  Hash_Free(cache.entries);
+  cache.entries = NULL;
+ err:
+  Log_Error("Error: Could not allocate memory for result cache\n");
+  return -1;
+}
+
+void LP_Cache_Disable(void) {
+  while (cache.tail)
+    Evict(cache.tail);
+  
+  Hash_Free(cache.entries);
+  free(cache.dir);
+  memset(&cache, 0, sizeof(cache));
+}
@@ -0,0 +1,64 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef LP_CACHE_H
+#define LP_CACHE_H
+
+#include <stdint.h>
+
+#include "libpolyhedra.h"
+
+/* Behind LP_Cache_Enable.  The cached entry points build a key from their
+ * input and parameters, return a hit if there is one, and otherwise store
+ * what they compute.  Keys are left invalid while the cache is off, and
+ * lookups and stores with them do nothing. */
+enum cache_op {
+  cache_hull,
+  cache_simplify,
+  cache_decomp
+};
+
+struct cache_key {
+  uint64_t hash[2];
+  int valid;
+};
+
+/* All bytes of params go into the hash, so clear it with memset first */
+void Cache_Key(struct cache_key *key, enum cache_op op, const struct lp_vertex_list *in, const void *params, size_t params_size);
+
+/* Hits are copies owned by the caller */
+struct lp_vl_list *Cache_Lookup(const struct cache_key *key);
+void Cache_Store(const struct cache_key *key, const struct lp_vl_list *result);
+
+/* The same, for operations that return a single vertex list */
+struct lp_vertex_list *Cache_LookupVl(const struct cache_key *key);
+void Cache_StoreVl(const struct cache_key *key, const struct lp_vertex_list *result);
+
+#endif
@@ -28,6 +28,10 @@
   POSSIBILITY OF SUCH DAMAGE.
 */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -36,10 +40,24 @@
 #include <math.h>
 #include <string.h>
 
+#ifdef HAVE_PTHREADS
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#endif
+
 #include "libpolyhedra.h"
 
+#include "cache.h"
+#include "convex_hull.h"
+#include "cut_score.h"
 #include "ftree.h"
+#include "heap.h"
+#include "hull_query.h"
+#include "log.h"
+#include "parallel.h"
 #include "queue.h"
+#include "stats.h"
 #include "util.h"
 #include "vef.h"
 
@@ -58,30 +76,27 @@ struct vlh_list {
   struct lp_vertex_list *vl;
   struct lp_vertex_list *hull;
   struct vlh_list *next;
+  struct vlh_list **link;  /* The pointer that holds this part */
+  size_t heap_pos;
   float err;
 };
 
 static float ConvexError(const struct lp_vertex_list *vl, const struct lp_vertex_list *hull) {
-  struct lp_mass_properties mp, mpc;
-  
-  LP_MassProperties(vl,   &mp);
-  LP_MassProperties(hull, &mpc);
-  
-  return mpc.volume - mp.volume;
+  return LP_Volume(hull) - LP_Volume(vl);
 }
 
 static struct vlh_list *VhlList_New(struct lp_vertex_list *vl) {
   struct vlh_list *vlh;
 
   if ((vlh = malloc(sizeof(*vlh))) == NULL) {
-    fprintf(stderr, "Could not allocate memeory for vlh list\n");
+    Log_Error("Could not allocate memeory for vlh list\n");
     goto err;
   }
   memset(vlh, 0, sizeof(*vlh));
 
   vlh->vl = vl;
 
-  if ((vlh->hull = LP_ConvexHull(vl)) == NULL)
+  if ((vlh->hull = ConvexHull_Build(vl)) == NULL)
     goto err2;
   
   vlh->err = ConvexError(vl, vlh->hull);
@@ -106,28 +121,6 @@ static void VlhList_Free(struct vlh_list *vlh) {
   }
 }
 
-static float VlhList_TotalError(struct vlh_list *vlh) {
-  float err = 0;
-
-  while (vlh != NULL) {
-    err += vlh->err;
-    vlh = vlh->next;
-  }
-  
-  return err;
-}
-
-static float VlhList_TotalSqrError(struct vlh_list *vlh) {
-  float err = 0;
-
-  while (vlh != NULL) {
-    err += vlh->err * vlh->err;
-    vlh = vlh->next;
-  }
-  
-  return err;
-}
-
 static size_t VlhList_Len(struct vlh_list *vlh) {
   size_t len = 0;
 
@@ -139,24 +132,29 @@ static size_t VlhList_Len(struct vlh_list *vlh) {
   return len;
 }
 
-static struct vlh_list *VlhList_Convert(struct lp_vl_list *list, float *err) {
+/* Points each part from *link up to end back at the pointer holding it */
+static struct vlh_list **VlhList_Link(struct vlh_list **link, struct vlh_list *end) {
+  while (*link != end) {
+    (*link)->link = link;
+    link = &(*link)->next;
+  }
+  
+  return link;
+}
+
+static struct vlh_list *VlhList_Convert(struct lp_vl_list *list) {
   struct vlh_list *head = NULL, **tail = &head;
   struct lp_vl_list *cur = list;
   
-  if (err)
-    *err = 0;
-  
   while (cur) {
     if (LP_VertexList_NumVert(cur->vl) > 4) {
       if ((*tail = VhlList_New(cur->vl)) == NULL)
 	goto err;
       cur->vl = NULL;
-      if (err)
-	*err += (*tail)->err;
       tail = &(*tail)->next;
     } else {
-      fprintf(stderr, "Warning: only %u points in polyhedron, skipping\n",
-	      LP_VertexList_NumVert(cur->vl));
+      Log_Warning("Warning: only %llu points in polyhedron, skipping\n",
+		  (unsigned long long) LP_VertexList_NumVert(cur->vl));
     }
     
     cur = cur->next;
@@ -199,70 +197,82 @@ static struct lp_vl_list *Vl_Convert(struct vlh_list *vlh, int hull, int free) {
   return NULL;
 }
 
-static struct vlh_list **WorstPart(struct vlh_list **list) {
-  float worst_err = -INFINITY, cur_err;
-  struct vlh_list **worst = NULL;
-  
-  while (*list != NULL) {
-    cur_err = (*list)->err;
-    if (cur_err > worst_err) {
-      worst_err = cur_err;
-      worst = list;
-    }
-
-    list = &(*list)->next;
-  }
-  
-  return worst;
-}
-
-static struct ftree *FurthestEdges(struct vef *full, struct vef *hull) {
-  struct ftree *ftree;
-  struct hash *hash;
-  struct queue *queue;
-  struct edge *edge, *ee;
-  struct face *start = NULL;
-  struct hash_iterator *hi;
+/* Breadth first over the edges, so the order does not depend on addresses.
+ * The rays from the edge midpoints are cast against the hull as a batch.
+ * Fills best with up to NUM_EDGES edges, furthest first, and returns how
+ * many. */
+static int FurthestEdges(struct vef *full, struct vef *hull, struct edge **best) {
+  struct edge *edge;
   struct lp_transform *trans;
-  float mid[3], dir[3], dist;
+  struct hull_query *hq;
+  unsigned *order, *ray_edge, ee, idx;
+  unsigned char *visited;
+  size_t head, tail, num_rays, first, pick, *sel;
+  const float *p0, *p1;
+  float *mids, *dirs, *dist, *mid, *dir;
   int count;
   
-  if ((ftree = FTree_New(NULL, NULL, NULL)) == NULL)
+  if (full->num_edges == 0)
     goto err;
-  if ((hash = Hash_NewPtr(NULL, NULL, NULL, NULL, NULL)) == NULL)
+  
+  if ((visited = calloc(full->num_edges, sizeof(*visited))) == NULL)
+    goto err;
+  if ((order = malloc(2 * full->num_edges * sizeof(*order))) == NULL)
     goto err2;
-  if ((queue = Queue_New()) == NULL)
-    goto err3;
+  ray_edge = order + full->num_edges;
   if ((trans = LP_Transform_New()) == NULL)
+    goto err3;
+  if ((mids = malloc(7 * full->num_edges * sizeof(*mids))) == NULL) {
+    Log_Error("Error: Could not allocate memory for edge rays\n");
     goto err4;
-  
-  if ((edge = Hash_GetFirstKey(full->edges)) == NULL)
-    goto err5;
-  if (Queue_PushBack(queue, edge) < 0)
-    goto err5;
-  if (Hash_Insert(hash, edge, PRESENT, NULL) < 0)
+  }
+  dirs = mids + 3 * full->num_edges;
+  dist = dirs + 3 * full->num_edges;
+  if ((hq = HullQuery_New(hull)) == NULL)
     goto err5;
   
-  while (Queue_Length(queue) > 0) {
-    if ((edge = (struct edge *) Queue_Pop(queue)) == NULL)
-      goto err5;
+  head = tail = num_rays = 0;
+  order[tail++] = 0;
+  visited[0] = 1;
+  
+  while (head < tail) {
+    edge = &full->edges[order[head++]];
     
-    Vef_CalcInfo(edge);
+    if (edge->face[1] == UINT_MAX) {
+      Log_Error("Error: Part to cut is not closed\n");
+      goto err6;
+    }
+    
+    for (count = 0; count < 2; count++) {
+      for (idx = full->vert_edge_idx[edge->vert[count]]; idx < full->vert_edge_idx[edge->vert[count] + 1]; idx++) {
+	ee = full->vert_edges[idx];
+	if (visited[ee])
+	  continue;
+	visited[ee] = 1;
+	order[tail++] = ee;
+      }
+    }
     
+    /* An edge with no length has no direction to cast a ray along */
+    p0 = &full->points[3 * edge->vert[0]];
+    p1 = &full->points[3 * edge->vert[1]];
+    if (edge->vert[0] == edge->vert[1] || Dist2(p0, p1) == 0)
+      continue;
+    
+    mid = &mids[3 * num_rays];
+    dir = &dirs[3 * num_rays];
+    ray_edge[num_rays++] = order[head - 1];
+    Vef_CalcInfo(full, edge);
 #ifdef DEBUG_EDGE
     printf("Finding distance of edge: (%g,%g,%g) - (%g,%g,%g): %g deg\n",
-	   edge->vert[0]->point[0],
-	   edge->vert[0]->point[1],
-	   edge->vert[0]->point[2],
-	   edge->vert[1]->point[0],
-	   edge->vert[1]->point[1],
-	   edge->vert[1]->point[2],
+	   p0[0], p0[1], p0[2],
+	   p1[0], p1[1], p1[2],
 	   edge->ang * 180 / M_PI);
 #endif
     
-    mid[0] = 0.5 * (edge->vert[0]->point[0] + edge->vert[1]->point[0]);
-    mid[1] = 0.5 * (edge->vert[0]->point[1] + edge->vert[1]->point[1]);
-    mid[2] = 0.5 * (edge->vert[0]->point[2] + edge->vert[1]->point[2]);
+    mid[0] = 0.5 * (p0[0] + p1[0]);
+    mid[1] = 0.5 * (p0[1] + p1[1]);
+    mid[2] = 0.5 * (p0[2] + p1[2]);
     
     LP_Transform_SetToIdentity(trans);
     LP_Transform_Rotate(trans,
@@ -271,68 +281,133 @@ static struct ftree *FurthestEdges(struct vef *full, struct vef *hull) {
 			edge->z_vec[1],
 			edge->z_vec[2]);
     LP_Transform_Point(trans, dir, edge->x_vec, LP_TRANSFORM_NO_OFFSET);
-
-#ifdef DEBUG_EDGE
-    float avg[3];
-    avg[0] = edge->face[0]->norm[0] + edge->face[1]->norm[0];
-    avg[1] = edge->face[0]->norm[1] + edge->face[1]->norm[1];
-    avg[2] = edge->face[0]->norm[2] + edge->face[1]->norm[2];
-    Normalize(avg);
-    printf("dir = (%g,%g,%g), norm avg = (%g,%g,%g)\n",
-	   dir[0], dir[1], dir[2],
-	   avg[0], avg[1], avg[2]);
-#endif
-    
-    if (isinf(dist = Vef_ConvexRayDist(hull, mid, dir, &start)))
-      goto err5;
-
-    if (FTree_Insert(ftree, dist, edge, NULL) < 0)
-      goto err5;
-    
-    for (count = 0; count < 2; count++) {
-      if ((hi = Hash_IteratorNew(edge->vert[count]->edges)) == NULL)
-	goto err5;
-      while (Hash_IteratorNext(hi)) {
-	ee = (struct edge *) Hash_IteratorGetData(hi);
-	if (Hash_Lookup(hash, ee, NULL))
-	  continue;
-	if (Hash_Insert(hash, ee, PRESENT, NULL) < 0)
-	  goto err6;
-	if (Queue_PushBack(queue, ee) < 0)
-	  goto err6;
-      }
-      Hash_IteratorFree(hi);
+  }
+  
+  if (HullQuery_RayDists(hq, dist, mids, dirs, num_rays) < 0)
+    goto err6;
+  
+  for (head = 0; head < num_rays; head++) {
+    if (isinf(dist[head])) {
+      Log_Error("Error: Edge ray does not leave the hull\n");
+      goto err6;
     }
   }
+  
+  /* Equal distances go to the later edge, as an ftree would order them */
+  if ((sel = malloc(num_rays * sizeof(*sel) + 1)) == NULL) {
+    Log_Error("Error: Could not allocate memory for edge order\n");
+    goto err6;
+  }
+  for (head = 0; head < num_rays; head++)
+    sel[head] = head;
+  first = num_rays > NUM_EDGES ? num_rays - NUM_EDGES : 0;
+  if (first > 0)
+    FTree_Select(dist, sel, num_rays, first);
+  for (count = 0; first + count < num_rays; count++) {
+    for (pick = first, head = first + 1; head < num_rays - count; head++)
+      if (dist[sel[head]] > dist[sel[pick]] || (dist[sel[head]] == dist[sel[pick]] && sel[head] > sel[pick]))
+        pick = head;
+    best[count] = &full->edges[ray_edge[sel[pick]]];
+    sel[pick] = sel[num_rays - count - 1];
+  }
+  free(sel);
 
+  HullQuery_Free(hq);
+  free(mids);
   LP_Transform_Free(trans);
-  Queue_Free(queue);
-  Hash_Free(hash);
-  return ftree;
+  free(order);
+  free(visited);
+  return count;
 
  err6:
-  Hash_IteratorFree(hi);
+  HullQuery_Free(hq);
  err5:
-  LP_Transform_Free(trans);
+  free(mids);
  err4:
-  Queue_Free(queue);
+  LP_Transform_Free(trans);
  err3:
-  Hash_Free(hash);
+  free(order);
  err2:
-  FTree_Free(ftree);
+  free(visited);
  err:
-  return NULL;
+  return -1;
+}
+
+struct cut_plane {
+  float norm[3];
+  float dist;
+  float weight;
+  float err;
+  size_t idx;
+};
+
+struct cut_eval {
+  const struct cut_score *cs;
+  struct cut_plane *planes;
+};
+
+/* Only scores the cut, the winner gets cut for real afterward */
+static int EvalCut(void *user, size_t idx, size_t thread) {
+  struct cut_eval *eval = (struct cut_eval *) user;
+  struct cut_plane *plane = &eval->planes[idx];
+  float err;
+  
+  if (CutScore_SqrError(eval->cs, plane->norm, plane->dist, &err) < 0)
+    err = INFINITY;
+  plane->err = err * plane->weight;
+  Log_Debug("Error after cut %g\n", plane->err);
+  
+  return 0;
+}
+
+static int CutPlaneCmp(const void *a, const void *b) {
+  const struct cut_plane *pa = (const struct cut_plane *) a, *pb = (const struct cut_plane *) b;
+  int fa = pa->err < INFINITY, fb = pb->err < INFINITY;
+  
+  if (fa != fb)
+    return fa ? -1 : 1;
+  if (fa && pa->err != pb->err)
+    return pa->err < pb->err ? -1 : 1;
+  
+  /* Ties go to the first candidate, same as a serial search */
+  return pa->idx < pb->idx ? -1 : pa->idx > pb->idx;
+}
+
+static int IsClosed(const struct vef *vef) {
+  size_t count;
+  
+  for (count = 0; count < vef->num_edges; count++)
+    if (vef->edges[count].face[1] == UINT_MAX)
+      return 0;
+  
+  return 1;
+}
+
+/* The heap is keyed by negated error, so its lowest entry is the worst part */
+static int VlhList_Queue(struct heap *heap, struct vlh_list *vlh, struct vlh_list *end, double *err) {
+  for (; vlh != end; vlh = vlh->next) {
+    if (Heap_Insert(heap, -vlh->err, vlh, &vlh->heap_pos) < 0)
+      return -1;
+    *err += vlh->err;
+  }
+  
+  return 0;
 }
 
-static int CutPart(struct vlh_list **vlh) {
+/* Replaces *vlh with its pieces, in place in the list and in the heap */
+static int CutPart(struct vlh_list **vlh, struct heap *heap, double *err) {
   struct vef *full, *hull;
-  struct ftree *ftree;
-  struct ftree_node *node;
   struct lp_transform *trans;
-  struct edge *edge;
-  struct vlh_list *cut, *min = NULL, *last;
-  int count, ang_count;
-  float norm[3], *nn, err, min_err = INFINITY, dist;
+  struct edge *edge, *best[NUM_EDGES];
+  struct cut_plane planes[NUM_EDGES * (NUM_ANGLES - 1)];
+  struct cut_eval eval;
+  struct cut_score *cs;
+  struct vlh_list *min = NULL, *last, **end;
+  size_t num_planes = 0, count_plane;
+  uint64_t start = 0;
+  int count, ang_count, num_best;
+  const float *pt;
+  float norm[3];
 
 #ifdef DEBUG
   struct lp_vl_list list_a, list_b;
@@ -343,38 +418,48 @@ static int CutPart(struct vlh_list **vlh) {
   LP_VertexList_Write("furthest.obj", &list_a, 1);
 #endif
   
+  if (stats_enabled)
+    start = Stats_Now();
+  
   if ((full = Vef_New((*vlh)->vl)) == NULL)
     goto err;
+  
+  /* A plane cut can leave an open sliver behind.  There are no edge rays
+   * to cut it along, so it stays as is and no longer counts as error. */
+  if (!IsClosed(full)) {
+    Log_Warning("Warning: part to cut is not closed, keeping its hull\n");
+    *err -= (*vlh)->err;
+    (*vlh)->err = 0;
+    Heap_Rekey(heap, (*vlh)->heap_pos, 0);
+    Vef_Free(full);
+    return 0;
+  }
   if ((hull = Vef_New((*vlh)->hull)) == NULL)
     goto err2;
-  if ((ftree = FurthestEdges(full, hull)) == NULL)
+  if ((num_best = FurthestEdges(full, hull, best)) < 0)
     goto err3;
   if ((trans = LP_Transform_New()) == NULL)
-    goto err4;
+    goto err3;
 
 #ifdef DEBUG
   printf("Cutting part with %zu vertices, %zu edges, and %zu faces\n",
-	 Hash_NumEntries(full->verts),
-	 Hash_NumEntries(full->edges),
-	 Hash_NumEntries(full->faces));
+	 full->num_verts,
+	 full->num_edges,
+	 full->num_faces);
 #endif
   
-  node = FTree_Highest(ftree);
-  for (count = 0; count < NUM_EDGES && node; count++, node = FTree_Prev(ftree, node)) {
-    edge = (struct edge *) FTree_GetData(node);
+  for (count = 0; count < num_best; count++) {
+    edge = best[count];
+    pt = &full->points[3 * edge->vert[0]];
 #ifdef DEBUG
     printf("  along edge from (%g, %g, %g) to (%g, %g, %g)\n",
-	   edge->vert[0]->point[0],
-	   edge->vert[0]->point[1],
-	   edge->vert[0]->point[2],
-	   edge->vert[1]->point[0],
-	   edge->vert[1]->point[1],
-	   edge->vert[1]->point[2]);
+	   pt[0], pt[1], pt[2],
+	   full->points[3 * edge->vert[1]],
+	   full->points[3 * edge->vert[1] + 1],
+	   full->points[3 * edge->vert[1] + 2]);
 #endif
     
-    norm[0] = edge->face[0]->norm[0];
-    norm[1] = edge->face[0]->norm[1];
-    norm[2] = edge->face[0]->norm[2];
+    memcpy(norm, full->faces[edge->face[0]].norm, sizeof(norm));
     LP_Transform_SetToIdentity(trans);
     LP_Transform_Rotate(trans,
 			edge->ang / NUM_ANGLES,
@@ -382,37 +467,48 @@ static int CutPart(struct vlh_list **vlh) {
 			edge->z_vec[1],
 			edge->z_vec[2]);
     for (ang_count = NUM_ANGLES - 1; ang_count > 0; ang_count--) {
-      nn = ang_count == 0 ? edge->face[1]->norm : norm;
-      dist = Dot(nn, edge->vert[0]->point);
-      if ((cut = VlhList_Convert(LP_PlaneCut((*vlh)->vl, nn, dist), &err)) == NULL)
-	goto err4;
-      err = VlhList_TotalSqrError(cut);
-      err *= (1 + 1e-3 * fabsf(count - (NUM_EDGES - 1) / 2));
-      printf("Error after cut %g\n", err);
-      if (err < min_err) {
-#ifdef DEBUG
-	printf("************ New min found *************\n");
-	LP_VertexList_Write("cut.obj", Vl_Convert(cut, 0, 0), 1);
-#endif
-	min_err = err;
-	VlhList_Free(min);
-	min = cut;
-      } else {
-	VlhList_Free(cut);
-      }
+      memcpy(planes[num_planes].norm, norm, sizeof(norm));
+      planes[num_planes].dist = Dot(norm, pt);
+      planes[num_planes].weight = 1 + 1e-3 * fabsf(count - (NUM_EDGES - 1) / 2);
+      num_planes++;
       
       LP_Transform_Point(trans, norm, norm, LP_TRANSFORM_NO_OFFSET);
       Normalize(norm);
     }
   }
   
-  if (min == NULL) {
-    LP_Transform_Free(trans);
-    FTree_Free(ftree);
-    Vef_Free(hull);
-    Vef_Free(full);
-    return 1;
+  if ((cs = CutScore_New((*vlh)->vl)) == NULL)
+    goto err4;
+  eval.cs = cs;
+  eval.planes = planes;
+  
+  if (Parallel_For(num_planes, EvalCut, &eval) < 0)
+    goto err5;
+  
+  for (count_plane = 0; count_plane < num_planes; count_plane++)
+    planes[count_plane].idx = count_plane;
+  qsort(planes, num_planes, sizeof(*planes), CutPlaneCmp);
+  
+  /* Fall back to the next best cut if the best one fails */
+  for (count_plane = 0; count_plane < num_planes; count_plane++) {
+    if (!(planes[count_plane].err < INFINITY))
+      break;
+    if ((min = VlhList_Convert(LP_PlaneCut((*vlh)->vl,
+					   planes[count_plane].norm,
+					   planes[count_plane].dist))))
+      break;
   }
+  
+  CutScore_Free(cs);
+  LP_Transform_Free(trans);
+  Vef_Free(hull);
+  Vef_Free(full);
+  
+  if (stats_enabled)
+    Stats_Add(STAT_CUTS_TRIED, num_planes, Stats_Now() - start);
+  
+  if (min == NULL)
+    return 1;
 
 #ifdef DEBUG
   printf("*****************************************************************\n");
@@ -426,56 +522,229 @@ static int CutPart(struct vlh_list **vlh) {
     last = last->next;
   last->next = (*vlh)->next;
   (*vlh)->next = NULL;
+  Heap_Delete(heap, (*vlh)->heap_pos);
+  *err -= (*vlh)->err;
   VlhList_Free(*vlh);
   *vlh = min;
   
-  LP_Transform_Free(trans);
-  FTree_Free(ftree);
-  Vef_Free(hull);
-  Vef_Free(full);
-  return 0;
+  if (*(end = VlhList_Link(vlh, last->next)) != NULL)
+    (*end)->link = end;
+  
+  return VlhList_Queue(heap, min, last->next, err);
 
+ err5:
+  CutScore_Free(cs);
  err4:
-  FTree_Free(ftree);
+  LP_Transform_Free(trans);
  err3:
   Vef_Free(hull);
  err2:
   Vef_Free(full);
  err:
-  VlhList_Free(min);
   return -1;
 }
 
 static const float x_axis[3] = {1, 0, 0};
 
+static int Cancelled(const volatile int *cancel) {
+  if (cancel == NULL)
+    return 0;
+#ifdef HAVE_ATOMIC_BUILTINS
+  return __atomic_load_n(cancel, __ATOMIC_RELAXED) != 0;
+#else
+  return *cancel != 0;
+#endif
+}
+
 struct lp_vl_list *LP_ConvexDecomp(const struct lp_vertex_list *in, float threshold) {
-  struct vlh_list *vlh;
-  struct lp_mass_properties mp;
-  float err, thresh;
-  int ret;
+  struct lp_decomp_options opts;
   
-  LP_MassProperties(in, &mp);
-  thresh = threshold * mp.volume;
+  memset(&opts, 0, sizeof(opts));
+  opts.threshold = threshold;
   
-  if ((vlh = VlhList_Convert(LP_PlaneCut(in, x_axis, INFINITY), &err)) == NULL)
+  return LP_ConvexDecompEx(in, &opts);
+}
+
+/* Components run by falling error, so the slow ones start first */
+struct comp_order {
+  float err;
+  size_t idx;
+};
+
+/* State shared by the refinement of every component */
+struct decomp {
+  const struct lp_decomp_options *opts;
+  uint64_t deadline;
+  double volume;
+  double err;          /* Over all parts */
+  size_t num_parts;
+  int stop;
+#ifdef HAVE_PTHREADS
+  pthread_mutex_t mutex;
+#endif
+  struct vlh_list **comps;
+  struct comp_order *order;
+};
+
+static void Decomp_Lock(struct decomp *dc) {
+#ifdef HAVE_PTHREADS
+  pthread_mutex_lock(&dc->mutex);
+#endif
+}
+
+static void Decomp_Unlock(struct decomp *dc) {
+#ifdef HAVE_PTHREADS
+  pthread_mutex_unlock(&dc->mutex);
+#endif
+}
+
+/* Cuts the worst part of *vlh until the error of the list is at most
+ * thresh or a limit is hit */
+static int Decomp_Refine(struct decomp *dc, struct vlh_list **vlh, float thresh) {
+  const struct lp_decomp_options *opts = dc->opts;
+  struct vlh_list *worst;
+  struct heap *heap;
+  double err = 0, before;
+  size_t num;
+  int ret, stop;
+  
+  VlhList_Link(vlh, NULL);
+  if ((heap = Heap_New()) == NULL)
     goto err;
+  if (VlhList_Queue(heap, *vlh, NULL, &err) < 0)
+    goto err2;
 
 #ifdef DEBUG
-  printf("Init err = %g, thresh = %g, %zu parts\n", err, thresh, VlhList_Len(vlh));
+  printf("Init err = %g, thresh = %g, %zu parts\n", err, thresh, VlhList_Len(*vlh));
 #endif
-  while (err > thresh) {
-    if ((ret = CutPart(WorstPart(&vlh))) < 0)
+  /* Every stop leaves a complete decomposition, just a coarser one */
+  while (err > thresh && (worst = Heap_Lowest(heap, NULL)) != NULL) {
+    if ((dc->deadline && Stats_Now() >= dc->deadline) || Cancelled(opts->cancel))
+      break;
+    
+    Decomp_Lock(dc);
+    stop = dc->stop || (opts->max_parts && dc->num_parts >= opts->max_parts);
+    Decomp_Unlock(dc);
+    if (stop)
+      break;
+    
+    before = err;
+    num = Heap_Count(heap);
+    if ((ret = CutPart(worst->link, heap, &err)) < 0)
       goto err2;
     if (ret == 1)
       break;
-    err = VlhList_TotalError(vlh);
 #ifdef DEBUG
-    printf("err = %g, thresh = %g, %zu parts\n", err, thresh, VlhList_Len(vlh));
+    printf("err = %g, thresh = %g, %zu parts\n", err, thresh, VlhList_Len(*vlh));
 
-    LP_VertexList_Write("decomp.obj", Vl_Convert(vlh, 0, 0), 1.0);
+    LP_VertexList_Write("decomp.obj", Vl_Convert(*vlh, 0, 0), 1.0);
 #endif
+    
+    Decomp_Lock(dc);
+    dc->err += err - before;
+    dc->num_parts += Heap_Count(heap) - num;
+    if (opts->progress && opts->progress(opts->user, dc->num_parts, dc->volume > 0 ? dc->err / dc->volume : 0) != 0)
+      dc->stop = 1;
+    stop = dc->stop;
+    Decomp_Unlock(dc);
+    if (stop)
+      break;
+  }
+  
+  Heap_Free(heap);
+  return 0;
+  
+ err2:
+  Heap_Free(heap);
+ err:
+  return -1;
+}
+
+/* Each component gets the share of the error budget of its volume */
+static int Decomp_Component(void *user, size_t idx, size_t thread) {
+  struct decomp *dc = (struct decomp *) user;
+  struct vlh_list **comp = &dc->comps[dc->order[idx].idx];
+  
+  return Decomp_Refine(dc, comp, dc->opts->threshold * LP_Volume((*comp)->vl));
+}
+
+static int OrderCmp(const void *a, const void *b) {
+  const struct comp_order *oa = (const struct comp_order *) a, *ob = (const struct comp_order *) b;
+  
+  if (oa->err != ob->err)
+    return oa->err > ob->err ? -1 : 1;
+  return oa->idx < ob->idx ? -1 : oa->idx > ob->idx;
+}
+
+static int Decomp_Components(struct decomp *dc, struct vlh_list **vlh, size_t num_comps) {
+  struct vlh_list *cur, **tail;
+  size_t count;
+  int ret;
+  
+  if ((dc->comps = malloc(num_comps * sizeof(*dc->comps))) == NULL ||
+      (dc->order = malloc(num_comps * sizeof(*dc->order))) == NULL) {
+    Log_Error("Error: Could not allocate memory for decomposition components\n");
+    free(dc->comps);
+    return -1;
+  }
+  
+  for (count = 0, cur = *vlh; count < num_comps; count++) {
+    dc->comps[count] = cur;
+    dc->order[count].err = cur->err;
+    dc->order[count].idx = count;
+    cur = cur->next;
+    dc->comps[count]->next = NULL;
+  }
+  qsort(dc->order, num_comps, sizeof(*dc->order), OrderCmp);
+  
+  ret = Parallel_For(num_comps, Decomp_Component, dc);
+  
+  /* Rejoined in component order, whatever order they finished in */
+  for (count = 0, tail = vlh; count < num_comps; count++)
+    for (*tail = dc->comps[count]; *tail != NULL; tail = &(*tail)->next)
+      ;
+  
+  free(dc->order);
+  free(dc->comps);
+  return ret;
+}
+
+static struct lp_vl_list *ConvexDecomp(const struct lp_vertex_list *in, const struct lp_decomp_options *opts) {
+  struct vlh_list *vlh, *cur;
+  struct decomp dc;
+  int ret;
+  
+  memset(&dc, 0, sizeof(dc));
+  dc.opts = opts;
+  if (opts->time_limit > 0)
+    dc.deadline = Stats_Now() + (uint64_t) (opts->time_limit * 1e9);
+  dc.volume = LP_Volume(in);
+  
+  if ((vlh = VlhList_Convert(LP_PlaneCut(in, x_axis, INFINITY))) == NULL)
+    goto err;
+  for (cur = vlh; cur != NULL; cur = cur->next) {
+    dc.err += cur->err;
+    dc.num_parts++;
   }
   
+#ifdef HAVE_PTHREADS
+  if (pthread_mutex_init(&dc.mutex, NULL) != 0) {
+    Log_Error("Error: Could not initialize mutex\n");
+    goto err2;
+  }
+#endif
+  
+  if ((opts->flags & LP_DECOMP_COMPONENTS) && dc.num_parts > 1)
+    ret = Decomp_Components(&dc, &vlh, dc.num_parts);
+  else
+    ret = Decomp_Refine(&dc, &vlh, opts->threshold * dc.volume);
+  
+#ifdef HAVE_PTHREADS
+  pthread_mutex_destroy(&dc.mutex);
+#endif
+  if (ret < 0)
+    goto err2;
+  
   return Vl_Convert(vlh, 1, 1);
 
  err2:
@@ -483,3 +752,31 @@ struct lp_vl_list *LP_ConvexDecomp(const struct lp_vertex_list *in, float thresh
  err:
   return NULL;
 }
+
+struct decomp_params {
+  uint64_t max_parts;
+  float threshold;
+  int32_t flags;
+};
+
+/* Only the limits that give the same parts on every run are cached */
+struct lp_vl_list *LP_ConvexDecompEx(const struct lp_vertex_list *in, const struct lp_decomp_options *opts) {
+  struct decomp_params params;
+  struct lp_vl_list *out;
+  struct cache_key key;
+  
+  if (opts->time_limit > 0 || opts->cancel || opts->progress)
+    return ConvexDecomp(in, opts);
+  
+  memset(&params, 0, sizeof(params));
+  params.max_parts = opts->max_parts;
+  params.threshold = opts->threshold;
+  params.flags = opts->flags;
+  Cache_Key(&key, cache_decomp, in, &params, sizeof(params));
+  if ((out = Cache_Lookup(&key)) != NULL)
+    return out;
+  
+  if ((out = ConvexDecomp(in, opts)) != NULL)
+    Cache_Store(&key, out);
+  return out;
+}
@@ -36,10 +36,16 @@
 #include <math.h>
 #include <string.h>
 
+#include "cache.h"
+#include "convex_hull.h"
 #include "ftree.h"
 #include "hash.h"
 #include "libpolyhedra.h"
-#include "unique_queue.h"
+#include "log.h"
+#include "parallel.h"
+#include "simd.h"
+#include "stats.h"
+#include "queue.h"
 #include "util.h"
 
 /* Reference: The Quickhull algorithm for convex hulls
@@ -50,14 +56,19 @@
 #define EXTEND  ((void *) 2)
 #define DELETE  ((void *) 3)
 
-struct point_list_elem {
-  size_t idx;
-  struct point_list_elem *next;
-};
-
+/* Outside set of a face.  Coordinates are copied next to the indices so
+ * distances to a plane can be computed with vector loads.  The furthest
+ * point, max_pos, plays the role of the head of the list. */
 struct point_list {
-  struct point_list_elem *head;
-  struct point_list_elem *tail;
+  size_t *idx;
+  float *x;
+  float *y;
+  float *z;
+  float *dist; /* Scratch for Face_AssignPoints */
+  size_t num;
+  size_t alloc;
+  size_t dist_alloc;
+  size_t max_pos;
   float max_dist;
 };
 
@@ -76,6 +87,9 @@ struct face {
   float yy[3];
   struct point_list *pts;
   struct ftree_node *node;
+  /* Category for the point being added, valid while visit is its epoch */
+  size_t visit, queued;
+  void *cat;
 };
 
 struct ridge_list_elem {
@@ -111,25 +125,6 @@ static void PrintFace(FILE *out, const struct face_vert *vert, const float *data
 }
 #endif
 
-static struct point_list_elem *PointListElem_New(size_t idx) {
-  struct point_list_elem *ple;
-
-  if ((ple = malloc(sizeof(*ple))) == NULL)
-    goto err;
-  memset(ple, 0, sizeof(*ple));
-
-  ple->idx = idx;
-
-  return ple;
-  
- err:
-  return NULL;
-}
-
-static void PointListElem_Free(struct point_list_elem *ple) {
-  free(ple);
-}
-
 static struct point_list *PointList_New(void) {
   struct point_list *pl;
 
@@ -144,65 +139,112 @@ static struct point_list *PointList_New(void) {
 }
 
 static void PointList_Clear(struct point_list *pl) {
-  struct point_list_elem *cur, *next;
-  
-  cur = pl->head;
-  while (cur) {
-    next = cur->next;
-    PointListElem_Free(cur);
-    cur = next;
-  }
-  
-  memset(pl, 0, sizeof(*pl));
+  pl->num = 0;
+  pl->max_pos = 0;
+  pl->max_dist = 0;
 }
 
 static void PointList_Free(struct point_list *pl) {
   if (pl == NULL)
     return;
   
-  PointList_Clear(pl);
-  
+  free(pl->idx);
+  free(pl->x);
+  free(pl->y);
+  free(pl->z);
+  free(pl->dist);
   free(pl);
 }
 
-static void PointList_Add(struct point_list *pl, struct point_list_elem *elem, float dist) {
-  if (pl->head == NULL) {
-    pl->max_dist = dist;
-    pl->head = elem;
-    pl->tail = elem;
-    elem->next = NULL;
-    return;
-  }
+static int PointList_Reserve(struct point_list *pl, size_t num) {
+  size_t alloc, *idx;
+  float *ff;
+  
+  if (num <= pl->alloc)
+    return 0;
+  
+  for (alloc = pl->alloc ? pl->alloc : 16; alloc < num; alloc *= 2)
+    ;
+  
+  if ((idx = realloc(pl->idx, alloc * sizeof(*idx))) == NULL)
+    goto err;
+  pl->idx = idx;
+  if ((ff = realloc(pl->x, alloc * sizeof(*ff))) == NULL)
+    goto err;
+  pl->x = ff;
+  if ((ff = realloc(pl->y, alloc * sizeof(*ff))) == NULL)
+    goto err;
+  pl->y = ff;
+  if ((ff = realloc(pl->z, alloc * sizeof(*ff))) == NULL)
+    goto err;
+  pl->z = ff;
+  pl->alloc = alloc;
+  
+  return 0;
+  
+ err:
+  Log_Error("Error: Could not allocate memory for convex hull points\n");
+  return -1;
+}
+
+static size_t PointList_Head(const struct point_list *pl) {
+  return pl->idx[pl->max_pos];
+}
+
+static int PointList_Add(struct point_list *pl, size_t idx, float x, float y, float z, float dist) {
+  if (PointList_Reserve(pl, pl->num + 1) < 0)
+    return -1;
   
-  if (dist > pl->max_dist) {
+  if (pl->num == 0 || dist > pl->max_dist) {
     pl->max_dist = dist;
-    elem->next = pl->head;
-    pl->head = elem;
-    return;
+    pl->max_pos = pl->num;
   }
   
-  pl->tail->next = elem;
-  pl->tail = elem;
-  elem->next = NULL;
+  pl->idx[pl->num] = idx;
+  pl->x[pl->num] = x;
+  pl->y[pl->num] = y;
+  pl->z[pl->num] = z;
+  pl->num++;
+  
+  return 0;
 }
 
-static void PointList_Join(struct point_list *dest, struct point_list *src) {
-  struct point_list_elem *elem;
+static int PointList_AddData(struct point_list *pl, size_t idx, const float *data, float dist) {
+  const float *pt = data + 3 * idx;
   
-  if (src->head == NULL)
-    return;
-
-  elem = src->head->next;
-  PointList_Add(dest, src->head, src->max_dist);
+  return PointList_Add(pl, idx, pt[0], pt[1], pt[2], dist);
+}
 
-  if (src->head == src->tail) {
-    memset(src, 0, sizeof(*src));
-    return;
+/* Moves all points from src to dest */
+static int PointList_Join(struct point_list *dest, struct point_list *src) {
+  struct point_list temp;
+  
+  if (src->num == 0)
+    return 0;
+  
+  if (dest->num == 0) {
+    temp = *dest;
+    *dest = *src;
+    *src = temp;
+    PointList_Clear(src);
+    return 0;
+  }
+  
+  if (PointList_Reserve(dest, dest->num + src->num) < 0)
+    return -1;
+  
+  memcpy(dest->idx + dest->num, src->idx, src->num * sizeof(*src->idx));
+  memcpy(dest->x + dest->num, src->x, src->num * sizeof(*src->x));
+  memcpy(dest->y + dest->num, src->y, src->num * sizeof(*src->y));
+  memcpy(dest->z + dest->num, src->z, src->num * sizeof(*src->z));
+  if (src->max_dist > dest->max_dist) {
+    dest->max_dist = src->max_dist;
+    dest->max_pos = dest->num + src->max_pos;
   }
+  dest->num += src->num;
+  PointList_Clear(src);
   
-  dest->tail->next = elem;
-  dest->tail = src->tail;
-  memset(src, 0, sizeof(*src));
+  return 0;
 }
 
 static struct face_vert *FaceVert_New(size_t idx, struct face_vert *prev) {
@@ -260,7 +302,7 @@ static struct face_vert *FaceVert_FindVert(struct face_vert *fv, size_t pt) {
     
     cur = cur->next;
     if (cur == fv) {
-      fprintf(stderr, "Internal Error: convex_hull.c: Face does not contain requested vert\n");
+      Log_Error("Internal Error: convex_hull.c: Face does not contain requested vert\n");
       return NULL;
     }
   }
@@ -275,33 +317,35 @@ static struct face_vert *FaceVert_FindEdge(struct face_vert *fv, size_t pt1, siz
     return NULL;
   
   if (cur->next->idx != pt2) {
-    fprintf(stderr, "Internal Error: convex_hull.c: Face does not contain requested edge\n");
+    Log_Error("Internal Error: convex_hull.c: Face does not contain requested edge\n");
     return NULL;
   }
   
   return cur;
 }
 
-static void FaceVert_PrepForRetention(struct face_vert **fv, struct hash *visited) {
+#define FACE_CAT(face, epoch) ((face)->visit == (epoch) ? (face)->cat : NULL)
+
+static void FaceVert_PrepForRetention(struct face_vert **fv, size_t epoch) {
   struct face_vert *cur = *fv;
   
-  while (Hash_Lookup(visited, cur->neighbor, NULL) != DELETE)
+  while (FACE_CAT(cur->neighbor, epoch) != DELETE)
     cur = cur->next;
   
   *fv = cur;
 }
 
-static void FaceVert_PrepForExtend(struct face_vert **fv, struct hash *visited) {
+static void FaceVert_PrepForExtend(struct face_vert **fv, size_t epoch) {
   struct face_vert *del, *cur = *fv;
   void *cat;
 
-  while ((cat = Hash_Lookup(visited, cur->neighbor, NULL)) == DELETE || cat == EXTEND)
+  while ((cat = FACE_CAT(cur->neighbor, epoch)) == DELETE || cat == EXTEND)
     cur = cur->prev;
   
-  while ((cat = Hash_Lookup(visited, cur->neighbor, NULL)) != DELETE && cat != EXTEND)
+  while ((cat = FACE_CAT(cur->neighbor, epoch)) != DELETE && cat != EXTEND)
     cur = cur->next;
   
-  while ((cat = Hash_Lookup(visited, cur->next->neighbor, NULL)) == DELETE || cat == EXTEND) {
+  while ((cat = FACE_CAT(cur->next->neighbor, epoch)) == DELETE || cat == EXTEND) {
     del = cur->next;
 #ifdef DEBUG
     printf("Deleting vert %zu\n", del->idx);
@@ -374,7 +418,7 @@ static void Face_Free_Func(void *user, void *data) {
 }
 
 static int Face_Update(struct face *face, struct ftree *ftree) {
-  if (face->pts->head == NULL) {
+  if (face->pts->num == 0) {
     if (face->node) {
       FTree_Delete(ftree, face->node);
       face->node = NULL;
@@ -393,9 +437,10 @@ static int Face_Update(struct face *face, struct ftree *ftree) {
   return 0;
 }
 
-static void *Categorize(const struct face *face, size_t idx, const float *data, float *dist_out) {
+/* dist is the distance below the plane of the face, as Categorize finds it */
+static void *CategorizeDist(const struct face *face, size_t idx, const float *data, float dist) {
   const float *pt, *vert;
-  float delta[3], dist, x1, x2, y1, y2, dx, dy, dd, max, area, tol, dpt;
+  float delta[3], x1, x2, y1, y2, dx, dy, dd, max, area, tol, dpt;
   struct face_vert *fv;
   
   pt   = data + 3 * idx;
@@ -404,9 +449,6 @@ static void *Categorize(const struct face *face, size_t idx, const float *data,
   delta[0] = vert[0] - pt[0];
   delta[1] = vert[1] - pt[1];
   delta[2] = vert[2] - pt[2];
-  dist = Dot(delta, face->norm);
-  if (dist_out)
-    *dist_out = dist;
 
   area = 0;
   max = -INFINITY;
@@ -458,20 +500,67 @@ static void *Categorize(const struct face *face, size_t idx, const float *data,
   return PRESENT;
 }
 
-static void Face_AssignPoints(struct face *face, struct point_list *pool, const float *data) {
-  struct point_list_elem *prev, *cur;
-  float dist;
+static void *Categorize(const struct face *face, size_t idx, const float *data, float *dist_out) {
+  const float *pt, *vert;
+  float delta[3], dist;
   
-  prev = pool->head;
-  while ((cur = prev->next)) {
-    if (Categorize(face, cur->idx, data, &dist) == DELETE) {
-      prev->next = cur->next;
-      PointList_Add(face->pts, cur, dist);
-    } else {
-      prev = cur;
+  if (stats_enabled)
+    Stats_Add(STAT_POINTS_CATEGORIZED, 1, 0);
+  
+  pt   = data + 3 * idx;
+  vert = data + 3 * face->verts->prev->idx;
+  delta[0] = vert[0] - pt[0];
+  delta[1] = vert[1] - pt[1];
+  delta[2] = vert[2] - pt[2];
+  dist = Dot(delta, face->norm);
+  if (dist_out)
+    *dist_out = dist;
+  
+  return CategorizeDist(face, idx, data, dist);
+}
+
+/* Moves the points of the pool other than its head that can see the face
+ * into the face's outside set.  A point can only see the face if it is
+ * above the plane, so only those are fully categorized. */
+static int Face_AssignPoints(struct face *face, struct point_list *pool, const float *data) {
+  size_t count, keep, head;
+  float *dist;
+  
+  if (pool->num > pool->dist_alloc) {
+    if ((dist = realloc(pool->dist, pool->alloc * sizeof(*dist))) == NULL) {
+      Log_Error("Error: Could not allocate memory for convex hull distances\n");
+      return -1;
+    }
+    pool->dist = dist;
+    pool->dist_alloc = pool->alloc;
+  }
+  
+  if (stats_enabled)
+    Stats_Add(STAT_POINTS_CATEGORIZED, pool->num - 1, 0);
+  
+  Simd_PlaneDist(pool->dist, pool->x, pool->y, pool->z, pool->num,
+		 data + 3 * face->verts->prev->idx, face->norm);
+  
+  head = pool->max_pos;
+  for (count = keep = 0; count < pool->num; count++) {
+    if (count != head && pool->dist[count] > 0 &&
+	CategorizeDist(face, pool->idx[count], data, pool->dist[count]) == DELETE) {
+      if (PointList_Add(face->pts, pool->idx[count], pool->x[count], pool->y[count], pool->z[count], pool->dist[count]) < 0)
+	return -1;
+      continue;
     }
+    
+    if (count == head)
+      pool->max_pos = keep;
+    pool->idx[keep] = pool->idx[count];
+    pool->x[keep] = pool->x[count];
+    pool->y[keep] = pool->y[count];
+    pool->z[keep] = pool->z[count];
+    keep++;
   }
-  pool->tail = prev;
+  pool->num = keep;
+  
+  return 0;
 }
 
 static struct ridge_list_elem *RidgeListElem_New(size_t idx, int extend, struct face *neighbor) {
@@ -491,13 +580,13 @@ static struct ridge_list_elem *RidgeListElem_New(size_t idx, int extend, struct
   return NULL;
 }
 
-static struct ridge_list_elem *RidgeListElem_NewV(struct face *neighbor, struct hash *visited) {
+static struct ridge_list_elem *RidgeListElem_NewV(struct face *neighbor, size_t epoch) {
   int extend;
 
-  if ((extend = Hash_Lookup(visited, neighbor, NULL) == EXTEND))
-    FaceVert_PrepForExtend(&neighbor->verts, visited);
+  if ((extend = FACE_CAT(neighbor, epoch) == EXTEND))
+    FaceVert_PrepForExtend(&neighbor->verts, epoch);
   else
-    FaceVert_PrepForRetention(&neighbor->verts, visited);
+    FaceVert_PrepForRetention(&neighbor->verts, epoch);
 
   return RidgeListElem_New(neighbor->verts->next->idx, extend, neighbor);
 }
@@ -562,10 +651,10 @@ static int RidgeList_Append(struct ridge_list *rl, size_t idx, int extend, struc
   return 0;
 }
 
-static int RidgeList_AppendV(struct ridge_list *rl, struct face *neighbor, struct hash *visited) {
+static int RidgeList_AppendV(struct ridge_list *rl, struct face *neighbor, size_t epoch) {
   struct ridge_list_elem *rle;
   
-  if ((rle = RidgeListElem_NewV(neighbor, visited)) == NULL)
+  if ((rle = RidgeListElem_NewV(neighbor, epoch)) == NULL)
     return -1;
   
   RidgeList_AppendRle(rl, rle);
@@ -578,11 +667,11 @@ static int BuildVl_AddFace(struct lp_vertex_list *out, struct face *face, const
   
   cur  = face->verts->next->next;
   while (cur != face->verts) {
-    if (LP_VertexList_Add(out, data + 3 * face->verts->idx) == UINT_MAX)
+    if (LP_VertexList_Add(out, data + 3 * face->verts->idx) == LP_INDEX_MAX)
       return -1;
-    if (LP_VertexList_Add(out, data + 3 * cur->idx) == UINT_MAX)
+    if (LP_VertexList_Add(out, data + 3 * cur->idx) == LP_INDEX_MAX)
       return -1;
-    if (LP_VertexList_Add(out, data + 3 * cur->prev->idx) == UINT_MAX)
+    if (LP_VertexList_Add(out, data + 3 * cur->prev->idx) == LP_INDEX_MAX)
       return -1;
     cur = cur->next;
   }
@@ -624,7 +713,7 @@ static int BuildNewFaces(struct ridge_list *rl, struct point_list *pool, struct
   first_neighbor = NULL;
   neighbor_prev = NULL;
   first_face = NULL;
-  idx = pool->head->idx;
+  idx = PointList_Head(pool);
   prev_idx = rl->tail->idx;
   face_prev = NULL;
   for (rle = rl->head; rle; prev_idx = rle->idx, rle = rle->next, face_prev = face) {
@@ -663,7 +752,8 @@ static int BuildNewFaces(struct ridge_list *rl, struct point_list *pool, struct
     if (first_face == NULL)
       first_face = face;
 
-    Face_AssignPoints(face, pool, data);
+    if (Face_AssignPoints(face, pool, data) < 0)
+      goto err;
 
     if (Face_Update(face, faces_with_pts) < 0)
       goto err;
@@ -673,9 +763,10 @@ static int BuildNewFaces(struct ridge_list *rl, struct point_list *pool, struct
   *neighbor_prev = first_face;
   
 #ifdef DEBUG
-  struct point_list_elem *cur;
-  for (cur = pool->head->next; cur; cur = cur->next)
-    PrintPoint(stdout, "Dropping interior point", cur->idx, data);
+  size_t pcount;
+  for (pcount = 0; pcount < pool->num; pcount++)
+    if (pcount != pool->max_pos)
+      PrintPoint(stdout, "Dropping interior point", pool->idx[pcount], data);
 
   struct hash_iterator *hi;
   struct face_vert *fv;
@@ -707,13 +798,12 @@ static int BuildNewFaces(struct ridge_list *rl, struct point_list *pool, struct
 static int FindHull(struct hash *faces, struct ftree *faces_with_pts, const float *data) {
   struct point_list *pool;
   struct ridge_list *rl;
-  struct hash *visited;
-  struct unique_queue *queued;
-  struct hash_iterator *hi;
+  struct queue *visited, *queued;
   struct face *face, *neighbor, *no_view;
   struct face_vert *cur;
   struct ftree_node *node;
-  size_t idx, first_idx;
+  size_t idx, first_idx, epoch = 0;
+  uint64_t start = 0, iterations = 0;
   void *cat;
   int found;
 #ifdef DEBUG
@@ -721,27 +811,32 @@ static int FindHull(struct hash *faces, struct ftree *faces_with_pts, const floa
   char buf[256];
 #endif
   
+  if (stats_enabled)
+    start = Stats_Now();
+  
   if ((pool = PointList_New()) == NULL)
     goto err;
   
   if ((rl = RidgeList_New()) == NULL)
     goto err2;
   
-  if ((visited = Hash_NewPtr(NULL, NULL, NULL, NULL, NULL)) == NULL)
+  if ((visited = Queue_New()) == NULL)
     goto err3;
   
-  if ((queued = UniqueQueue_New()) == NULL)
+  if ((queued = Queue_New()) == NULL)
     goto err4;
   
   while ((node = FTree_Highest(faces_with_pts))) {
     /* Found face with points above */
     face = (struct face *) FTree_GetData(node);
-    if (face->pts->head == NULL) {
+    if (face->pts->num == 0) {
       Face_Update(face, faces_with_pts);
       continue;
     }
-    PointList_Join(pool, face->pts);
-    idx = pool->head->idx;
+    if (PointList_Join(pool, face->pts) < 0)
+      goto err5;
+    idx = PointList_Head(pool);
+    iterations++;
 
 #ifdef DEBUG
     struct lp_vl_list list;
@@ -770,10 +865,12 @@ static int FindHull(struct hash *faces, struct ftree *faces_with_pts, const floa
       
       if (!found) {
 	/* No deletion face, reassign points in the pool and try next point */
-	Face_AssignPoints(face, pool, data);
+	if (Face_AssignPoints(face, pool, data) < 0)
+	  goto err5;
 	Face_Update(face, faces_with_pts);
 	do {
-	  Face_AssignPoints(cur->neighbor, pool, data);
+	  if (Face_AssignPoints(cur->neighbor, pool, data) < 0)
+	    goto err5;
 	  Face_Update(face, faces_with_pts);
 	  
 	  cur = cur->next;
@@ -782,9 +879,9 @@ static int FindHull(struct hash *faces, struct ftree *faces_with_pts, const floa
 #ifdef DEBUG
 	printf("Could not find deletion face\n");
 	
-	struct point_list_elem *cur;
-	for (cur = pool->head; cur != NULL; cur = cur->next)
-	  PrintPoint(stdout, "Dropping point", cur->idx, data);
+	size_t pcount;
+	for (pcount = 0; pcount < pool->num; pcount++)
+	  PrintPoint(stdout, "Dropping point", pool->idx[pcount], data);
 #endif
 	PointList_Clear(pool);
 	continue;
@@ -793,13 +890,16 @@ static int FindHull(struct hash *faces, struct ftree *faces_with_pts, const floa
     
     /* Identify all faces with view of point */
     no_view = NULL;
+    epoch++;
     do {
       cat = Categorize(face, idx, data, NULL);
 #ifdef DEBUG
       printf("Face marked for %s\n", cat == DELETE ? "deletion" : cat == EXTEND ? "extension" : "retention");
       PrintFace(stdout, face->verts, data);
 #endif
-      if (Hash_Insert(visited, face, cat, NULL) < 0)
+      face->visit = epoch;
+      face->cat = cat;
+      if (Queue_PushBack(visited, face) < 0)
 	goto err5;
       if (cat != DELETE) {
 	no_view = face;
@@ -807,18 +907,22 @@ static int FindHull(struct hash *faces, struct ftree *faces_with_pts, const floa
       }
       
       face->pts->max_dist = 0;
-      PointList_Join(pool, face->pts);
+      if (PointList_Join(pool, face->pts) < 0)
+	goto err5;
       
       cur = face->verts;
       do {
-	if (!Hash_Lookup(visited, cur->neighbor, NULL))
-	  if (UniqueQueue_PushBack(queued, cur->neighbor) < 0)
+	neighbor = cur->neighbor;
+	if (neighbor->visit != epoch && neighbor->queued != epoch) {
+	  neighbor->queued = epoch;
+	  if (Queue_PushBack(queued, neighbor) < 0)
 	    goto err5;
+	}
 	cur = cur->next;
       } while (cur != face->verts);
-    } while ((face = UniqueQueue_Pop(queued)));
+    } while ((face = Queue_Pop(queued)));
     if (no_view == NULL) {
-      fprintf(stderr, "Internal error: convex_hull.c: All faces can view point\n");
+      Log_Error("Internal error: convex_hull.c: All faces can view point\n");
       goto err5;
     }
     
@@ -828,7 +932,7 @@ static int FindHull(struct hash *faces, struct ftree *faces_with_pts, const floa
     printf("Before first append\n");
     PrintFace(stdout, face->verts, data);
 #endif
-    if (RidgeList_AppendV(rl, face, visited) < 0)
+    if (RidgeList_AppendV(rl, face, epoch) < 0)
       goto err5;
 #ifdef DEBUG
     printf("After first append\n");
@@ -854,10 +958,10 @@ static int FindHull(struct hash *faces, struct ftree *faces_with_pts, const floa
       }
       
       neighbor = cur->neighbor;
-      if ((cat = Hash_Lookup(visited, neighbor, NULL)) == DELETE) {
+      if ((cat = FACE_CAT(neighbor, epoch)) == DELETE) {
 	RidgeList_Append(rl, cur->next->idx, 0, face);
       } else if (cat == EXTEND) {
-	RidgeList_AppendV(rl, neighbor, visited);
+	RidgeList_AppendV(rl, neighbor, epoch);
 	face = neighbor;
       } else {
 	face = neighbor;
@@ -865,43 +969,39 @@ static int FindHull(struct hash *faces, struct ftree *faces_with_pts, const floa
     }
     
     /* Delete old faces */
-    if ((hi = Hash_IteratorNew(visited)) == NULL)
-      goto err5;
-    while (Hash_IteratorNext(hi)) {
-      if ((cat = Hash_IteratorGetData(hi)) == DELETE || cat == EXTEND) {
-	face = (struct face *) Hash_IteratorGetKey(hi);
+    while ((face = Queue_Pop(visited))) {
+      if ((cat = face->cat) == DELETE || cat == EXTEND) {
 	if (Face_Update(face, faces_with_pts) < 0)
-	  goto err6;
+	  goto err5;
 	if (cat == DELETE)
 	  Hash_Remove(faces, face);
       }
     }
-    Hash_IteratorFree(hi);
 
     /* Build new faces */
     if (BuildNewFaces(rl, pool, faces, faces_with_pts, data) < 0)
       goto err5;
     
-    if (pool->head->idx != idx)
-      fprintf(stderr, "Internal error: convex_hull.c: pool corruption\n");
+    if (PointList_Head(pool) != idx)
+      Log_Error("Internal error: convex_hull.c: pool corruption\n");
     
-    Hash_Clear(visited);
     PointList_Clear(pool);
     RidgeList_Clear(rl);
   }
 
-  UniqueQueue_Free(queued);
-  Hash_Free(visited);
+  Queue_Free(queued);
+  Queue_Free(visited);
   RidgeList_Free(rl);
   PointList_Free(pool);
+  
+  if (stats_enabled)
+    Stats_Add(STAT_HULL_ITERATIONS, iterations, Stats_Now() - start);
   return 0;
 
- err6:
-  Hash_IteratorFree(hi);
  err5:
-  UniqueQueue_Free(queued);
+  Queue_Free(queued);
  err4:
-  Hash_Free(visited);
+  Queue_Free(visited);
  err3:
   RidgeList_Free(rl);
  err2:
@@ -915,14 +1015,13 @@ static int InitSimplex(size_t len, const float *data, struct hash *faces, struct
   const float *max_p, *min_p;
   size_t idx, min_idx, max_idx, dd_idx, temp_idx;
   struct face *face;
-  struct point_list *pool, *below, *temp_pl;
-  struct point_list_elem *elem;
+  struct point_list *pool, *below, *temp_pl, *dest;
   struct ridge_list *rl;
   struct face_vert *cur;
   void *cat;
   
   if (len < 4) {
-    fprintf(stderr, "Cannot build convex hull from less than 4 points: %zu unique points found\n", len);
+    Log_Error("Cannot build convex hull from less than 4 points: %zu unique points found\n", len);
     goto err;
   }
   
@@ -960,7 +1059,7 @@ static int InitSimplex(size_t len, const float *data, struct hash *faces, struct
     goto err;
   
   if (Norm2(face->norm) == 0) {
-    fprintf(stderr, "Cannot create convex hull: All points are colinear\n");
+    Log_Error("Cannot create convex hull: All points are colinear\n");
     goto err;
   }
   
@@ -975,16 +1074,18 @@ static int InitSimplex(size_t len, const float *data, struct hash *faces, struct
     if (idx == min_idx || idx == max_idx || idx == dd_idx)
       continue;
     
-    if ((elem = PointListElem_New(idx)) == NULL)
-      goto err2;
-
     if ((cat = Categorize(face, idx, data, &dist)) == DELETE) {
-      PointList_Add(face->pts, elem, dist);
+      dest = face->pts;
     } else if (cat == EXTEND) {
-      PointList_Add(pool, elem, fabsf(dist));
+      dest = pool;
+      dist = fabsf(dist);
     } else {
-      PointList_Add(below, elem, -dist);
+      dest = below;
+      dist = -dist;
     }
+    
+    if (PointList_AddData(dest, idx, data, dist) < 0)
+      goto err3;
   }
 
   /* If furthest point was above, flip face */
@@ -1000,8 +1101,8 @@ static int InitSimplex(size_t len, const float *data, struct hash *faces, struct
     face->norm[2] = -face->norm[2];
   }
   
-  if (below->head == NULL) {
-    fprintf(stderr, "Cannot create convex hull: All points coplaner\n");
+  if (below->num == 0) {
+    Log_Error("Cannot create convex hull: All points coplaner\n");
     goto err3;
   }
 
@@ -1009,7 +1110,8 @@ static int InitSimplex(size_t len, const float *data, struct hash *faces, struct
     goto err3;
   
   /* Build remaining faces */
-  PointList_Join(pool, below);
+  if (PointList_Join(pool, below) < 0)
+    goto err3;
   if ((rl = RidgeList_New()) == NULL)
     goto err3;
   cur = face->verts;
@@ -1036,10 +1138,511 @@ static int InitSimplex(size_t len, const float *data, struct hash *faces, struct
   return -1;
 }
 
-struct lp_vertex_list *LP_ConvexHull(const struct lp_vertex_list *in) {
-  struct lp_vertex_list *in3, *out;
+static struct lp_vertex_list *Hull(const float *data, size_t len) {
+  struct lp_vertex_list *out;
   struct hash *faces;
   struct ftree *faces_with_pts;
+  
+  if ((faces = Hash_NewPtr(NULL, Face_Free_Func, NULL, NULL, NULL)) == NULL)
+    goto err;
+  
+  if ((faces_with_pts = FTree_New(NULL, NULL, NULL)) == NULL)
+    goto err2;
+  
+  if (InitSimplex(len, data, faces, faces_with_pts) < 0)
+    goto err3;
+  
+  if (FindHull(faces, faces_with_pts, data) < 0)
+    goto err3;
+  
+  if ((out = BuildVl(faces, data)) == NULL)
+    goto err3;
+  
+  FTree_Free(faces_with_pts);
+  Hash_Free(faces);
+  return out;
+
+ err3:
+  FTree_Free(faces_with_pts);
+ err2:
+  Hash_Free(faces);
+ err:
+  return NULL;
+}
+
+/************************ Interior culling ***************************/
+/* Reference: A fast convex hull algorithm
+ * Selim G. Akl, Godfried T. Toussaint
+ *
+ * Points well inside the hull of the extremes along CULL_DIRS directions
+ * can't be on the hull, so they are dropped before InitSimplex. */
+#define CULL_MIN_POINTS 1024
+#define CULL_DIRS       13
+#define CULL_CHUNK      4096
+#define CULL_BLOCK      256
+
+static const float cull_dir[CULL_DIRS][3] = {
+  {1, 0, 0}, {0, 1, 0}, {0, 0, 1},
+  {1, 1, 0}, {1, -1, 0}, {1, 0, 1}, {1, 0, -1}, {0, 1, 1}, {0, 1, -1},
+  {1, 1, 1}, {1, 1, -1}, {1, -1, 1}, {-1, 1, 1}
+};
+
+struct cull_extreme {
+  size_t min_idx[CULL_DIRS];
+  size_t max_idx[CULL_DIRS];
+  float min[CULL_DIRS];
+  float max[CULL_DIRS];
+};
+
+struct cull {
+  const float *data;
+  size_t len;
+  struct cull_extreme *extreme; /* One per chunk */
+  float *planes;                /* Point on plane and inward normal */
+  size_t num_planes;
+  float margin;
+  unsigned char *keep;
+};
+
+static int Cull_Extremes(void *user, size_t chunk, size_t thread) {
+  struct cull *cull = (struct cull *) user;
+  struct cull_extreme *ext = &cull->extreme[chunk];
+  size_t idx, end, dir;
+  const float *pt;
+  float dd;
+  
+  idx = chunk * CULL_CHUNK;
+  end = idx + CULL_CHUNK < cull->len ? idx + CULL_CHUNK : cull->len;
+  for (dir = 0; dir < CULL_DIRS; dir++) {
+    ext->min[dir] = INFINITY;
+    ext->max[dir] = -INFINITY;
+    ext->min_idx[dir] = idx;
+    ext->max_idx[dir] = idx;
+  }
+  
+  for (; idx < end; idx++) {
+    pt = cull->data + 3 * idx;
+    for (dir = 0; dir < CULL_DIRS; dir++) {
+      dd = Dot(pt, cull_dir[dir]);
+      if (dd < ext->min[dir]) {
+	ext->min[dir] = dd;
+	ext->min_idx[dir] = idx;
+      }
+      if (dd > ext->max[dir]) {
+	ext->max[dir] = dd;
+	ext->max_idx[dir] = idx;
+      }
+    }
+  }
+  
+  return 0;
+}
+
+/* keep[idx] is cleared for points further than margin inside every plane */
+static int Cull_Filter(void *user, size_t chunk, size_t thread) {
+  struct cull *cull = (struct cull *) user;
+  float x[CULL_BLOCK], y[CULL_BLOCK], z[CULL_BLOCK], dist[CULL_BLOCK];
+  unsigned char inside[CULL_BLOCK];
+  size_t start, end, block, num, count, plane;
+  const float *pt;
+  
+  start = chunk * CULL_CHUNK;
+  end = start + CULL_CHUNK < cull->len ? start + CULL_CHUNK : cull->len;
+  for (block = start; block < end; block += num) {
+    num = end - block < CULL_BLOCK ? end - block : CULL_BLOCK;
+    for (count = 0; count < num; count++) {
+      pt = cull->data + 3 * (block + count);
+      x[count] = pt[0];
+      y[count] = pt[1];
+      z[count] = pt[2];
+      inside[count] = 1;
+    }
+    
+    for (plane = 0; plane < cull->num_planes; plane++) {
+      Simd_PlaneDist(dist, x, y, z, num, cull->planes + 6 * plane, cull->planes + 6 * plane + 3);
+      for (count = 0; count < num; count++)
+	inside[count] &= dist[count] < -cull->margin;
+    }
+    
+    for (count = 0; count < num; count++)
+      cull->keep[block + count] = !inside[count];
+  }
+  
+  return 0;
+}
+
+static void Cull_Delta(float *delta, const float *pt, const float *origin) {
+  delta[0] = pt[0] - origin[0];
+  delta[1] = pt[1] - origin[1];
+  delta[2] = pt[2] - origin[2];
+}
+
+/* Checks that the points span a volume, so their hull can be built */
+static int Cull_Flat(const float *data, size_t num) {
+  const float *a, *b, *c, *pt;
+  size_t count;
+  float edge[3], delta[3], cross[3], norm[3], dd, max, len;
+  
+  /* Furthest point from the first */
+  a = b = data;
+  max = 0;
+  for (count = 0, pt = data; count < num; count++, pt += 3) {
+    if ((dd = Dist(pt, a)) > max) {
+      max = dd;
+      b = pt;
+    }
+  }
+  if (max == 0)
+    return 1;
+  len = max;
+  
+  /* Furthest point from that line */
+  Cull_Delta(edge, b, a);
+  Normalize(edge);
+  c = a;
+  max = 0;
+  for (count = 0, pt = data; count < num; count++, pt += 3) {
+    Cull_Delta(delta, pt, a);
+    Cross(cross, delta, edge);
+    if ((dd = Norm(cross)) > max) {
+      max = dd;
+      c = pt;
+    }
+  }
+  if (!(max > 1e-3 * len))
+    return 1;
+  
+  /* Furthest point from that plane */
+  PlaneNorm(norm, a, b, c);
+  max = 0;
+  for (count = 0, pt = data; count < num; count++, pt += 3) {
+    Cull_Delta(delta, pt, a);
+    if ((dd = fabsf(Dot(delta, norm))) > max)
+      max = dd;
+  }
+  
+  return !(max > 1e-3 * len);
+}
+
+/* Builds the inward facing planes of the hull of the extreme points.
+ * Returns 1 if the extremes don't enclose a volume. */
+static int Cull_Planes(struct cull *cull) {
+  struct cull_extreme *ext = cull->extreme;
+  struct lp_vertex_list *pts, *hull;
+  const float *a, *b, *c;
+  float center[3], lo[3], hi[3], extent, *plane;
+  size_t chunk, num_chunks, dir, count, num;
+  lp_index_t *ind;
+  int ret = 1;
+  
+  num_chunks = (cull->len + CULL_CHUNK - 1) / CULL_CHUNK;
+  for (chunk = 1; chunk < num_chunks; chunk++) {
+    for (dir = 0; dir < CULL_DIRS; dir++) {
+      if (cull->extreme[chunk].min[dir] < ext->min[dir]) {
+	ext->min[dir] = cull->extreme[chunk].min[dir];
+	ext->min_idx[dir] = cull->extreme[chunk].min_idx[dir];
+      }
+      if (cull->extreme[chunk].max[dir] > ext->max[dir]) {
+	ext->max[dir] = cull->extreme[chunk].max[dir];
+	ext->max_idx[dir] = cull->extreme[chunk].max_idx[dir];
+      }
+    }
+  }
+  
+  if ((pts = LP_VertexList_New(3, lp_pt_point)) == NULL)
+    goto err;
+  for (dir = 0; dir < CULL_DIRS; dir++) {
+    if (LP_VertexList_Add(pts, cull->data + 3 * ext->min_idx[dir]) == LP_INDEX_MAX ||
+	LP_VertexList_Add(pts, cull->data + 3 * ext->max_idx[dir]) == LP_INDEX_MAX)
+      goto err2;
+  }
+  if (LP_VertexList_NumVert(pts) < 4 ||
+      Cull_Flat(LP_VertexList_GetVert(pts), LP_VertexList_NumVert(pts))) {
+    LP_VertexList_Free(pts);
+    return 1;
+  }
+  
+  if ((hull = ConvexHull_Build(pts)) == NULL)
+    goto err2;
+  
+  num = LP_VertexList_NumInd(hull) / 3;
+  ind = LP_VertexList_GetInd(hull);
+  if ((cull->planes = malloc(6 * num * sizeof(*cull->planes))) == NULL) {
+    Log_Error("Error: Could not allocate memory for culling planes\n");
+    goto err3;
+  }
+  
+  memset(center, 0, sizeof(center));
+  for (count = 0; count < LP_VertexList_NumVert(hull); count++) {
+    a = LP_VertexList_GetVert(hull) + 3 * count;
+    for (dir = 0; dir < 3; dir++) {
+      center[dir] += a[dir];
+      lo[dir] = count == 0 || a[dir] < lo[dir] ? a[dir] : lo[dir];
+      hi[dir] = count == 0 || a[dir] > hi[dir] ? a[dir] : hi[dir];
+    }
+  }
+  for (dir = 0; dir < 3; dir++)
+    center[dir] /= LP_VertexList_NumVert(hull);
+  
+  extent = 0;
+  for (dir = 0; dir < 3; dir++)
+    if (hi[dir] - lo[dir] > extent)
+      extent = hi[dir] - lo[dir];
+  cull->margin = 1e-4 * extent;
+  
+  cull->num_planes = 0;
+  for (count = 0; count < num; count++) {
+    a = LP_VertexList_GetVert(hull) + 3 * ind[3 * count];
+    b = LP_VertexList_GetVert(hull) + 3 * ind[3 * count + 1];
+    c = LP_VertexList_GetVert(hull) + 3 * ind[3 * count + 2];
+    plane = cull->planes + 6 * cull->num_planes;
+    PlaneNorm(plane + 3, a, b, c);
+    if (!(Norm2(plane + 3) > 0.5))
+      continue;
+    memcpy(plane, a, 3 * sizeof(*plane));
+    
+    /* Point the normal inward, Simd_PlaneDist is then negative inside */
+    if (Dot(plane + 3, center) < Dot(plane + 3, a)) {
+      plane[3] = -plane[3];
+      plane[4] = -plane[4];
+      plane[5] = -plane[5];
+    }
+    cull->num_planes++;
+  }
+  ret = cull->num_planes >= 4 ? 0 : 1;
+  
+  LP_VertexList_Free(hull);
+  LP_VertexList_Free(pts);
+  return ret;
+
+ err3:
+  LP_VertexList_Free(hull);
+ err2:
+  LP_VertexList_Free(pts);
+ err:
+  return -1;
+}
+
+/* Returns a copy of data without the interior points in *out, or NULL if
+ * nothing was culled */
+static int CullInterior(const float *data, size_t len, float **out, size_t *out_len) {
+  struct cull cull;
+  size_t num_chunks, idx, num;
+  float *kept;
+  int ret;
+  
+  *out = NULL;
+  if (len < CULL_MIN_POINTS)
+    return 0;
+  
+  memset(&cull, 0, sizeof(cull));
+  cull.data = data;
+  cull.len = len;
+  num_chunks = (len + CULL_CHUNK - 1) / CULL_CHUNK;
+  if ((cull.extreme = malloc(num_chunks * sizeof(*cull.extreme))) == NULL) {
+    Log_Error("Error: Could not allocate memory for culling extremes\n");
+    goto err;
+  }
+  if (Parallel_For(num_chunks, Cull_Extremes, &cull) < 0)
+    goto err2;
+  
+  if ((ret = Cull_Planes(&cull)) != 0) {
+    free(cull.extreme);
+    return ret < 0 ? -1 : 0;
+  }
+  
+  if ((cull.keep = malloc(len)) == NULL) {
+    Log_Error("Error: Could not allocate memory for culling\n");
+    goto err3;
+  }
+  if (Parallel_For(num_chunks, Cull_Filter, &cull) < 0)
+    goto err4;
+  
+  for (idx = num = 0; idx < len; idx++)
+    num += cull.keep[idx];
+  
+  if (num < len) {
+    if ((kept = malloc(3 * num * sizeof(*kept))) == NULL) {
+      Log_Error("Error: Could not allocate memory for culled points\n");
+      goto err4;
+    }
+    for (idx = num = 0; idx < len; idx++)
+      if (cull.keep[idx])
+	memcpy(kept + 3 * num++, data + 3 * idx, 3 * sizeof(*kept));
+    *out = kept;
+    *out_len = num;
+  }
+  
+  free(cull.keep);
+  free(cull.planes);
+  free(cull.extreme);
+  return 0;
+
+ err4:
+  free(cull.keep);
+ err3:
+  free(cull.planes);
+ err2:
+  free(cull.extreme);
+ err:
+  return -1;
+}
+
+/************************ Parallel partitions ***************************/
+/* Large inputs are split into slabs along their longest axis and the slabs
+ * are hulled concurrently.  Only vertices of the partial hulls can be on
+ * the final hull, which is built from their union. */
+#define PARTITION_MIN_POINTS 65536
+#define PARTITION_PER_THREAD 2
+
+struct partition {
+  const float *data;             /* Points grouped by slab */
+  size_t *start;                 /* Offset of each slab, num_slabs + 1 */
+  struct lp_vertex_list **hulls; /* NULL for slabs passed through */
+};
+
+static int Partition_Hull(void *user, size_t slab, size_t thread) {
+  struct partition *part = (struct partition *) user;
+  const float *data = part->data + 3 * part->start[slab];
+  size_t len = part->start[slab + 1] - part->start[slab];
+  
+  /* Degenerate slabs keep all of their points */
+  if (len < 4 || Cull_Flat(data, len))
+    return 0;
+  
+  if ((part->hulls[slab] = Hull(data, len)) == NULL)
+    return -1;
+  
+  return 0;
+}
+
+static size_t Partition_Slab(const float *pt, size_t axis, float lo, float scale, size_t num_slabs) {
+  size_t slab = (size_t) ((pt[axis] - lo) * scale);
+  
+  return slab < num_slabs ? slab : num_slabs - 1;
+}
+
+/* Returns the union of the partial hull vertices in *out, or NULL if the
+ * input was too small to partition */
+static int PartitionHull(const float *data, size_t len, float **out, size_t *out_len) {
+  struct partition part;
+  float lo[3], hi[3], scale, *sorted, *merged;
+  size_t num_slabs, slab, idx, axis, num, count, *fill;
+  const float *pt;
+  
+  *out = NULL;
+  if (len < PARTITION_MIN_POINTS || Parallel_Available() <= 1)
+    return 0;
+  
+  /* Flat slabs pass their points through, so flat input as a whole goes
+   * straight to Hull to fail or succeed the same as a serial build */
+  if (Cull_Flat(data, len))
+    return 0;
+  
+  for (axis = 0; axis < 3; axis++)
+    lo[axis] = hi[axis] = data[axis];
+  for (idx = 1, pt = data + 3; idx < len; idx++, pt += 3) {
+    for (axis = 0; axis < 3; axis++) {
+      if (pt[axis] < lo[axis])
+	lo[axis] = pt[axis];
+      if (pt[axis] > hi[axis])
+	hi[axis] = pt[axis];
+    }
+  }
+  axis = 0;
+  if (hi[1] - lo[1] > hi[axis] - lo[axis])
+    axis = 1;
+  if (hi[2] - lo[2] > hi[axis] - lo[axis])
+    axis = 2;
+  if (!(hi[axis] > lo[axis]))
+    return 0;
+  
+  num_slabs = PARTITION_PER_THREAD * Parallel_Available();
+  scale = num_slabs / (hi[axis] - lo[axis]);
+  
+  memset(&part, 0, sizeof(part));
+  if ((part.start = calloc(num_slabs + 1, sizeof(*part.start))) == NULL) {
+    Log_Error("Error: Could not allocate memory for hull partitions\n");
+    goto err;
+  }
+  if ((fill = malloc(num_slabs * sizeof(*fill))) == NULL) {
+    Log_Error("Error: Could not allocate memory for hull partitions\n");
+    goto err2;
+  }
+  if ((part.hulls = calloc(num_slabs, sizeof(*part.hulls))) == NULL) {
+    Log_Error("Error: Could not allocate memory for partial hulls\n");
+    goto err3;
+  }
+  if ((sorted = malloc(3 * len * sizeof(*sorted))) == NULL) {
+    Log_Error("Error: Could not allocate memory for hull partitions\n");
+    goto err4;
+  }
+  
+  /* Counting sort of the points by slab */
+  for (idx = 0, pt = data; idx < len; idx++, pt += 3)
+    part.start[Partition_Slab(pt, axis, lo[axis], scale, num_slabs) + 1]++;
+  for (slab = 0; slab < num_slabs; slab++) {
+    part.start[slab + 1] += part.start[slab];
+    fill[slab] = part.start[slab];
+  }
+  for (idx = 0, pt = data; idx < len; idx++, pt += 3) {
+    slab = Partition_Slab(pt, axis, lo[axis], scale, num_slabs);
+    memcpy(sorted + 3 * fill[slab]++, pt, 3 * sizeof(*sorted));
+  }
+  part.data = sorted;
+  
+  if (Parallel_For(num_slabs, Partition_Hull, &part) < 0)
+    goto err5;
+  
+  for (slab = num = 0; slab < num_slabs; slab++) {
+    if (part.hulls[slab])
+      num += LP_VertexList_NumVert(part.hulls[slab]);
+    else
+      num += part.start[slab + 1] - part.start[slab];
+  }
+  if ((merged = malloc(3 * num * sizeof(*merged))) == NULL) {
+    Log_Error("Error: Could not allocate memory for partial hulls\n");
+    goto err5;
+  }
+  for (slab = num = 0; slab < num_slabs; slab++) {
+    if (part.hulls[slab]) {
+      count = LP_VertexList_NumVert(part.hulls[slab]);
+      pt = LP_VertexList_GetVert(part.hulls[slab]);
+    } else {
+      count = part.start[slab + 1] - part.start[slab];
+      pt = sorted + 3 * part.start[slab];
+    }
+    memcpy(merged + 3 * num, pt, 3 * count * sizeof(*merged));
+    num += count;
+  }
+  *out = merged;
+  *out_len = num;
+  
+  for (slab = 0; slab < num_slabs; slab++)
+    LP_VertexList_Free(part.hulls[slab]);
+  free(sorted);
+  free(part.hulls);
+  free(fill);
+  free(part.start);
+  return 0;
+
+ err5:
+  for (slab = 0; slab < num_slabs; slab++)
+    LP_VertexList_Free(part.hulls[slab]);
+  free(sorted);
+ err4:
+  free(part.hulls);
+ err3:
+  free(fill);
+ err2:
+  free(part.start);
+ err:
+  return -1;
+}
+
+struct lp_vertex_list *ConvexHull_Build(const struct lp_vertex_list *in) {
+  struct lp_vertex_list *in3, *out;
+  float *culled = NULL, *merged;
   const float *data;
   size_t fpv, idx, len;
   
@@ -1048,14 +1651,14 @@ struct lp_vertex_list *LP_ConvexHull(const struct lp_vertex_list *in) {
   
   if ((fpv = LP_VertexList_FloatsPerVert(in)) != 3) {
     if (fpv < 3) {
-      fprintf(stderr, "Error: Need at least 3 floats per vertex for convex hull\n");
+      Log_Error("Error: Need at least 3 floats per vertex for convex hull\n");
       goto err2;
     }
 
     data = LP_VertexList_GetVert(in);
     len = LP_VertexList_NumVert(in);
     for (idx = 0; idx < len; idx++, data += fpv) {
-      if (LP_VertexList_Add(in3, data) == UINT_MAX)
+      if (LP_VertexList_Add(in3, data) == LP_INDEX_MAX)
 	goto err2;
     }
     in = in3;
@@ -1063,41 +1666,51 @@ struct lp_vertex_list *LP_ConvexHull(const struct lp_vertex_list *in) {
   
   data = LP_VertexList_GetVert(in);
   len  = LP_VertexList_NumVert(in);
+  
+  if (CullInterior(data, len, &culled, &len) < 0)
+    goto err2;
+  if (culled)
+    data = culled;
+  
+  if (PartitionHull(data, len, &merged, &len) < 0)
+    goto err3;
+  if (merged) {
+    free(culled);
+    data = culled = merged;
+  }
 
 #ifdef DEBUG
   printf("Finding convex hull of %zu points\n", len);
 #endif
   
-  if ((faces = Hash_NewPtr(NULL, Face_Free_Func, NULL, NULL, NULL)) == NULL)
-    goto err2;
-  
-  if ((faces_with_pts = FTree_New(NULL, NULL, NULL)) == NULL)
+  if ((out = Hull(data, len)) == NULL)
     goto err3;
   
-  if (InitSimplex(len, data, faces, faces_with_pts) < 0)
-    goto err4;
-  
-  if (FindHull(faces, faces_with_pts, data) < 0)
-    goto err4;
-  
-  if ((out = BuildVl(faces, data)) == NULL)
-    goto err4;
-  
-  FTree_Free(faces_with_pts);
-  Hash_Free(faces);
+  free(culled);
   LP_VertexList_Free(in3);
 #ifdef DEBUG
   printf("Returning convex hull with %zu faces\n", LP_VertexList_NumInd(out) / 3);
 #endif
   return out;
 
- err4:
-  FTree_Free(faces_with_pts);
  err3:
-  Hash_Free(faces);
+  free(culled);
  err2:
   LP_VertexList_Free(in3);
  err:
-  fprintf(stderr, "Error: Could not build convex hull\n");
+  Log_Error("Error: Could not build convex hull\n");
   return NULL;
 }
+
+struct lp_vertex_list *LP_ConvexHull(const struct lp_vertex_list *in) {
+  struct lp_vertex_list *hull;
+  struct cache_key key;
+  
+  Cache_Key(&key, cache_hull, in, NULL, 0);
+  if ((hull = Cache_LookupVl(&key)) != NULL)
+    return hull;
+  
+  if ((hull = ConvexHull_Build(in)) != NULL)
+    Cache_StoreVl(&key, hull);
+  return hull;
+}
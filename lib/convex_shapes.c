@@ -0,0 +1,354 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+#include "libpolyhedra.h"
+
+#include "log.h"
+#include "parallel.h"
+#include "util.h"
+#include "vef.h"
+
+/* Neighbouring triangles share a plane if they face the same way and their
+ * corners lie within the vef tolerance of it */
+#define PLANE_COS 0.9999f
+
+struct shape_part {
+  struct vef *vef;
+  float *planes;  /* 4 per plane */
+  size_t num_planes;
+};
+
+struct shape_build {
+  const struct lp_vertex_list **in;
+  struct shape_part *part;
+};
+
+static int Shape_OnPlane(const struct vef *vef, const struct face *face, const float *norm, float dist, float tol) {
+  int count;
+  
+  if (Dot(face->norm, norm) < PLANE_COS)
+    return 0;
+  
+  for (count = 0; count < 3; count++)
+    if (fabsf(Dot(&vef->points[3 * face->vert[count]], norm) - dist) > tol)
+      return 0;
+  
+  return 1;
+}
+
+static void Shape_FaceArea(const struct vef *vef, const struct face *face, float *area) {
+  const float *v0, *v1, *v2;
+  float d1[3], d2[3];
+  
+  v0 = &vef->points[3 * face->vert[0]];
+  v1 = &vef->points[3 * face->vert[1]];
+  v2 = &vef->points[3 * face->vert[2]];
+  
+  d1[0] = v1[0] - v0[0];
+  d1[1] = v1[1] - v0[1];
+  d1[2] = v1[2] - v0[2];
+  
+  d2[0] = v2[0] - v0[0];
+  d2[1] = v2[1] - v0[1];
+  d2[2] = v2[2] - v0[2];
+  
+  Cross(area, d1, d2);
+}
+
+/* Floods out from each unclaimed face over its coplanar neighbours.  The
+ * plane of a group is its area weighted normal, pushed out to the furthest
+ * corner so that every vertex stays inside. */
+static int Shape_Planes(struct shape_part *part) {
+  const struct vef *vef = part->vef;
+  const struct face *face;
+  unsigned *group, *member, idx, adj;
+  size_t seed, num, pos;
+  float norm[3], area[3], dist, tol, *plane;
+  int count;
+  
+  if ((group = malloc(vef->num_faces * sizeof(*group) + 1)) == NULL)
+    goto err;
+  if ((member = malloc(vef->num_faces * sizeof(*member) + 1)) == NULL)
+    goto err2;
+  if ((part->planes = malloc(4 * vef->num_faces * sizeof(*part->planes) + 1)) == NULL)
+    goto err3;
+  
+  for (seed = 0; seed < vef->num_faces; seed++)
+    group[seed] = UINT_MAX;
+  tol = 1e-6f * Dist(vef->max, vef->min);
+  
+  for (seed = 0; seed < vef->num_faces; seed++) {
+    if (group[seed] != UINT_MAX)
+      continue;
+    
+    /* Slivers with no area have no direction to add */
+    Shape_FaceArea(vef, &vef->faces[seed], area);
+    if (!(Norm2(area) > 0)) {
+      group[seed] = (unsigned) vef->num_faces;
+      continue;
+    }
+    
+    face = &vef->faces[seed];
+    group[seed] = (unsigned) part->num_planes;
+    member[0] = (unsigned) seed;
+    norm[0] = norm[1] = norm[2] = 0;
+    
+    for (num = 1, pos = 0; pos < num; pos++) {
+      idx = member[pos];
+      Shape_FaceArea(vef, &vef->faces[idx], area);
+      norm[0] += area[0];
+      norm[1] += area[1];
+      norm[2] += area[2];
+      
+      for (count = 0; count < 3; count++) {
+	if ((adj = Vef_FaceAdj(vef, idx, count)) == UINT_MAX || group[adj] != UINT_MAX)
+	  continue;
+	if (!Shape_OnPlane(vef, &vef->faces[adj], face->norm, face->dist, tol))
+	  continue;
+	group[adj] = (unsigned) part->num_planes;
+	member[num++] = adj;
+      }
+    }
+    
+    Normalize(norm);
+    dist = -INFINITY;
+    for (pos = 0; pos < num; pos++)
+      for (count = 0; count < 3; count++)
+	dist = fmaxf(dist, Dot(&vef->points[3 * vef->faces[member[pos]].vert[count]], norm));
+    
+    plane = &part->planes[4 * part->num_planes++];
+    plane[0] = norm[0];
+    plane[1] = norm[1];
+    plane[2] = norm[2];
+    plane[3] = dist;
+  }
+  
+  free(member);
+  free(group);
+  return 0;
+  
+ err3:
+  free(member);
+ err2:
+  free(group);
+ err:
+  Log_Error("Error: Could not allocate memory for convex shape planes\n");
+  return -1;
+}
+
+static int Shape_BuildPart(void *user, size_t idx, size_t thread) {
+  struct shape_build *build = (struct shape_build *) user;
+  struct shape_part *part = &build->part[idx];
+  const struct lp_vertex_list *in = build->in[idx];
+  
+  if (LP_VertexList_PrimativeType(in) != lp_pt_triangle || LP_VertexList_FloatsPerVert(in) < 3 ||
+      LP_VertexList_NumInd(in) < 3) {
+    Log_Error("Error: Convex shape part %zu is not a triangle mesh\n", idx);
+    return -1;
+  }
+  
+  if ((part->vef = Vef_New(in)) == NULL)
+    return -1;
+  
+  return Shape_Planes(part);
+}
+
+static void Shape_Bounds(const struct vef *vef, struct lp_convex_part *out) {
+  size_t count;
+  float radius = 0;
+  
+  out->center[0] = 0.5f * (vef->min[0] + vef->max[0]);
+  out->center[1] = 0.5f * (vef->min[1] + vef->max[1]);
+  out->center[2] = 0.5f * (vef->min[2] + vef->max[2]);
+  
+  for (count = 0; count < vef->num_verts; count++)
+    radius = fmaxf(radius, Dist(out->center, &vef->points[3 * count]));
+  out->radius = radius;
+}
+
+/* Copies part into the block, with its vertex neighbours taken from the
+ * edges around each vertex */
+static void Shape_Pack(struct lp_convex_shapes *shapes, const struct shape_part *part, struct lp_convex_part *out, unsigned *adj_pos) {
+  const struct vef *vef = part->vef;
+  const struct edge *edge;
+  unsigned *adj_start, *adj;
+  size_t count, ee;
+  
+  memcpy((char *) shapes + shapes->verts + 3 * sizeof(float) * out->first_vert, vef->points, 3 * vef->num_verts * sizeof(float));
+  memcpy((char *) shapes + shapes->planes + 4 * sizeof(float) * out->first_plane, part->planes, 4 * part->num_planes * sizeof(float));
+  
+  adj_start = (unsigned *) ((char *) shapes + shapes->adj_start) + out->first_vert;
+  adj = (unsigned *) ((char *) shapes + shapes->adj);
+  
+  for (count = 0; count < vef->num_verts; count++) {
+    adj_start[count] = *adj_pos;
+    for (ee = vef->vert_edge_idx[count]; ee < vef->vert_edge_idx[count + 1]; ee++) {
+      edge = &vef->edges[vef->vert_edges[ee]];
+      adj[(*adj_pos)++] = edge->vert[edge->vert[0] == count ? 1 : 0];
+    }
+  }
+  
+  Shape_Bounds(vef, out);
+}
+
+static void Shape_FreeBuild(struct shape_build *build, size_t num) {
+  size_t count;
+  
+  for (count = 0; count < num; count++) {
+    Vef_Free(build->part[count].vef);
+    free(build->part[count].planes);
+  }
+  free(build->part);
+  free(build->in);
+}
+
+struct lp_convex_shapes *LP_ConvexShapes_New(const struct lp_vl_list *parts) {
+  struct lp_convex_shapes *shapes, head;
+  struct lp_convex_part *out;
+  struct shape_build build;
+  const struct lp_vl_list *cur;
+  uint64_t num_verts = 0, num_planes = 0, num_adj = 0, size;
+  size_t num, count;
+  unsigned adj_pos;
+  
+  num = LP_VertexList_ListLength((struct lp_vl_list *) parts);
+  
+  if ((build.in = malloc(num * sizeof(*build.in) + 1)) == NULL)
+    goto err;
+  if ((build.part = calloc(num + 1, sizeof(*build.part))) == NULL)
+    goto err2;
+  
+  for (count = 0, cur = parts; cur != NULL; cur = cur->next, count++)
+    build.in[count] = cur->vl;
+  
+  if (Parallel_For(num, Shape_BuildPart, &build) < 0)
+    goto err3;
+  
+  for (count = 0; count < num; count++) {
+    num_verts  += build.part[count].vef->num_verts;
+    num_planes += build.part[count].num_planes;
+    num_adj    += 2 * build.part[count].vef->num_edges;
+  }
+  
+  memset(&head, 0, sizeof(head));
+  head.version    = LP_CONVEX_SHAPES_VERSION;
+  head.parts      = sizeof(head);
+  size = head.parts + num * sizeof(struct lp_convex_part);
+  head.verts      = (unsigned) size;
+  size += 3 * num_verts * sizeof(float);
+  head.planes     = (unsigned) size;
+  size += 4 * num_planes * sizeof(float);
+  head.adj_start  = (unsigned) size;
+  size += (num_verts + 1) * sizeof(unsigned);
+  head.adj        = (unsigned) size;
+  size += num_adj * sizeof(unsigned);
+  
+  if (size > UINT_MAX) {
+    Log_Error("Error: Convex shapes do not fit in a 4GB block\n");
+    goto err3;
+  }
+  
+  head.size       = (unsigned) size;
+  head.num_parts  = (unsigned) num;
+  head.num_verts  = (unsigned) num_verts;
+  head.num_planes = (unsigned) num_planes;
+  head.num_adj    = (unsigned) num_adj;
+  
+  if ((shapes = malloc(size)) == NULL) {
+    Log_Error("Error: Could not allocate memory for convex shapes\n");
+    goto err3;
+  }
+  memcpy(shapes, &head, sizeof(head));
+  
+  out = (struct lp_convex_part *) ((char *) shapes + shapes->parts);
+  for (count = 0, adj_pos = 0; count < num; count++) {
+    out[count].first_vert  = count ? out[count - 1].first_vert  + out[count - 1].num_verts  : 0;
+    out[count].first_plane = count ? out[count - 1].first_plane + out[count - 1].num_planes : 0;
+    out[count].num_verts   = (unsigned) build.part[count].vef->num_verts;
+    out[count].num_planes  = (unsigned) build.part[count].num_planes;
+    Shape_Pack(shapes, &build.part[count], &out[count], &adj_pos);
+  }
+  ((unsigned *) ((char *) shapes + shapes->adj_start))[num_verts] = adj_pos;
+  
+  Shape_FreeBuild(&build, num);
+  return shapes;
+  
+ err3:
+  Shape_FreeBuild(&build, num);
+  return NULL;
+ err2:
+  free(build.in);
+ err:
+  Log_Error("Error: Could not allocate memory for convex shapes\n");
+  return NULL;
+}
+
+void LP_ConvexShapes_Free(struct lp_convex_shapes *shapes) {
+  free(shapes);
+}
+
+unsigned int LP_ConvexShapes_Support(const struct lp_convex_shapes *shapes, unsigned int part, const float *dir, unsigned int start) {
+  const struct lp_convex_part *pp = LP_CONVEX_SHAPES_ARRAY(shapes, struct lp_convex_part, parts) + part;
+  const unsigned *adj_start, *adj;
+  unsigned int best, cur, count;
+  const float *verts;
+  float best_dot, dot;
+  
+  verts = LP_CONVEX_SHAPES_ARRAY(shapes, float, verts) + 3 * pp->first_vert;
+  adj_start = LP_CONVEX_SHAPES_ARRAY(shapes, unsigned, adj_start) + pp->first_vert;
+  adj = LP_CONVEX_SHAPES_ARRAY(shapes, unsigned, adj);
+  
+  /* A local maximum over the edges of a convex hull is the global one */
+  best = start < pp->num_verts ? start : 0;
+  best_dot = Dot(&verts[3 * best], dir);
+  do {
+    cur = best;
+    for (count = adj_start[cur]; count < adj_start[cur + 1]; count++) {
+      if ((dot = Dot(&verts[3 * adj[count]], dir)) > best_dot) {
+	best = adj[count];
+	best_dot = dot;
+      }
+    }
+  } while (best != cur);
+  
+  return best;
+}
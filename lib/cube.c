@@ -38,49 +38,38 @@
 
 #include "libpolyhedra.h"
 
-static int AddVert(struct lp_vertex_list *vl, float x, float y, float z) {
-  float vert[3];
+#include "vertex_list.h"
 
-  vert[0] = x;
-  vert[1] = y;
-  vert[2] = z;
-
-  if (LP_VertexList_Add(vl, vert) == UINT_MAX)
-    return -1;
-  
-  return 0;
-}
+/* Vertex n is at (x, y, z) with the signs flipped by bits 2, 1 and 0 of n */
+static const unsigned char cube_faces[36] = {
+  3, 1, 0,  3, 0, 2,
+  5, 7, 6,  5, 6, 4,
+  1, 5, 4,  1, 4, 0,
+  7, 3, 2,  7, 2, 6,
+  6, 2, 0,  6, 0, 4,
+  3, 7, 5,  3, 5, 1
+};
 
 struct lp_vertex_list *LP_Cube(float x, float y, float z) {
-  struct lp_vertex_list *pts, *hull;
+  struct lp_vertex_list *out;
+  lp_index_t *ind;
+  float *vert;
+  size_t count;
   
-  if ((pts = LP_VertexList_New(3, lp_pt_point)) == NULL)
-    goto err;
+  if ((out = VertexList_NewMesh(8, 36, &vert, &ind)) == NULL)
+    return NULL;
   
-  if (AddVert(pts,  x,  y,  z) < 0)
-    goto err2;
-  if (AddVert(pts,  x,  y, -z) < 0)
-    goto err2;
-  if (AddVert(pts,  x, -y,  z) < 0)
-    goto err2;
-  if (AddVert(pts,  x, -y, -z) < 0)
-    goto err2;
-  if (AddVert(pts, -x,  y,  z) < 0)
-    goto err2;
-  if (AddVert(pts, -x,  y, -z) < 0)
-    goto err2;
-  if (AddVert(pts, -x, -y,  z) < 0)
-    goto err2;
-  if (AddVert(pts, -x, -y, -z) < 0)
-    goto err2;
+  x = fabsf(x);
+  y = fabsf(y);
+  z = fabsf(z);
+  for (count = 0; count < 8; count++) {
+    *vert++ = count & 4 ? -x : x;
+    *vert++ = count & 2 ? -y : y;
+    *vert++ = count & 1 ? -z : z;
+  }
   
-  if ((hull = LP_ConvexHull(pts)) == NULL)
-    goto err2;
+  for (count = 0; count < 36; count++)
+    ind[count] = cube_faces[count];
   
-  return hull;
-
- err2:
-  LP_VertexList_Free(pts);
- err:
-  return NULL;
+  return out;
 }
@@ -0,0 +1,787 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+#include "libpolyhedra.h"
+
+#include "convex_hull.h"
+#include "cut_score.h"
+#include "hash.h"
+#include "log.h"
+#include "util.h"
+
+/* Scores a plane cut the way LP_PlaneCut followed by a convex hull of every
+ * piece would, but only keeps the signed distance classification of the
+ * triangles.  The volume of each piece is summed from tetrahedra with their
+ * apex on the cutting plane, so the caps add no volume and are only used to
+ * find which surface fragments they join.  Fragments are joined through
+ * shared edges, same as Build_Poly3d() in plane_cut.c.
+ */
+
+struct cut_score {
+  size_t num_pts;
+  size_t num_edges;
+  size_t num_tri;
+  float *pts;         /* 3 floats per unique point */
+  unsigned *tri;      /* 3 point ids per triangle */
+  unsigned *tri_edge; /* Edge k of a triangle goes from tri[k] to tri[k + 1] */
+  unsigned *edge;     /* 2 point ids per edge, lowest first */
+  unsigned *edge_tri; /* 2 triangles per edge, UINT_MAX if missing */
+};
+
+struct side {
+  unsigned *parent;   /* Union find over triangles */
+  double *vol;
+  unsigned *poly;     /* Up to 4 point ids per triangle */
+  unsigned char *num_poly;
+  unsigned char *toggle; /* Edges on the plane */
+  unsigned *seg;      /* Cap boundary: 2 point ids and a triangle */
+  size_t num_seg;
+};
+
+struct scratch {
+  const struct cut_score *cs;
+  float norm[3];
+  float x_axis[3];
+  float y_axis[3];
+  float apex[3];
+  float *d;
+  float *inter;
+  unsigned *deg;
+  unsigned *first_seg;
+  unsigned *stamp;
+  unsigned *list;
+  struct side side[2];
+};
+
+struct seg_loop {
+  unsigned root;
+  unsigned idx;
+};
+
+struct cap_loop {
+  size_t first;
+  size_t num;
+  float min[2];
+  float max[2];
+  size_t depth;
+};
+
+static unsigned Find(unsigned *parent, unsigned id) {
+  while (parent[id] != id) {
+    parent[id] = parent[parent[id]];
+    id = parent[id];
+  }
+  
+  return id;
+}
+
+static void Union(unsigned *parent, unsigned a, unsigned b) {
+  a = Find(parent, a);
+  b = Find(parent, b);
+  
+  if (a < b)
+    parent[b] = a;
+  else if (b < a)
+    parent[a] = b;
+}
+
+static unsigned PointId(struct hash *hash, const float *pt, float *pts, size_t *num_pts) {
+  void *data;
+  unsigned id;
+  
+  if ((data = Hash_Lookup(hash, pt, NULL)))
+    return (unsigned) ((uintptr_t) data - 1);
+  
+  id = *num_pts;
+  memcpy(&pts[3 * id], pt, 3 * sizeof(*pts));
+  if (Hash_Insert(hash, &pts[3 * id], (void *) ((uintptr_t) id + 1), NULL) < 0)
+    return UINT_MAX;
+  (*num_pts)++;
+  
+  return id;
+}
+
+static unsigned EdgeId(struct hash *hash, unsigned a, unsigned b, struct cut_score *cs) {
+  unsigned key[2];
+  void *data;
+  unsigned id;
+  
+  key[0] = a < b ? a : b;
+  key[1] = a < b ? b : a;
+  if ((data = Hash_Lookup(hash, key, NULL)))
+    return (unsigned) ((uintptr_t) data - 1);
+  
+  id = cs->num_edges;
+  cs->edge[2 * id]     = key[0];
+  cs->edge[2 * id + 1] = key[1];
+  cs->edge_tri[2 * id]     = UINT_MAX;
+  cs->edge_tri[2 * id + 1] = UINT_MAX;
+  if (Hash_Insert(hash, key, (void *) ((uintptr_t) id + 1), NULL) < 0)
+    return UINT_MAX;
+  cs->num_edges++;
+  
+  return id;
+}
+
+struct cut_score *CutScore_New(const struct lp_vertex_list *vl) {
+  struct cut_score *cs;
+  struct hash *pt_hash, *edge_hash;
+  size_t count, num_ind;
+  unsigned edge;
+  int kk;
+  
+  if (LP_VertexList_FloatsPerVert(vl) < 3 || LP_VertexList_PrimativeType(vl) != lp_pt_triangle) {
+    Log_Error("Error: Can only score cuts of triangular shapes\n");
+    goto err;
+  }
+  
+  if ((cs = malloc(sizeof(*cs))) == NULL) {
+    Log_Error("Error: Could not allocate memory for cut score\n");
+    goto err;
+  }
+  memset(cs, 0, sizeof(*cs));
+  
+  num_ind = LP_VertexList_NumInd(vl);
+  cs->num_tri = num_ind / 3;
+  if ((cs->pts = malloc(3 * num_ind * sizeof(*cs->pts) + 1)) == NULL ||
+      (cs->tri = malloc(num_ind * sizeof(*cs->tri) + 1)) == NULL ||
+      (cs->tri_edge = malloc(num_ind * sizeof(*cs->tri_edge) + 1)) == NULL ||
+      (cs->edge = malloc(2 * num_ind * sizeof(*cs->edge) + 1)) == NULL ||
+      (cs->edge_tri = malloc(2 * num_ind * sizeof(*cs->edge_tri) + 1)) == NULL) {
+    Log_Error("Error: Could not allocate memory for cut score\n");
+    goto err2;
+  }
+  
+  if ((pt_hash = Hash_NewFixed(3 * sizeof(float), NULL, NULL, NULL, NULL)) == NULL)
+    goto err2;
+  if ((edge_hash = Hash_NewFixed(2 * sizeof(unsigned), NULL, NULL, NULL, NULL)) == NULL)
+    goto err3;
+  
+  for (count = 0; count < 3 * cs->num_tri; count++)
+    if ((cs->tri[count] = PointId(pt_hash, LP_VertexList_LookupVert(vl, count), cs->pts, &cs->num_pts)) == UINT_MAX)
+      goto err4;
+  
+  for (count = 0; count < cs->num_tri; count++) {
+    for (kk = 0; kk < 3; kk++) {
+      if ((edge = EdgeId(edge_hash, cs->tri[3 * count + kk], cs->tri[3 * count + (kk + 1) % 3], cs)) == UINT_MAX)
+	goto err4;
+      cs->tri_edge[3 * count + kk] = edge;
+      cs->edge_tri[2 * edge + (cs->edge_tri[2 * edge] == UINT_MAX ? 0 : 1)] = count;
+    }
+  }
+  
+  Hash_Free(edge_hash);
+  Hash_Free(pt_hash);
+  return cs;
+  
+ err4:
+  Hash_Free(edge_hash);
+ err3:
+  Hash_Free(pt_hash);
+ err2:
+  CutScore_Free(cs);
+ err:
+  return NULL;
+}
+
+void CutScore_Free(struct cut_score *cs) {
+  if (cs == NULL)
+    return;
+  
+  free(cs->edge_tri);
+  free(cs->edge);
+  free(cs->tri_edge);
+  free(cs->tri);
+  free(cs->pts);
+  free(cs);
+}
+
+static const float *Point(const struct scratch *sc, unsigned id) {
+  if (id < sc->cs->num_pts)
+    return &sc->cs->pts[3 * id];
+  
+  return &sc->inter[3 * (id - sc->cs->num_pts)];
+}
+
+static double TetraVol(const float *apex, const float *p1, const float *p2, const float *p3) {
+  double a[3], b[3], c[3];
+  int count;
+  
+  for (count = 0; count < 3; count++) {
+    a[count] = (double) p1[count] - apex[count];
+    b[count] = (double) p2[count] - apex[count];
+    c[count] = (double) p3[count] - apex[count];
+  }
+  
+  return (a[0] * (b[1] * c[2] - b[2] * c[1]) +
+	  a[1] * (b[2] * c[0] - b[0] * c[2]) +
+	  a[2] * (b[0] * c[1] - b[1] * c[0])) / 6;
+}
+
+static void AddPoly(struct scratch *sc, int side, size_t tt, const unsigned *ids, int num) {
+  struct side *ss = &sc->side[side];
+  double vol = 0;
+  int count;
+  
+  for (count = 1; count < num - 1; count++)
+    vol += TetraVol(sc->apex, Point(sc, ids[0]), Point(sc, ids[count]), Point(sc, ids[count + 1]));
+  
+  ss->vol[tt] = vol;
+  ss->num_poly[tt] = num;
+  memcpy(&ss->poly[4 * tt], ids, num * sizeof(*ids));
+}
+
+static void AddSeg(struct scratch *sc, int side, unsigned a, unsigned b, size_t tt) {
+  struct side *ss = &sc->side[side];
+  
+  ss->seg[3 * ss->num_seg]     = a;
+  ss->seg[3 * ss->num_seg + 1] = b;
+  ss->seg[3 * ss->num_seg + 2] = tt;
+  ss->num_seg++;
+}
+
+static int Classify(struct scratch *sc, size_t tt) {
+  const struct cut_score *cs = sc->cs;
+  const unsigned *v = &cs->tri[3 * tt], *e = &cs->tri_edge[3 * tt];
+  unsigned ids[4];
+  float *d = sc->d;
+  int inter[3], count, non1, non2, i1, i2, side;
+  
+  for (count = 0; count < 3; count++)
+    inter[count] = ((d[v[count]] > 0 && d[v[(count + 1) % 3]] < 0) ||
+		    (d[v[count]] < 0 && d[v[(count + 1) % 3]] > 0));
+  
+  /* Same cases as Make_Faces() in plane_cut.c */
+  switch (inter[0] + inter[1] + inter[2]) {
+  case 0:
+    switch ((d[v[0]] == 0) + (d[v[1]] == 0) + (d[v[2]] == 0)) {
+    case 0:
+    case 1:
+      non1 = d[v[0]] != 0 ? 0 : 1;
+      AddPoly(sc, d[v[non1]] > 0, tt, v, 3);
+      break;
+      
+    case 2:
+      if (d[v[0]] != 0)
+	non1 = 0;
+      else if (d[v[1]] != 0)
+	non1 = 1;
+      else
+	non1 = 2;
+      
+      side = d[v[non1]] > 0;
+      AddPoly(sc, side, tt, v, 3);
+      sc->side[side].toggle[e[(non1 + 1) % 3]] ^= 1;
+      break;
+    }
+    break;
+    
+  case 1:
+    if (inter[0])
+      i1 = 0;
+    else if (inter[1])
+      i1 = 1;
+    else
+      i1 = 2;
+    
+    non1 = (i1 + 1) % 3;
+    non2 = (i1 + 2) % 3;
+    
+    if (d[v[non2]] != 0) {
+      Log_Error("Internal Error: cut_score.c: Expected point to be on plane\n");
+      return -1;
+    }
+    
+    ids[0] = v[non1];
+    ids[1] = v[non2];
+    ids[2] = cs->num_pts + e[i1];
+    AddPoly(sc, d[v[non1]] > 0, tt, ids, 3);
+    ids[0] = v[non2];
+    ids[1] = v[i1];
+    AddPoly(sc, d[v[i1]] > 0, tt, ids, 3);
+    
+    AddSeg(sc, 0, cs->num_pts + e[i1], v[non2], tt);
+    AddSeg(sc, 1, cs->num_pts + e[i1], v[non2], tt);
+    break;
+    
+  case 2:
+    if (!inter[0])
+      non1 = 0;
+    else if (!inter[1])
+      non1 = 1;
+    else
+      non1 = 2;
+    
+    i1 = (non1 + 1) % 3;
+    i2 = (non1 + 2) % 3;
+    
+    ids[0] = v[i2];
+    ids[1] = cs->num_pts + e[i2];
+    ids[2] = cs->num_pts + e[i1];
+    AddPoly(sc, d[v[i2]] > 0, tt, ids, 3);
+    ids[0] = v[non1];
+    ids[1] = v[i1];
+    ids[2] = cs->num_pts + e[i1];
+    ids[3] = cs->num_pts + e[i2];
+    AddPoly(sc, d[v[i1]] > 0, tt, ids, 4);
+    
+    AddSeg(sc, 0, cs->num_pts + e[i1], cs->num_pts + e[i2], tt);
+    AddSeg(sc, 1, cs->num_pts + e[i1], cs->num_pts + e[i2], tt);
+    break;
+    
+  default:
+    Log_Error("Internal Error: cut_score.c: Invalid number of edges intersects plane\n");
+    return -1;
+  }
+  
+  return 0;
+}
+
+static void JoinSurface(struct scratch *sc) {
+  const struct cut_score *cs = sc->cs;
+  const unsigned *tri;
+  struct side *ss;
+  size_t count;
+  float da, db;
+  int side, on_side;
+  
+  for (count = 0; count < cs->num_edges; count++) {
+    tri = &cs->edge_tri[2 * count];
+    if (tri[0] == UINT_MAX || tri[1] == UINT_MAX)
+      continue;
+    
+    da = sc->d[cs->edge[2 * count]];
+    db = sc->d[cs->edge[2 * count + 1]];
+    for (side = 0; side < 2; side++) {
+      ss = &sc->side[side];
+      if (da == 0 && db == 0)
+	on_side = 1;
+      else
+	on_side = (da != 0 && (da > 0) == side) || (db != 0 && (db > 0) == side);
+      
+      if (on_side && ss->num_poly[tri[0]] && ss->num_poly[tri[1]])
+	Union(ss->parent, tri[0], tri[1]);
+    }
+  }
+}
+
+static int SegLoopCmp(const void *a, const void *b) {
+  const struct seg_loop *sa = (const struct seg_loop *) a, *sb = (const struct seg_loop *) b;
+  
+  if (sa->root != sb->root)
+    return sa->root < sb->root ? -1 : 1;
+  if (sa->idx != sb->idx)
+    return sa->idx < sb->idx ? -1 : 1;
+  return 0;
+}
+
+static int Inside(const float *pt, const struct cap_loop *loop, const struct seg_loop *order, const float *seg2d) {
+  const float *ss;
+  size_t count;
+  int in = 0;
+  
+  if (pt[0] < loop->min[0] || pt[0] > loop->max[0] ||
+      pt[1] < loop->min[1] || pt[1] > loop->max[1])
+    return 0;
+  
+  for (count = loop->first; count < loop->first + loop->num; count++) {
+    ss = &seg2d[4 * order[count].idx];
+    if ((ss[1] > pt[1]) != (ss[3] > pt[1]) &&
+	pt[0] < ss[0] + (pt[1] - ss[1]) * (ss[2] - ss[0]) / (ss[3] - ss[1]))
+      in = !in;
+  }
+  
+  return in;
+}
+
+/* The cap triangulation joins every fragment along a loop, and every hole
+ * to the loop around it.  Loops are split where more than two cap edges
+ * meet.  Loops are nested by the even-odd rule, those at an odd depth are
+ * holes.
+ */
+static int JoinCap(struct scratch *sc, int side) {
+  struct side *ss = &sc->side[side];
+  struct seg_loop *order;
+  struct cap_loop *loops, *loop;
+  unsigned *seg_uf, *loop_uf, *seg, pt_id, rep;
+  float *seg2d, *pt, mid[2];
+  size_t count, num_loops, ii, jj;
+  int kk;
+  
+  if (ss->num_seg == 0)
+    return 0;
+  
+  if ((order = malloc(ss->num_seg * sizeof(*order))) == NULL)
+    goto err;
+  if ((seg2d = malloc(4 * ss->num_seg * sizeof(*seg2d))) == NULL)
+    goto err2;
+  if ((loops = malloc(ss->num_seg * sizeof(*loops))) == NULL)
+    goto err3;
+  if ((seg_uf = malloc(2 * ss->num_seg * sizeof(*seg_uf))) == NULL)
+    goto err4;
+  loop_uf = &seg_uf[ss->num_seg];
+  
+  for (count = 0; count < 2 * ss->num_seg; count++) {
+    sc->deg[ss->seg[3 * (count / 2) + count % 2]]++;
+    sc->first_seg[ss->seg[3 * (count / 2) + count % 2]] = UINT_MAX;
+  }
+  for (count = 0; count < ss->num_seg; count++)
+    seg_uf[count] = count;
+  for (count = 0; count < 2 * ss->num_seg; count++) {
+    pt_id = ss->seg[3 * (count / 2) + count % 2];
+    if (sc->deg[pt_id] != 2)
+      continue;
+    if (sc->first_seg[pt_id] == UINT_MAX)
+      sc->first_seg[pt_id] = count / 2;
+    else
+      Union(seg_uf, sc->first_seg[pt_id], count / 2);
+  }
+  for (count = 0; count < 2 * ss->num_seg; count++)
+    sc->deg[ss->seg[3 * (count / 2) + count % 2]] = 0;
+  
+  for (count = 0; count < ss->num_seg; count++) {
+    order[count].root = Find(seg_uf, count);
+    order[count].idx  = count;
+    for (kk = 0; kk < 2; kk++) {
+      pt = (float *) Point(sc, ss->seg[3 * count + kk]);
+      seg2d[4 * count + 2 * kk]     = Dot(pt, sc->x_axis);
+      seg2d[4 * count + 2 * kk + 1] = Dot(pt, sc->y_axis);
+    }
+  }
+  qsort(order, ss->num_seg, sizeof(*order), SegLoopCmp);
+  
+  num_loops = 0;
+  for (count = 0; count < ss->num_seg; count++) {
+    pt = &seg2d[4 * order[count].idx];
+    if (count == 0 || order[count].root != order[count - 1].root) {
+      loop = &loops[num_loops++];
+      loop->first = count;
+      loop->num   = 0;
+      loop->depth = 0;
+      loop->min[0] = loop->max[0] = pt[0];
+      loop->min[1] = loop->max[1] = pt[1];
+    }
+    loop->num++;
+    for (kk = 0; kk < 4; kk += 2) {
+      if (pt[kk] < loop->min[0])
+	loop->min[0] = pt[kk];
+      if (pt[kk] > loop->max[0])
+	loop->max[0] = pt[kk];
+      if (pt[kk + 1] < loop->min[1])
+	loop->min[1] = pt[kk + 1];
+      if (pt[kk + 1] > loop->max[1])
+	loop->max[1] = pt[kk + 1];
+    }
+  }
+  
+  for (ii = 0; ii < num_loops; ii++)
+    loop_uf[ii] = ii;
+  
+  if (num_loops > 1) {
+    for (ii = 0; ii < num_loops; ii++) {
+      pt = &seg2d[4 * order[loops[ii].first].idx];
+      mid[0] = 0.5 * (pt[0] + pt[2]);
+      mid[1] = 0.5 * (pt[1] + pt[3]);
+      for (jj = 0; jj < num_loops; jj++)
+	if (jj != ii && Inside(mid, &loops[jj], order, seg2d))
+	  loops[ii].depth++;
+    }
+    
+    for (ii = 0; ii < num_loops; ii++) {
+      if ((loops[ii].depth & 1) == 0)
+	continue;
+      pt = &seg2d[4 * order[loops[ii].first].idx];
+      mid[0] = 0.5 * (pt[0] + pt[2]);
+      mid[1] = 0.5 * (pt[1] + pt[3]);
+      for (jj = 0; jj < num_loops; jj++) {
+	if (jj != ii &&
+	    loops[jj].depth + 1 == loops[ii].depth &&
+	    Inside(mid, &loops[jj], order, seg2d)) {
+	  Union(loop_uf, ii, jj);
+	  break;
+	}
+      }
+    }
+  }
+  
+  for (ii = 0; ii < num_loops; ii++) {
+    rep = ss->seg[3 * order[loops[Find(loop_uf, ii)].first].idx + 2];
+    for (count = loops[ii].first; count < loops[ii].first + loops[ii].num; count++) {
+      seg = &ss->seg[3 * order[count].idx];
+      Union(ss->parent, seg[2], rep);
+    }
+  }
+  
+  free(seg_uf);
+  free(loops);
+  free(seg2d);
+  free(order);
+  return 0;
+  
+ err4:
+  free(loops);
+ err3:
+  free(seg2d);
+ err2:
+  free(order);
+ err:
+  Log_Error("Error: Could not allocate memory for cap loops\n");
+  return -1;
+}
+
+static int SideError(struct scratch *sc, int side, double *sqr_err) {
+  const struct cut_score *cs = sc->cs;
+  struct side *ss = &sc->side[side];
+  struct lp_vertex_list *pts, *hull;
+  size_t count, num_comp = 0, cc, start, num_pts, kk;
+  unsigned *comp, *first, *tris, stamp;
+  double *vol, err;
+  
+  if ((comp = malloc(cs->num_tri * sizeof(*comp) + 1)) == NULL)
+    goto err;
+  for (count = 0; count < cs->num_tri; count++)
+    comp[count] = UINT_MAX;
+  for (count = 0; count < cs->num_tri; count++) {
+    if (ss->num_poly[count] == 0)
+      continue;
+    if (comp[Find(ss->parent, count)] == UINT_MAX)
+      comp[Find(ss->parent, count)] = num_comp++;
+  }
+  
+  if ((first = calloc(num_comp + 1, sizeof(*first))) == NULL)
+    goto err2;
+  if ((vol = calloc(num_comp + 1, sizeof(*vol))) == NULL)
+    goto err3;
+  if ((tris = malloc(cs->num_tri * sizeof(*tris) + 1)) == NULL)
+    goto err4;
+  
+  for (count = 0; count < cs->num_tri; count++) {
+    if (ss->num_poly[count] == 0)
+      continue;
+    cc = comp[Find(ss->parent, count)];
+    first[cc + 1]++;
+    vol[cc] += ss->vol[count];
+  }
+  for (cc = 0; cc < num_comp; cc++)
+    first[cc + 1] += first[cc];
+  for (count = 0; count < cs->num_tri; count++) {
+    if (ss->num_poly[count] == 0)
+      continue;
+    cc = comp[Find(ss->parent, count)];
+    tris[first[cc]++] = count;
+  }
+  /* first[cc] is now the end of component cc */
+  
+  for (cc = 0; cc < num_comp; cc++) {
+    stamp = side * cs->num_tri + cc + 1;
+    num_pts = 0;
+    for (count = cc == 0 ? 0 : first[cc - 1]; count < first[cc]; count++) {
+      for (kk = 0; kk < ss->num_poly[tris[count]]; kk++) {
+	start = ss->poly[4 * tris[count] + kk];
+	if (sc->stamp[start] == stamp)
+	  continue;
+	sc->stamp[start] = stamp;
+	sc->list[num_pts++] = start;
+      }
+    }
+    if (num_pts <= 4)
+      continue;
+    
+    if ((pts = LP_VertexList_New(3, lp_pt_point)) == NULL)
+      goto err5;
+    for (count = 0; count < num_pts; count++) {
+      if (LP_VertexList_Add(pts, Point(sc, sc->list[count])) == LP_INDEX_MAX) {
+	LP_VertexList_Free(pts);
+	goto err5;
+      }
+    }
+    hull = ConvexHull_Build(pts);
+    LP_VertexList_Free(pts);
+    if (hull == NULL)
+      goto err5;
+    err = LP_Volume(hull) - vol[cc];
+    LP_VertexList_Free(hull);
+    *sqr_err += err * err;
+  }
+  
+  free(tris);
+  free(vol);
+  free(first);
+  free(comp);
+  return 0;
+  
+ err5:
+  free(tris);
+ err4:
+  free(vol);
+ err3:
+  free(first);
+ err2:
+  free(comp);
+ err:
+  return -1;
+}
+
+int CutScore_SqrError(const struct cut_score *cs, const float *norm, float dist, float *sqr_err) {
+  struct scratch sc;
+  size_t num, num_seg, count, tt;
+  const float *p1, *p2;
+  const unsigned *tri;
+  double err = 0;
+  float tol, x, y, d1, d2;
+  int side, kk;
+  char *block, *cur;
+  
+  memset(&sc, 0, sizeof(sc));
+  sc.cs = cs;
+  memcpy(sc.norm, norm, sizeof(sc.norm));
+  Normalize(sc.norm);
+  BasisVectors(sc.x_axis, sc.y_axis, sc.norm);
+  for (kk = 0; kk < 3; kk++)
+    sc.apex[kk] = sc.norm[kk] * dist;
+  
+  /* Point ids are followed by one intersection id per edge */
+  num = cs->num_pts + cs->num_edges;
+  num_seg = cs->num_tri + cs->num_edges;
+  if ((block = malloc(2 * cs->num_tri * (sizeof(double) + 5 * sizeof(unsigned) + 1) +
+		      2 * 3 * num_seg * sizeof(unsigned) +
+		      4 * num * sizeof(unsigned) +
+		      (3 * cs->num_edges + cs->num_pts) * sizeof(float) +
+		      2 * cs->num_edges + 1)) == NULL) {
+    Log_Error("Error: Could not allocate memory for cut score\n");
+    goto err;
+  }
+  
+  cur = block;
+  for (side = 0; side < 2; side++) {
+    sc.side[side].vol = (double *) cur;
+    cur += cs->num_tri * sizeof(double);
+  }
+  for (side = 0; side < 2; side++) {
+    sc.side[side].parent = (unsigned *) cur;
+    cur += cs->num_tri * sizeof(unsigned);
+    sc.side[side].poly = (unsigned *) cur;
+    cur += 4 * cs->num_tri * sizeof(unsigned);
+    sc.side[side].seg = (unsigned *) cur;
+    cur += 3 * num_seg * sizeof(unsigned);
+  }
+  sc.deg = (unsigned *) cur;
+  cur += num * sizeof(unsigned);
+  sc.first_seg = (unsigned *) cur;
+  cur += num * sizeof(unsigned);
+  sc.stamp = (unsigned *) cur;
+  cur += num * sizeof(unsigned);
+  sc.list = (unsigned *) cur;
+  cur += num * sizeof(unsigned);
+  sc.inter = (float *) cur;
+  cur += 3 * cs->num_edges * sizeof(float);
+  sc.d = (float *) cur;
+  cur += cs->num_pts * sizeof(float);
+  for (side = 0; side < 2; side++) {
+    sc.side[side].num_poly = (unsigned char *) cur;
+    cur += cs->num_tri;
+    sc.side[side].toggle = (unsigned char *) cur;
+    cur += cs->num_edges;
+  }
+  
+  for (side = 0; side < 2; side++) {
+    memset(sc.side[side].num_poly, 0, cs->num_tri);
+    memset(sc.side[side].toggle, 0, cs->num_edges);
+    for (count = 0; count < cs->num_tri; count++)
+      sc.side[side].parent[count] = count;
+  }
+  memset(sc.deg, 0, num * sizeof(unsigned));
+  memset(sc.stamp, 0, num * sizeof(unsigned));
+  
+  /* Same tolerance as Vert_New() in plane_cut.c */
+  for (count = 0; count < cs->num_pts; count++) {
+    p1 = &cs->pts[3 * count];
+    tol = Norm(p1);
+    if (fabsf(dist) > tol)
+      tol = fabsf(dist);
+    tol *= 1e-5;
+    
+    sc.d[count] = Dot(p1, sc.norm) - dist;
+    if (fabsf(sc.d[count]) < tol)
+      sc.d[count] = 0;
+  }
+  
+  for (count = 0; count < cs->num_edges; count++) {
+    d1 = sc.d[cs->edge[2 * count]];
+    d2 = sc.d[cs->edge[2 * count + 1]];
+    if (!((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0)))
+      continue;
+    
+    p1 = &cs->pts[3 * cs->edge[2 * count]];
+    p2 = &cs->pts[3 * cs->edge[2 * count + 1]];
+    x = -d1 / (d2 - d1);
+    y = 1 - x;
+    for (kk = 0; kk < 3; kk++)
+      sc.inter[3 * count + kk] = y * p1[kk] + x * p2[kk];
+  }
+  
+  for (count = 0; count < cs->num_tri; count++)
+    if (Classify(&sc, count) < 0)
+      goto err2;
+  
+  JoinSurface(&sc);
+  
+  for (side = 0; side < 2; side++) {
+    for (count = 0; count < cs->num_edges; count++) {
+      if (!sc.side[side].toggle[count])
+	continue;
+      tri = &cs->edge_tri[2 * count];
+      tt = tri[1] != UINT_MAX && sc.side[side].num_poly[tri[1]] ? tri[1] : tri[0];
+      AddSeg(&sc, side, cs->edge[2 * count], cs->edge[2 * count + 1], tt);
+    }
+    
+    if (JoinCap(&sc, side) < 0)
+      goto err2;
+    if (SideError(&sc, side, &err) < 0)
+      goto err2;
+  }
+  
+  free(block);
+  *sqr_err = err;
+  return 0;
+  
+ err2:
+  free(block);
+ err:
+  return -1;
+}
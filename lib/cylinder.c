@@ -38,47 +38,57 @@
 
 #include "libpolyhedra.h"
 
-static int AddVert(struct lp_vertex_list *vl, float x, float y, float z) {
-  float vert[3];
+#include "log.h"
+#include "vertex_list.h"
 
-  vert[0] = x;
-  vert[1] = y;
-  vert[2] = z;
-
-  if (LP_VertexList_Add(vl, vert) == UINT_MAX)
-    return -1;
-  
-  return 0;
-}
+#define ADD_TRI(aa, bb, cc)	\
+  do {				\
+    *ind++ = (aa);		\
+    *ind++ = (bb);		\
+    *ind++ = (cc);		\
+  } while (0)
 
+/* Vertex 2 * n is on the top rim and 2 * n + 1 below it; the caps are fans */
 struct lp_vertex_list *LP_Cylinder(float r, float h, int pts_per_rev) {
-  struct lp_vertex_list *pts, *hull;
+  struct lp_vertex_list *out;
+  lp_index_t *ind, top, next;
   int count;
-  float ang, incr, xx, yy, zz;
+  float *vert, incr, xx, yy, zz;
   
   if (pts_per_rev < 3)
     pts_per_rev = 3;
   
-  if ((pts = LP_VertexList_New(3, lp_pt_point)) == NULL)
-    goto err;
-
-  ang = 0;
+  if ((size_t) pts_per_rev > LP_INDEX_MAX / 2) {
+    Log_Error("Error: Too many points for a cylinder: %d\n", pts_per_rev);
+    return NULL;
+  }
+  
+  if ((out = VertexList_NewMesh((lp_index_t) (2 * (size_t) pts_per_rev), 12 * (size_t) pts_per_rev - 12, &vert, &ind)) == NULL)
+    return NULL;
+  
   incr = 2 * M_PI / pts_per_rev;
   zz = h / 2;
-  for (count = 0; count < pts_per_rev; count++, ang += incr) {
-    xx = r * cos(ang);
-    yy = r * sin(ang);
-    AddVert(pts, xx, yy,  zz);
-    AddVert(pts, xx, yy, -zz);
+  for (count = 0; count < pts_per_rev; count++) {
+    xx = r * cos((float) count * incr);
+    yy = r * sin((float) count * incr);
+    *vert++ = xx;
+    *vert++ = yy;
+    *vert++ = zz;
+    *vert++ = xx;
+    *vert++ = yy;
+    *vert++ = -zz;
   }
   
-  if ((hull = LP_ConvexHull(pts)) == NULL)
-    goto err2;
+  for (count = 0; count < pts_per_rev; count++) {
+    top = 2 * count;
+    next = 2 * ((count + 1) % pts_per_rev);
+    ADD_TRI(top + 1, next + 1, next);
+    ADD_TRI(top + 1, next, top);
+    if (count > 0 && count < pts_per_rev - 1) {
+      ADD_TRI(0, top, next);
+      ADD_TRI(1, next + 1, top + 1);
+    }
+  }
   
-  return hull;
-
- err2:
-  LP_VertexList_Free(pts);
- err:
-  return NULL;
+  return out;
 }
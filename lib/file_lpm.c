@@ -0,0 +1,386 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include <limits.h>
+#include <string.h>
+
+#include "file_lpm.h"
+#include "file_map.h"
+#include "log.h"
+#include "vertex_list.h"
+#include "write_buf.h"
+
+/* Little endian throughout.  A header, then one entry per vertex list, then
+ * the vertex and index arrays of each list.  Every section starts on an
+ * LPM_ALIGN boundary, so the arrays can be used where they lie. */
+#define LPM_MAGIC   "\x89LPM\r\n\x1a\n"
+#define LPM_VERSION 1
+#define LPM_ALIGN   64
+#define SWAP_CHUNK  1024
+
+struct lpm_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t index_size;  /* Bytes per index, 4 or 8 */
+  uint64_t num_lists;
+  uint64_t reserved[5];
+};
+
+struct lpm_entry {
+  uint64_t floats_per_vert;
+  uint64_t primative_type;
+  uint64_t num_vert;
+  uint64_t num_ind;
+  uint64_t vert_offset;  /* From the start of the file */
+  uint64_t ind_offset;
+  uint64_t reserved[2];
+};
+
+static int IsLittleEndian(void) {
+  const union {uint16_t i; unsigned char c[2];} one = {1};
+  
+  return one.c[0];
+}
+
+static uint32_t Swap32(uint32_t val) {
+  return
+    ((val >> 24)) |
+    ((val >>  8) & 0xFF00) |
+    ((val <<  8) & 0xFF0000) |
+    ((val << 24));
+}
+
+static uint64_t Swap64(uint64_t val) {
+  return ((uint64_t) Swap32((uint32_t) val) << 32) | Swap32((uint32_t) (val >> 32));
+}
+
+static void MakeLittle32(void *data, size_t num) {
+  uint32_t *vv = (uint32_t *) data;
+  size_t count;
+  
+  if (IsLittleEndian())
+    return;
+  
+  for (count = 0; count < num; count++)
+    vv[count] = Swap32(vv[count]);
+}
+
+static void MakeLittle64(void *data, size_t num) {
+  uint64_t *vv = (uint64_t *) data;
+  size_t count;
+  
+  if (IsLittleEndian())
+    return;
+  
+  for (count = 0; count < num; count++)
+    vv[count] = Swap64(vv[count]);
+}
+
+static void MakeLittleHeader(struct lpm_header *head) {
+  MakeLittle32(&head->version, 1);
+  MakeLittle32(&head->index_size, 1);
+  MakeLittle64(&head->num_lists, 1);
+}
+
+static void MakeLittleEntry(struct lpm_entry *entry) {
+  MakeLittle64(entry, sizeof(*entry) / sizeof(uint64_t));
+}
+
+static uint64_t Align(uint64_t offset) {
+  return (offset + LPM_ALIGN - 1) & ~(uint64_t) (LPM_ALIGN - 1);
+}
+
+static int CheckSection(const struct file_map *map, uint64_t offset, uint64_t num, uint64_t size) {
+  if (offset % LPM_ALIGN != 0 || offset > map->size || num > (map->size - offset) / size) {
+    Log_Error("Error: .lpm section is out of bounds of the file\n");
+    return -1;
+  }
+  
+  return 0;
+}
+
+/* Indices in the file have a different width than lp_index_t */
+static int ConvertInd(struct lp_vertex_list *vl, const unsigned char *src, size_t num, uint32_t index_size) {
+  lp_index_t *ind;
+  uint64_t val;
+  uint32_t val32;
+  size_t count;
+  
+  if (LP_VertexList_Reserve(vl, 0, num) < 0 || (ind = VertexList_AppendInd(vl, num)) == NULL)
+    return -1;
+  
+  for (count = 0; count < num; count++) {
+    if (index_size == sizeof(uint32_t)) {
+      memcpy(&val32, src + count * sizeof(val32), sizeof(val32));
+      MakeLittle32(&val32, 1);
+      val = val32;
+    } else {
+      memcpy(&val, src + count * sizeof(val), sizeof(val));
+      MakeLittle64(&val, 1);
+    }
+    
+    if (val >= LP_VertexList_NumVert(vl)) {
+      Log_Error("Error: .lpm vertex index is out of range\n");
+      return -1;
+    }
+    ind[count] = (lp_index_t) val;
+  }
+  
+  return 0;
+}
+
+static struct lp_vertex_list *ReadList(struct file_map *map, const struct lpm_header *head, const struct lpm_entry *entry, float scale) {
+  struct lp_vertex_list *vl;
+  lp_index_t *ind;
+  float *vert;
+  size_t count, num;
+  
+  if (entry->floats_per_vert == 0 || entry->floats_per_vert > SIZE_MAX / sizeof(float) ||
+      entry->primative_type > lp_pt_unspecified) {
+    Log_Error("Error: Bad vertex format in .lpm file\n");
+    goto err;
+  }
+  
+  if (entry->num_vert > LP_INDEX_MAX || entry->num_ind > SIZE_MAX / sizeof(lp_index_t)) {
+    Log_Error("Error: Too many vertices in .lpm file\n");
+    goto err;
+  }
+  
+  if (CheckSection(map, entry->vert_offset, entry->num_vert, entry->floats_per_vert * sizeof(float)) < 0 ||
+      CheckSection(map, entry->ind_offset, entry->num_ind, head->index_size) < 0)
+    goto err;
+  
+  if ((vl = LP_VertexList_NewEx(entry->floats_per_vert, (enum primative_type) entry->primative_type, LP_VERTEX_LIST_NO_DEDUP)) == NULL)
+    goto err;
+  
+  /* The mapping is private, so fixing up the data in place only copies the
+   * pages touched */
+  vert = (float *) (map->data + entry->vert_offset);
+  num = entry->num_vert * entry->floats_per_vert;
+  MakeLittle32(vert, num);
+  if (scale != 1.0)
+    for (count = 0; count < num; count++)
+      vert[count] *= scale;
+  
+  if (head->index_size != sizeof(lp_index_t)) {
+    VertexList_Borrow(vl, map, vert, entry->num_vert, NULL, 0);
+    if (ConvertInd(vl, map->data + entry->ind_offset, entry->num_ind, head->index_size) < 0)
+      goto err2;
+    return vl;
+  }
+  
+  ind = (lp_index_t *) (map->data + entry->ind_offset);
+  if (sizeof(lp_index_t) == sizeof(uint32_t))
+    MakeLittle32(ind, entry->num_ind);
+  else
+    MakeLittle64(ind, entry->num_ind);
+  
+  for (count = 0; count < entry->num_ind; count++) {
+    if (ind[count] >= entry->num_vert) {
+      Log_Error("Error: .lpm vertex index is out of range\n");
+      goto err2;
+    }
+  }
+  
+  VertexList_Borrow(vl, map, vert, entry->num_vert, ind, entry->num_ind);
+  return vl;
+  
+ err2:
+  LP_VertexList_Free(vl);
+ err:
+  return NULL;
+}
+
+struct lp_vl_list *FileLpm_Read(FILE *in, float scale) {
+  struct lp_vl_list *list = NULL, *new_list;
+  struct lp_vertex_list *vl;
+  struct lpm_header head;
+  struct lpm_entry entry;
+  struct file_map *map;
+  uint64_t count;
+  
+  if ((map = FileMap_Open(in)) == NULL)
+    goto err;
+  
+  if (map->size < sizeof(head)) {
+    Log_Error("Error: Unable to read .lpm header\n");
+    goto err2;
+  }
+  memcpy(&head, map->data, sizeof(head));
+  MakeLittleHeader(&head);
+  
+  if (memcmp(head.magic, LPM_MAGIC, sizeof(head.magic)) != 0) {
+    Log_Error("Error: Not an .lpm file\n");
+    goto err2;
+  }
+  
+  if (head.version != LPM_VERSION) {
+    Log_Error("Error: Unsupported .lpm version %u\n", (unsigned int) head.version);
+    goto err2;
+  }
+  
+  if ((head.index_size != sizeof(uint32_t) && head.index_size != sizeof(uint64_t)) ||
+      head.num_lists > (map->size - sizeof(head)) / sizeof(entry)) {
+    Log_Error("Error: Bad .lpm header\n");
+    goto err2;
+  }
+  
+  for (count = 0; count < head.num_lists; count++) {
+    memcpy(&entry, map->data + sizeof(head) + count * sizeof(entry), sizeof(entry));
+    MakeLittleEntry(&entry);
+    
+    if ((vl = ReadList(map, &head, &entry, scale)) == NULL)
+      goto err3;
+    
+    if ((new_list = LP_VertexList_ListAppend(list, vl)) == NULL) {
+      Log_Error("Error: Could not allocate memory for vertex list\n");
+      LP_VertexList_Free(vl);
+      goto err3;
+    }
+    list = new_list;
+  }
+  
+  FileMap_Release(map);
+  return list;
+  
+ err3:
+  LP_VertexList_ListFree(list);
+ err2:
+  FileMap_Release(map);
+ err:
+  return NULL;
+}
+
+static int WritePad(struct write_buf *wb, uint64_t len) {
+  static const char zero[LPM_ALIGN];
+  
+  return WriteBuf_Add(wb, zero, Align(len) - len);
+}
+
+static int WriteVert(struct write_buf *wb, const struct lp_vertex_list *vl, float scale) {
+  float buf[SWAP_CHUNK];
+  const float *vert;
+  size_t count, num, len;
+  
+  vert = LP_VertexList_GetVert(vl);
+  num = (size_t) LP_VertexList_NumVert(vl) * LP_VertexList_FloatsPerVert(vl);
+  
+  if (scale == 1.0 && IsLittleEndian()) {
+    if (WriteBuf_Add(wb, vert, num * sizeof(*vert)) < 0)
+      return -1;
+  } else {
+    for (; num > 0; num -= len, vert += len) {
+      len = num < SWAP_CHUNK ? num : SWAP_CHUNK;
+      for (count = 0; count < len; count++)
+	buf[count] = vert[count] * scale;
+      MakeLittle32(buf, len);
+      if (WriteBuf_Add(wb, buf, len * sizeof(*buf)) < 0)
+	return -1;
+    }
+  }
+  
+  return WritePad(wb, (uint64_t) LP_VertexList_NumVert(vl) * LP_VertexList_FloatsPerVert(vl) * sizeof(float));
+}
+
+static int WriteInd(struct write_buf *wb, const struct lp_vertex_list *vl) {
+  lp_index_t buf[SWAP_CHUNK];
+  const lp_index_t *ind;
+  size_t num, len;
+  
+  ind = LP_VertexList_GetInd(vl);
+  num = LP_VertexList_NumInd(vl);
+  
+  if (IsLittleEndian()) {
+    if (WriteBuf_Add(wb, ind, num * sizeof(*ind)) < 0)
+      return -1;
+  } else {
+    for (; num > 0; num -= len, ind += len) {
+      len = num < SWAP_CHUNK ? num : SWAP_CHUNK;
+      memcpy(buf, ind, len * sizeof(*buf));
+      if (sizeof(lp_index_t) == sizeof(uint32_t))
+	MakeLittle32(buf, len);
+      else
+	MakeLittle64(buf, len);
+      if (WriteBuf_Add(wb, buf, len * sizeof(*buf)) < 0)
+	return -1;
+    }
+  }
+  
+  return WritePad(wb, (uint64_t) LP_VertexList_NumInd(vl) * sizeof(lp_index_t));
+}
+
+int FileLpm_Write(struct write_buf *wb, const struct lp_vl_list *list, float scale) {
+  const struct lp_vl_list *cur;
+  struct lpm_header head;
+  struct lpm_entry entry;
+  uint64_t offset;
+  
+  memset(&head, 0, sizeof(head));
+  memcpy(head.magic, LPM_MAGIC, sizeof(head.magic));
+  head.version = LPM_VERSION;
+  head.index_size = sizeof(lp_index_t);
+  for (cur = list; cur != NULL; cur = cur->next)
+    head.num_lists++;
+  offset = sizeof(head) + head.num_lists * sizeof(entry);
+  
+  MakeLittleHeader(&head);
+  if (WriteBuf_Add(wb, &head, sizeof(head)) < 0)
+    return -1;
+  
+  for (cur = list; cur != NULL; cur = cur->next) {
+    memset(&entry, 0, sizeof(entry));
+    entry.floats_per_vert = LP_VertexList_FloatsPerVert(cur->vl);
+    entry.primative_type = LP_VertexList_PrimativeType(cur->vl);
+    entry.num_vert = LP_VertexList_NumVert(cur->vl);
+    entry.num_ind = LP_VertexList_NumInd(cur->vl);
+    entry.vert_offset = offset;
+    offset += Align(entry.num_vert * entry.floats_per_vert * sizeof(float));
+    entry.ind_offset = offset;
+    offset += Align(entry.num_ind * sizeof(lp_index_t));
+    
+    MakeLittleEntry(&entry);
+    if (WriteBuf_Add(wb, &entry, sizeof(entry)) < 0)
+      return -1;
+  }
+  
+  for (cur = list; cur != NULL; cur = cur->next)
+    if (WriteVert(wb, cur->vl, scale) < 0 || WriteInd(wb, cur->vl) < 0)
+      return -1;
+  
+  return 0;
+}
@@ -0,0 +1,206 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include <string.h>
+
+#ifdef HAVE_PTHREADS
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#endif
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define USE_MMAP
+#ifdef MAP_POPULATE
+#define MAP_FLAGS (MAP_PRIVATE | MAP_POPULATE)
+#else
+#define MAP_FLAGS MAP_PRIVATE
+#endif
+#endif
+
+#include "file_map.h"
+#include "log.h"
+
+#if !defined(HAVE_ATOMIC_BUILTINS) && defined(HAVE_PTHREADS)
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+int FileMap_Map(FILE *in, const unsigned char **data, size_t *size) {
+#ifdef USE_MMAP
+  struct stat st;
+  void *mem;
+  
+  if (fstat(fileno(in), &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+    return 1;
+  
+  if ((uintmax_t) st.st_size > SIZE_MAX)
+    return 1;
+  
+  if ((mem = mmap(NULL, st.st_size, PROT_READ, MAP_FLAGS, fileno(in), 0)) == MAP_FAILED)
+    return 1;
+  
+#ifdef HAVE_MADVISE
+  madvise(mem, st.st_size, MADV_SEQUENTIAL);
+#endif
+  
+  *data = (const unsigned char *) mem;
+  *size = st.st_size;
+  return 0;
+#else
+  return 1;
+#endif
+}
+
+void FileMap_Unmap(const unsigned char *data, size_t size) {
+#ifdef USE_MMAP
+  munmap((void *) data, size);
+#endif
+}
+
+static int ReadAll(FILE *in, struct file_map *map) {
+  size_t alloc = 1 << 16, num;
+  unsigned char *new_data;
+  
+  if ((map->data = malloc(alloc)) == NULL)
+    goto err;
+  
+  while ((num = fread(map->data + map->size, 1, alloc - map->size, in)) > 0) {
+    map->size += num;
+    if (map->size < alloc)
+      continue;
+    
+    if ((alloc << 1) < alloc || (new_data = realloc(map->data, alloc << 1)) == NULL)
+      goto err2;
+    map->data = new_data;
+    alloc <<= 1;
+  }
+  
+  if (ferror(in)) {
+    Log_Perror("Error: Could not read file");
+    free(map->data);
+    return -1;
+  }
+  return 0;
+  
+ err2:
+  free(map->data);
+ err:
+  Log_Error("Error: Out of memory reading file\n");
+  return -1;
+}
+
+struct file_map *FileMap_Open(FILE *in) {
+  struct file_map *map;
+#ifdef USE_MMAP
+  struct stat st;
+  void *mem;
+#endif
+  
+  if ((map = malloc(sizeof(*map))) == NULL) {
+    Log_Perror("Error: Could not allocate file map");
+    goto err;
+  }
+  memset(map, 0, sizeof(*map));
+  map->refs = 1;
+  
+#ifdef USE_MMAP
+  /* Not populated, the pages a caller never touches are never read */
+  if (fstat(fileno(in), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+      (uintmax_t) st.st_size <= SIZE_MAX &&
+      (mem = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(in), 0)) != MAP_FAILED) {
+    map->data = (unsigned char *) mem;
+    map->size = st.st_size;
+    map->mapped = 1;
+    return map;
+  }
+#endif
+  
+  if (ReadAll(in, map) < 0)
+    goto err2;
+  return map;
+  
+ err2:
+  free(map);
+ err:
+  return NULL;
+}
+
+void FileMap_Ref(struct file_map *map) {
+#ifdef HAVE_ATOMIC_BUILTINS
+  __atomic_fetch_add(&map->refs, 1, __ATOMIC_RELAXED);
+#else
+#ifdef HAVE_PTHREADS
+  pthread_mutex_lock(&mutex);
+#endif
+  map->refs++;
+#ifdef HAVE_PTHREADS
+  pthread_mutex_unlock(&mutex);
+#endif
+#endif
+}
+
+void FileMap_Release(struct file_map *map) {
+  size_t refs;
+  
+  if (map == NULL)
+    return;
+  
+#ifdef HAVE_ATOMIC_BUILTINS
+  refs = __atomic_sub_fetch(&map->refs, 1, __ATOMIC_ACQ_REL);
+#else
+#ifdef HAVE_PTHREADS
+  pthread_mutex_lock(&mutex);
+#endif
+  refs = --map->refs;
+#ifdef HAVE_PTHREADS
+  pthread_mutex_unlock(&mutex);
+#endif
+#endif
+  if (refs > 0)
+    return;
+  
+#ifdef USE_MMAP
+  if (map->mapped)
+    munmap(map->data, map->size);
+  else
+#endif
+    free(map->data);
+  free(map);
+}
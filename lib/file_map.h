@@ -0,0 +1,56 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef LP_FILE_MAP_H
+#define LP_FILE_MAP_H
+
+#include <stdio.h>
+
+/* Maps all of a regular file read only.  Returns 1 if the file can not be
+ * mapped, in which case the caller reads it through the FILE instead. */
+int FileMap_Map(FILE *in, const unsigned char **data, size_t *size);
+void FileMap_Unmap(const unsigned char *data, size_t size);
+
+/* A private, writable view of a whole file that vertex lists can point
+ * into.  Pages are only copied once written, and never reach the file.
+ * Inputs that can not be mapped are read into memory instead.  Freed when
+ * the last reference is released. */
+struct file_map {
+  unsigned char *data;
+  size_t size;
+  int mapped;
+  size_t refs;
+};
+
+struct file_map *FileMap_Open(FILE *in);
+void FileMap_Ref(struct file_map *map);
+void FileMap_Release(struct file_map *map);
+
+#endif
@@ -28,6 +28,10 @@
   POSSIBILITY OF SUCH DAMAGE.
 */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -35,7 +39,13 @@
 #include <limits.h>
 #include <string.h>
 
+#include "file_map.h"
 #include "file_obj.h"
+#include "log.h"
+#include "parallel.h"
+#include "parse.h"
+#include "vertex_list.h"
+#include "write_buf.h"
 
 enum obj_state {
   o_firstword,
@@ -57,11 +67,11 @@ enum obj_type {
 static int ObjPushFloat(int type, size_t count, struct lp_vertex_list *v, struct lp_vertex_list *vn, struct lp_vertex_list *vt, float *ff, size_t line, size_t col) {
   if (type == t_v) {
     if (count < 3) {
-      fprintf(stderr, "Error: Line %zu, column %zu: too few floating point numbers, expected 3\n", line, col);
+      Log_Error("Error: Line %zu, column %zu: too few floating point numbers, expected 3\n", line, col);
       return -1;
     }
     
-    if (LP_VertexList_Add(v, ff) == UINT_MAX)
+    if (LP_VertexList_Add(v, ff) == LP_INDEX_MAX)
       return -1;
     
     return 0;
@@ -69,11 +79,11 @@ static int ObjPushFloat(int type, size_t count, struct lp_vertex_list *v, struct
   
   if (type == t_vn) {
     if (count < 3) {
-      fprintf(stderr, "Error: Line %zu, column %zu: too few floating point numbers, expected 3\n", line, col);
+      Log_Error("Error: Line %zu, column %zu: too few floating point numbers, expected 3\n", line, col);
       return -1;
     }
 
-    if (LP_VertexList_Add(vn, ff) == UINT_MAX)
+    if (LP_VertexList_Add(vn, ff) == LP_INDEX_MAX)
       return -1;
     
     return 0;
@@ -81,17 +91,17 @@ static int ObjPushFloat(int type, size_t count, struct lp_vertex_list *v, struct
   
   if (type == t_vt) {
     if (count < 2) {
-      fprintf(stderr, "Error: Line %zu, column %zu: too few floating point numbers, expected 2\n", line, col);
+      Log_Error("Error: Line %zu, column %zu: too few floating point numbers, expected 2\n", line, col);
       return -1;
     }
     
-    if (LP_VertexList_Add(vt, ff) == UINT_MAX)
+    if (LP_VertexList_Add(vt, ff) == LP_INDEX_MAX)
       return -1;
     
     return 0;
   }
 
-  fprintf(stderr, "Internal Error: file_obj.c: Invalid float category\n");
+  Log_Error("Internal Error: file_obj.c: Invalid float category\n");
   return -1;
 }
 
@@ -99,6 +109,12 @@ static int ObjPushVert(struct lp_vertex_list *vl, struct lp_vertex_list *v, stru
   float ff[8], *f, *cur = ff;
   int count, exp_sub = 0;
 
+  /* v//vn leaves the middle index empty */
+  if (has_n && !has_t && subcount == 2 && ii[1] == 0) {
+    ii[1] = ii[2];
+    subcount = 1;
+  }
+
   if (has_n)
     exp_sub++;
 
@@ -108,21 +124,21 @@ static int ObjPushVert(struct lp_vertex_list *vl, struct lp_vertex_list *v, stru
   if (subcount != exp_sub) {
     if (has_t) {
       if (has_n)
-	fprintf(stderr, "Error: Line %zu, column %zu: each face vertex needs a vertex, a normal, and a uv\n", line, col);
+	Log_Error("Error: Line %zu, column %zu: each face vertex needs a vertex, a normal, and a uv\n", line, col);
       else
-	fprintf(stderr, "Error: Line %zu, column %zu: each face vertex needs a vertex and a uv\n", line, col);
+	Log_Error("Error: Line %zu, column %zu: each face vertex needs a vertex and a uv\n", line, col);
     } else {
       if (has_n)
-	fprintf(stderr, "Error: Line %zu, column %zu: each face vertex needs a vertex and a normal\n", line, col);
+	Log_Error("Error: Line %zu, column %zu: each face vertex needs a vertex and a normal\n", line, col);
       else
-	fprintf(stderr, "Error: Line %zu, column %zu: each face vertex needs a vertex and no other values\n", line, col);
+	Log_Error("Error: Line %zu, column %zu: each face vertex needs a vertex and no other values\n", line, col);
     }
     
     return -1;
   }
   
   if (ii[0] == 0 || ii[0] > LP_VertexList_NumInd(v)) {
-    fprintf(stderr, "Error: Line %zu, column %zu: Vertex index out of range (1 - %zu): %llu\n", line, col, LP_VertexList_NumInd(v), ii[0]);
+    Log_Error("Error: Line %zu, column %zu: Vertex index out of range (1 - %zu): %llu\n", line, col, LP_VertexList_NumInd(v), ii[0]);
     return -1;
   }
   
@@ -134,7 +150,7 @@ static int ObjPushVert(struct lp_vertex_list *vl, struct lp_vertex_list *v, stru
   if (has_n) {
     count = has_t ? 2 : 1;
     if (ii[count] == 0 || ii[count] > LP_VertexList_NumInd(vn)) {
-      fprintf(stderr, "Error: Line %zu, column %zu: Normal index out of range (1 - %zu): %llu\n", line, col, LP_VertexList_NumInd(vn), ii[count]);
+      Log_Error("Error: Line %zu, column %zu: Normal index out of range (1 - %zu): %llu\n", line, col, LP_VertexList_NumInd(vn), ii[count]);
       return -1;
     }
   
@@ -146,7 +162,7 @@ static int ObjPushVert(struct lp_vertex_list *vl, struct lp_vertex_list *v, stru
 
   if (has_t) {
     if (ii[1] == 0 || ii[1] > LP_VertexList_NumInd(vt)) {
-      fprintf(stderr, "Error: Line %zu, column %zu: UV index out of range (1 - %zu): %llu\n", line, col, LP_VertexList_NumInd(vt), ii[1]);
+      Log_Error("Error: Line %zu, column %zu: UV index out of range (1 - %zu): %llu\n", line, col, LP_VertexList_NumInd(vt), ii[1]);
       return -1;
     }
     
@@ -155,7 +171,7 @@ static int ObjPushVert(struct lp_vertex_list *vl, struct lp_vertex_list *v, stru
     *cur++ = *f;
   }
   
-  if (LP_VertexList_Add(vl, ff) == UINT_MAX)
+  if (LP_VertexList_Add(vl, ff) == LP_INDEX_MAX)
     return -1;
   
   return 0;
@@ -185,7 +201,7 @@ static struct lp_vertex_list *FileObj_ReadSingle(FILE *in, float scale, struct l
     if (++fd->cur >= fd->end) {
       if ((len = fread(fd->buf, 1, sizeof(fd->buf), in)) == 0) {
 	if (ferror(in)) {
-	  fprintf(stderr, "Error: Cannot read from file\n");
+	  Log_Error("Error: Cannot read from file\n");
 	  goto err;
 	}
 	break;
@@ -215,14 +231,14 @@ static struct lp_vertex_list *FileObj_ReadSingle(FILE *in, float scale, struct l
 	subcount = 0;
 	if (strcmp(str, "v") == 0) {
 	  if (vl) {
-	    fprintf(stderr, "Error: v entries must be before f entries\n");
+	    Log_Error("Error: v entries must be before f entries\n");
 	    goto err;
 	  }
 	  type = t_v;
 	  state = o_floatspace;
 	} else if (strcmp(str, "vt") == 0) {
 	  if (vl) {
-	    fprintf(stderr, "Error: vt entries must be before f entries\n");
+	    Log_Error("Error: vt entries must be before f entries\n");
 	    goto err;
 	  }
 	  type = t_vt;
@@ -230,7 +246,7 @@ static struct lp_vertex_list *FileObj_ReadSingle(FILE *in, float scale, struct l
 	  has_t = 1;
 	} else if (strcmp(str, "vn") == 0) {
 	  if (vl) {
-	    fprintf(stderr, "Error: vn entries must be before f entries\n");
+	    Log_Error("Error: vn entries must be before f entries\n");
 	    goto err;
 	  }
 	  type = t_vn;
@@ -269,7 +285,7 @@ static struct lp_vertex_list *FileObj_ReadSingle(FILE *in, float scale, struct l
 
       if (ch == '\n' || ch == '\r') {
 	if (ObjPushFloat(type, count, v, vn, vt, ff, fd->line, fd->col) < 0) {
-	  fprintf(stderr, "Error: Line %zu, column %zu: Could not push float at end of line\n", fd->line, fd->col);
+	  Log_Error("Error: Line %zu, column %zu: Could not push float at end of line\n", fd->line, fd->col);
 	  goto err;
 	}
 	state = o_firstword;
@@ -278,11 +294,11 @@ static struct lp_vertex_list *FileObj_ReadSingle(FILE *in, float scale, struct l
       }
       
       if ((type == t_v || type == t_vn) && count > 3) {
-	fprintf(stderr, "Error: Line %zu, column %zu: too many floating point numbers, expected 3\n", fd->line, fd->col);
+	Log_Error("Error: Line %zu, column %zu: too many floating point numbers, expected 3\n", fd->line, fd->col);
 	goto err;
       }
       if (type == t_vt && count > 2) {
-	fprintf(stderr, "Error: Line %zu, column %zu: too many floating point numbers, expected 2\n", fd->line, fd->col);
+	Log_Error("Error: Line %zu, column %zu: too many floating point numbers, expected 2\n", fd->line, fd->col);
 	goto err;
       }
       state = o_float;
@@ -300,7 +316,7 @@ static struct lp_vertex_list *FileObj_ReadSingle(FILE *in, float scale, struct l
 	  ff[count] = 1.0 - ff[count];
 	count++;
 	if (*curst != '\0') {
-	  fprintf(stderr, "Error: Line %zu, column %zu: invalid floating point number: %s\n", fd->line, fd->col, str);
+	  Log_Error("Error: Line %zu, column %zu: invalid floating point number: %s\n", fd->line, fd->col, str);
 	  goto err;
 	}
 	if (ch == ' ') {
@@ -309,7 +325,7 @@ static struct lp_vertex_list *FileObj_ReadSingle(FILE *in, float scale, struct l
 	}
 
 	if (ObjPushFloat(type, count, v, vn, vt, ff, fd->line, fd->col) < 0) {
-	  fprintf(stderr, "Error: Line %zu, column %zu: Could not push float\n", fd->line, fd->col);
+	  Log_Error("Error: Line %zu, column %zu: Could not push float\n", fd->line, fd->col);
 	  goto err;
 	}
 	state = o_firstword;
@@ -318,7 +334,7 @@ static struct lp_vertex_list *FileObj_ReadSingle(FILE *in, float scale, struct l
       }
       
       if (curst >= str + sizeof(str) - 1) {
-	fprintf(stderr, "Error: Line %zu, column %zu: floating point number too long\n", fd->line, fd->col);
+	Log_Error("Error: Line %zu, column %zu: floating point number too long\n", fd->line, fd->col);
 	goto err;
       }
       
@@ -331,7 +347,7 @@ static struct lp_vertex_list *FileObj_ReadSingle(FILE *in, float scale, struct l
 
       if (ch == '\n' || ch == '\r') {
 	if (count != 3) {
-	  fprintf(stderr, "Error: Line %zu, column %zu: incorrect number of vertices for face, expected 3\n", fd->line, fd->col);
+	  Log_Error("Error: Line %zu, column %zu: incorrect number of vertices for face, expected 3\n", fd->line, fd->col);
 	  goto err;
 	}
 
@@ -343,7 +359,7 @@ static struct lp_vertex_list *FileObj_ReadSingle(FILE *in, float scale, struct l
       subcount = 0;
       count++;
       if (count > 3) {
-	fprintf(stderr, "Error: Line %zu, column %zu: incorrect number of vertices for face, expected 3 (only triangular faces are supported)\n", fd->line, fd->col);
+	Log_Error("Error: Line %zu, column %zu: incorrect number of vertices for face, expected 3 (only triangular faces are supported)\n", fd->line, fd->col);
 	goto err;
       }
       state = o_int;
@@ -356,7 +372,7 @@ static struct lp_vertex_list *FileObj_ReadSingle(FILE *in, float scale, struct l
 	*curst = '\0';
 	ii[subcount] = strtoull(str, &curst, 0);
 	if (*curst != '\0') {
-	  fprintf(stderr, "Error: Line %zu, column %zu: invalid integer\n", fd->line, fd->col);
+	  Log_Error("Error: Line %zu, column %zu: invalid integer\n", fd->line, fd->col);
 	  goto err;
 	}
 
@@ -367,7 +383,7 @@ static struct lp_vertex_list *FileObj_ReadSingle(FILE *in, float scale, struct l
 	}
 	
 	if (ObjPushVert(vl, v, vn, vt, ii, subcount, has_n, has_t, fd->line, fd->col) < 0) {
-	  fprintf(stderr, "Error: Line %zu, column %zu: Could not push vertex\n", fd->line, fd->col);
+	  Log_Error("Error: Line %zu, column %zu: Could not push vertex\n", fd->line, fd->col);
 	  goto err;
 	}
 	
@@ -377,7 +393,7 @@ static struct lp_vertex_list *FileObj_ReadSingle(FILE *in, float scale, struct l
 	}
 	
 	if (count != 3) {
-	  fprintf(stderr, "Error: Line %zu, column %zu: incorrect number of vertices for face, expected 3\n", fd->line, fd->col);
+	  Log_Error("Error: Line %zu, column %zu: incorrect number of vertices for face, expected 3\n", fd->line, fd->col);
 	  goto err;
 	}
 	state = o_firstword;
@@ -386,7 +402,7 @@ static struct lp_vertex_list *FileObj_ReadSingle(FILE *in, float scale, struct l
       }
       
       if (curst >= str + sizeof(str) - 1) {
-	fprintf(stderr, "Error: Line %zu, column %zu: integer too long\n", fd->line, fd->col);
+	Log_Error("Error: Line %zu, column %zu: integer too long\n", fd->line, fd->col);
 	goto err;
       }
       
@@ -423,7 +439,7 @@ static struct lp_vertex_list *FileObj_ReadSingle(FILE *in, float scale, struct l
     
   case o_intspace:
     if (count != 3) {
-      fprintf(stderr, "Error: Line %zu, column %zu: incorrect number of vertices for face, expected 3\n", fd->line, fd->col);
+      Log_Error("Error: Line %zu, column %zu: incorrect number of vertices for face, expected 3\n", fd->line, fd->col);
       goto err;
     }
     break;
@@ -432,12 +448,12 @@ static struct lp_vertex_list *FileObj_ReadSingle(FILE *in, float scale, struct l
     *curst = '\0';
     ii[subcount] = strtoull(str, &curst, 0);
     if (*curst != '\0') {
-      fprintf(stderr, "Error: Line %zu, column %zu: invalid integer\n", fd->line, fd->col);
+      Log_Error("Error: Line %zu, column %zu: invalid integer\n", fd->line, fd->col);
       goto err;
     }
     
     if (ObjPushVert(vl, v, vn, vt, ii, subcount, has_n, has_t, fd->line, fd->col) < 0) {
-      fprintf(stderr, "Error: Line %zu, column %zu: Could not push final vertex\n", fd->line, fd->col);
+      Log_Error("Error: Line %zu, column %zu: Could not push final vertex\n", fd->line, fd->col);
       goto err;
     }
     break;
@@ -448,14 +464,529 @@ static struct lp_vertex_list *FileObj_ReadSingle(FILE *in, float scale, struct l
  err:
   LP_VertexList_Free(vl);
   fd->err = 1;
-  fprintf(stderr, "Error: Line %zu, column %zu: Could not parse .obj file\n", fd->line, fd->col);
+  Log_Error("Error: Line %zu, column %zu: Could not parse .obj file\n", fd->line, fd->col);
   return NULL;
 }
 
+/********************** Chunked reader *****************************/
+
+/* Mapped files are split into newline aligned chunks that are parsed in
+ * parallel.  Anything the chunk parser does not understand, including
+ * every error, sends the whole file back through the streaming reader
+ * above, which produces identical meshes and reports line numbers. */
+#define CHUNK_SIZE (1 << 20)
+
+struct obj_buf {
+  void *mem;
+  size_t used;
+  size_t alloc;
+};
+
+struct obj_corner {
+  unsigned int ii[3];
+  unsigned int subcount;
+};
+
+/* The part of a chunk between 'o' lines */
+struct obj_piece {
+  size_t num_val[3]; /* By enum obj_type */
+  size_t corner, num_corner;
+  int ends_obj;
+  
+  struct obj_seg *seg;
+  size_t dest;
+  size_t vis[3];
+};
+
+struct obj_chunk {
+  const char *start, *end;
+  struct obj_buf val[3];
+  struct obj_buf corner;
+  struct obj_buf piece;
+  int err; /* 1 if the streaming reader is needed, -1 on error */
+};
+
+/* Everything between 'o' lines, which becomes one vertex list */
+struct obj_seg {
+  size_t num_corner;
+  int has_n, has_t;
+  struct lp_vertex_list *vl;
+  float *vert;
+};
+
+struct obj_read {
+  struct obj_chunk *chunk;
+  size_t num_chunk;
+  float scale;
+  
+  float *val[3];
+};
+
+
+static void *BufAdd(struct obj_buf *buf, size_t num, size_t size) {
+  size_t new_alloc;
+  void *new_mem;
+  
+  if (buf->used + num > buf->alloc) {
+    new_alloc = buf->alloc ? buf->alloc : 64;
+    while (new_alloc < buf->used + num)
+      new_alloc <<= 1;
+    
+    if (SIZE_MAX / size < new_alloc || (new_mem = realloc(buf->mem, new_alloc * size)) == NULL) {
+      Log_Error("Error: Out of memory reading .obj file\n");
+      return NULL;
+    }
+    
+    buf->mem = new_mem;
+    buf->alloc = new_alloc;
+  }
+  
+  buf->used += num;
+  return (char *) buf->mem + (buf->used - num) * size;
+}
+
+static int IsLineEnd(char ch) {
+  return ch == '\n' || ch == '\r';
+}
+
+static const char *SkipLine(const char *cur, const char *end) {
+  while (cur < end && !IsLineEnd(*cur))
+    cur++;
+  
+  return cur < end ? cur + 1 : end;
+}
+
+/* Returns the number of floats, or -1 if the line is not plain numbers */
+static int ParseFloats(const char **cur, const char *end, float *ff, int max) {
+  const char *pos = *cur;
+  double val;
+  int count = 0;
+  
+  while (1) {
+    while (pos < end && *pos == ' ')
+      pos++;
+    
+    if (pos >= end)
+      return -1;
+    
+    if (IsLineEnd(*pos))
+      break;
+    
+    if (count >= max || (pos = Parse_Double(pos, end, &val)) == NULL)
+      return -1;
+    
+    if (pos < end && *pos != ' ' && !IsLineEnd(*pos))
+      return -1;
+    
+    ff[count++] = val;
+  }
+  
+  *cur = pos + 1;
+  return count;
+}
+
+static int ParseFace(const char **cur, const char *end, struct obj_corner *corner) {
+  const char *pos = *cur;
+  int count = 0, empty;
+  
+  while (1) {
+    while (pos < end && *pos == ' ')
+      pos++;
+    
+    if (pos >= end || IsLineEnd(*pos))
+      break;
+    
+    if (count >= 3)
+      return -1;
+    
+    corner[count].subcount = 0;
+    empty = 0;
+    while (1) {
+      /* strtoull with base 0 reads a leading zero as octal */
+      if (pos >= end || *pos == '0')
+	return -1;
+      
+      if ((pos = Parse_Unsigned(pos, end, &corner[count].ii[corner[count].subcount])) == NULL)
+	return -1;
+      
+      if (pos >= end || *pos != '/')
+	break;
+      
+      if (empty || ++corner[count].subcount > 2 || ++pos >= end)
+	return -1;
+      
+      /* v//vn is stored like v/vn */
+      if (corner[count].subcount == 1 && *pos == '/') {
+	empty = 1;
+	pos++;
+      }
+    }
+    
+    if (pos < end && *pos != ' ' && !IsLineEnd(*pos))
+      return -1;
+    
+    count++;
+  }
+  
+  if (count != 3)
+    return -1;
+  
+  *cur = pos < end ? pos + 1 : end;
+  return 0;
+}
+
+static struct obj_piece *NewPiece(struct obj_chunk *ch) {
+  struct obj_piece *piece;
+  
+  if ((piece = BufAdd(&ch->piece, 1, sizeof(*piece))) == NULL)
+    return NULL;
+  
+  memset(piece, 0, sizeof(*piece));
+  piece->corner = ch->corner.used;
+  
+  return piece;
+}
+
+static int ParseChunk(void *user, size_t idx, size_t thread) {
+  struct obj_read *rd = (struct obj_read *) user;
+  struct obj_chunk *ch = &rd->chunk[idx];
+  const char *cur = ch->start, *end = ch->end, *word;
+  struct obj_corner corner[3];
+  struct obj_piece *piece;
+  float ff[3], *dest;
+  size_t len;
+  
+  if ((piece = NewPiece(ch)) == NULL)
+    goto err;
+  
+  while (cur < end) {
+    while (cur < end && *cur == ' ')
+      cur++;
+    
+    for (word = cur; cur < end && *cur != ' ' && *cur != '#' && !IsLineEnd(*cur); cur++)
+      ;
+    
+    len = cur - word;
+    if (cur >= end || *cur != ' ' || len > 2) {
+      cur = SkipLine(cur, end);
+      continue;
+    }
+    cur++;
+    
+    if (len == 1 && word[0] == 'v') {
+      if (piece->num_corner || ParseFloats(&cur, end, ff, 3) != 3)
+	goto unsupported;
+      if ((dest = BufAdd(&ch->val[t_v], 3, sizeof(float))) == NULL)
+	goto err;
+      dest[0] = ff[0] * rd->scale;
+      dest[1] = ff[1] * rd->scale;
+      dest[2] = ff[2] * rd->scale;
+      piece->num_val[t_v]++;
+    } else if (len == 2 && word[0] == 'v' && word[1] == 'n') {
+      if (piece->num_corner || ParseFloats(&cur, end, ff, 3) != 3)
+	goto unsupported;
+      if ((dest = BufAdd(&ch->val[t_vn], 3, sizeof(float))) == NULL)
+	goto err;
+      memcpy(dest, ff, 3 * sizeof(float));
+      piece->num_val[t_vn]++;
+    } else if (len == 2 && word[0] == 'v' && word[1] == 't') {
+      if (piece->num_corner || ParseFloats(&cur, end, ff, 3) < 2)
+	goto unsupported;
+      if ((dest = BufAdd(&ch->val[t_vt], 2, sizeof(float))) == NULL)
+	goto err;
+      dest[0] = 1.0 - ff[0];
+      dest[1] = 1.0 - ff[1];
+      piece->num_val[t_vt]++;
+    } else if (len == 1 && word[0] == 'f') {
+      if (ParseFace(&cur, end, corner) < 0)
+	goto unsupported;
+      if ((dest = BufAdd(&ch->corner, 3, sizeof(corner[0]))) == NULL)
+	goto err;
+      memcpy(dest, corner, sizeof(corner));
+      piece->num_corner += 3;
+    } else if (len == 1 && word[0] == 'o') {
+      cur = SkipLine(cur, end);
+      piece->ends_obj = 1;
+      if ((piece = NewPiece(ch)) == NULL)
+	goto err;
+    } else {
+      cur = SkipLine(cur, end);
+    }
+  }
+  
+  return 0;
+  
+ unsupported:
+  ch->err = 1;
+  return -1;
+  
+ err:
+  ch->err = -1;
+  return -1;
+}
+
+static int FillChunk(void *user, size_t idx, size_t thread) {
+  struct obj_read *rd = (struct obj_read *) user;
+  struct obj_chunk *ch = &rd->chunk[idx];
+  struct obj_piece *piece = ch->piece.mem;
+  struct obj_corner *corner;
+  struct obj_seg *seg;
+  size_t count, fpv, num;
+  unsigned int *ii, n_sub;
+  float *dest;
+  
+  for (num = 0; num < ch->piece.used; num++, piece++) {
+    if ((seg = piece->seg) == NULL)
+      continue;
+    
+    fpv = LP_VertexList_FloatsPerVert(seg->vl);
+    n_sub = seg->has_t ? 2 : 1;
+    corner = (struct obj_corner *) ch->corner.mem + piece->corner;
+    dest = seg->vert + piece->dest * fpv;
+    
+    for (count = 0; count < piece->num_corner; count++, corner++, dest += fpv) {
+      ii = corner->ii;
+      if (corner->subcount != (seg->has_n ? 1 : 0) + (seg->has_t ? 1 : 0))
+	goto unsupported;
+      
+      if (ii[0] == 0 || ii[0] > piece->vis[t_v])
+	goto unsupported;
+      memcpy(dest, rd->val[t_v] + 3 * (ii[0] - 1), 3 * sizeof(float));
+      
+      if (seg->has_n) {
+	if (ii[n_sub] == 0 || ii[n_sub] > piece->vis[t_vn])
+	  goto unsupported;
+	memcpy(dest + 3, rd->val[t_vn] + 3 * (ii[n_sub] - 1), 3 * sizeof(float));
+      }
+      
+      if (seg->has_t) {
+	if (ii[1] == 0 || ii[1] > piece->vis[t_vt])
+	  goto unsupported;
+	memcpy(dest + (seg->has_n ? 6 : 3), rd->val[t_vt] + 2 * (ii[1] - 1), 2 * sizeof(float));
+      }
+    }
+  }
+  
+  return 0;
+  
+ unsupported:
+  ch->err = 1;
+  return -1;
+}
+
+static int MergeFloats(struct obj_read *rd, int type) {
+  struct obj_buf *buf;
+  size_t count, total = 0;
+  float *cur;
+  
+  for (count = 0; count < rd->num_chunk; count++)
+    total += rd->chunk[count].val[type].used;
+  
+  if ((rd->val[type] = malloc((total ? total : 1) * sizeof(float))) == NULL) {
+    Log_Error("Error: Out of memory reading .obj file\n");
+    return -1;
+  }
+  
+  for (cur = rd->val[type], count = 0; count < rd->num_chunk; count++) {
+    buf = &rd->chunk[count].val[type];
+    if (buf->used)
+      memcpy(cur, buf->mem, buf->used * sizeof(float));
+    cur += buf->used;
+  }
+  
+  return 0;
+}
+
+/* Assigns every piece to its segment, checking the ordering rules the
+ * streaming reader enforces.  Returns the number of segments or 0. */
+static size_t AssignSegments(struct obj_read *rd, struct obj_seg *segs) {
+  size_t count, num, vis[3] = {0, 0, 0};
+  struct obj_seg *seg = segs;
+  struct obj_piece *piece;
+  int type;
+  
+  for (count = 0; count < rd->num_chunk; count++) {
+    piece = rd->chunk[count].piece.mem;
+    for (num = 0; num < rd->chunk[count].piece.used; num++, piece++) {
+      for (type = t_v; type < t_f; type++) {
+	if (seg->num_corner && piece->num_val[type])
+	  return 0;
+	vis[type] += piece->num_val[type];
+      }
+      seg->has_n |= piece->num_val[t_vn] != 0;
+      seg->has_t |= piece->num_val[t_vt] != 0;
+      
+      if (piece->num_corner) {
+	piece->seg  = seg;
+	piece->dest = seg->num_corner;
+	memcpy(piece->vis, vis, sizeof(vis));
+	seg->num_corner += piece->num_corner;
+      }
+      
+      if (piece->ends_obj)
+	seg++;
+    }
+  }
+  
+  return seg - segs + 1;
+}
+
+static void FreeChunks(struct obj_read *rd) {
+  size_t count;
+  int type;
+  
+  for (count = 0; count < rd->num_chunk; count++) {
+    for (type = t_v; type < t_f; type++)
+      free(rd->chunk[count].val[type].mem);
+    free(rd->chunk[count].corner.mem);
+    free(rd->chunk[count].piece.mem);
+  }
+  
+  free(rd->chunk);
+}
+
+/* Returns 1 if the streaming reader is needed */
+static int ReadChunked(const char *data, size_t size, float scale, struct lp_vl_list **list) {
+  size_t count, num_seg = 1, fpv, num;
+  struct obj_seg *segs, *seg;
+  const char *cur, *end;
+  struct obj_read rd;
+  lp_index_t *ind;
+  
+  memset(&rd, 0, sizeof(rd));
+  rd.scale = scale;
+  
+  if ((rd.chunk = calloc(size / CHUNK_SIZE + 1, sizeof(*rd.chunk))) == NULL) {
+    Log_Error("Error: Out of memory reading .obj file\n");
+    goto err;
+  }
+  
+  for (cur = data; cur < data + size; cur = end) {
+    end = size - (cur - data) > CHUNK_SIZE ? cur + CHUNK_SIZE : data + size;
+    while (end < data + size && !IsLineEnd(end[-1]))
+      end++;
+    
+    rd.chunk[rd.num_chunk].start = cur;
+    rd.chunk[rd.num_chunk].end = end;
+    rd.num_chunk++;
+  }
+  
+  if (Parallel_For(rd.num_chunk, ParseChunk, &rd) < 0)
+    goto chunk_err;
+  
+  for (count = 0; count < rd.num_chunk; count++)
+    num_seg += rd.chunk[count].piece.used;
+  
+  if ((segs = calloc(num_seg, sizeof(*segs))) == NULL) {
+    Log_Error("Error: Out of memory reading .obj file\n");
+    goto err2;
+  }
+  
+  if ((num_seg = AssignSegments(&rd, segs)) == 0)
+    goto unsupported;
+  
+  if (MergeFloats(&rd, t_v) < 0)
+    goto err3;
+  if (MergeFloats(&rd, t_vt) < 0)
+    goto err4;
+  if (MergeFloats(&rd, t_vn) < 0)
+    goto err5;
+  
+  for (count = 0, seg = segs; count < num_seg; count++, seg++) {
+    if (seg->num_corner == 0)
+      continue;
+    
+    if (seg->num_corner > LP_INDEX_MAX) {
+      Log_Error("Error: Too many vertices in a single vertex list\n");
+      goto err6;
+    }
+    
+    fpv = 3 + (seg->has_n ? 3 : 0) + (seg->has_t ? 2 : 0);
+    if ((seg->vl = LP_VertexList_New(fpv, lp_pt_triangle)) == NULL)
+      goto err6;
+    
+    /* Every corner is appended as is and merged in one pass */
+    if (LP_VertexList_Reserve(seg->vl, seg->num_corner, seg->num_corner) < 0)
+      goto err6;
+    if ((seg->vert = VertexList_AppendVerts(seg->vl, seg->num_corner, NULL)) == NULL)
+      goto err6;
+    if ((ind = VertexList_AppendInd(seg->vl, seg->num_corner)) == NULL)
+      goto err6;
+    for (num = 0; num < seg->num_corner; num++)
+      ind[num] = num;
+  }
+  
+  if (Parallel_For(rd.num_chunk, FillChunk, &rd) < 0)
+    goto unsupported2;
+  
+  for (count = 0, seg = segs; count < num_seg; count++, seg++) {
+    if (seg->vl == NULL)
+      continue;
+    
+    if (VertexList_Dedup(seg->vl) < 0)
+      goto err6;
+    
+    *list = LP_VertexList_ListAppend(*list, seg->vl);
+    seg->vl = NULL;
+  }
+  
+  free(rd.val[t_vn]);
+  free(rd.val[t_vt]);
+  free(rd.val[t_v]);
+  free(segs);
+  FreeChunks(&rd);
+  return 0;
+  
+ unsupported2:
+  for (count = 0; count < num_seg; count++)
+    LP_VertexList_Free(segs[count].vl);
+  free(rd.val[t_vn]);
+  free(rd.val[t_vt]);
+  free(rd.val[t_v]);
+ unsupported:
+  free(segs);
+  FreeChunks(&rd);
+  return 1;
+  
+ chunk_err:
+  for (count = 0; count < rd.num_chunk; count++)
+    if (rd.chunk[count].err < 0)
+      goto err2;
+  FreeChunks(&rd);
+  return 1;
+  
+ err6:
+  for (count = 0; count < num_seg; count++)
+    LP_VertexList_Free(segs[count].vl);
+  free(rd.val[t_vn]);
+ err5:
+  free(rd.val[t_vt]);
+ err4:
+  free(rd.val[t_v]);
+ err3:
+  free(segs);
+ err2:
+  FreeChunks(&rd);
+ err:
+  return -1;
+}
+
 struct lp_vl_list *FileObj_Read(FILE *in, float scale) {
   struct lp_vl_list *list = NULL;
   struct lp_vertex_list *v, *vn, *vt;
+  const unsigned char *data;
   struct file_data fd;
+  size_t size;
+  int ret;
+  
+  if (FileMap_Map(in, &data, &size) == 0) {
+    ret = ReadChunked((const char *) data, size, scale, &list);
+    FileMap_Unmap(data, size);
+    if (ret == 0)
+      return list;
+    if (ret < 0)
+      goto err;
+  }
   
   if ((v = LP_VertexList_New(3, lp_pt_point)) == NULL)
     goto err;
@@ -498,10 +1029,31 @@ struct wface {
   size_t vt;
 };
 
-static int FileObj_WriteSingle(FILE *out, size_t poly_count, const struct lp_vertex_list *vl, float scale, size_t *v_off, size_t *vn_off, size_t *vt_off) {
+static int WriteFloats(struct write_buf *wb, const char *prefix, const float *ff, int num, float scale, int flip) {
+  char *dest, *cur;
+  int count;
+  
+  if ((dest = WriteBuf_Space(wb, 4 + num * (WRITE_BUF_FLOAT_LEN + 1))) == NULL)
+    return -1;
+  
+  for (cur = dest; *prefix; )
+    *cur++ = *prefix++;
+  
+  for (count = 0; count < num; count++) {
+    *cur++ = ' ';
+    cur = WriteBuf_FormatFloat(cur, flip ? 1 - ff[count] : ff[count] * scale);
+  }
+  *cur++ = '\n';
+  
+  WriteBuf_Commit(wb, cur - dest);
+  return 0;
+}
+
+static int FileObj_WriteSingle(struct write_buf *wb, size_t poly_count, const struct lp_vertex_list *vl, float scale, size_t *v_off, size_t *vn_off, size_t *vt_off) {
   struct lp_vertex_list *v, *vn, *vt;
   struct wface *wf, *wfmem;
   size_t fpv, count, num, num_verts;
+  char *dest, *cur;
   float *ff;
   int has_vn, has_vt, face;
 
@@ -509,17 +1061,18 @@ static int FileObj_WriteSingle(FILE *out, size_t poly_count, const struct lp_ver
   num = LP_VertexList_NumInd(vl);
   
   if (fpv < 3) {
-    fprintf(stderr, "Error: Two few floats per vert to write .obj file\n");
+    Log_Error("Error: Two few floats per vert to write .obj file\n");
     goto err;
   }
   
   if (LP_VertexList_PrimativeType(vl) != lp_pt_triangle) {
-    fprintf(stderr, "Error: Incorrect primative type for .obj\n");
+    Log_Error("Error: Incorrect primative type for .obj\n");
     goto err;
   }
   
-  has_vn = fpv == 5 || fpv == 8;
-  has_vt = fpv == 6 || fpv == 8;
+  /* Same layout as the reader: position, then normal, then uv */
+  has_vn = fpv == 6 || fpv == 8;
+  has_vt = fpv == 5 || fpv == 8;
   
   if ((wf = calloc(num, sizeof(*wf))) == NULL)
     goto err;
@@ -536,43 +1089,59 @@ static int FileObj_WriteSingle(FILE *out, size_t poly_count, const struct lp_ver
   
   for (count = 0; count < num; count++) {
     ff = LP_VertexList_LookupVert(vl, count);
-    if ((wf[count].v = LP_VertexList_Add(v, &ff[0])) == UINT_MAX)
+    if ((wf[count].v = LP_VertexList_Add(v, &ff[0])) == LP_INDEX_MAX)
       goto err5;
     if (has_vn)
-      if ((wf[count].vn = LP_VertexList_Add(vn, &ff[3])) == UINT_MAX)
+      if ((wf[count].vn = LP_VertexList_Add(vn, &ff[3])) == LP_INDEX_MAX)
 	goto err5;
     if (has_vt)
-      if ((wf[count].vt = LP_VertexList_Add(vt, &ff[has_vn ? 6 : 3])) == UINT_MAX)
+      if ((wf[count].vt = LP_VertexList_Add(vt, &ff[has_vn ? 6 : 3])) == LP_INDEX_MAX)
 	goto err5;
   }
   
-  fprintf(out, "o polyhedra.%03zu\n", poly_count);
+  if (WriteBuf_Printf(wb, "o polyhedra.%03zu\n", poly_count) < 0)
+    goto err5;
   
   num_verts = LP_VertexList_NumVert(v);
   ff = LP_VertexList_GetVert(v);
   for (count = 0; count < num_verts; count++, ff += 3)
-    fprintf(out, "v %f %f %f\n", ff[0] * scale, ff[1] * scale, ff[2] * scale);
+    if (WriteFloats(wb, "v", ff, 3, scale, 0) < 0)
+      goto err5;
   
+  /* The reader flips v */
   num_verts = LP_VertexList_NumVert(vt);
   ff = LP_VertexList_GetVert(vt);
   for (count = 0; count < num_verts; count++, ff += 2)
-    fprintf(out, "vt %f %f\n", ff[0], ff[1]);
+    if (WriteFloats(wb, "vt", ff, 2, 1, 1) < 0)
+      goto err5;
   
   num_verts = LP_VertexList_NumVert(vn);
   ff = LP_VertexList_GetVert(vn);
   for (count = 0; count < num_verts; count++, ff += 3)
-    fprintf(out, "vn %f %f %f\n", ff[0], ff[1], ff[2]);
+    if (WriteFloats(wb, "vn", ff, 3, 1, 0) < 0)
+      goto err5;
   
   for (count = 0; count < num / 3; count++) {
-    fprintf(out, "f");
+    if ((dest = WriteBuf_Space(wb, 2 + 3 * 3 * 24)) == NULL)
+      goto err5;
+    
+    cur = dest;
+    *cur++ = 'f';
     for (face = 0; face < 3; face++, wf++) {
-      fprintf(out, " %zu", wf->v + *v_off);
+      *cur++ = ' ';
+      cur = WriteBuf_FormatSize(cur, wf->v + *v_off);
+      if (has_vt || has_vn)
+	*cur++ = '/';
       if (has_vt)
-	fprintf(out, "/%zu", wf->vt + *vt_off);
-      if (has_vn)
-	fprintf(out, "%s/%zu", has_vt ? "" : "/", wf->vn + *vn_off);
+	cur = WriteBuf_FormatSize(cur, wf->vt + *vt_off);
+      if (has_vn) {
+	*cur++ = '/';
+	cur = WriteBuf_FormatSize(cur, wf->vn + *vn_off);
+      }
     }
-    fprintf(out, "\n");
+    *cur++ = '\n';
+    
+    WriteBuf_Commit(wb, cur - dest);
   }
   
   *v_off  += LP_VertexList_NumVert(v);
@@ -597,13 +1166,14 @@ static int FileObj_WriteSingle(FILE *out, size_t poly_count, const struct lp_ver
   return -1;
 }
 
-int FileObj_Write(FILE *out, const struct lp_vl_list *list, float scale) {
+int FileObj_Write(struct write_buf *wb, const struct lp_vl_list *list, float scale) {
   size_t v_off = 1, vn_off = 1, vt_off = 1, count = 0;
 
-  fprintf(out, "# libpolyhedra\n\n");
+  if (WriteBuf_Printf(wb, "# libpolyhedra\n\n") < 0)
+    return -1;
   
   while (list) {
-    if (FileObj_WriteSingle(out, count++, list->vl, scale, &v_off, &vn_off, &vt_off) < 0)
+    if (FileObj_WriteSingle(wb, count++, list->vl, scale, &v_off, &vn_off, &vt_off) < 0)
       return -1;
     
     list = list->next;
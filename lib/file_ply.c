@@ -0,0 +1,913 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include <limits.h>
+#include <string.h>
+
+#include "file_map.h"
+#include "file_ply.h"
+#include "log.h"
+#include "parse.h"
+#include "vertex_list.h"
+#include "write_buf.h"
+
+#define PLY_MAX_ELEMENTS   16
+#define PLY_MAX_PROPERTIES 64
+#define PLY_MAX_WORDS      5
+#define PLY_MAX_LIST       ((uint64_t) 1 << 32)
+#define IND_CHUNK          3072
+#define SWAP_CHUNK         512
+#define FACE_CHUNK         1024
+#define FACE_SIZE          13
+
+enum ply_format {
+  ply_ascii,
+  ply_little_endian,
+  ply_big_endian
+};
+
+enum ply_type {
+  ply_none,
+  ply_int8,
+  ply_uint8,
+  ply_int16,
+  ply_uint16,
+  ply_int32,
+  ply_uint32,
+  ply_float32,
+  ply_float64
+};
+
+static const char *const type_names[][2] = {
+  {NULL,     NULL},
+  {"char",   "int8"},
+  {"uchar",  "uint8"},
+  {"short",  "int16"},
+  {"ushort", "uint16"},
+  {"int",    "int32"},
+  {"uint",   "uint32"},
+  {"float",  "float32"},
+  {"double", "float64"}
+};
+
+static const size_t type_size[] = {0, 1, 1, 2, 2, 4, 4, 4, 8};
+
+/* Vertex properties are stored position, normal, then uv, the same layout
+ * as the .obj reader */
+#define ROLE_NONE    -1
+#define ROLE_INDICES 8
+
+static const char *const role_names[ROLE_INDICES][3] = {
+  {"x"},
+  {"y"},
+  {"z"},
+  {"nx"},
+  {"ny"},
+  {"nz"},
+  {"s",  "u",  "texture_u"},
+  {"t",  "v",  "texture_v"}
+};
+
+struct ply_prop {
+  enum ply_type type;
+  enum ply_type count_type;  /* ply_none unless the property is a list */
+  int role;
+};
+
+struct ply_element {
+  uint64_t count;
+  size_t stride;  /* Bytes per binary item, 0 if it holds a list */
+  size_t num_props;
+  struct ply_prop prop[PLY_MAX_PROPERTIES];
+};
+
+struct ply_header {
+  enum ply_format format;
+  int vertex, face;  /* -1 if the file has no such element */
+  size_t data;       /* Offset of the first element */
+  size_t num_elements;
+  struct ply_element element[PLY_MAX_ELEMENTS];
+};
+
+struct ply_cursor {
+  unsigned char *pos, *end;
+  enum ply_format format;
+  int swap;
+};
+
+struct ind_buf {
+  struct lp_vertex_list *vl;
+  size_t used;
+  lp_index_t ind[IND_CHUNK];
+};
+
+static int IsLittleEndian(void) {
+  const union {uint16_t i; unsigned char c[2];} one = {1};
+  
+  return one.c[0];
+}
+
+static uint32_t Swap32(uint32_t val) {
+  return
+    ((val >> 24)) |
+    ((val >>  8) & 0xFF00) |
+    ((val <<  8) & 0xFF0000) |
+    ((val << 24));
+}
+
+static uint64_t Swap64(uint64_t val) {
+  return ((uint64_t) Swap32((uint32_t) val) << 32) | Swap32((uint32_t) (val >> 32));
+}
+
+static void Swap32Array(void *data, size_t num) {
+  uint32_t *vv = (uint32_t *) data;
+  size_t count;
+  
+  for (count = 0; count < num; count++)
+    vv[count] = Swap32(vv[count]);
+}
+
+static void MakeLittle32(void *data, size_t num) {
+  if (!IsLittleEndian())
+    Swap32Array(data, num);
+}
+
+/*************************** Header ********************************/
+
+static int IsSpace(char ch) {
+  return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r' || ch == '\v' || ch == '\f';
+}
+
+/* Returns the number of words, PLY_MAX_WORDS + 1 if there are more than fit */
+static int SplitLine(const char *line, const char *end, const char **word, size_t *len) {
+  int num = 0;
+  
+  while (1) {
+    while (line < end && IsSpace(*line))
+      line++;
+    
+    if (line == end)
+      return num;
+    
+    if (num == PLY_MAX_WORDS)
+      return num + 1;
+    
+    word[num] = line;
+    while (line < end && !IsSpace(*line))
+      line++;
+    len[num] = (size_t) (line - word[num]);
+    num++;
+  }
+}
+
+static int WordIs(const char *word, size_t len, const char *str) {
+  return strlen(str) == len && memcmp(word, str, len) == 0;
+}
+
+static enum ply_type ParseType(const char *word, size_t len) {
+  int type;
+  
+  for (type = ply_int8; type <= ply_float64; type++)
+    if (WordIs(word, len, type_names[type][0]) || WordIs(word, len, type_names[type][1]))
+      return (enum ply_type) type;
+  
+  return ply_none;
+}
+
+static int ParseRole(const char *word, size_t len, int is_vertex, int is_list) {
+  int role, name;
+  
+  if (is_list)
+    return !is_vertex && (WordIs(word, len, "vertex_indices") || WordIs(word, len, "vertex_index")) ? ROLE_INDICES : ROLE_NONE;
+  
+  if (is_vertex)
+    for (role = 0; role < ROLE_INDICES; role++)
+      for (name = 0; name < 3 && role_names[role][name]; name++)
+	if (WordIs(word, len, role_names[role][name]))
+	  return role;
+  
+  return ROLE_NONE;
+}
+
+static int ParseCount(const char *word, size_t len, uint64_t *count) {
+  size_t pos;
+  
+  *count = 0;
+  for (pos = 0; pos < len; pos++) {
+    if (word[pos] < '0' || word[pos] > '9' || *count > (UINT64_MAX - 9) / 10)
+      return -1;
+    *count = *count * 10 + (word[pos] - '0');
+  }
+  
+  return 0;
+}
+
+static int ParseProperty(struct ply_header *head, const char **word, size_t *len, int num) {
+  struct ply_element *elem;
+  struct ply_prop *prop;
+  int idx;
+  
+  if (head->num_elements == 0)
+    return -1;
+  
+  idx = (int) head->num_elements - 1;
+  elem = &head->element[idx];
+  if (elem->num_props == PLY_MAX_PROPERTIES)
+    return -1;
+  prop = &elem->prop[elem->num_props++];
+  
+  if (num == 3) {
+    prop->count_type = ply_none;
+    prop->type = ParseType(word[1], len[1]);
+  } else if (num == 5 && WordIs(word[1], len[1], "list")) {
+    prop->count_type = ParseType(word[2], len[2]);
+    prop->type = ParseType(word[3], len[3]);
+    if (prop->count_type == ply_none || prop->count_type >= ply_float32)
+      return -1;
+  } else {
+    return -1;
+  }
+  
+  if (prop->type == ply_none)
+    return -1;
+  
+  prop->role = ParseRole(word[num - 1], len[num - 1], idx == head->vertex, prop->count_type != ply_none);
+  return 0;
+}
+
+static int ParseHeader(const struct file_map *map, struct ply_header *head) {
+  const char *pos, *end, *line_end, *word[PLY_MAX_WORDS];
+  size_t len[PLY_MAX_WORDS], line, count, prop;
+  struct ply_element *elem;
+  int num, have_format = 0;
+  
+  memset(head, 0, sizeof(*head));
+  head->vertex = head->face = -1;
+  
+  pos = (const char *) map->data;
+  end = pos + map->size;
+  
+  for (line = 1; ; line++, pos = line_end + 1) {
+    if ((line_end = memchr(pos, '\n', end - pos)) == NULL) {
+      Log_Error("Error: .ply header is missing end_header\n");
+      return -1;
+    }
+    
+    num = SplitLine(pos, line_end, word, len);
+    
+    if (line == 1) {
+      if (num != 1 || !WordIs(word[0], len[0], "ply")) {
+	Log_Error("Error: Not a .ply file\n");
+	return -1;
+      }
+      continue;
+    }
+    
+    if (num == 0 || WordIs(word[0], len[0], "comment") || WordIs(word[0], len[0], "obj_info"))
+      continue;
+    
+    if (WordIs(word[0], len[0], "end_header") && num == 1)
+      break;
+    
+    if (WordIs(word[0], len[0], "format") && num == 3 && WordIs(word[2], len[2], "1.0")) {
+      if (WordIs(word[1], len[1], "ascii"))
+	head->format = ply_ascii;
+      else if (WordIs(word[1], len[1], "binary_little_endian"))
+	head->format = ply_little_endian;
+      else if (WordIs(word[1], len[1], "binary_big_endian"))
+	head->format = ply_big_endian;
+      else
+	goto err;
+      have_format = 1;
+    } else if (WordIs(word[0], len[0], "element") && num == 3) {
+      if (head->num_elements == PLY_MAX_ELEMENTS)
+	goto err;
+      elem = &head->element[head->num_elements];
+      if (ParseCount(word[2], len[2], &elem->count) < 0)
+	goto err;
+      if (WordIs(word[1], len[1], "vertex") && head->vertex < 0)
+	head->vertex = (int) head->num_elements;
+      else if (WordIs(word[1], len[1], "face") && head->face < 0)
+	head->face = (int) head->num_elements;
+      head->num_elements++;
+    } else if (WordIs(word[0], len[0], "property")) {
+      if (ParseProperty(head, word, len, num) < 0)
+	goto err;
+    } else {
+      goto err;
+    }
+  }
+  
+  if (!have_format) {
+    Log_Error("Error: .ply header has no format line\n");
+    return -1;
+  }
+  head->data = line_end + 1 - (const char *) map->data;
+  
+  for (count = 0; count < head->num_elements; count++) {
+    elem = &head->element[count];
+    for (prop = 0; prop < elem->num_props; prop++) {
+      if (elem->prop[prop].count_type != ply_none) {
+	elem->stride = 0;
+	break;
+      }
+      elem->stride += type_size[elem->prop[prop].type];
+    }
+  }
+  
+  return 0;
+  
+ err:
+  Log_Error("Error: Line %zu: bad .ply header line\n", line);
+  return -1;
+}
+
+/* Slot of each property in the vertex, ROLE_NONE if it is not kept.
+ * Returns the floats per vertex, 0 if there is no position. */
+static size_t VertexLayout(const struct ply_element *elem, int *slot) {
+  int present[ROLE_INDICES], has_n, has_t, role;
+  size_t prop;
+  
+  memset(present, 0, sizeof(present));
+  for (prop = 0; prop < elem->num_props; prop++)
+    if (elem->prop[prop].role >= 0 && elem->prop[prop].role < ROLE_INDICES)
+      present[elem->prop[prop].role] = 1;
+  
+  if (!present[0] || !present[1] || !present[2])
+    return 0;
+  
+  has_n = present[3] && present[4] && present[5];
+  has_t = present[6] && present[7];
+  
+  for (prop = 0; prop < elem->num_props; prop++) {
+    role = elem->prop[prop].role;
+    if (role >= 0 && role < 3)
+      slot[prop] = role;
+    else if (role >= 3 && role < 6 && has_n)
+      slot[prop] = role;
+    else if (role >= 6 && role < ROLE_INDICES && has_t)
+      slot[prop] = has_n ? role : role - 3;
+    else
+      slot[prop] = ROLE_NONE;
+  }
+  
+  return 3 + 3 * has_n + 2 * has_t;
+}
+
+/**************************** Data *********************************/
+
+static int ReadValue(struct ply_cursor *cur, enum ply_type type, double *val) {
+  union {
+    int8_t i8; uint8_t u8; int16_t i16; uint16_t u16;
+    int32_t i32; uint32_t u32; float f; uint64_t u64; double d;
+  } raw;
+  unsigned char *end;
+  size_t size;
+  
+  if (cur->format == ply_ascii) {
+    while (cur->pos < cur->end && IsSpace(*cur->pos))
+      cur->pos++;
+    for (end = cur->pos; end < cur->end && !IsSpace(*end); end++)
+      ;
+    
+    if (end == cur->pos)
+      goto err;
+    
+    if (Parse_Double((const char *) cur->pos, (const char *) end, val) != (const char *) end) {
+      Log_Error("Error: Bad number in .ply data: %.*s\n", (int) (end - cur->pos), (const char *) cur->pos);
+      return -1;
+    }
+    
+    cur->pos = end;
+    return 0;
+  }
+  
+  size = type_size[type];
+  if ((size_t) (cur->end - cur->pos) < size)
+    goto err;
+  
+  memcpy(&raw, cur->pos, size);
+  cur->pos += size;
+  
+  if (cur->swap) {
+    if (size == 2)
+      raw.u16 = (uint16_t) ((raw.u16 >> 8) | (raw.u16 << 8));
+    else if (size == 4)
+      raw.u32 = Swap32(raw.u32);
+    else if (size == 8)
+      raw.u64 = Swap64(raw.u64);
+  }
+  
+  switch (type) {
+  case ply_none:    *val = 0;       break;
+  case ply_int8:    *val = raw.i8;  break;
+  case ply_uint8:   *val = raw.u8;  break;
+  case ply_int16:   *val = raw.i16; break;
+  case ply_uint16:  *val = raw.u16; break;
+  case ply_int32:   *val = raw.i32; break;
+  case ply_uint32:  *val = raw.u32; break;
+  case ply_float32: *val = raw.f;   break;
+  case ply_float64: *val = raw.d;   break;
+  }
+  
+  return 0;
+  
+ err:
+  Log_Error("Error: .ply file ends before its data\n");
+  return -1;
+}
+
+/* List lengths and vertex indices, which must be whole numbers below max */
+static int ReadIndex(struct ply_cursor *cur, enum ply_type type, uint64_t max, const char *what, uint64_t *out) {
+  double val;
+  
+  if (ReadValue(cur, type, &val) < 0)
+    return -1;
+  
+  if (!(val >= 0 && val < (double) max) || val != (double) (uint64_t) val) {
+    Log_Error("Error: .ply %s is out of range\n", what);
+    return -1;
+  }
+  
+  *out = (uint64_t) val;
+  return 0;
+}
+
+static int SkipValues(struct ply_cursor *cur, enum ply_type type, uint64_t num) {
+  double val;
+  
+  if (cur->format != ply_ascii) {
+    if (num > (size_t) (cur->end - cur->pos) / type_size[type]) {
+      Log_Error("Error: .ply file ends before its data\n");
+      return -1;
+    }
+    cur->pos += num * type_size[type];
+    return 0;
+  }
+  
+  for (; num > 0; num--)
+    if (ReadValue(cur, type, &val) < 0)
+      return -1;
+  
+  return 0;
+}
+
+static int SkipProp(struct ply_cursor *cur, const struct ply_prop *prop) {
+  uint64_t num = 1;
+  
+  if (prop->count_type != ply_none && ReadIndex(cur, prop->count_type, PLY_MAX_LIST, "list length", &num) < 0)
+    return -1;
+  
+  return SkipValues(cur, prop->type, num);
+}
+
+static int SkipElement(struct ply_cursor *cur, const struct ply_element *elem) {
+  uint64_t count;
+  size_t prop;
+  
+  if (elem->num_props == 0)
+    return 0;
+  
+  if (cur->format != ply_ascii && elem->stride > 0) {
+    if (elem->count > (size_t) (cur->end - cur->pos) / elem->stride) {
+      Log_Error("Error: .ply file ends before its data\n");
+      return -1;
+    }
+    cur->pos += elem->count * elem->stride;
+    return 0;
+  }
+  
+  for (count = 0; count < elem->count; count++)
+    for (prop = 0; prop < elem->num_props; prop++)
+      if (SkipProp(cur, &elem->prop[prop]) < 0)
+	return -1;
+  
+  return 0;
+}
+
+static int ReadVertices(struct ply_cursor *cur, struct file_map *map, const struct ply_element *elem, const int *slot, struct lp_vertex_list *vl, float scale) {
+  size_t fpv, num, count, prop;
+  float *vert, *vv;
+  double val;
+  int direct, borrow = 0, uv;
+  
+  fpv = LP_VertexList_FloatsPerVert(vl);
+  /* Flipped like .obj texture coordinates, uv is the first slot to flip */
+  uv = fpv == 5 || fpv == 8 ? (int) fpv - 2 : (int) fpv;
+  if (elem->count == 0)
+    return 0;
+  
+  /* Each vertex takes at least a byte, which bounds the allocation */
+  if (elem->count > (size_t) (cur->end - cur->pos)) {
+    Log_Error("Error: .ply file ends before its data\n");
+    return -1;
+  }
+  
+  direct = cur->format != ply_ascii && elem->stride == fpv * sizeof(float);
+  for (prop = 0; direct && prop < elem->num_props; prop++)
+    direct = elem->prop[prop].type == ply_float32 && slot[prop] == (int) prop;
+  
+  if (direct) {
+    if (elem->count > (size_t) (cur->end - cur->pos) / elem->stride) {
+      Log_Error("Error: .ply file ends before its data\n");
+      return -1;
+    }
+    
+    /* The mapping is private, so the vertices are fixed up in place and used
+     * where they lie when aligned */
+    num = elem->count * fpv;
+    if ((uintptr_t) cur->pos % sizeof(float) == 0 && LP_VertexList_NumInd(vl) == 0) {
+      vert = (float *) cur->pos;
+      borrow = 1;
+    } else {
+      if ((vert = VertexList_AppendVerts(vl, elem->count, NULL)) == NULL)
+	return -1;
+      memcpy(vert, cur->pos, num * sizeof(float));
+    }
+    
+    if (cur->swap)
+      Swap32Array(vert, num);
+    if (scale != 1.0 || uv < (int) fpv)
+      for (vv = vert; vv < vert + num; vv += fpv) {
+	vv[0] *= scale;
+	vv[1] *= scale;
+	vv[2] *= scale;
+	if (uv < (int) fpv) {
+	  vv[uv]     = 1 - vv[uv];
+	  vv[uv + 1] = 1 - vv[uv + 1];
+	}
+      }
+    
+    if (borrow)
+      VertexList_Borrow(vl, map, vert, elem->count, NULL, 0);
+    cur->pos += elem->count * elem->stride;
+    return 0;
+  }
+  
+  if ((vert = VertexList_AppendVerts(vl, elem->count, NULL)) == NULL)
+    return -1;
+  
+  for (count = 0, vv = vert; count < elem->count; count++, vv += fpv) {
+    for (prop = 0; prop < elem->num_props; prop++) {
+      if (slot[prop] == ROLE_NONE) {
+	if (SkipProp(cur, &elem->prop[prop]) < 0)
+	  return -1;
+	continue;
+      }
+      
+      if (ReadValue(cur, elem->prop[prop].type, &val) < 0)
+	return -1;
+      if (slot[prop] < 3)
+	val *= scale;
+      else if (slot[prop] >= uv)
+	val = 1 - val;
+      vv[slot[prop]] = (float) val;
+    }
+  }
+  
+  return 0;
+}
+
+static int FlushInd(struct ind_buf *ib) {
+  lp_index_t *ind;
+  
+  if (ib->used == 0)
+    return 0;
+  
+  if ((ind = VertexList_AppendInd(ib->vl, ib->used)) == NULL)
+    return -1;
+  
+  memcpy(ind, ib->ind, ib->used * sizeof(*ind));
+  ib->used = 0;
+  return 0;
+}
+
+/* Polygons are split into a fan around their first corner */
+static int AddCorner(struct ind_buf *ib, uint64_t corner, lp_index_t idx, lp_index_t *first, lp_index_t *prev) {
+  if (corner == 0) {
+    *first = idx;
+  } else if (corner >= 2) {
+    if (ib->used == IND_CHUNK && FlushInd(ib) < 0)
+      return -1;
+    ib->ind[ib->used++] = *first;
+    ib->ind[ib->used++] = *prev;
+    ib->ind[ib->used++] = idx;
+  }
+  
+  *prev = idx;
+  return 0;
+}
+
+/* list uchar int vertex_indices with nothing else, read without conversion */
+static int ReadFastFaces(struct ply_cursor *cur, const struct ply_element *elem, struct ind_buf *ib, uint64_t limit) {
+  lp_index_t first = 0, prev = 0;
+  uint64_t count, corner, num;
+  uint32_t val;
+  
+  for (count = 0; count < elem->count; count++) {
+    if (cur->pos == cur->end)
+      goto err;
+    
+    num = *cur->pos++;
+    if (num > (size_t) (cur->end - cur->pos) / sizeof(val))
+      goto err;
+    
+    for (corner = 0; corner < num; corner++, cur->pos += sizeof(val)) {
+      memcpy(&val, cur->pos, sizeof(val));
+      if (cur->swap)
+	val = Swap32(val);
+      
+      if (val >= limit) {
+	Log_Error("Error: .ply vertex index is out of range\n");
+	return -1;
+      }
+      
+      if (AddCorner(ib, corner, val, &first, &prev) < 0)
+	return -1;
+    }
+  }
+  
+  return FlushInd(ib);
+  
+ err:
+  Log_Error("Error: .ply file ends before its data\n");
+  return -1;
+}
+
+static int ReadListFaces(struct ply_cursor *cur, const struct ply_element *elem, struct ind_buf *ib, uint64_t num_vert) {
+  const struct ply_prop *prop;
+  lp_index_t first = 0, prev = 0;
+  uint64_t count, corner, num, idx;
+  size_t pp;
+  
+  for (count = 0; count < elem->count; count++) {
+    for (pp = 0; pp < elem->num_props; pp++) {
+      prop = &elem->prop[pp];
+      if (prop->role != ROLE_INDICES) {
+	if (SkipProp(cur, prop) < 0)
+	  return -1;
+	continue;
+      }
+      
+      if (ReadIndex(cur, prop->count_type, PLY_MAX_LIST, "list length", &num) < 0)
+	return -1;
+      
+      for (corner = 0; corner < num; corner++)
+	if (ReadIndex(cur, prop->type, num_vert, "vertex index", &idx) < 0 ||
+	    AddCorner(ib, corner, (lp_index_t) idx, &first, &prev) < 0)
+	  return -1;
+    }
+  }
+  
+  return FlushInd(ib);
+}
+
+static int ReadFaces(struct ply_cursor *cur, const struct ply_element *elem, struct lp_vertex_list *vl, uint64_t num_vert) {
+  const struct ply_prop *prop = &elem->prop[0];
+  struct ind_buf *ib;
+  int ret;
+  
+  if ((ib = malloc(sizeof(*ib))) == NULL) {
+    Log_Error("Error: Could not allocate .ply face buffer\n");
+    return -1;
+  }
+  ib->vl = vl;
+  ib->used = 0;
+  
+  /* Exact for triangle meshes, and each face takes at least a byte */
+  if (elem->count <= (size_t) (cur->end - cur->pos) && LP_VertexList_Reserve(vl, 0, 3 * elem->count) < 0)
+    ret = -1;
+  else if (cur->format != ply_ascii && elem->num_props == 1 && prop->role == ROLE_INDICES &&
+	   prop->count_type == ply_uint8 && type_size[prop->type] == sizeof(uint32_t))
+    ret = ReadFastFaces(cur, elem, ib, prop->type == ply_int32 && num_vert > INT32_MAX ? (uint64_t) INT32_MAX + 1 : num_vert);
+  else
+    ret = ReadListFaces(cur, elem, ib, num_vert);
+  
+  free(ib);
+  return ret;
+}
+
+struct lp_vl_list *FilePly_Read(FILE *in, float scale) {
+  int slot[PLY_MAX_PROPERTIES];
+  struct lp_vl_list *list;
+  struct lp_vertex_list *vl;
+  const struct ply_element *elem;
+  struct ply_header head;
+  struct ply_cursor cur;
+  struct file_map *map;
+  uint64_t num_vert;
+  lp_index_t *ind, count;
+  size_t fpv, idx;
+  int ret;
+  
+  if ((map = FileMap_Open(in)) == NULL)
+    goto err;
+  
+  if (ParseHeader(map, &head) < 0)
+    goto err2;
+  
+  if (head.vertex < 0 || (fpv = VertexLayout(&head.element[head.vertex], slot)) == 0) {
+    Log_Error("Error: .ply file has no vertex positions\n");
+    goto err2;
+  }
+  
+  if ((num_vert = head.element[head.vertex].count) > LP_INDEX_MAX) {
+    Log_Error("Error: Too many vertices in .ply file\n");
+    goto err2;
+  }
+  
+  /* Without faces the vertices are read as a point cloud */
+  if ((vl = LP_VertexList_New(fpv, head.face < 0 ? lp_pt_point : lp_pt_triangle)) == NULL)
+    goto err2;
+  
+  cur.pos = map->data + head.data;
+  cur.end = map->data + map->size;
+  cur.format = head.format;
+  cur.swap = head.format == (IsLittleEndian() ? ply_big_endian : ply_little_endian);
+  
+  for (idx = 0; idx < head.num_elements; idx++) {
+    elem = &head.element[idx];
+    if ((int) idx == head.vertex)
+      ret = ReadVertices(&cur, map, elem, slot, vl, scale);
+    else if ((int) idx == head.face)
+      ret = ReadFaces(&cur, elem, vl, num_vert);
+    else
+      ret = SkipElement(&cur, elem);
+    
+    if (ret < 0)
+      goto err3;
+  }
+  
+  if (head.face < 0 && num_vert > 0) {
+    if ((ind = VertexList_AppendInd(vl, num_vert)) == NULL)
+      goto err3;
+    for (count = 0; count < num_vert; count++)
+      ind[count] = count;
+  }
+  
+  if ((list = LP_VertexList_ListAppend(NULL, vl)) == NULL) {
+    Log_Error("Error: Could not allocate memory for vertex list\n");
+    goto err3;
+  }
+  
+  FileMap_Release(map);
+  return list;
+  
+ err3:
+  LP_VertexList_Free(vl);
+ err2:
+  FileMap_Release(map);
+ err:
+  return NULL;
+}
+
+/*************************** Writing *******************************/
+
+static int WriteVert(struct write_buf *wb, const struct lp_vertex_list *vl, size_t out_fpv, float scale) {
+  float buf[SWAP_CHUNK * 8], *dest;
+  const float *vv;
+  size_t fpv, num, len, count, uv;
+  
+  vv = LP_VertexList_GetVert(vl);
+  fpv = LP_VertexList_FloatsPerVert(vl);
+  num = LP_VertexList_NumVert(vl);
+  uv = out_fpv == 5 || out_fpv == 8 ? out_fpv - 2 : out_fpv;
+  
+  if (fpv == out_fpv && uv == out_fpv && scale == 1.0 && IsLittleEndian())
+    return WriteBuf_Add(wb, vv, num * fpv * sizeof(*vv));
+  
+  for (; num > 0; num -= len) {
+    len = num < SWAP_CHUNK ? num : SWAP_CHUNK;
+    for (count = 0, dest = buf; count < len; count++, vv += fpv, dest += out_fpv) {
+      dest[0] = vv[0] * scale;
+      dest[1] = vv[1] * scale;
+      dest[2] = vv[2] * scale;
+      memcpy(dest + 3, vv + 3, (out_fpv - 3) * sizeof(*dest));
+      if (uv < out_fpv) {
+	dest[uv]     = 1 - dest[uv];
+	dest[uv + 1] = 1 - dest[uv + 1];
+      }
+    }
+    
+    MakeLittle32(buf, len * out_fpv);
+    if (WriteBuf_Add(wb, buf, len * out_fpv * sizeof(*buf)) < 0)
+      return -1;
+  }
+  
+  return 0;
+}
+
+static int WriteFaces(struct write_buf *wb, const struct lp_vertex_list *vl) {
+  unsigned char buf[FACE_CHUNK * FACE_SIZE], *dest;
+  const lp_index_t *ind;
+  size_t num, len, count;
+  uint32_t val;
+  int corner;
+  
+  ind = LP_VertexList_GetInd(vl);
+  num = LP_VertexList_NumInd(vl) / 3;
+  
+  for (; num > 0; num -= len) {
+    len = num < FACE_CHUNK ? num : FACE_CHUNK;
+    for (count = 0, dest = buf; count < len; count++) {
+      *dest++ = 3;
+      for (corner = 0; corner < 3; corner++, dest += sizeof(val)) {
+	val = (uint32_t) *ind++;
+	MakeLittle32(&val, 1);
+	memcpy(dest, &val, sizeof(val));
+      }
+    }
+    
+    if (WriteBuf_Add(wb, buf, len * FACE_SIZE) < 0)
+      return -1;
+  }
+  
+  return 0;
+}
+
+int FilePly_Write(struct write_buf *wb, const struct lp_vl_list *list, float scale) {
+  const struct lp_vertex_list *vl;
+  enum primative_type pt;
+  int has_n, has_t;
+  size_t fpv;
+  
+  if (list == NULL || list->next != NULL) {
+    Log_Error("Error: PLY supports exactly one mesh per file\n");
+    return -1;
+  }
+  vl = list->vl;
+  fpv = LP_VertexList_FloatsPerVert(vl);
+  pt = LP_VertexList_PrimativeType(vl);
+  
+  if (fpv < 3) {
+    Log_Error("Error: Too few floats per vert for .ply file\n");
+    return -1;
+  }
+  if (pt != lp_pt_triangle && pt != lp_pt_point) {
+    Log_Error("Error: wrong primative type for .ply file\n");
+    return -1;
+  }
+  if (LP_VertexList_NumVert(vl) > INT32_MAX) {
+    Log_Error("Error: Too many vertices for .ply file\n");
+    return -1;
+  }
+  
+  /* Same layout as the reader: position, then normal, then uv */
+  has_n = fpv == 6 || fpv == 8;
+  has_t = fpv == 5 || fpv == 8;
+  
+  /* Kept to a line or three per call for small write buffers */
+  if (WriteBuf_Printf(wb, "ply\nformat binary_little_endian 1.0\n") < 0 ||
+      WriteBuf_Printf(wb, "comment libpolyhedra\n") < 0 ||
+      WriteBuf_Printf(wb, "element vertex %zu\n", (size_t) LP_VertexList_NumVert(vl)) < 0 ||
+      WriteBuf_Printf(wb, "property float x\nproperty float y\nproperty float z\n") < 0 ||
+      (has_n && WriteBuf_Printf(wb, "property float nx\nproperty float ny\nproperty float nz\n") < 0) ||
+      (has_t && WriteBuf_Printf(wb, "property float s\nproperty float t\n") < 0))
+    return -1;
+  
+  if (pt == lp_pt_triangle &&
+      (WriteBuf_Printf(wb, "element face %zu\n", LP_VertexList_NumInd(vl) / 3) < 0 ||
+       WriteBuf_Printf(wb, "property list uchar int vertex_indices\n") < 0))
+    return -1;
+  
+  if (WriteBuf_Printf(wb, "end_header\n") < 0 ||
+      WriteVert(wb, vl, 3 + 3 * has_n + 2 * has_t, scale) < 0)
+    return -1;
+  
+  return pt == lp_pt_triangle ? WriteFaces(wb, vl) : 0;
+}
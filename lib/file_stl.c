@@ -28,6 +28,10 @@
   POSSIBILITY OF SUCH DAMAGE.
 */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -35,8 +39,18 @@
 #include <limits.h>
 #include <string.h>
 
+#include "file_map.h"
 #include "file_stl.h"
+#include "log.h"
+#include "parallel.h"
+#include "parse.h"
 #include "util.h"
+#include "vertex_list.h"
+#include "write_buf.h"
+
+#define HEADER_SIZE  84
+#define RECORD_SIZE  50
+#define DECODE_CHUNK 16384
 
 static inline int IsLittleEndian(void) {
   const union {uint16_t i; unsigned char c[2];} one = {1};
@@ -48,7 +62,7 @@ static void MakeLittleInt16(uint16_t *val) {
   if (IsLittleEndian())
     return;
   
-  *val = (*val >> 16) | (*val << 16);
+  *val = (*val >> 8) | (*val << 8);
 }
 
 static void MakeLittleInt32(uint32_t *val) {
@@ -113,12 +127,12 @@ static int ReadBinaryStl(FILE *in, struct lp_vertex_list *vl, float scale) {
   int vert;
   
   if (fread(head, sizeof(head), 1, in) != 1) {
-    fprintf(stderr, "Error: Unable to read stl header(2)\n");
+    Log_Error("Error: Unable to read stl header(2)\n");
     return -1;
   }
   
   if (fread(&num_faces, sizeof(num_faces), 1, in) != 1) {
-    fprintf(stderr, "Error: Unable to read number of faces\n");
+    Log_Error("Error: Unable to read number of faces\n");
     return -1;
   }
   
@@ -126,7 +140,7 @@ static int ReadBinaryStl(FILE *in, struct lp_vertex_list *vl, float scale) {
   
   for (count = 0; count < num_faces; count++) {
     if (fread(&face, sizeof(face), 1, in) != 1) {
-      fprintf(stderr, "Error: Unable to read face %lu\n", (unsigned long) count);
+      Log_Error("Error: Unable to read face %lu\n", (unsigned long) count);
       return -1;
     }
     
@@ -141,12 +155,12 @@ static int ReadBinaryStl(FILE *in, struct lp_vertex_list *vl, float scale) {
       ff[4] = face.norm[1];
       ff[5] = face.norm[2];
       
-      if (LP_VertexList_Add(vl, ff) == UINT_MAX)
+      if (LP_VertexList_Add(vl, ff) == LP_INDEX_MAX)
 	return -1;
     }
     
     if (fread(&attr_bytes, sizeof(attr_bytes), 1, in) != 1) {
-      fprintf(stderr, "Error: Unable to read face %lu attribute size\n", (unsigned long) count);
+      Log_Error("Error: Unable to read face %lu attribute size\n", (unsigned long) count);
       return -1;
     }
     
@@ -154,7 +168,8 @@ static int ReadBinaryStl(FILE *in, struct lp_vertex_list *vl, float scale) {
       MakeLittleInt16(&attr_bytes);
       for (attr_count = 0; attr_count < attr_bytes; attr_count++) {
 	if (fread(head, 1, 1, in) != 1) {
-	  fprintf(stderr, "Error: Unable to read face %lu attribute byte %u\n", (unsigned long) count, (int) attr_count);
+	  Log_Error("Error: Unable to read face %lu attribute byte %u\n", (unsigned long) count, (int) attr_count);
+	  return -1;
 	}
       }
     }
@@ -163,34 +178,385 @@ static int ReadBinaryStl(FILE *in, struct lp_vertex_list *vl, float scale) {
   return 0;
 }
 
-static int ReadAsciiStl(FILE *in, struct lp_vertex_list *vl, float scale) {
-  fprintf(stderr, "Error: ASCII .stl not yet supported\n");
-  return -1;
+struct decode {
+  const unsigned char *data;
+  size_t num_faces;
+  float scale;
+  float *vert;
+  lp_index_t *ind;
+  lp_index_t first;
+};
+
+static int DecodeChunk(void *user, size_t chunk, size_t thread) {
+  struct decode *dec = (struct decode *) user;
+  size_t count, end;
+  struct face face;
+  lp_index_t *ii;
+  float *vv;
+  int vert;
+  
+  end = (chunk + 1) * DECODE_CHUNK;
+  if (end > dec->num_faces)
+    end = dec->num_faces;
+  
+  for (count = chunk * DECODE_CHUNK; count < end; count++) {
+    memcpy(&face, dec->data + HEADER_SIZE + count * RECORD_SIZE, sizeof(face));
+    MakeLittleFace(&face);
+    FixWindingOrder(&face);
+    
+    vv = dec->vert + 18 * count;
+    ii = dec->ind + 3 * count;
+    for (vert = 0; vert < 3; vert++) {
+      vv[0] = face.v[3 * vert    ] * dec->scale;
+      vv[1] = face.v[3 * vert + 1] * dec->scale;
+      vv[2] = face.v[3 * vert + 2] * dec->scale;
+      vv[3] = face.norm[0];
+      vv[4] = face.norm[1];
+      vv[5] = face.norm[2];
+      vv += 6;
+      
+      ii[vert] = dec->first + 3 * count + vert;
+    }
+  }
+  
+  return 0;
+}
+
+/* Returns 1 if the size does not match a binary stl with no attribute bytes */
+static int DecodeBinaryStl(const unsigned char *data, size_t size, struct lp_vertex_list *vl, float scale) {
+  struct decode dec;
+  uint32_t num_faces;
+  
+  if (size < HEADER_SIZE)
+    return 1;
+  
+  memcpy(&num_faces, data + HEADER_SIZE - sizeof(num_faces), sizeof(num_faces));
+  MakeLittleInt32(&num_faces);
+  
+  if ((size - HEADER_SIZE) % RECORD_SIZE != 0 || (size - HEADER_SIZE) / RECORD_SIZE != num_faces)
+    return 1;
+  
+  if (num_faces > LP_INDEX_MAX / 3) {
+    Log_Error("Error: Too many faces in stl file: %lu\n", (unsigned long) num_faces);
+    return -1;
+  }
+  
+  /* Every vertex is new, so skip the per-vertex hash and dedup in one pass */
+  if (LP_VertexList_Reserve(vl, 3 * num_faces, 3 * (size_t) num_faces) < 0)
+    return -1;
+  
+  memset(&dec, 0, sizeof(dec));
+  dec.data = data;
+  dec.num_faces = num_faces;
+  dec.scale = scale;
+  if ((dec.vert = VertexList_AppendVerts(vl, 3 * num_faces, &dec.first)) == NULL)
+    return -1;
+  if ((dec.ind = VertexList_AppendInd(vl, 3 * (size_t) num_faces)) == NULL)
+    return -1;
+  
+  if (Parallel_For((dec.num_faces + DECODE_CHUNK - 1) / DECODE_CHUNK, DecodeChunk, &dec) < 0)
+    return -1;
+  
+  return VertexList_Dedup(vl);
+}
+
+/* Returns 1 if the file can not be mapped or needs the streaming reader */
+static int ReadMappedStl(FILE *in, struct lp_vertex_list *vl, float scale) {
+  const unsigned char *data;
+  size_t size;
+  int ret;
+  
+  if (FileMap_Map(in, &data, &size) != 0)
+    return 1;
+  
+  ret = DecodeBinaryStl(data, size, vl, scale);
+  
+  FileMap_Unmap(data, size);
+  return ret;
+}
+
+#define TEXT_BUF_SIZE 65536
+
+struct stl_text {
+  FILE *in;
+  size_t pos, len;
+  size_t line;
+  char buf[TEXT_BUF_SIZE];
+};
+
+static int IsSpace(char ch) {
+  return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r' || ch == '\v' || ch == '\f';
+}
+
+/* Keeps the unread part of the buffer and reads more behind it */
+static ssize_t TextFill(struct stl_text *st) {
+  size_t num;
+  
+  if (st->pos) {
+    memmove(st->buf, st->buf + st->pos, st->len - st->pos);
+    st->len -= st->pos;
+    st->pos = 0;
+  }
+  
+  if ((num = fread(st->buf + st->len, 1, sizeof(st->buf) - st->len, st->in)) == 0 && ferror(st->in)) {
+    Log_Error("Error: Cannot read from file\n");
+    return -1;
+  }
+  
+  st->len += num;
+  return num;
 }
 
-static struct lp_vertex_list *FileStl_ReadSingle(FILE *in, float scale) {
+/* Returns 1 for a token, 0 at the end of the file or -1 on error */
+static int NextToken(struct stl_text *st, const char **tok, size_t *len) {
+  size_t end;
+  ssize_t ret;
+  
+  while (1) {
+    for (; st->pos < st->len && IsSpace(st->buf[st->pos]); st->pos++)
+      if (st->buf[st->pos] == '\n')
+	st->line++;
+    
+    if (st->pos < st->len)
+      break;
+    
+    if ((ret = TextFill(st)) <= 0)
+      return ret;
+  }
+  
+  for (end = st->pos; ; ) {
+    while (end < st->len && !IsSpace(st->buf[end]))
+      end++;
+    
+    if (end < st->len)
+      break;
+    
+    if (st->pos == 0 && st->len == sizeof(st->buf)) {
+      Log_Error("Error: Line %zu: token too long\n", st->line);
+      return -1;
+    }
+    
+    end -= st->pos;
+    if ((ret = TextFill(st)) < 0)
+      return -1;
+    if (ret == 0)
+      break;
+  }
+  
+  *tok = st->buf + st->pos;
+  *len = end - st->pos;
+  st->pos = end;
+  return 1;
+}
+
+/* Skips the rest of the line, used for solid names */
+static int SkipLine(struct stl_text *st) {
+  while (1) {
+    for (; st->pos < st->len; st->pos++)
+      if (st->buf[st->pos] == '\n') {
+	st->pos++;
+	st->line++;
+	return 0;
+      }
+    
+    if (TextFill(st) <= 0)
+      return ferror(st->in) ? -1 : 0;
+  }
+}
+
+static int TokenIs(const char *tok, size_t len, const char *word) {
+  size_t count;
+  
+  for (count = 0; count < len; count++)
+    if (word[count] == '\0' || (tok[count] | 0x20) != word[count])
+      return 0;
+  
+  return word[len] == '\0';
+}
+
+static int ExpectToken(struct stl_text *st, const char *word) {
+  const char *tok;
+  size_t len;
+  
+  if (NextToken(st, &tok, &len) != 1 || !TokenIs(tok, len, word)) {
+    Log_Error("Error: Line %zu: expected '%s'\n", st->line, word);
+    return -1;
+  }
+  
+  return 0;
+}
+
+static int ReadFloats(struct stl_text *st, float *ff, int num) {
+  const char *tok;
+  double val;
+  size_t len;
+  int count;
+  
+  for (count = 0; count < num; count++) {
+    if (NextToken(st, &tok, &len) != 1) {
+      Log_Error("Error: Line %zu: expected a floating point number\n", st->line);
+      return -1;
+    }
+    
+    if (Parse_Double(tok, tok + len, &val) != tok + len) {
+      Log_Error("Error: Line %zu: invalid floating point number: %.*s\n", st->line, (int) len, tok);
+      return -1;
+    }
+    
+    ff[count] = val;
+  }
+  
+  return 0;
+}
+
+static int ReadAsciiFacet(struct stl_text *st, struct lp_vertex_list *vl, float scale) {
+  struct face face;
+  lp_index_t first, *ii;
+  float *vv;
+  int vert;
+  
+  if (ExpectToken(st, "normal") < 0 || ReadFloats(st, face.norm, 3) < 0)
+    return -1;
+  
+  if (ExpectToken(st, "outer") < 0 || ExpectToken(st, "loop") < 0)
+    return -1;
+  
+  for (vert = 0; vert < 3; vert++)
+    if (ExpectToken(st, "vertex") < 0 || ReadFloats(st, &face.v[3 * vert], 3) < 0)
+      return -1;
+  
+  if (ExpectToken(st, "endloop") < 0 || ExpectToken(st, "endfacet") < 0)
+    return -1;
+  
+  FixWindingOrder(&face);
+  
+  if ((vv = VertexList_AppendVerts(vl, 3, &first)) == NULL)
+    return -1;
+  if ((ii = VertexList_AppendInd(vl, 3)) == NULL)
+    return -1;
+  
+  for (vert = 0; vert < 3; vert++, vv += 6) {
+    vv[0] = face.v[3 * vert    ] * scale;
+    vv[1] = face.v[3 * vert + 1] * scale;
+    vv[2] = face.v[3 * vert + 2] * scale;
+    vv[3] = face.norm[0];
+    vv[4] = face.norm[1];
+    vv[5] = face.norm[2];
+    ii[vert] = first + vert;
+  }
+  
+  return 0;
+}
+
+/* head holds the bytes already read from the start of the file */
+static struct lp_vl_list *ReadAsciiStl(FILE *in, const char *head, size_t head_len, float scale) {
+  struct lp_vl_list *list = NULL;
+  struct lp_vertex_list *vl;
+  struct stl_text *st;
+  const char *tok;
+  size_t len;
+  int ret;
+  
+  if ((st = malloc(sizeof(*st))) == NULL) {
+    Log_Error("Error: Could not allocate stl read buffer\n");
+    goto err;
+  }
+  
+  st->in   = in;
+  st->pos  = 0;
+  st->len  = head_len;
+  st->line = 1;
+  memcpy(st->buf, head, head_len);
+  
+  /* Each solid becomes its own vertex list */
+  while ((ret = NextToken(st, &tok, &len)) == 1) {
+    if (!TokenIs(tok, len, "solid")) {
+      Log_Error("Error: Line %zu: expected 'solid'\n", st->line);
+      goto err2;
+    }
+    
+    if (SkipLine(st) < 0)
+      goto err2;
+    
+    if ((vl = LP_VertexList_New(6, lp_pt_triangle)) == NULL)
+      goto err2;
+    
+    while (1) {
+      if (NextToken(st, &tok, &len) != 1) {
+	Log_Error("Error: Line %zu: expected 'facet' or 'endsolid'\n", st->line);
+	goto err3;
+      }
+      
+      if (TokenIs(tok, len, "endsolid"))
+	break;
+      
+      if (!TokenIs(tok, len, "facet")) {
+	Log_Error("Error: Line %zu: expected 'facet' or 'endsolid'\n", st->line);
+	goto err3;
+      }
+      
+      if (ReadAsciiFacet(st, vl, scale) < 0)
+	goto err3;
+    }
+    
+    if (SkipLine(st) < 0)
+      goto err3;
+    
+    if (LP_VertexList_NumInd(vl) == 0) {
+      LP_VertexList_Free(vl);
+      continue;
+    }
+    
+    if (VertexList_Dedup(vl) < 0)
+      goto err3;
+    
+    list = LP_VertexList_ListAppend(list, vl);
+  }
+  
+  if (ret < 0)
+    goto err2;
+  
+  free(st);
+  return list;
+  
+ err3:
+  LP_VertexList_Free(vl);
+ err2:
+  free(st);
+ err:
+  LP_VertexList_ListFree(list);
+  return NULL;
+}
+
+struct lp_vl_list *FileStl_Read(FILE *in, float scale) {
   struct lp_vertex_list *vl;
   char head[6];
   
   if ((vl = LP_VertexList_New(6, lp_pt_triangle)) == NULL) {
-    fprintf(stderr, "Error: Could not allocate memory for vertex list");
+    Log_Error("Error: Could not allocate memory for vertex list");
     goto err;
   }
   
+  switch (ReadMappedStl(in, vl, scale)) {
+  case 0:  return LP_VertexList_ListAppend(NULL, vl);
+  case 1:  break;
+  default: goto err2;
+  }
+  
   if (fread(head, sizeof(head), 1, in) != 1) {
-    fprintf(stderr, "Error: Unable to read stl header\n");
+    Log_Error("Error: Unable to read stl header\n");
     goto err2;
   }
   
-  if (memcmp(head, "solid ", 6) == 0) {
-    if (ReadAsciiStl(in, vl, scale) < 0)
-      goto err2;
-  } else {
-    if (ReadBinaryStl(in, vl, scale) < 0)
-      goto err2;
+  if (TokenIs(head, 5, "solid") && IsSpace(head[5])) {
+    LP_VertexList_Free(vl);
+    return ReadAsciiStl(in, head, sizeof(head), scale);
   }
   
-  return vl;
+  if (ReadBinaryStl(in, vl, scale) < 0)
+    goto err2;
+  
+  return LP_VertexList_ListAppend(NULL, vl);
   
  err2:
   LP_VertexList_Free(vl);
@@ -198,37 +564,31 @@ static struct lp_vertex_list *FileStl_ReadSingle(FILE *in, float scale) {
   return NULL;
 }
 
-struct lp_vl_list *FileStl_Read(FILE *in, float scale) {
-  return LP_VertexList_ListAppend(NULL, FileStl_ReadSingle(in, scale));
-}
-
-const uint16_t zero_attr = 0;
-
-static int FileStl_WriteSingle(FILE *out, const struct lp_vertex_list *vl, float scale) {
+static int FileStl_WriteSingle(struct write_buf *wb, const struct lp_vertex_list *vl, float scale) {
   struct face face;
   size_t count, num;
   uint32_t num_tri;
-  char head[80];
+  char head[80], *dest;
   float *ff;
 
   if (LP_VertexList_FloatsPerVert(vl) < 3) {
-    fprintf(stderr, "Error: Too few floats per vert for .stl file\n");
+    Log_Error("Error: Too few floats per vert for .stl file\n");
     return -1;
   }
   if (LP_VertexList_PrimativeType(vl) != lp_pt_triangle) {
-    fprintf(stderr, "Error: wrong primative type for .stl file\n");
+    Log_Error("Error: wrong primative type for .stl file\n");
     return -1;
   }
   num = LP_VertexList_NumInd(vl);
   
   memset(head, 0, sizeof(head));
   strncpy(head, "binary stl libpolyhedra\n", sizeof(head));
-  if (fwrite(head, sizeof(head), 1, out) != 1)
+  if (WriteBuf_Add(wb, head, sizeof(head)) < 0)
     return -1;
   
   num_tri = num / 3;
   MakeLittleInt32(&num_tri);
-  if (fwrite(&num_tri, sizeof(num_tri), 1, out) != 1)
+  if (WriteBuf_Add(wb, &num_tri, sizeof(num_tri)) < 0)
     return -1;
   
   for (count = 0; count < num / 3; count++) {
@@ -246,20 +606,22 @@ static int FileStl_WriteSingle(FILE *out, const struct lp_vertex_list *vl, float
     face.v[8] = ff[2] * scale;
     PlaneNorm(face.norm, &face.v[0], &face.v[3], &face.v[6]);
     MakeLittleFace(&face);
-    if (fwrite(&face, sizeof(face), 1, out) != 1)
-      return -1;
-    if (fwrite(&zero_attr, sizeof(zero_attr), 1, out) != 1)
+    
+    if ((dest = WriteBuf_Space(wb, RECORD_SIZE)) == NULL)
       return -1;
+    memcpy(dest, &face, sizeof(face));
+    memset(dest + sizeof(face), 0, RECORD_SIZE - sizeof(face));
+    WriteBuf_Commit(wb, RECORD_SIZE);
   }
   
   return 0;
 }
 
-int FileStl_Write(FILE *out, const struct lp_vl_list *list, float scale) {
+int FileStl_Write(struct write_buf *wb, const struct lp_vl_list *list, float scale) {
   if (list == NULL || list->next != NULL) {
-    fprintf(stderr, "Error: STL supports exactly one mesh per file\n");
+    Log_Error("Error: STL supports exactly one mesh per file\n");
     return -1;
   }
   
-  return FileStl_WriteSingle(out, list->vl, scale);
+  return FileStl_WriteSingle(wb, list->vl, scale);
 }
@@ -32,8 +32,9 @@
 #define LP_FILE_STL_H
 
 #include "libpolyhedra.h"
+#include "write_buf.h"
 
 struct lp_vl_list *FileStl_Read(FILE *in, float scale);
-int FileStl_Write(FILE *out, const struct lp_vl_list *list, float scale);
+int FileStl_Write(struct write_buf *wb, const struct lp_vl_list *list, float scale);
 
 #endif
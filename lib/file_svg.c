@@ -37,20 +37,21 @@
 #include <string.h>
 
 #include "file_svg.h"
+#include "log.h"
 #include "util.h"
 
 struct lp_vl_list *FileSvg_Read(FILE *in, float scale) {
-  fprintf(stderr, "Reading .svg files not yet supported\n");
+  Log_Error("Reading .svg files not yet supported\n");
   return NULL;
 }
 
 static int FileSvg_WriteSingle(FILE *out, const struct lp_vertex_list *vl, float scale) {
   size_t count, num, num_lines;
   float *ff1, *ff2, *ff3;
-  unsigned int *ind;
+  lp_index_t *ind;
 
   if (LP_VertexList_FloatsPerVert(vl) < 2) {
-    fprintf(stderr, "Error: Too few floats per vert for .svg\n");
+    Log_Error("Error: Too few floats per vert for .svg\n");
     return -1;
   }
   num = LP_VertexList_NumInd(vl);
@@ -62,9 +63,9 @@ static int FileSvg_WriteSingle(FILE *out, const struct lp_vertex_list *vl, float
     for (count = 0; count < num_lines; count++) {
       ff1 = LP_VertexList_LookupVert(vl, 2 * count);
       ff2 = LP_VertexList_LookupVert(vl, 2 * count + 1);
-      fprintf(out, "    <!-- %04u,%04u --><line x1=\"%g\" y1=\"%g\" x2=\"%g\" y2=\"%g\"/>\n",
-	      ind[2 * count],
-	      ind[2 * count + 1],
+      fprintf(out, "    <!-- %04llu,%04llu --><line x1=\"%g\" y1=\"%g\" x2=\"%g\" y2=\"%g\"/>\n",
+	      (unsigned long long) ind[2 * count],
+	      (unsigned long long) ind[2 * count + 1],
 	      ff1[0] * scale,
 	      ff1[1] * scale,
 	      ff2[0] * scale,
@@ -78,10 +79,10 @@ static int FileSvg_WriteSingle(FILE *out, const struct lp_vertex_list *vl, float
       ff1 = LP_VertexList_LookupVert(vl, 3 * count);
       ff2 = LP_VertexList_LookupVert(vl, 3 * count + 1);
       ff3 = LP_VertexList_LookupVert(vl, 3 * count + 2);
-      fprintf(out, "    <!-- %04u,%04u,%04u --><polygon points=\"%g,%g %g,%g %g,%g\"/>\n",
-	      ind[3 * count],
-	      ind[3 * count + 1],
-	      ind[3 * count + 2],
+      fprintf(out, "    <!-- %04llu,%04llu,%04llu --><polygon points=\"%g,%g %g,%g %g,%g\"/>\n",
+	      (unsigned long long) ind[3 * count],
+	      (unsigned long long) ind[3 * count + 1],
+	      (unsigned long long) ind[3 * count + 2],
 	      ff1[0] * scale,
 	      ff1[1] * scale,
 	      ff2[0] * scale,
@@ -92,7 +93,7 @@ static int FileSvg_WriteSingle(FILE *out, const struct lp_vertex_list *vl, float
     break;
     
   default:
-    fprintf(stderr, "Error: Incorrect primative type for .svg\n");
+    Log_Error("Error: Incorrect primative type for .svg\n");
     return -1;
   }
   
@@ -112,7 +113,7 @@ int FileSvg_Write(FILE *out, const struct lp_vl_list *list, float scale) {
   for (cur = list; cur != NULL; cur = cur->next) {
     fpv = LP_VertexList_FloatsPerVert(cur->vl);
     if (fpv < 2) {
-      fprintf(stderr, "Error: Too few floats per vert for .svg\n");
+      Log_Error("Error: Too few floats per vert for .svg\n");
       return -1;
     }
     
@@ -144,7 +145,7 @@ int FileSvg_Write(FILE *out, const struct lp_vl_list *list, float scale) {
       fprintf(out, "  <g id=\"polyline_%03zu\" fill=\"blue\" stroke=\"none\">\n", count);
       break;
     default:
-      fprintf(stderr, "Error: Incorrect primative type for .svg\n");
+      Log_Error("Error: Incorrect primative type for .svg\n");
       return -1;
     }
     if (FileSvg_WriteSingle(out, cur->vl, scale) < 0)
@@ -34,10 +34,17 @@
 
 #include <string.h>
 
+#include "arena.h"
 #include "ftree.h"
+#include "log.h"
+
+/* Nodes per arena block */
+#define NODE_BLOCK 256
 
 struct ftree {
   struct ftree_node *root;
+  struct arena *arena;
+  struct ftree_node *free_nodes;
   ftree_copy_func_t copy_data;
   ftree_free_func_t free_data;
   ftree_key_func_t  dyn_key;
@@ -68,35 +75,61 @@ struct ftree *FTree_New(ftree_copy_func_t copy_data, ftree_free_func_t free_data
   memset(ftree->root, 0, sizeof(*ftree->root));
   ftree->root->items = 1;
   
+  if ((ftree->arena = Arena_New(NODE_BLOCK * sizeof(struct ftree_node))) == NULL)
+    goto err3;
+  
   return ftree;
 
+ err3:
+  free(ftree->root);
  err2:
   free(ftree);
  err:
   return NULL;
 }
 
-static void Node_Free(struct ftree_node *node, ftree_free_func_t free_data) {
+/* Deleted nodes are chained through parent for reuse */
+static struct ftree_node *Node_Alloc(struct ftree *ftree) {
+  struct ftree_node *node;
+  
+  if ((node = ftree->free_nodes) != NULL)
+    ftree->free_nodes = node->parent;
+  else if ((node = Arena_Alloc(ftree->arena, sizeof(*node))) == NULL)
+    return NULL;
+  
+  memset(node, 0, sizeof(*node));
+  return node;
+}
+
+static void Node_Release(struct ftree *ftree, struct ftree_node *node) {
+  node->parent = ftree->free_nodes;
+  ftree->free_nodes = node;
+}
+
+static void Node_Free(struct ftree *ftree, struct ftree_node *node) {
   if (node == NULL)
     return;
 
-  if (free_data)
-    free_data(node->data);
-  Node_Free(node->left, free_data);
-  Node_Free(node->right, free_data);
-  free(node);
+  if (ftree->free_data)
+    ftree->free_data(node->data);
+  Node_Free(ftree, node->left);
+  Node_Free(ftree, node->right);
+  Node_Release(ftree, node);
 }
 
 void FTree_Free(struct ftree *ftree) {
   if (ftree == NULL)
     return;
 
-  Node_Free(ftree->root, ftree->free_data);
+  if (ftree->free_data)
+    Node_Free(ftree, ftree->root->left);
+  Arena_Free(ftree->arena);
+  free(ftree->root);
   free(ftree);
 }
 
 void FTree_Clear(struct ftree *ftree) {
-  Node_Free(ftree->root->left, ftree->free_data);
+  Node_Free(ftree, ftree->root->left);
   memset(ftree->root, 0, sizeof(*ftree->root));
   ftree->root->items = 1;
 }
@@ -264,9 +297,8 @@ static void Place(struct ftree *ftree, struct ftree_node *node, void *user) {
 struct ftree_node *FTree_Insert(struct ftree *ftree, float key, void *data, void *user) {
   struct ftree_node *node;
   
-  if ((node = malloc(sizeof(*node))) == NULL)
+  if ((node = Node_Alloc(ftree)) == NULL)
     goto err;
-  memset(node, 0, sizeof(*node));
 
   node->key = key;
   node->items = 1;
@@ -320,7 +352,7 @@ void FTree_Delete(struct ftree *ftree, struct ftree_node *node) {
   
   if (ftree->free_data)
     ftree->free_data(node->data);
-  free(node);  
+  Node_Release(ftree, node);
 }
 
 void FTree_Rekey(struct ftree *ftree, struct ftree_node *node, float new_key, void *user) {
@@ -430,6 +462,82 @@ struct ftree_node *FTree_Median(struct ftree *tree) {
   return NULL;
 }
 
+static struct ftree_node *Node_Build(struct ftree *ftree, struct ftree_node *node, const float *key, void *const *data,
+				     size_t num, struct ftree_node *parent) {
+  struct ftree_node *mid;
+  size_t half;
+  
+  if (num == 0)
+    return NULL;
+  
+  half = num / 2;
+  mid = &node[half];
+  mid->key = key ? key[half] : 0;
+  mid->data = ftree->copy_data ? ftree->copy_data(data[half]) : data[half];
+  mid->parent = parent;
+  mid->left  = Node_Build(ftree, node, key, data, half, mid);
+  mid->right = Node_Build(ftree, mid + 1, key ? key + half + 1 : NULL, data + half + 1, num - half - 1, mid);
+  FixHeight(mid);
+  
+  return mid;
+}
+
+int FTree_BuildSorted(struct ftree *ftree, const float *key, void *const *data, size_t num) {
+  struct ftree_node *node;
+  
+  if (ITEMS(ftree->root->left) != 0) {
+    Log_Error("Error: Can only bulk build an empty tree\n");
+    return -1;
+  }
+  if (num == 0)
+    return 0;
+  
+  if (num > SIZE_MAX / sizeof(*node) || (node = Arena_Alloc(ftree->arena, num * sizeof(*node))) == NULL) {
+    Log_Error("Error: Could not allocate memory for tree nodes\n");
+    return -1;
+  }
+  memset(node, 0, num * sizeof(*node));
+  
+  ftree->root->left = Node_Build(ftree, node, key, data, num, ftree->root);
+  return 0;
+}
+
+#define SEL_LESS(a, b) (key[a] < key[b] || (key[a] == key[b] && (a) < (b)))
+
+size_t FTree_Select(const float *key, size_t *idx, size_t num, size_t kth) {
+  size_t lo = 0, hi = num - 1, mid, store, count, tmp;
+  
+#define SWAP(a, b) do { tmp = idx[a]; idx[a] = idx[b]; idx[b] = tmp; } while (0)
+  while (lo < hi) {
+    /* Median of three, left at hi as the pivot */
+    mid = lo + (hi - lo) / 2;
+    if (SEL_LESS(idx[mid], idx[lo]))
+      SWAP(mid, lo);
+    if (SEL_LESS(idx[hi], idx[lo]))
+      SWAP(hi, lo);
+    if (SEL_LESS(idx[mid], idx[hi]))
+      SWAP(mid, hi);
+    
+    for (store = lo, count = lo; count < hi; count++) {
+      if (SEL_LESS(idx[count], idx[hi])) {
+	SWAP(count, store);
+	store++;
+      }
+    }
+    SWAP(store, hi);
+    
+    if (store == kth)
+      break;
+    if (kth < store)
+      hi = store - 1;
+    else
+      lo = store + 1;
+  }
+#undef SWAP
+  
+  return idx[kth];
+}
+
 float FTree_GetKey(struct ftree_node *node) {
   return node->key;
 }
@@ -453,14 +561,14 @@ static void CheckHeight(const struct ftree_node *node) {
   rh = HEIGHT(node->right);
   hh = (lh > rh ? lh : rh) + 1;
   if (node->height != hh)
-    printf("Incorrect height %d -> (%d, %d)\n", node->height, lh, rh);
+    Log_Error("Incorrect height %d -> (%d, %d)\n", node->height, lh, rh);
   
   if (lh > rh + 1 || rh > lh + 1)
-    printf("Tree out of balance (%d, %d)\n", lh, rh);
+    Log_Error("Tree out of balance (%d, %d)\n", lh, rh);
 
   items = ITEMS(node->left) + ITEMS(node->right) + 1;
   if (items != node->items)
-    printf("Incorrect count %zd -> (%zd, %zd)\n", node->items, ITEMS(node->left), ITEMS(node->right));
+    Log_Error("Incorrect count %zd -> (%zd, %zd)\n", node->items, ITEMS(node->left), ITEMS(node->right));
 }
 
 static void CheckNode(const struct ftree_node *node, const struct ftree_node *parent, void (*check_data)(void *)) {
@@ -470,7 +578,7 @@ static void CheckNode(const struct ftree_node *node, const struct ftree_node *pa
   CheckHeight(node);
   
   if (node->parent != parent)
-    printf("Incorrect parent %p != %p\n", node->parent, parent);
+    Log_Error("Incorrect parent %p != %p\n", node->parent, parent);
   
   if (check_data)
     check_data(node->data);
@@ -478,21 +586,21 @@ static void CheckNode(const struct ftree_node *node, const struct ftree_node *pa
 
 void FTree_Check(const struct ftree *ftree, void (*check_data)(void *)) {
   if (ftree->root == NULL) {
-    printf("Invalid NULL root\n");
+    Log_Error("Invalid NULL root\n");
     return;
   }
 
   if (ftree->root->parent != NULL)
-    printf("Invalid root->parent = %p\n", ftree->root->parent);
+    Log_Error("Invalid root->parent = %p\n", ftree->root->parent);
   
   if (ftree->root->key != 0)
-    printf("Invalid root->key = %g\n", ftree->root->key);
+    Log_Error("Invalid root->key = %g\n", ftree->root->key);
 
   if (ftree->root->data != NULL)
-    printf("Invalid root->data = %p\n", ftree->root->data);
+    Log_Error("Invalid root->data = %p\n", ftree->root->data);
   
   if (ftree->root->right != NULL)
-    printf("Invalid root->right = %p\n", ftree->root->right);
+    Log_Error("Invalid root->right = %p\n", ftree->root->right);
 
   CheckNode(ftree->root->left, ftree->root, check_data);
 }
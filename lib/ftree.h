@@ -48,6 +48,16 @@ struct ftree_node *FTree_Insert(struct ftree *ftree, float key, void *data, void
 void FTree_Delete(struct ftree *ftree, struct ftree_node *node);
 void FTree_Rekey(struct ftree *ftree, struct ftree_node *node, float new_key, void *user);
 
+/* Fills an empty tree from num items in ascending key order in O(num).  key
+ * may be NULL for a tree with a dyn_key function. */
+int FTree_BuildSorted(struct ftree *ftree, const float *key, void *const *data, size_t num);
+
+/* Partially orders the num indices in idx by key so idx[kth], kth < num, is
+ * the kth smallest, with smaller ones before it and larger ones after.  Equal
+ * keys order by index, as a tree orders them by insertion.  Returns idx[kth];
+ * kth = num / 2 finds the same item as FTree_Median. */
+size_t FTree_Select(const float *key, size_t *idx, size_t num, size_t kth);
+
 struct ftree_node *FTree_Lowest(struct ftree *tree);
 struct ftree_node *FTree_Highest(struct ftree *tree);
 struct ftree_node *FTree_Next(struct ftree *tree, struct ftree_node *node);
@@ -28,6 +28,10 @@
   POSSIBILITY OF SUCH DAMAGE.
 */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -36,18 +40,22 @@
 #include <string.h>
 
 #include "hash.h"
+#include "log.h"
 #include "random.h"
 #include "SipHash/siphash.h"
+#include "stats.h"
 
-struct element {
+/* Open addressing with linear probing, a hash_val of 0 marks an empty slot */
+struct slot {
   uint64_t hash_val;
   void *key;
   void *data;
-  struct element *next;
 };
 
+#define MIN_SLOTS 8
+
 struct hash {
-  size_t num_buckets;
+  size_t num_slots; /* Power of 2 */
   size_t num_items;
 
   void *user;
@@ -59,21 +67,76 @@ struct hash {
   hash_free_func_t free_data;
   hash_free_func_t free_user;
   
-  struct element **buckets;
+  struct slot *slots;
   
   unsigned char secret[16];
 };
 
+#ifdef USE_FAST_HASH
+/* Nothing hashed here comes from an untrusted source, so a multiply and
+ * xorshift mixer is enough */
+#define FAST_K1 UINT64_C(0x9e3779b97f4a7c15)
+#define FAST_K2 UINT64_C(0xc2b2ae3d27d4eb4f)
+
+static inline uint64_t FastMix(uint64_t x) {
+  x ^= x >> 30;
+  x *= UINT64_C(0xbf58476d1ce4e5b9);
+  x ^= x >> 27;
+  x *= UINT64_C(0x94d049bb133111eb);
+  x ^= x >> 31;
+  
+  return x;
+}
+
+static inline uint64_t FastWord(uint64_t h, uint64_t word) {
+  h ^= word * FAST_K2;
+  h = (h << 31) | (h >> 33);
+  
+  return h * FAST_K1;
+}
+#endif
+
+uint64_t Hash_Bytes(const unsigned char secret[16], const void *key, size_t len) {
+#ifdef USE_FAST_HASH
+  const unsigned char *cur = (const unsigned char *) key;
+  uint64_t h, word;
+  
+  memcpy(&h, secret, sizeof(h));
+  h ^= len * FAST_K1;
+  for (; len >= 2 * sizeof(word); cur += 2 * sizeof(word), len -= 2 * sizeof(word)) {
+    memcpy(&word, cur, sizeof(word));
+    h = FastWord(h, word);
+    memcpy(&word, cur + sizeof(word), sizeof(word));
+    h = FastWord(h, word);
+  }
+  if (len >= sizeof(word)) {
+    memcpy(&word, cur, sizeof(word));
+    h = FastWord(h, word);
+    cur += sizeof(word);
+    len -= sizeof(word);
+  }
+  if (len) {
+    word = 0;
+    memcpy(&word, cur, len);
+    h = FastWord(h, word);
+  }
+  
+  return FastMix(h);
+#else
+  return siphash(secret, (const unsigned char *) key, len);
+#endif
+}
+
 struct hash *Hash_New(void *user, hash_hash_func_t hash_func, hash_cmp_func_t cmp, hash_copy_func_t copy_key, hash_free_func_t free_key, hash_copy_func_t copy_data, hash_free_func_t free_data, hash_free_func_t free_user) {
   struct hash *hash;
   
   if (hash_func == NULL || cmp == NULL) {
-    fprintf(stderr, "Error: Hash function and compare function cannot be NULL\n");
+    Log_Error("Error: Hash function and compare function cannot be NULL\n");
     goto err;
   }
   
   if ((hash = malloc(sizeof(*hash))) == NULL) {
-    fprintf(stderr, "Error: Could not allocate space for hash table\n");
+    Log_Error("Error: Could not allocate space for hash table\n");
     goto err;
   }
   memset(hash, 0, sizeof(*hash));
@@ -87,13 +150,15 @@ struct hash *Hash_New(void *user, hash_hash_func_t hash_func, hash_cmp_func_t cm
   hash->free_data  = free_data;
   hash->free_user  = free_user;
   
-  hash->num_buckets = 128;
-  if ((hash->buckets = calloc(hash->num_buckets, sizeof(void *))) == NULL) {
-    fprintf(stderr, "Error: Could not allocate space for hash table buckets\n");
+  hash->num_slots = MIN_SLOTS;
+  if ((hash->slots = calloc(hash->num_slots, sizeof(*hash->slots))) == NULL) {
+    Log_Error("Error: Could not allocate space for hash table slots\n");
     goto err2;
   }
   
+#ifndef USE_FAST_HASH
   Random(hash->secret, sizeof(hash->secret));
+#endif
   
   return hash;
   
@@ -104,7 +169,7 @@ struct hash *Hash_New(void *user, hash_hash_func_t hash_func, hash_cmp_func_t cm
 }
 
 static uint64_t StringHash(const void *user, const unsigned char secret[16], const void *key) {
-  return siphash(secret, (const unsigned char *) key, strlen((const char *) key));
+  return Hash_Bytes(secret, key, strlen((const char *) key));
 }
 
 static int StringCmp(const void *user, const void *key_a, const void *key_b) {
@@ -124,7 +189,11 @@ struct hash *Hash_NewString(void *user, hash_copy_func_t copy_data, hash_free_fu
 }
 
 static uint64_t PtrHash(const void *user, const unsigned char secret[16], const void *key) {
+#ifdef USE_FAST_HASH
+  return FastMix((uintptr_t) key);
+#else
   return siphash(secret, (unsigned char *) &key, sizeof(key));
+#endif
 }
 
 static int PtrCmp(const void *user, const void *key_a, const void *key_b) {
@@ -146,7 +215,7 @@ struct fixed_data {
 static uint64_t FixedHash(const void *user, const unsigned char secret[16], const void *key) {
   const struct fixed_data *fd = (const struct fixed_data *) user;
   
-  return siphash(secret, (const unsigned char *) key, fd->size);
+  return Hash_Bytes(secret, key, fd->size);
 }
 
 static int FixedCmp(const void *user, const void *key_a, const void *key_b) {
@@ -223,113 +292,116 @@ struct hash *Hash_NewFixed(size_t size, void *user, hash_copy_func_t copy_data,
   return NULL;
 }
 
-static void FreeElement(struct hash *hash, struct element *elem) {
+static void FreeSlot(struct hash *hash, struct slot *slot) {
   if (hash->free_key)
-    hash->free_key(hash->user, elem->key);
+    hash->free_key(hash->user, slot->key);
   if (hash->free_data)
-    hash->free_data(hash->user, elem->data);
-  free(elem);
+    hash->free_data(hash->user, slot->data);
+  slot->hash_val = 0;
 }
 
 void Hash_Free(struct hash *hash) {
   size_t count;
-  struct element *cur, *next;
 
   if (hash == NULL)
     return;
   
-  for (count = 0; count < hash->num_buckets; count++) {
-    cur = hash->buckets[count];
-    while (cur) {
-      next = cur->next;
-      FreeElement(hash, cur);
-      cur = next;
-    }
-  }
+  if (hash->free_key || hash->free_data)
+    for (count = 0; count < hash->num_slots; count++)
+      if (hash->slots[count].hash_val)
+	FreeSlot(hash, &hash->slots[count]);
 
   if (hash->free_user)
     hash->free_user(hash->user, NULL);
-  free(hash->buckets);
+  free(hash->slots);
   free(hash);
 }
 
 void Hash_Clear(struct hash *hash) {
   size_t count;
-  struct element *cur, *next;
-  
-  for (count = 0; count < hash->num_buckets; count++) {
-    cur = hash->buckets[count];
-    hash->buckets[count] = NULL;
-    while (cur) {
-      next = cur->next;
-      FreeElement(hash, cur);
-      cur = next;
-    }
+  
+  if (hash->free_key || hash->free_data) {
+    for (count = 0; count < hash->num_slots; count++)
+      if (hash->slots[count].hash_val)
+	FreeSlot(hash, &hash->slots[count]);
+  } else {
+    memset(hash->slots, 0, hash->num_slots * sizeof(*hash->slots));
   }
+  hash->num_items = 0;
 }
 
 size_t Hash_NumEntries(const struct hash *hash) {
   return hash->num_items;
 }
 
-static void Rehash(struct hash *hash) {
-  struct element **new_buckets, **old_buckets, *cur, *next, **dest;
-  size_t new_num_buckets, count;
+/* Zero is reserved for empty slots */
+static uint64_t HashVal(const struct hash *hash, const void *key) {
+  uint64_t hash_val;
   
-  if (hash->num_buckets > SIZE_MAX / 2)
-    return;
+  hash_val = hash->hash_func(hash->user, hash->secret, key);
   
-  new_num_buckets = hash->num_buckets << 1;
+  return hash_val ? hash_val : 1;
+}
+
+static int Rehash(struct hash *hash) {
+  struct slot *new_slots, *old_slots, *dest;
+  size_t new_num_slots, count, mask;
+  uint64_t start = 0;
   
-  if ((new_buckets = calloc(new_num_buckets, sizeof(void *))) == NULL) {
-    fprintf(stderr, "Could not allcoate memory for hash buckets");
-    return;
+  if (hash->num_slots > SIZE_MAX / 2 / sizeof(*new_slots))
+    return -1;
+  
+  if (stats_enabled)
+    start = Stats_Now();
+  
+  new_num_slots = hash->num_slots << 1;
+  
+  if ((new_slots = calloc(new_num_slots, sizeof(*new_slots))) == NULL) {
+    Log_Error("Could not allcoate memory for hash slots\n");
+    return -1;
   }
   
-  old_buckets = hash->buckets;
+  old_slots = hash->slots;
+  mask = new_num_slots - 1;
   
-  for (count = 0; count < hash->num_buckets; count++) {
-    cur = old_buckets[count];
-    while (cur) {
-      next = cur->next;
-      dest = new_buckets + (cur->hash_val % new_num_buckets);
-      cur->next = *dest;
-      *dest = cur;
-      cur = next;
-    }
+  for (count = 0; count < hash->num_slots; count++) {
+    if (old_slots[count].hash_val == 0)
+      continue;
+    dest = new_slots + (old_slots[count].hash_val & mask);
+    while (dest->hash_val)
+      dest = dest == new_slots + mask ? new_slots : dest + 1;
+    *dest = old_slots[count];
   }
 
-  hash->buckets = new_buckets;
-  hash->num_buckets = new_num_buckets;
-  free(old_buckets);
+  hash->slots = new_slots;
+  hash->num_slots = new_num_slots;
+  free(old_slots);
+  
+  if (stats_enabled)
+    Stats_Add(STAT_REHASHES, 1, Stats_Now() - start);
+  
+  return 0;
 }
 
-static struct element **Find(const struct hash *hash, const void *key, uint64_t hash_val) {
-  size_t bucket;
-  struct element **cur;
+/* Returns the slot holding key, or the empty slot where it would go */
+static struct slot *Find(const struct hash *hash, const void *key, uint64_t hash_val) {
+  size_t idx, mask = hash->num_slots - 1;
+  struct slot *cur;
   
-  bucket = hash_val % hash->num_buckets;
-
-  cur = hash->buckets + bucket;
-  while (*cur) {
-    if ((*cur)->hash_val == hash_val) {
-      if (hash->cmp(hash->user, (*cur)->key, key) == 0)
-	return cur;
-    }
-    
-    cur = &(*cur)->next;
+  for (idx = hash_val & mask; ; idx = (idx + 1) & mask) {
+    cur = hash->slots + idx;
+    if (cur->hash_val == 0)
+      return cur;
+    if (cur->hash_val == hash_val && hash->cmp(hash->user, cur->key, key) == 0)
+      return cur;
   }
-  
-  return cur;
 }
 
 void *Hash_Lookup(const struct hash *hash, const void *key, int *was_found) {
-  uint64_t hash_val;
-  struct element **loc;
+  struct slot *loc;
   
-  hash_val = hash->hash_func(hash->user, hash->secret, key);
-  loc = Find(hash, key, hash_val);
-  if (!*loc) {
+  loc = Find(hash, key, HashVal(hash, key));
+  if (loc->hash_val == 0) {
     if (was_found)
       *was_found = 0;
     return NULL;
@@ -338,109 +410,113 @@ void *Hash_Lookup(const struct hash *hash, const void *key, int *was_found) {
   if (was_found)
     *was_found = 1;
   
-  return (*loc)->data;
+  return loc->data;
 }
 
 int Hash_Insert(struct hash *hash, const void *key, const void *data, void **key_out) {
   uint64_t hash_val;
-  struct element **loc, *new_elem;
+  struct slot *loc;
   void *new_data, *new_key;
   
-  hash_val = hash->hash_func(hash->user, hash->secret, key);
+  hash_val = HashVal(hash, key);
   loc = Find(hash, key, hash_val);
-  if (*loc) {
+  if (loc->hash_val) {
     if (hash->free_data)
-      hash->free_data(hash->user, (*loc)->data);
+      hash->free_data(hash->user, loc->data);
     if (hash->copy_data) {
       if ((new_data = hash->copy_data(hash->user, data)) == NULL) {
-	fprintf(stderr, "Could not copy data into existing hash element\n");
+	Log_Error("Could not copy data into existing hash element\n");
 	return -1;
       }
-      (*loc)->data = new_data;
+      loc->data = new_data;
     } else {
-      (*loc)->data = (void *) data;
+      loc->data = (void *) data;
     }
     
     if (key_out)
-      *key_out = (*loc)->key;
+      *key_out = loc->key;
     return 0;
   }
   
-  if ((new_elem = malloc(sizeof(*new_elem))) == NULL) {
-    fprintf(stderr, "Could not allocate memory for hash element\n");
-    return -1;
+  /* Keep the load factor at or below 3/4 */
+  if ((hash->num_items + 1) * 4 > hash->num_slots * 3) {
+    if (Rehash(hash) == 0)
+      loc = Find(hash, key, hash_val);
+    else if (hash->num_items + 1 >= hash->num_slots)
+      return -1;
   }
-  memset(new_elem, 0, sizeof(*new_elem));
-  
-  new_elem->hash_val = hash_val;
-  new_elem->next = NULL;
   
   if (hash->copy_key) {
     if ((new_key = hash->copy_key(hash->user, key)) == NULL) {
-      fprintf(stderr, "Could not copy key into new hash element\n");
+      Log_Error("Could not copy key into new hash element\n");
       return -1;
     }
-    new_elem->key = new_key;
   } else {
-    new_elem->key = (void *) key;
+    new_key = (void *) key;
   }
 
   if (hash->copy_data) {
     if ((new_data = hash->copy_data(hash->user, data)) == NULL) {
-      fprintf(stderr, "Could not copy data into new hash element\n");
+      Log_Error("Could not copy data into new hash element\n");
+      if (hash->free_key)
+	hash->free_key(hash->user, new_key);
       return -1;
     }
-    new_elem->data = new_data;
   } else {
-    new_elem->data = (void *) data;
+    new_data = (void *) data;
   }
 
-  *loc = new_elem;
-
-  if ((hash->num_items >> 1) > hash->num_buckets)
-    Rehash(hash);
+  loc->hash_val = hash_val;
+  loc->key = new_key;
+  loc->data = new_data;
   
   hash->num_items++;  
   if (key_out)
-    *key_out = new_elem->key;
+    *key_out = new_key;
   return 1;
 }
 
 int Hash_Remove(struct hash *hash, const void *key) {
-  uint64_t hash_val;
-  struct element **loc, *rem;
+  size_t hole, idx, home, mask = hash->num_slots - 1;
+  struct slot *loc;
   
-  hash_val = hash->hash_func(hash->user, hash->secret, key);
-  loc = Find(hash, key, hash_val);
-  if (!*loc)
+  loc = Find(hash, key, HashVal(hash, key));
+  if (loc->hash_val == 0)
     return 0;
   
-  rem = *loc;
-  *loc = rem->next;
-  
-  FreeElement(hash, rem);
+  FreeSlot(hash, loc);
   hash->num_items--;
   
+  /* Shift later entries of the probe run back so no tombstones are needed */
+  hole = loc - hash->slots;
+  for (idx = (hole + 1) & mask; hash->slots[idx].hash_val; idx = (idx + 1) & mask) {
+    home = hash->slots[idx].hash_val & mask;
+    if (((idx - home) & mask) >= ((idx - hole) & mask)) {
+      hash->slots[hole] = hash->slots[idx];
+      hash->slots[idx].hash_val = 0;
+      hole = idx;
+    }
+  }
+  
   return 1;
 }
 
 struct hash_iterator {
   struct hash *hash;
-  size_t bucket;
-  struct element *elem;
+  size_t idx;
+  struct slot *slot;
 };
 
 struct hash_iterator *Hash_IteratorNew(struct hash *hash) {
   struct hash_iterator *hi;
 
   if ((hi = malloc(sizeof(*hi))) == NULL) {
-    perror("Error: Could not allocate memory for hash table iterator");
+    Log_Perror("Error: Could not allocate memory for hash table iterator");
     goto err;
   }
   memset(hi, 0, sizeof(*hi));
   
   hi->hash = hash;
-  hi->bucket = -1;
   
   return hi;
   
@@ -456,31 +532,28 @@ void Hash_IteratorFree(struct hash_iterator *hi) {
 }
 
 int Hash_IteratorNext(struct hash_iterator *hi) {
-  if (hi->elem && hi->elem->next) {
-    hi->elem = hi->elem->next;
-    return 1;
-  }
-  
-  while (hi->bucket < hi->hash->num_buckets || hi->bucket == SIZE_MAX) {
-    if ((hi->elem = hi->hash->buckets[++hi->bucket]))
+  while (hi->idx < hi->hash->num_slots) {
+    hi->slot = &hi->hash->slots[hi->idx++];
+    if (hi->slot->hash_val)
       return 1;
   }
+  hi->slot = NULL;
   
   return 0;
 }
 
 void *Hash_IteratorGetKey(struct hash_iterator *hi) {
-  if (hi->elem == NULL)
+  if (hi->slot == NULL)
     return NULL;
 
-  return hi->elem->key;
+  return hi->slot->key;
 }
 
 void *Hash_IteratorGetData(struct hash_iterator *hi) {
-  if (hi->elem == NULL)
+  if (hi->slot == NULL)
     return NULL;
 
-  return hi->elem->data;
+  return hi->slot->data;
 }
 
 void *Hash_GetFirstKey(struct hash *hash) {
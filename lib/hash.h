@@ -63,4 +63,7 @@ void *Hash_IteratorGetData(struct hash_iterator *hi);
 
 void *Hash_GetFirstKey(struct hash *hash);
 
+/* For hash_hash_func_t implementations, SipHash unless built with fast hashing */
+uint64_t Hash_Bytes(const unsigned char secret[16], const void *key, size_t len);
+
 #endif
@@ -0,0 +1,190 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include <string.h>
+
+#include "heap.h"
+#include "log.h"
+
+#define INITIAL_ALLOC 64
+
+struct heap_entry {
+  float key;
+  size_t seq;
+  void *data;
+  size_t *pos;
+};
+
+struct heap {
+  struct heap_entry *entry;
+  size_t num;
+  size_t alloc;
+  size_t seq;
+};
+
+static int Entry_Less(const struct heap_entry *a, const struct heap_entry *b) {
+  return a->key < b->key || (a->key == b->key && a->seq < b->seq);
+}
+
+static void Heap_Set(struct heap *heap, size_t pos, const struct heap_entry *entry) {
+  heap->entry[pos] = *entry;
+  *entry->pos = pos;
+}
+
+static void Heap_Up(struct heap *heap, size_t pos) {
+  struct heap_entry entry = heap->entry[pos];
+  size_t parent;
+  
+  while (pos > 0) {
+    parent = (pos - 1) / 2;
+    if (!Entry_Less(&entry, &heap->entry[parent]))
+      break;
+    Heap_Set(heap, pos, &heap->entry[parent]);
+    pos = parent;
+  }
+  Heap_Set(heap, pos, &entry);
+}
+
+static void Heap_Down(struct heap *heap, size_t pos) {
+  struct heap_entry entry = heap->entry[pos];
+  size_t child;
+  
+  while ((child = 2 * pos + 1) < heap->num) {
+    if (child + 1 < heap->num && Entry_Less(&heap->entry[child + 1], &heap->entry[child]))
+      child++;
+    if (!Entry_Less(&heap->entry[child], &entry))
+      break;
+    Heap_Set(heap, pos, &heap->entry[child]);
+    pos = child;
+  }
+  Heap_Set(heap, pos, &entry);
+}
+
+struct heap *Heap_New(void) {
+  struct heap *heap;
+  
+  if ((heap = malloc(sizeof(*heap))) == NULL) {
+    Log_Error("Error: Could not allocate memory for heap\n");
+    goto err;
+  }
+  memset(heap, 0, sizeof(*heap));
+  
+  return heap;
+  
+ err:
+  return NULL;
+}
+
+void Heap_Free(struct heap *heap) {
+  if (heap == NULL)
+    return;
+  
+  free(heap->entry);
+  free(heap);
+}
+
+size_t Heap_Count(const struct heap *heap) {
+  return heap->num;
+}
+
+int Heap_Append(struct heap *heap, float key, void *data, size_t *pos) {
+  struct heap_entry *entry;
+  size_t alloc;
+  
+  if (heap->num == heap->alloc) {
+    alloc = heap->alloc ? 2 * heap->alloc : INITIAL_ALLOC;
+    if (alloc > SIZE_MAX / sizeof(*entry) ||
+	(entry = realloc(heap->entry, alloc * sizeof(*entry))) == NULL) {
+      Log_Error("Error: Could not allocate memory for heap\n");
+      return -1;
+    }
+    heap->entry = entry;
+    heap->alloc = alloc;
+  }
+  
+  entry = &heap->entry[heap->num];
+  entry->key  = key;
+  entry->seq  = heap->seq++;
+  entry->data = data;
+  entry->pos  = pos;
+  *pos = heap->num++;
+  
+  return 0;
+}
+
+void Heap_Heapify(struct heap *heap) {
+  size_t pos;
+  
+  for (pos = heap->num / 2; pos-- > 0;)
+    Heap_Down(heap, pos);
+}
+
+int Heap_Insert(struct heap *heap, float key, void *data, size_t *pos) {
+  if (Heap_Append(heap, key, data, pos) < 0)
+    return -1;
+  
+  Heap_Up(heap, *pos);
+  
+  return 0;
+}
+
+void Heap_Delete(struct heap *heap, size_t pos) {
+  if (--heap->num == pos)
+    return;
+  
+  Heap_Set(heap, pos, &heap->entry[heap->num]);
+  if (pos > 0 && Entry_Less(&heap->entry[pos], &heap->entry[(pos - 1) / 2]))
+    Heap_Up(heap, pos);
+  else
+    Heap_Down(heap, pos);
+}
+
+void Heap_Rekey(struct heap *heap, size_t pos, float key) {
+  float old = heap->entry[pos].key;
+  
+  heap->entry[pos].key = key;
+  if (key < old)
+    Heap_Up(heap, pos);
+  else if (key > old)
+    Heap_Down(heap, pos);
+}
+
+void *Heap_Lowest(const struct heap *heap, float *key) {
+  if (heap->num == 0)
+    return NULL;
+  
+  if (key)
+    *key = heap->entry[0].key;
+  return heap->entry[0].data;
+}
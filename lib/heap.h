@@ -0,0 +1,59 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef LP_HEAP_H
+#define LP_HEAP_H
+
+#include <stddef.h>
+
+/* Array backed min heap of (key, insertion order).  The heap keeps the
+ * current position of each entry in the size_t passed to Heap_Insert,
+ * which is the handle used to rekey or delete it. */
+struct heap;
+
+struct heap *Heap_New(void);
+void Heap_Free(struct heap *heap);
+
+size_t Heap_Count(const struct heap *heap);
+
+int Heap_Insert(struct heap *heap, float key, void *data, size_t *pos);
+
+/* Bulk build: Heap_Append adds without restoring the heap order, then
+ * Heap_Heapify must be called before any other operation */
+int Heap_Append(struct heap *heap, float key, void *data, size_t *pos);
+void Heap_Heapify(struct heap *heap);
+
+void Heap_Delete(struct heap *heap, size_t pos);
+void Heap_Rekey(struct heap *heap, size_t pos, float key);
+
+/* Returns NULL if the heap is empty */
+void *Heap_Lowest(const struct heap *heap, float *key);
+
+#endif
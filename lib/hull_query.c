@@ -0,0 +1,133 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include <math.h>
+#include <string.h>
+
+#include "hull_query.h"
+#include "log.h"
+#include "parallel.h"
+#include "simd.h"
+
+#define RAY_CHUNK 64
+
+struct hull_query {
+  float *nx; /* Planes are Dot((nx, ny, nz), x) = d */
+  float *ny;
+  float *nz;
+  float *d;
+  size_t num;
+};
+
+struct ray_batch {
+  const struct hull_query *hq;
+  float *dist;
+  const float *pts;
+  const float *dirs;
+  size_t num;
+};
+
+struct hull_query *HullQuery_New(const struct vef *hull) {
+  struct hull_query *hq;
+  size_t num = hull->num_faces, count;
+  
+  if ((hq = malloc(sizeof(*hq))) == NULL) {
+    Log_Error("Error: Could not allocate memory for hull query\n");
+    goto err;
+  }
+  memset(hq, 0, sizeof(*hq));
+  
+  if ((hq->nx = malloc((4 * num + 1) * sizeof(*hq->nx))) == NULL) {
+    Log_Error("Error: Could not allocate memory for hull planes\n");
+    goto err2;
+  }
+  hq->ny  = hq->nx + num;
+  hq->nz  = hq->ny + num;
+  hq->d   = hq->nz + num;
+  hq->num = num;
+  
+  for (count = 0; count < num; count++) {
+    hq->nx[count] = hull->faces[count].norm[0];
+    hq->ny[count] = hull->faces[count].norm[1];
+    hq->nz[count] = hull->faces[count].norm[2];
+    hq->d[count]  = hull->faces[count].dist;
+  }
+  
+  return hq;
+  
+ err2:
+  free(hq);
+ err:
+  return NULL;
+}
+
+void HullQuery_Free(struct hull_query *hq) {
+  if (hq == NULL)
+    return;
+  
+  free(hq->nx);
+  free(hq);
+}
+
+float HullQuery_RayDist(const struct hull_query *hq, const float *pt, const float *dir) {
+  return Simd_RayExit(hq->nx, hq->ny, hq->nz, hq->d, hq->num, pt, dir);
+}
+
+static int HullQuery_RayChunk(void *user, size_t chunk, size_t thread) {
+  struct ray_batch *batch = (struct ray_batch *) user;
+  size_t idx, end;
+  
+  idx = chunk * RAY_CHUNK;
+  end = idx + RAY_CHUNK < batch->num ? idx + RAY_CHUNK : batch->num;
+  for (; idx < end; idx++)
+    batch->dist[idx] = HullQuery_RayDist(batch->hq, batch->pts + 3 * idx, batch->dirs + 3 * idx);
+  
+  return 0;
+}
+
+int HullQuery_RayDists(const struct hull_query *hq, float *dist, const float *pts, const float *dirs, size_t num) {
+  struct ray_batch batch;
+  
+  batch.hq   = hq;
+  batch.dist = dist;
+  batch.pts  = pts;
+  batch.dirs = dirs;
+  batch.num  = num;
+  
+  return Parallel_For((num + RAY_CHUNK - 1) / RAY_CHUNK, HullQuery_RayChunk, &batch);
+}
+
+float HullQuery_InteriorDist(const struct hull_query *hq, const float *pt) {
+  return Simd_PlaneMin(hq->nx, hq->ny, hq->nz, hq->d, hq->num, pt);
+}
@@ -0,0 +1,54 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef LP_HULL_QUERY_H
+#define LP_HULL_QUERY_H
+
+#include "vef.h"
+
+/* Convex hull stored as arrays of face planes, so queries are a single
+ * pass over all planes instead of a walk across faces */
+struct hull_query;
+
+/* hull must be convex and closed */
+struct hull_query *HullQuery_New(const struct vef *hull);
+void HullQuery_Free(struct hull_query *hq);
+
+/* Distance along dir from an interior point to where the ray leaves the
+ * hull, in units of dir.  INFINITY if it never leaves. */
+float HullQuery_RayDist(const struct hull_query *hq, const float *pt, const float *dir);
+
+/* dist[i] = HullQuery_RayDist(hq, &pts[3 * i], &dirs[3 * i]), in parallel */
+int HullQuery_RayDists(const struct hull_query *hq, float *dist, const float *pts, const float *dirs, size_t num);
+
+/* Distance from an interior point to the surface, negative outside */
+float HullQuery_InteriorDist(const struct hull_query *hq, const float *pt);
+
+#endif
@@ -41,7 +41,30 @@
 #include <string.h>
 
 #include "libpolyhedra.h"
+
+#include "log.h"
 #include "util.h"
+#include "vertex_list.h"
+
+static const unsigned char ico_faces[20][3] = {
+  {0, 11, 5}, {0, 5, 1}, {0, 1, 7}, {0, 7, 10}, {0, 10, 11},
+  {1, 5, 9}, {5, 11, 4}, {11, 10, 2}, {10, 7, 6}, {7, 1, 8},
+  {3, 9, 4}, {3, 4, 2}, {3, 2, 6}, {3, 6, 8}, {3, 8, 9},
+  {4, 9, 5}, {2, 4, 11}, {6, 2, 10}, {8, 6, 7}, {9, 8, 1}
+};
+
+/* Midpoints already added for the current level, keyed by edge */
+struct edge_mid {
+  lp_index_t aa, bb, mid;
+};
+
+struct mid_table {
+  struct edge_mid *slot;
+  size_t mask;
+  float *vert;
+  lp_index_t num_vert;
+  float radius;
+};
 
 static void FindMid(float *mid, float *aa, float *bb, float radius) {
   mid[0] = aa[0] + bb[0];
@@ -54,51 +77,60 @@ static void FindMid(float *mid, float *aa, float *bb, float radius) {
   mid[2] *= radius;
 }
 
-static int AddTri(struct lp_vertex_list *vl, float *v1, float *v2, float *v3) {
-  if (LP_VertexList_Add(vl, v1) == UINT_MAX)
-    return -1;
-  if (LP_VertexList_Add(vl, v2) == UINT_MAX)
-    return -1;
-  if (LP_VertexList_Add(vl, v3) == UINT_MAX)
-    return -1;
+static lp_index_t MidPoint(struct mid_table *tab, lp_index_t aa, lp_index_t bb) {
+  struct edge_mid *em;
+  lp_index_t tmp;
+  uint64_t hash;
+  size_t idx;
+  
+  if (aa > bb) {
+    tmp = aa;
+    aa = bb;
+    bb = tmp;
+  }
   
-  return 0;
+  hash = (uint64_t) aa * 0x9e3779b97f4a7c15ULL ^ (uint64_t) bb * 0xc2b2ae3d27d4eb4fULL;
+  for (idx = (size_t) (hash ^ (hash >> 32)) & tab->mask; ; idx = (idx + 1) & tab->mask) {
+    em = &tab->slot[idx];
+    if (em->mid == LP_INDEX_MAX)
+      break;
+    if (em->aa == aa && em->bb == bb)
+      return em->mid;
+  }
+  
+  em->aa = aa;
+  em->bb = bb;
+  em->mid = tab->num_vert++;
+  FindMid(tab->vert + 3 * em->mid, tab->vert + 3 * aa, tab->vert + 3 * bb, tab->radius);
+  return em->mid;
 }
 
-static struct lp_vertex_list *SubDivide(const struct lp_vertex_list *in, float radius) {
-  struct lp_vertex_list *out;
-  size_t num_vert, count;
-  float *v1, *v2, *v3, aa[3], bb[3], cc[3];
+static void SubDivide(struct mid_table *tab, const lp_index_t *in, size_t num_tri, lp_index_t *out) {
+  lp_index_t v1, v2, v3, aa, bb, cc;
+  size_t count;
   
-  if ((out = LP_VertexList_New(3, lp_pt_triangle)) == NULL)
-    goto err;
-  
-  num_vert = LP_VertexList_NumInd(in);
-  for (count = 0; count < num_vert; count += 3) {
-    v1 = LP_VertexList_LookupVert(in, count);
-    v2 = LP_VertexList_LookupVert(in, count + 1);
-    v3 = LP_VertexList_LookupVert(in, count + 2);
+  for (count = 0; count < num_tri; count++, in += 3, out += 12) {
+    v1 = in[0];
+    v2 = in[1];
+    v3 = in[2];
     
-    FindMid(aa, v1, v2, radius);
-    FindMid(bb, v1, v3, radius);
-    FindMid(cc, v2, v3, radius);
+    aa = MidPoint(tab, v1, v2);
+    bb = MidPoint(tab, v1, v3);
+    cc = MidPoint(tab, v2, v3);
     
-    if (AddTri(out, v1, aa, bb) < 0)
-      goto err2;
-    if (AddTri(out, v2, cc, aa) < 0)
-      goto err2;
-    if (AddTri(out, v3, bb, cc) < 0)
-      goto err2;
-    if (AddTri(out, aa, cc, bb) < 0)
-      goto err2;
+    out[0] = v1;
+    out[1] = aa;
+    out[2] = bb;
+    out[3] = v2;
+    out[4] = cc;
+    out[5] = aa;
+    out[6] = v3;
+    out[7] = bb;
+    out[8] = cc;
+    out[9] = aa;
+    out[10] = cc;
+    out[11] = bb;
   }
-  
-  return out;
-
- err2:
-  LP_VertexList_Free(out);
- err:
-  return NULL;
 }
 
 #define ADD_PT(xx, yy, zz)	\
@@ -108,15 +140,9 @@ static struct lp_vertex_list *SubDivide(const struct lp_vertex_list *in, float r
     *cur++ = (zz);		\
   } while (0)
 
-#define ADD_TRI(aa, bb, cc)						\
-  do {									\
-    if (AddTri(out, vv + 3 * (aa), vv + 3 * (bb), vv + 3 * (cc)) < 0)	\
-      goto err2;							\
-  } while (0)
-
-static struct lp_vertex_list *MakeIcohedron(float radius) {
-  struct lp_vertex_list *out;
-  float s, t, scale, vv[36], *cur;
+static void MakeIcohedron(float *vv, lp_index_t *ind, float radius) {
+  float s, t, scale, *cur;
+  size_t count;
   
   t = (1.0f + sqrtf(5.0f)) / 2.0f;
   scale = radius / sqrtf(1 + t * t);
@@ -140,60 +166,68 @@ static struct lp_vertex_list *MakeIcohedron(float radius) {
   ADD_PT(-t,  0, -s);
   ADD_PT(-t,  0,  s);
   
-  if ((out = LP_VertexList_New(3, lp_pt_triangle)) == NULL)
-    goto err;
-  
   /* Faces */
-  ADD_TRI(0, 11, 5);
-  ADD_TRI(0, 5, 1);
-  ADD_TRI(0, 1, 7);
-  ADD_TRI(0, 7, 10);
-  ADD_TRI(0, 10, 11);
-  
-  ADD_TRI(1, 5, 9);
-  ADD_TRI(5, 11, 4);
-  ADD_TRI(11, 10, 2);
-  ADD_TRI(10, 7, 6);
-  ADD_TRI(7, 1, 8);
-
-  ADD_TRI(3, 9, 4);
-  ADD_TRI(3, 4, 2);
-  ADD_TRI(3, 2, 6);
-  ADD_TRI(3, 6, 8);
-  ADD_TRI(3, 8, 9);
-
-  ADD_TRI(4, 9, 5);
-  ADD_TRI(2, 4, 11);
-  ADD_TRI(6, 2, 10);
-  ADD_TRI(8, 6, 7);
-  ADD_TRI(9, 8, 1);
-
-  return out;
-
- err2:
-  LP_VertexList_Free(out);
- err:
-  return NULL;
+  for (count = 0; count < 60; count++)
+    ind[count] = ico_faces[count / 3][count % 3];
 }
 
+/* Every level has four times the faces and adds one vertex per edge, so the
+ * counts are known up front and the faces ping-pong between two buffers that
+ * end with the last level in the list itself. */
 struct lp_vertex_list *LP_IcoSphere(float radius, int num_subdiv) {
-  struct lp_vertex_list *cur, *next;
+  struct lp_vertex_list *out;
+  struct mid_table tab;
+  lp_index_t *ind, *buf = NULL, *cur, *next;
+  size_t num_tri, level_tri, slots;
   int count;
   
-  if ((cur = MakeIcohedron(radius)) == NULL)
+  if (num_subdiv < 0)
+    num_subdiv = 0;
+  
+  for (count = 0, num_tri = 20; count < num_subdiv; count++, num_tri *= 4) {
+    if (num_tri > (LP_INDEX_MAX - 2) / 2 || num_tri > SIZE_MAX / (12 * sizeof(lp_index_t))) {
+      Log_Error("Error: Too many subdivisions for an icosphere: %d\n", num_subdiv);
+      goto err;
+    }
+  }
+  
+  memset(&tab, 0, sizeof(tab));
+  if ((out = VertexList_NewMesh((lp_index_t) (num_tri / 2 + 2), 3 * num_tri, &tab.vert, &ind)) == NULL)
     goto err;
   
-  for (count = 0; count < num_subdiv; count++) {
-    if ((next = SubDivide(cur, radius)) == NULL)
+  if (num_subdiv > 0) {
+    for (slots = 1; slots < 3 * num_tri / 4; slots <<= 1)
+      ;
+    if ((buf = malloc(3 * num_tri / 4 * sizeof(*buf))) == NULL ||
+	(tab.slot = malloc(slots * sizeof(*tab.slot))) == NULL) {
+      Log_Perror("Error: Could not allocate icosphere");
       goto err2;
-    LP_VertexList_Free(cur);
+    }
+  }
+  
+  cur = num_subdiv % 2 ? buf : ind;
+  MakeIcohedron(tab.vert, cur, radius);
+  tab.num_vert = 12;
+  tab.radius = radius;
+  
+  for (count = 0, level_tri = 20; count < num_subdiv; count++, level_tri *= 4) {
+    for (slots = 1; slots < 3 * level_tri; slots <<= 1)
+      ;
+    memset(tab.slot, 0xff, slots * sizeof(*tab.slot));
+    tab.mask = slots - 1;
+    
+    next = cur == ind ? buf : ind;
+    SubDivide(&tab, cur, level_tri, next);
     cur = next;
   }
   
-  return cur;
+  free(tab.slot);
+  free(buf);
+  return out;
   
  err2:
-  LP_VertexList_Free(cur);
+  free(buf);
+  LP_VertexList_Free(out);
  err:
   return NULL;
 }
@@ -0,0 +1,147 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+
+#include "libpolyhedra.h"
+#include "log.h"
+
+#define LOG_BUF_SIZE 512
+
+static void DefaultLog(void *user, enum lp_log_level level, const char *msg);
+
+static lp_log_func_t log_func = DefaultLog;
+static void *log_user;
+static enum lp_log_level log_level = lp_log_error;
+
+static void DefaultLog(void *user, enum lp_log_level level, const char *msg) {
+  fprintf(stderr, "%s\n", msg);
+}
+
+void LP_SetLogCallback(lp_log_func_t func, void *user) {
+  log_func = func ? func : DefaultLog;
+  log_user = func ? user : NULL;
+}
+
+void LP_SetLogLevel(enum lp_log_level level) {
+  log_level = level;
+}
+
+enum lp_log_level LP_GetLogLevel(void) {
+  return log_level;
+}
+
+static void Log(enum lp_log_level level, const char *fmt, va_list ap) {
+  char buf[LOG_BUF_SIZE], *msg = buf;
+  va_list copy;
+  int len;
+  
+  va_copy(copy, ap);
+  if ((len = vsnprintf(buf, sizeof(buf), fmt, ap)) < 0)
+    goto err;
+  
+  if ((size_t) len >= sizeof(buf)) {
+    if ((msg = malloc(len + 1)) == NULL)
+      msg = buf;
+    else
+      vsnprintf(msg, len + 1, fmt, copy);
+    len = strlen(msg);
+  }
+  
+  if (len > 0 && msg[len - 1] == '\n')
+    msg[len - 1] = '\0';
+  
+  log_func(log_user, level, msg);
+  
+  if (msg != buf)
+    free(msg);
+  
+ err:
+  va_end(copy);
+}
+
+void Log_Error(const char *fmt, ...) {
+  va_list ap;
+  
+  if (log_level < lp_log_error)
+    return;
+  
+  va_start(ap, fmt);
+  Log(lp_log_error, fmt, ap);
+  va_end(ap);
+}
+
+void Log_Warning(const char *fmt, ...) {
+  va_list ap;
+  
+  if (log_level < lp_log_warning)
+    return;
+  
+  va_start(ap, fmt);
+  Log(lp_log_warning, fmt, ap);
+  va_end(ap);
+}
+
+void Log_Info(const char *fmt, ...) {
+  va_list ap;
+  
+  if (log_level < lp_log_info)
+    return;
+  
+  va_start(ap, fmt);
+  Log(lp_log_info, fmt, ap);
+  va_end(ap);
+}
+
+void Log_Debug(const char *fmt, ...) {
+  va_list ap;
+  
+  if (log_level < lp_log_debug)
+    return;
+  
+  va_start(ap, fmt);
+  Log(lp_log_debug, fmt, ap);
+  va_end(ap);
+}
+
+void Log_Perror(const char *msg) {
+  int err = errno;
+  
+  Log_Error("%s: %s", msg, strerror(err));
+}
@@ -0,0 +1,313 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_PTHREADS
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#endif
+
+#include "libpolyhedra.h"
+
+#include "log.h"
+#include "parallel.h"
+
+#define PRESENT ((void *) 1)
+
+static size_t num_threads = 1;
+
+void LP_SetNumThreads(size_t threads) {
+#if defined(HAVE_UNISTD_H) && defined(_SC_NPROCESSORS_ONLN)
+  long online;
+  
+  if (threads == 0 && (online = sysconf(_SC_NPROCESSORS_ONLN)) > 0)
+    threads = online;
+#endif
+  
+  num_threads = threads > 0 ? threads : 1;
+}
+
+size_t LP_GetNumThreads(void) {
+  return num_threads;
+}
+
+#ifdef HAVE_PTHREADS
+/* Each worker starts with an even share of the indices and runs them from
+ * the front.  When it runs out it steals the back half of the largest
+ * remaining range. */
+struct range {
+  pthread_mutex_t mutex;
+  size_t next;
+  size_t end;
+};
+
+struct parallel {
+  pthread_mutex_t mutex;
+  parallel_func_t func;
+  void *user;
+  struct range *ranges;
+  size_t num_workers;
+  int err;
+};
+
+struct worker {
+  struct parallel *par;
+  size_t thread;
+};
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_key_t in_worker;
+static int have_key;
+
+static void MakeKey(void) {
+  have_key = pthread_key_create(&in_worker, NULL) == 0;
+}
+
+static int Steal(struct parallel *par, size_t thread) {
+  struct range *range, *victim = NULL;
+  size_t count, left, most = 0, mid;
+  int err;
+  
+  pthread_mutex_lock(&par->mutex);
+  err = par->err;
+  pthread_mutex_unlock(&par->mutex);
+  if (err)
+    return 0;
+  
+  for (count = 1; count < par->num_workers; count++) {
+    range = &par->ranges[(thread + count) % par->num_workers];
+    pthread_mutex_lock(&range->mutex);
+    left = range->end - range->next;
+    pthread_mutex_unlock(&range->mutex);
+    if (left > most) {
+      most = left;
+      victim = range;
+    }
+  }
+  
+  if (victim == NULL)
+    return 0;
+  
+  /* Lock in address order so two thieves can't deadlock.  The victim may
+   * have moved on since it was picked. */
+  range = &par->ranges[thread];
+  pthread_mutex_lock(&(range < victim ? range : victim)->mutex);
+  pthread_mutex_lock(&(range < victim ? victim : range)->mutex);
+  left = victim->end - victim->next;
+  mid = victim->end - left / 2 - left % 2;
+  range->next = mid;
+  range->end = victim->end;
+  victim->end = mid;
+  pthread_mutex_unlock(&victim->mutex);
+  pthread_mutex_unlock(&range->mutex);
+  
+  return 1;
+}
+
+/* Stops every worker after their current call */
+static void Abort(struct parallel *par) {
+  struct range *range;
+  size_t count;
+  
+  pthread_mutex_lock(&par->mutex);
+  par->err = 1;
+  pthread_mutex_unlock(&par->mutex);
+  
+  for (count = 0; count < par->num_workers; count++) {
+    range = &par->ranges[count];
+    pthread_mutex_lock(&range->mutex);
+    range->end = range->next;
+    pthread_mutex_unlock(&range->mutex);
+  }
+}
+
+static void Work(struct parallel *par, size_t thread) {
+  struct range *range = &par->ranges[thread];
+  size_t idx;
+  
+  while (1) {
+    pthread_mutex_lock(&range->mutex);
+    if (range->next >= range->end) {
+      pthread_mutex_unlock(&range->mutex);
+      if (Steal(par, thread))
+	continue;
+      return;
+    }
+    idx = range->next++;
+    pthread_mutex_unlock(&range->mutex);
+    
+    if (par->func(par->user, idx, thread) < 0)
+      Abort(par);
+  }
+}
+
+static void *Worker(void *arg) {
+  struct worker *worker = (struct worker *) arg;
+  
+  pthread_setspecific(in_worker, PRESENT);
+  Work(worker->par, worker->thread);
+  
+  return NULL;
+}
+#endif
+
+size_t Parallel_NumThreads(void) {
+#ifdef HAVE_PTHREADS
+  return num_threads;
+#else
+  return 1;
+#endif
+}
+
+size_t Parallel_Available(void) {
+#ifdef HAVE_PTHREADS
+  pthread_once(&once, MakeKey);
+  if (!have_key || pthread_getspecific(in_worker))
+    return 1;
+  return num_threads;
+#else
+  return 1;
+#endif
+}
+
+static int Serial_For(size_t num, parallel_func_t func, void *user) {
+  size_t idx;
+  
+  for (idx = 0; idx < num; idx++)
+    if (func(user, idx, 0) < 0)
+      return -1;
+  
+  return 0;
+}
+
+int Parallel_For(size_t num, parallel_func_t func, void *user) {
+  return Parallel_ForThreads(num, num_threads, func, user);
+}
+
+int Parallel_ForThreads(size_t num, size_t threads_wanted, parallel_func_t func, void *user) {
+#ifdef HAVE_PTHREADS
+  struct parallel par;
+  struct worker *workers;
+  struct range *ranges;
+  pthread_t *threads;
+  size_t count, num_started, num_workers, num_ranges;
+  
+  num_workers = threads_wanted < num ? threads_wanted : num;
+  if (num_workers <= 1)
+    return Serial_For(num, func, user);
+  
+  pthread_once(&once, MakeKey);
+  if (!have_key || pthread_getspecific(in_worker))
+    return Serial_For(num, func, user);
+  
+  if ((threads = malloc(num_workers * sizeof(*threads))) == NULL) {
+    Log_Error("Error: Could not allocate memory for threads\n");
+    goto err;
+  }
+  if ((workers = malloc(num_workers * sizeof(*workers))) == NULL) {
+    Log_Error("Error: Could not allocate memory for workers\n");
+    goto err2;
+  }
+  if ((ranges = malloc(num_workers * sizeof(*ranges))) == NULL) {
+    Log_Error("Error: Could not allocate memory for work ranges\n");
+    goto err3;
+  }
+  
+  memset(&par, 0, sizeof(par));
+  if (pthread_mutex_init(&par.mutex, NULL) != 0) {
+    Log_Error("Error: Could not initialize mutex\n");
+    goto err4;
+  }
+  for (num_ranges = 0; num_ranges < num_workers; num_ranges++) {
+    if (pthread_mutex_init(&ranges[num_ranges].mutex, NULL) != 0) {
+      Log_Error("Error: Could not initialize mutex\n");
+      goto err5;
+    }
+    ranges[num_ranges].next = num * num_ranges / num_workers;
+    ranges[num_ranges].end  = num * (num_ranges + 1) / num_workers;
+  }
+  par.func = func;
+  par.user = user;
+  par.ranges = ranges;
+  par.num_workers = num_workers;
+  
+  /* Current thread is worker 0 */
+  pthread_setspecific(in_worker, PRESENT);
+  for (num_started = 1; num_started < num_workers; num_started++) {
+    workers[num_started].par    = &par;
+    workers[num_started].thread = num_started;
+    if (pthread_create(&threads[num_started], NULL, Worker, &workers[num_started]) != 0)
+      break;
+  }
+  
+  /* Work assigned to threads that failed to start gets stolen */
+  Work(&par, 0);
+  for (count = 1; count < num_started; count++)
+    pthread_join(threads[count], NULL);
+  pthread_setspecific(in_worker, NULL);
+  
+  for (count = 0; count < num_ranges; count++)
+    pthread_mutex_destroy(&ranges[count].mutex);
+  pthread_mutex_destroy(&par.mutex);
+  free(ranges);
+  free(workers);
+  free(threads);
+  return par.err ? -1 : 0;
+  
+ err5:
+  for (count = 0; count < num_ranges; count++)
+    pthread_mutex_destroy(&ranges[count].mutex);
+  pthread_mutex_destroy(&par.mutex);
+ err4:
+  free(ranges);
+ err3:
+  free(workers);
+ err2:
+  free(threads);
+ err:
+  return -1;
+#else
+  return Serial_For(num, func, user);
+#endif
+}
@@ -0,0 +1,51 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+ 
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+ 
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+ 
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+ 
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef LP_PARALLEL_H
+#define LP_PARALLEL_H
+
+/* Called once for every idx in [0, num).  thread is in [0, Parallel_NumThreads())
+ * and is unique among the calls running at the same time.  Return < 0 to stop. */
+typedef int (*parallel_func_t)(void *user, size_t idx, size_t thread);
+
+size_t Parallel_NumThreads(void);
+
+/* Number of threads a Parallel_For started from here would use, 1 inside
+ * another Parallel_For */
+size_t Parallel_Available(void);
+
+/* Returns -1 if any call to func failed.  Runs serially when called from
+ * inside another Parallel_For. */
+int Parallel_For(size_t num, parallel_func_t func, void *user);
+
+/* Same, with up to threads workers instead of LP_GetNumThreads() */
+int Parallel_ForThreads(size_t num, size_t threads, parallel_func_t func, void *user);
+
+#endif
@@ -0,0 +1,144 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include <limits.h>
+
+#include "parse.h"
+
+#define MAX_DIGITS 19
+#define MAX_EXP    300
+
+static const double pow10[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+  1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+  1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define MAX_POW10 22
+
+const char *Parse_Double(const char *str, const char *end, double *out) {
+  uint64_t mant = 0;
+  int neg = 0, exp_neg = 0, digits = 0, any = 0;
+  long exp = 0, exp_part = 0;
+  double val;
+  
+  if (str < end && (*str == '-' || *str == '+'))
+    neg = *str++ == '-';
+  
+  for (; str < end && *str >= '0' && *str <= '9'; str++) {
+    any = 1;
+    if (digits < MAX_DIGITS) {
+      mant = mant * 10 + (*str - '0');
+      if (mant)
+	digits++;
+    } else {
+      exp++;
+    }
+  }
+  
+  if (str < end && *str == '.') {
+    for (str++; str < end && *str >= '0' && *str <= '9'; str++) {
+      any = 1;
+      if (digits < MAX_DIGITS) {
+	mant = mant * 10 + (*str - '0');
+	if (mant)
+	  digits++;
+	exp--;
+      }
+    }
+  }
+  
+  if (!any)
+    return NULL;
+  
+  if (str < end && (*str == 'e' || *str == 'E')) {
+    str++;
+    if (str < end && (*str == '-' || *str == '+'))
+      exp_neg = *str++ == '-';
+    
+    if (str >= end || *str < '0' || *str > '9')
+      return NULL;
+    
+    for (; str < end && *str >= '0' && *str <= '9'; str++)
+      if (exp_part < 10 * MAX_EXP)
+	exp_part = exp_part * 10 + (*str - '0');
+    
+    exp += exp_neg ? -exp_part : exp_part;
+  }
+  
+  if (mant == 0) {
+    *out = neg ? -0.0 : 0.0;
+    return str;
+  }
+  
+  if (exp < -MAX_EXP || exp > MAX_EXP)
+    return NULL;
+  
+  /* Exact when the mantissa and power of ten are both exact doubles, 
+   * otherwise within a few ulp, which is far below float precision */
+  val = (double) mant;
+  for (; exp > MAX_POW10; exp -= MAX_POW10)
+    val *= pow10[MAX_POW10];
+  for (; exp < -MAX_POW10; exp += MAX_POW10)
+    val /= pow10[MAX_POW10];
+  
+  if (exp >= 0)
+    val *= pow10[exp];
+  else
+    val /= pow10[-exp];
+  
+  *out = neg ? -val : val;
+  return str;
+}
+
+const char *Parse_Unsigned(const char *str, const char *end, unsigned int *out) {
+  const char *start = str;
+  unsigned long long val = 0;
+  
+  for (; str < end && *str >= '0' && *str <= '9'; str++) {
+    val = val * 10 + (*str - '0');
+    if (val > UINT_MAX)
+      return NULL;
+  }
+  
+  if (str == start)
+    return NULL;
+  
+  *out = val;
+  return str;
+}
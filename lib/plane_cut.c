@@ -38,660 +38,870 @@
 
 #include "libpolyhedra.h"
 
-#include "hash.h"
-#include "queue.h"
-#include "SipHash/siphash.h"
+#include "log.h"
 #include "util.h"
 
-#define PRESENT ((void *) 1)
+/* Cuts work on flat arrays of point ids.  The input vertices are welded by
+ * position, every point gets a code (2 k inside slab k, 2 j + 1 on plane j)
+ * and the outline of each triangle, with its plane crossings inserted, is
+ * clipped to every slab it touches.  Piece sides on a plane outline the
+ * caps, which are triangulated in 2d at the end. */
+
+#define EMPTY_KEY UINT64_MAX
+#define MIX_K     UINT64_C(0x9e3779b97f4a7c15)
 
 struct plane {
   float norm[3];
   float x_axis[3];
   float y_axis[3];
-  float dist;
 };
 
-struct face;
-
-struct vert {
-  float point[3];
-  struct hash *edges;
-  float dist;
+/* Open addressing from an ordered pair of point ids to a value */
+struct edge_table {
+  uint64_t *keys;
+  unsigned *vals;
+  size_t size;
+  size_t num;
+  int shift;
 };
 
-struct edge {
-  struct vert *vert[2];
-  struct face *face[2];
-  float inter[3];
-  int inter_vld;
+struct tri_buf {
+  unsigned *ind;
+  size_t num;
+  size_t alloc;
 };
 
-struct face {
-  struct vert *vert[3];
-  struct edge *edge[3];
-  int visited;
+struct seg {
+  unsigned pt[2];
+  unsigned cap;  /* 2 k is the lower cap of slab k, 2 k + 1 the upper one */
+  unsigned odd;  /* Outlines the cap if an odd number of pieces share it */
 };
 
-struct shape {
-  struct hash *verts;
-  struct hash *edges;
-  struct hash *faces;
-  struct hash *pt2d;
-  struct hash *edge2d;
-  struct lp_vertex_list *poly2d;
+struct cut {
+  struct plane plane;
+  const float *dists;
+  size_t num_planes;
+  size_t num_slabs;
+  
+  float *pts;       /* 3 per point, welded input vertices then crossings */
+  unsigned *code;
+  size_t num_pts;
+  size_t alloc_pts;
+  
+  struct edge_table cross; /* Edge to its crossing of the lowest plane it crosses */
+  struct edge_table seg_idx;
+  struct seg *segs;
+  size_t num_segs;
+  size_t alloc_segs;
+  
+  unsigned *bound; /* Outline of the current triangle */
+  unsigned *piece;
+  struct tri_buf *tris; /* One per slab */
 };
 
-static struct vert *Vert_New(const float *point, const struct plane *plane, struct shape *shape) {
-  struct vert *vert;
-  float tol;
-  
-  if ((vert = Hash_Lookup(shape->verts, point, NULL)))
-    return vert;
-  
-  if ((vert = malloc(sizeof(*vert))) == NULL) {
-    fprintf(stderr, "Could not allocate vertex for plane cut");
-    goto err;
+static int EdgeTable_Init(struct edge_table *et, size_t num) {
+  et->size = 16;
+  et->shift = 60;
+  while (et->size < 2 * num) {
+    et->size <<= 1;
+    et->shift--;
   }
-  memset(vert, 0, sizeof(*vert));
+  et->num = 0;
   
-  vert->point[0] = point[0];
-  vert->point[1] = point[1];
-  vert->point[2] = point[2];
-
-  if (plane) {
-    tol = Norm(point);
-    if (fabsf(plane->dist) > tol)
-      tol = fabsf(plane->dist);
-    tol *= 1e-5;
-    
-    vert->dist = Dot(point, plane->norm) - plane->dist;
-    if (fabsf(vert->dist) < tol)
-      vert->dist = 0;
+  if ((et->keys = malloc(et->size * (sizeof(*et->keys) + sizeof(*et->vals)))) == NULL) {
+    Log_Error("Error: Could not allocate memory for edge table\n");
+    return -1;
   }
+  et->vals = (unsigned *) (et->keys + et->size);
+  memset(et->keys, 0xff, et->size * sizeof(*et->keys));
   
-  if ((vert->edges = Hash_NewPtr(NULL, NULL, NULL, NULL, NULL)) == NULL)
-    goto err2;
-  
-  if (Hash_Insert(shape->verts, point, vert, NULL) < 0)
-    goto err3;
-
-  return vert;
-
- err3:
-  Hash_Free(vert->edges);
- err2:
-  free(vert);
- err:
-  fprintf(stderr, "Error: Could not create vertex\n");
-  return NULL;
+  return 0;
 }
 
-static void Vert_Free(struct vert *vert) {
-  if (vert == NULL)
-    return;
+static void EdgeTable_Free(struct edge_table *et) {
+  free(et->keys);
+  et->keys = NULL;
+}
 
-  Hash_Free(vert->edges);
-  free(vert);
+static size_t EdgeTable_Slot(const struct edge_table *et, uint64_t key) {
+  size_t slot = (size_t) ((key * MIX_K) >> et->shift);
+  
+  while (et->keys[slot] != EMPTY_KEY && et->keys[slot] != key)
+    slot = (slot + 1) & (et->size - 1);
+  
+  return slot;
 }
 
-static void Vert_Free_Func(void *user, void *data) {
-  Vert_Free((struct vert *) data);
+static int EdgeTable_Grow(struct edge_table *et) {
+  struct edge_table old = *et;
+  size_t count, slot;
+  
+  if (EdgeTable_Init(et, old.size) < 0) {
+    *et = old;
+    return -1;
+  }
+  for (count = 0; count < old.size; count++) {
+    if (old.keys[count] == EMPTY_KEY)
+      continue;
+    slot = EdgeTable_Slot(et, old.keys[count]);
+    et->keys[slot] = old.keys[count];
+    et->vals[slot] = old.vals[count];
+  }
+  et->num = old.num;
+  EdgeTable_Free(&old);
+  
+  return 0;
 }
 
-static struct edge *Edge_New(struct vert *v1, struct vert *v2, const struct plane *plane, struct shape *shape) {
-  struct edge *edge;
-  float x, y;
+/* Returns the value slot of (a, b), adding it if *found is cleared */
+static unsigned *EdgeTable_Find(struct edge_table *et, unsigned a, unsigned b, int *found) {
+  uint64_t key = ((uint64_t) a << 32) | b;
+  size_t slot;
   
-  if ((edge = Hash_Lookup(v1->edges, v2, NULL)))
-    return edge;
+  slot = EdgeTable_Slot(et, key);
+  if ((*found = (et->keys[slot] == key)))
+    return &et->vals[slot];
   
-  if ((edge = malloc(sizeof(*edge))) == NULL) {
-    perror("Could not allocate edge for plane cut");
-    goto err;
+  if (2 * (et->num + 1) > et->size) {
+    if (EdgeTable_Grow(et) < 0)
+      return NULL;
+    slot = EdgeTable_Slot(et, key);
   }
-  memset(edge, 0, sizeof(*edge));
+  et->keys[slot] = key;
+  et->num++;
   
-  edge->vert[0] = v1;
-  edge->vert[1] = v2;
+  return &et->vals[slot];
+}
+
+static int Tri_Add(struct tri_buf *tb, unsigned a, unsigned b, unsigned c) {
+  size_t new_alloc;
+  unsigned *new_ind;
   
-  if (Hash_Insert(v1->edges, v2, edge, NULL) < 0)
-    goto err2;
-  if (Hash_Insert(v2->edges, v1, edge, NULL) < 0)
-    goto err2;
+  if (tb->num + 3 > tb->alloc) {
+    new_alloc = tb->alloc ? 2 * tb->alloc : 48;
+    if ((new_ind = realloc(tb->ind, new_alloc * sizeof(*new_ind))) == NULL) {
+      Log_Error("Error: Could not allocate memory for cut faces\n");
+      return -1;
+    }
+    tb->ind = new_ind;
+    tb->alloc = new_alloc;
+  }
   
-  if (plane &&
-      ((v1->dist > 0 && v2->dist < 0) ||
-       (v1->dist < 0 && v2->dist > 0))) {
-    /* Intersects plane */
-    x = -v1->dist / (v2->dist - v1->dist);
-    y = 1 - x;
-    edge->inter[0] = y * v1->point[0] + x * v2->point[0];
-    edge->inter[1] = y * v1->point[1] + x * v2->point[1];
-    edge->inter[2] = y * v1->point[2] + x * v2->point[2];
-    edge->inter_vld = 1;
+  tb->ind[tb->num++] = a;
+  tb->ind[tb->num++] = b;
+  tb->ind[tb->num++] = c;
+  
+  return 0;
+}
+
+static unsigned Cut_AddPoint(struct cut *cut, const float *pt, unsigned code) {
+  size_t new_alloc;
+  float *new_pts;
+  unsigned *new_code;
+  
+  if (cut->num_pts >= UINT_MAX - 1) {
+    Log_Error("Error: Too many points in plane cut\n");
+    return UINT_MAX;
+  }
+  if (cut->num_pts >= cut->alloc_pts) {
+    new_alloc = 2 * cut->alloc_pts + 16;
+    if ((new_pts = realloc(cut->pts, 3 * new_alloc * sizeof(*new_pts))) == NULL)
+      goto err;
+    cut->pts = new_pts;
+    if ((new_code = realloc(cut->code, new_alloc * sizeof(*new_code))) == NULL)
+      goto err;
+    cut->code = new_code;
+    cut->alloc_pts = new_alloc;
   }
   
-  if (Hash_Insert(shape->edges, edge, PRESENT, NULL) < 0)
-    goto err2;
+  memcpy(&cut->pts[3 * cut->num_pts], pt, 3 * sizeof(*pt));
+  cut->code[cut->num_pts] = code;
   
-  return edge;
+  return cut->num_pts++;
   
- err2:
-  free(edge);
  err:
-  fprintf(stderr, "Error: Could not create edge\n");
-  return NULL;
-}
-
-static void Edge_Free_Func(void *user, void *data) {
-  free(data);
+  Log_Error("Error: Could not allocate memory for cut points\n");
+  return UINT_MAX;
 }
 
-static struct face *Face_New(float *p1, float *p2, float *p3, struct shape *shape) {
-  struct face *face;
-  struct edge *edge;
-  float *pt[3];
-  int count;
+/* Same tolerance as a cut by a single plane has always used */
+static int OnPlane(float proj, float dist, const float *pt) {
+  float tol = Norm(pt);
   
-  pt[0] = p1;
-  pt[1] = p2;
-  pt[2] = p3;
+  if (proj == dist)
+    return 1;
+  if (fabsf(dist) > tol)
+    tol = fabsf(dist);
   
-  if ((face = malloc(sizeof(*face))) == NULL) {
-    perror("Error: Could not allocate face for plane cut");
-    goto err;
-  }
-  memset(face, 0, sizeof(*face));
-
-  for (count = 0; count < 3; count++)
-    if ((face->vert[count] = Vert_New(pt[count], NULL, shape)) == NULL)
-      goto err2;
+  return fabsf(proj - dist) < 1e-5 * tol;
+}
 
-  for (count = 0; count < 3; count++) {
-    if ((edge = face->edge[count] = Edge_New(face->vert[count],
-					     face->vert[(count + 1) % 3],
-					     NULL,
-					     shape)) == NULL)
-      goto err2;
-    
-    edge->face[edge->face[0] == NULL ? 0 : 1] = face;
-  }
+static unsigned Slab_Code(const struct cut *cut, const float *pt, float proj) {
+  size_t lo = 0, hi = cut->num_planes, mid;
   
-  if (Hash_Insert(shape->faces, face, PRESENT, NULL) < 0)
-    goto err2;
+  /* First plane above proj */
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (cut->dists[mid] > proj)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
   
-  return face;
+  if (lo > 0 && OnPlane(proj, cut->dists[lo - 1], pt))
+    return 2 * (lo - 1) + 1;
+  if (lo < cut->num_planes && OnPlane(proj, cut->dists[lo], pt))
+    return 2 * lo + 1;
   
- err2:
-  free(face);
- err:
-  fprintf(stderr, "Error: Could not create face\n");
-  return NULL;
+  return 2 * lo;
 }
 
-static void Face_Free_Func(void *user, void *data) {
-  free(data);
+static uint64_t PointHash(const float *pt) {
+  uint32_t bits[3];
+  uint64_t hash;
+  
+  memcpy(bits, pt, sizeof(bits));
+  hash = (bits[0] * MIX_K) ^ bits[1];
+  hash = (hash * MIX_K) ^ bits[2];
+  
+  return hash * MIX_K;
 }
 
-static int Make_Quad(float *p1, float *p2, float *p3, float *p4, struct shape *shape) {
-  /* Split into triangles along shortest diagonal */
-  if (Dist2(p1, p3) > Dist2(p2, p4)) {
-    if (Face_New(p2, p3, p4, shape) == NULL)
-      return -1;
-    if (Face_New(p1, p2, p4, shape) == NULL)
-      return -1;
-  } else {
-    if (Face_New(p1, p3, p4, shape) == NULL)
-      return -1;
-    if (Face_New(p1, p2, p3, shape) == NULL)
+/* Fills id with the point of every input vertex, merged by position as
+ * vertices that differ only in their other floats are the same point */
+static int Cut_Weld(struct cut *cut, const struct lp_vertex_list *in, unsigned *id) {
+  const float *data = LP_VertexList_GetVert(in);
+  size_t fpv = LP_VertexList_FloatsPerVert(in), num_vert = LP_VertexList_NumVert(in);
+  size_t count, size = 16, slot;
+  unsigned *table, pt;
+  int shift = 60;
+  
+  if (fpv == 3) {
+    for (count = 0; count < num_vert; count++)
+      if ((id[count] = Cut_AddPoint(cut, &data[3 * count], 0)) == UINT_MAX)
+	return -1;
+    return 0;
+  }
+  
+  while (size < 2 * num_vert) {
+    size <<= 1;
+    shift--;
+  }
+  if ((table = malloc(size * sizeof(*table))) == NULL) {
+    Log_Error("Error: Could not allocate memory for welding vertices\n");
+    return -1;
+  }
+  memset(table, 0xff, size * sizeof(*table));
+  
+  for (count = 0; count < num_vert; count++) {
+    slot = (size_t) (PointHash(&data[fpv * count]) >> shift);
+    while ((pt = table[slot]) != UINT_MAX &&
+	   memcmp(&cut->pts[3 * pt], &data[fpv * count], 3 * sizeof(float)) != 0)
+      slot = (slot + 1) & (size - 1);
+    if (pt == UINT_MAX &&
+	(pt = table[slot] = Cut_AddPoint(cut, &data[fpv * count], 0)) == UINT_MAX) {
+      free(table);
       return -1;
+    }
+    id[count] = pt;
   }
+  free(table);
   
   return 0;
 }
 
-static int Add2dPoint(float *pt, const struct plane *plane, struct shape *shape) {
-  struct vert *v;
-  float ff[2];
+/* Crossings can round onto an input vertex or onto each other.  canon
+ * gets the first id at each position, the one the output dedup keeps. */
+static int Cut_Canon(const struct cut *cut, unsigned *canon) {
+  size_t count, size = 16, slot;
+  unsigned *table, pt;
+  int shift = 60;
   
-  if ((v = Vert_New(pt, NULL, shape)) == NULL)
+  while (size < 2 * cut->num_pts) {
+    size <<= 1;
+    shift--;
+  }
+  if ((table = malloc(size * sizeof(*table))) == NULL) {
+    Log_Error("Error: Could not allocate memory for merging cut points\n");
     return -1;
+  }
+  memset(table, 0xff, size * sizeof(*table));
+  
+  for (count = 0; count < cut->num_pts; count++) {
+    slot = (size_t) (PointHash(&cut->pts[3 * count]) >> shift);
+    while ((pt = table[slot]) != UINT_MAX &&
+	   memcmp(&cut->pts[3 * pt], &cut->pts[3 * count], 3 * sizeof(float)) != 0)
+      slot = (slot + 1) & (size - 1);
+    if (pt == UINT_MAX)
+      pt = table[slot] = (unsigned) count;
+    canon[count] = pt;
+  }
+  free(table);
   
-  ff[0] = Dot(pt, plane->x_axis);
-  ff[1] = Dot(pt, plane->y_axis);  
-  if (LP_VertexList_Add(shape->poly2d, ff) == UINT_MAX)
-    return -1;
-  if (Hash_Insert(shape->pt2d, ff, v, NULL) < 0)
-    return -1;
+  return 0;
+}
+
+/* Faces with two corners at one position would leave an edge from a
+ * vertex to itself in the output */
+static void Cut_DropCollapsed(struct tri_buf *tb, const unsigned *canon) {
+  size_t count, num = 0;
+  unsigned a, b, c;
+  
+  for (count = 0; count + 3 <= tb->num; count += 3) {
+    a = canon[tb->ind[count]];
+    b = canon[tb->ind[count + 1]];
+    c = canon[tb->ind[count + 2]];
+    if (a == b || b == c || c == a)
+      continue;
+    tb->ind[num++] = a;
+    tb->ind[num++] = b;
+    tb->ind[num++] = c;
+  }
+  tb->num = num;
+}
+
+static int PointCmp(const float *a, const float *b) {
+  int count;
+  
+  for (count = 0; count < 3; count++)
+    if (a[count] != b[count])
+      return a[count] < b[count] ? -1 : 1;
   
   return 0;
 }
 
-static int Make_Faces(float *p1, float *p2, float *p3, const struct plane *plane, struct shape **shape) {
-  struct vert *v[3];
-  struct edge *e[3], *edge;
-  struct face *face;
-  struct shape *ss;
-  float *pt[3];
-  int count, non1, non2, i1, i2;
+/* Id of the crossing of plane j by edge (a, b).  The crossings of an edge
+ * are made together and interpolated from its lower point, so they do not
+ * depend on which face asks first. */
+static unsigned Cut_Crossing(struct cut *cut, unsigned a, unsigned b, size_t j) {
+  unsigned *base, lo, hi, tmp, pt;
+  size_t jj, j_first, j_end;
+  float da, db, x, y, inter[3];
+  int found;
+  
+  if (a > b) {
+    tmp = a;
+    a = b;
+    b = tmp;
+  }
+  lo = cut->code[a] < cut->code[b] ? cut->code[a] : cut->code[b];
+  hi = cut->code[a] < cut->code[b] ? cut->code[b] : cut->code[a];
+  j_first = (lo + 1) / 2;
+  
+  if ((base = EdgeTable_Find(&cut->cross, a, b, &found)) == NULL)
+    return UINT_MAX;
+  if (found)
+    return *base + (j - j_first);
+  
+  if (PointCmp(&cut->pts[3 * a], &cut->pts[3 * b]) > 0) {
+    tmp = a;
+    a = b;
+    b = tmp;
+  }
+  j_end = hi / 2;
+  for (jj = j_first; jj < j_end; jj++) {
+    da = Dot(&cut->pts[3 * a], cut->plane.norm) - cut->dists[jj];
+    db = Dot(&cut->pts[3 * b], cut->plane.norm) - cut->dists[jj];
+    x = -da / (db - da);
+    y = 1 - x;
+    inter[0] = y * cut->pts[3 * a + 0] + x * cut->pts[3 * b + 0];
+    inter[1] = y * cut->pts[3 * a + 1] + x * cut->pts[3 * b + 1];
+    inter[2] = y * cut->pts[3 * a + 2] + x * cut->pts[3 * b + 2];
+    if ((pt = Cut_AddPoint(cut, inter, 2 * jj + 1)) == UINT_MAX)
+      return UINT_MAX;
+    if (jj == j_first)
+      *base = pt;
+  }
   
-  pt[0] = p1;
-  pt[1] = p2;
-  pt[2] = p3;
+  return *base + (j - j_first);
+}
+
+/* A piece side on a plane is keyed low id first when the piece is below
+ * the plane and high id first when it is above, so the two caps of a
+ * plane are kept apart */
+static int Cut_ToggleSeg(struct cut *cut, unsigned a, unsigned b, unsigned cap) {
+  struct seg *new_segs;
+  unsigned *idx, lo, hi;
+  size_t new_alloc;
+  int found;
+  
+  lo = a < b ? a : b;
+  hi = a < b ? b : a;
+  if (cap & 1)
+    idx = EdgeTable_Find(&cut->seg_idx, lo, hi, &found);
+  else
+    idx = EdgeTable_Find(&cut->seg_idx, hi, lo, &found);
+  if (idx == NULL)
+    return -1;
+  if (found) {
+    cut->segs[*idx].odd ^= 1;
+    return 0;
+  }
   
-  for (count = 0; count < 3; count++)
-    if ((v[count] = Vert_New(pt[count], plane, shape[2])) == NULL)
+  if (cut->num_segs >= cut->alloc_segs) {
+    new_alloc = 2 * cut->alloc_segs + 16;
+    if ((new_segs = realloc(cut->segs, new_alloc * sizeof(*new_segs))) == NULL) {
+      Log_Error("Error: Could not allocate memory for cap outlines\n");
       return -1;
+    }
+    cut->segs = new_segs;
+    cut->alloc_segs = new_alloc;
+  }
   
-  for (count = 0; count < 3; count++)
-    if ((e[count] = Edge_New(v[count], v[(count + 1) % 3], plane, shape[2])) == NULL)
-      return -1;
+  *idx = cut->num_segs;
+  cut->segs[cut->num_segs].pt[0] = a;
+  cut->segs[cut->num_segs].pt[1] = b;
+  cut->segs[cut->num_segs].cap = cap;
+  cut->segs[cut->num_segs].odd = 1;
+  cut->num_segs++;
   
-  switch (e[0]->inter_vld +
-	  e[1]->inter_vld +
-	  e[2]->inter_vld) {
-  case 0:
-    /* Doesn't intersect plane */
-    switch ((v[0]->dist == 0) +
-	    (v[1]->dist == 0) +
-	    (v[2]->dist == 0)) {
-    case 0:
-    case 1:
-      /* At most 1 point on plane */
-      if (v[0]->dist != 0)
-	non1 = 0;
-      else
-	non1 = 1;
-      
-      if (Face_New(p1, p2, p3, shape[v[non1]->dist > 0]) == NULL)
-	return -1;
-      break;
-      
-    case 2:
-      /* Two points lie on plane: exactly one edge on plane */
-      if (v[0]->dist != 0)
-	non1 = 0;
-      else if (v[1]->dist != 0)
-	non1 = 1;
-      else
-	non1 = 2;
-      
-      i1 = (non1 + 1) % 3;
-      i2 = (non1 + 2) % 3;
-      ss = shape[v[non1]->dist > 0];
-      
-      if ((face = Face_New(p1, p2, p3, ss)) == NULL)
-	return -1;
-      
-      edge = face->edge[i1];
-      if (Hash_Lookup(ss->edge2d, edge, NULL)) {
-	Hash_Remove(ss->edge2d, edge);
+  return 0;
+}
+
+static int Cut_Face(struct cut *cut, const unsigned *pt) {
+  struct tri_buf *tb;
+  size_t num_bound = 0, num_piece, count, jj, kk, k_last;
+  unsigned cmin, cmax, cc, ca, cb, *pp;
+  int aa, bb;
+  
+  for (aa = 0; aa < 3; aa++) {
+    bb = (aa + 1) % 3;
+    ca = cut->code[pt[aa]];
+    cb = cut->code[pt[bb]];
+    cut->bound[num_bound++] = pt[aa];
+    
+    if (ca < cb) {
+      for (jj = (ca + 1) / 2; jj < cb / 2; jj++)
+	if ((cut->bound[num_bound++] = Cut_Crossing(cut, pt[aa], pt[bb], jj)) == UINT_MAX)
+	  return -1;
+    } else {
+      for (jj = ca / 2; jj-- > (cb + 1) / 2;)
+	if ((cut->bound[num_bound++] = Cut_Crossing(cut, pt[aa], pt[bb], jj)) == UINT_MAX)
+	  return -1;
+    }
+  }
+  
+  cmin = cmax = cut->code[pt[0]];
+  for (aa = 1; aa < 3; aa++) {
+    if (cut->code[pt[aa]] < cmin)
+      cmin = cut->code[pt[aa]];
+    if (cut->code[pt[aa]] > cmax)
+      cmax = cut->code[pt[aa]];
+  }
+  
+  /* A face lying on a plane gets no slab, the caps cover it */
+  k_last = cmax / 2;
+  for (kk = (cmin + 1) / 2; kk <= k_last; kk++) {
+    num_piece = 0;
+    for (count = 0; count < num_bound; count++) {
+      cc = cut->code[cut->bound[count]];
+      if (cc + 1 >= 2 * kk && cc <= 2 * kk + 1)
+	cut->piece[num_piece++] = cut->bound[count];
+    }
+    if (num_piece < 3)
+      continue;
+    
+    pp = cut->piece;
+    tb = &cut->tris[kk];
+    if (num_piece == 4) {
+      /* Split into triangles along shortest diagonal */
+      if (Dist2(&cut->pts[3 * pp[0]], &cut->pts[3 * pp[2]]) > Dist2(&cut->pts[3 * pp[1]], &cut->pts[3 * pp[3]])) {
+	if (Tri_Add(tb, pp[1], pp[2], pp[3]) < 0 ||
+	    Tri_Add(tb, pp[0], pp[1], pp[3]) < 0)
+	  return -1;
       } else {
-	if (Hash_Insert(ss->edge2d, edge, PRESENT, NULL) < 0)
+	if (Tri_Add(tb, pp[0], pp[2], pp[3]) < 0 ||
+	    Tri_Add(tb, pp[0], pp[1], pp[2]) < 0)
 	  return -1;
       }
-      break;
-      
-    case 3:
-      /* All points on plane, ignore face */
-      break;
+    } else {
+      for (count = 1; count + 1 < num_piece; count++)
+	if (Tri_Add(tb, pp[0], pp[count], pp[count + 1]) < 0)
+	  return -1;
     }
-    break;
-    
-  case 1:
-    /* One edge intersects plane */
-    /* One point exactly on plane, other two straddle plane */
-    if (e[0]->inter_vld)
-      i1 = 0;
-    else if (e[1]->inter_vld)
-      i1 = 1;
-    else
-      i1 = 2;
-    
-    non1 = (i1 + 1) % 3;
-    non2 = (i1 + 2) % 3;
     
-    if (v[non2]->dist != 0) {
-      fprintf(stderr, "Internal Error: plane_cut.c: Expected point to be on plane\n");
-      return -1;
+    /* Sides of the piece on its lower or upper plane outline the caps */
+    for (count = 0; count < num_piece; count++) {
+      cc = cut->code[pp[count]];
+      if (!(cc & 1) || cut->code[pp[(count + 1) % num_piece]] != cc)
+	continue;
+      if (Cut_ToggleSeg(cut, pp[count], pp[(count + 1) % num_piece], 2 * kk + (cc == 2 * kk + 1)) < 0)
+	return -1;
     }
-    
-    if (Add2dPoint(e[i1]->inter, plane, shape[0]) < 0)
-      return -1;
-    if (Add2dPoint(e[i1]->inter, plane, shape[1]) < 0)
-      return -1;
-    if (Add2dPoint(v[non2]->point, plane, shape[0]) < 0)
-      return -1;
-    if (Add2dPoint(v[non2]->point, plane, shape[1]) < 0)
-      return -1;
-    
-    if (Face_New(v[non1]->point, v[non2]->point, e[i1]->inter, shape[v[non1]->dist > 0]) == NULL)
-      return -1;
-    if (Face_New(v[non2]->point, v[i1]->point,   e[i1]->inter, shape[v[i1]->dist > 0]) == NULL)
-      return -1;
-    break;
-
-  case 2:
-    /* Two edges intersect plane */
-    /* Two points on one side, one on the other */
-    if (!e[0]->inter_vld)
-      non1 = 0;
-    else if (!e[1]->inter_vld)
-      non1 = 1;
-    else
-      non1 = 2;
-  
-    i1 = (non1 + 1) % 3;
-    i2 = (non1 + 2) % 3;
-    
-    if (Add2dPoint(e[i1]->inter, plane, shape[0]) < 0)
-      return -1;
-    if (Add2dPoint(e[i1]->inter, plane, shape[1]) < 0)
-      return -1;
-    if (Add2dPoint(e[i2]->inter, plane, shape[0]) < 0)
-      return -1;
-    if (Add2dPoint(e[i2]->inter, plane, shape[1]) < 0)
-      return -1;
-    
-    if (Face_New(v[i2]->point, e[i2]->inter, e[i1]->inter, shape[v[i2]->dist > 0]) == NULL)
-      return -1;
-    if (Make_Quad(v[non1]->point, v[i1]->point, e[i1]->inter, e[i2]->inter, shape[v[i1]->dist > 0]) < 0)
-      return -1;
-    break;
-
-  default:
-    fprintf(stderr, "Internal Error: plane_cut.c: Invalid number of edges intersects plane\n");
-    return -1;
-  }  
+  }
   
   return 0;
 }
 
-static int AddEdge2d(struct shape *shape, const struct plane *plane) {
-  struct hash_iterator *hi;
-  struct edge *edge;
+struct cap_pt {
+  float pt[2];
+  unsigned id;
+};
 
-  if ((hi = Hash_IteratorNew(shape->edge2d)) == NULL)
-    goto err;
-  while (Hash_IteratorNext(hi)) {
-    edge = (struct edge *) Hash_IteratorGetKey(hi);
-    if (Add2dPoint(edge->vert[0]->point, plane, shape) < 0)
-      goto err2;
-    if (Add2dPoint(edge->vert[1]->point, plane, shape) < 0)
-      goto err2;
-  }
-  Hash_IteratorFree(hi);
+static int CapPtCmp(const void *a, const void *b) {
+  const struct cap_pt *pa = (const struct cap_pt *) a, *pb = (const struct cap_pt *) b;
   
+  if (pa->pt[0] != pb->pt[0])
+    return pa->pt[0] < pb->pt[0] ? -1 : 1;
+  if (pa->pt[1] != pb->pt[1])
+    return pa->pt[1] < pb->pt[1] ? -1 : 1;
   return 0;
-  
- err2:
-  Hash_IteratorFree(hi);
- err:
-  return -1;
 }
 
-static int Make_Face_From_2d(const float *p1, const float *p2, const float *p3, struct shape *shape, int sense) {
-  struct vert *v1, *v2, *v3;
-  
-  if ((v1 = (struct vert *) Hash_Lookup(shape->pt2d, p1, NULL)) == NULL ||
-      (v2 = (struct vert *) Hash_Lookup(shape->pt2d, p2, NULL)) == NULL ||
-      (v3 = (struct vert *) Hash_Lookup(shape->pt2d, p3, NULL)) == NULL) {
-    fprintf(stderr, "Error: Unexpected 2d point when slicing polyhedron\n");
-    return -1;
+/* Triangulates the outline of one cap from segs and adds it to the slab.
+ * The lower cap of a slab faces down, the upper cap up. */
+static int Cut_Cap(struct cut *cut, const struct seg *const *segs, size_t num, unsigned cap) {
+  struct lp_vertex_list *poly2d, *tri;
+  struct cap_pt *cp, key, *found;
+  unsigned *map;
+  lp_index_t *ind;
+  size_t count, num_cp = 0, num_tri;
+  const float *pt;
+  int end;
+  
+  if (num == 0)
+    return 0;
+  
+  if ((cp = malloc(2 * num * sizeof(*cp))) == NULL) {
+    Log_Error("Error: Could not allocate memory for cap points\n");
+    goto err;
   }
+  if ((poly2d = LP_VertexList_New(2, lp_pt_line)) == NULL)
+    goto err2;
   
-  if (sense) {
-    if (Face_New(v1->point, v2->point, v3->point, shape) == NULL)
-      return -1;
-  } else {
-    if (Face_New(v1->point, v3->point, v2->point, shape) == NULL)
-      return -1;
+  for (count = 0; count < num; count++) {
+    for (end = 0; end < 2; end++) {
+      pt = &cut->pts[3 * segs[count]->pt[end]];
+      cp[num_cp].pt[0] = Dot(pt, cut->plane.x_axis);
+      cp[num_cp].pt[1] = Dot(pt, cut->plane.y_axis);
+      cp[num_cp].id = segs[count]->pt[end];
+      if (LP_VertexList_Add(poly2d, cp[num_cp].pt) == LP_INDEX_MAX)
+	goto err3;
+      num_cp++;
+    }
   }
+  qsort(cp, num_cp, sizeof(*cp), CapPtCmp);
   
-  return 0;
-}
-
-static struct face *Get_Next(struct face *face, struct edge *edge) {
-  return edge->face[edge->face[0] == face ? 1 : 0];
-}
-
-static int Build_Poly3d(struct lp_vertex_list *poly3d, struct face *face) {
-  struct queue *queue;
-  struct face *next;
-  int count;
-  
-  if ((queue = Queue_New()) == NULL)
-    goto err;
+  if ((tri = LP_Triangulate2D(poly2d)) == NULL)
+    goto err3;
   
-  face->visited = 1;
-  if (Queue_Push(queue, face) < 0)
-    goto err2;
+  if ((map = malloc(LP_VertexList_NumVert(tri) * sizeof(*map) + 1)) == NULL) {
+    Log_Error("Error: Could not allocate memory for cap points\n");
+    goto err4;
+  }
+  for (count = 0; count < LP_VertexList_NumVert(tri); count++) {
+    memcpy(key.pt, &LP_VertexList_GetVert(tri)[2 * count], sizeof(key.pt));
+    if ((found = bsearch(&key, cp, num_cp, sizeof(*cp), CapPtCmp)) == NULL) {
+      Log_Error("Error: Unexpected 2d point when slicing polyhedron\n");
+      goto err5;
+    }
+    map[count] = found->id;
+  }
   
-  while (Queue_Length(queue) > 0) {
-    face = (struct face *) Queue_Pop(queue);
-    
-    for (count = 0; count < 3; count++) {
-      if (LP_VertexList_Add(poly3d, face->vert[count]->point) < 0)
-	goto err2;
-      
-      if ((next = Get_Next(face, face->edge[count])) == NULL) {
-	fprintf(stderr, "Warning: Could not find adjacent face\n");
-	continue;
-      }
-      if (next->visited)
-	continue;
-      next->visited = 1;
-      if (Queue_Push(queue, next) < 0)
-	goto err2;
+  ind = LP_VertexList_GetInd(tri);
+  num_tri = LP_VertexList_NumInd(tri);
+  for (count = 0; count + 3 <= num_tri; count += 3) {
+    if (cap & 1) {
+      if (Tri_Add(&cut->tris[cap / 2], map[ind[count]], map[ind[count + 2]], map[ind[count + 1]]) < 0)
+	goto err5;
+    } else {
+      if (Tri_Add(&cut->tris[cap / 2], map[ind[count]], map[ind[count + 1]], map[ind[count + 2]]) < 0)
+	goto err5;
     }
   }
   
-  Queue_Free(queue);
+  free(map);
+  LP_VertexList_Free(tri);
+  LP_VertexList_Free(poly2d);
+  free(cp);
   return 0;
-
+  
+ err5:
+  free(map);
+ err4:
+  LP_VertexList_Free(tri);
+ err3:
+  LP_VertexList_Free(poly2d);
  err2:
-  Queue_Free(queue);
+  free(cp);
  err:
-  fprintf(stderr, "Error: Could not build 3d polyhedron\n");
   return -1;
 }
 
-static struct shape *Shape_New(void) {
-  struct shape *shape;
+static unsigned Find(unsigned *parent, unsigned idx) {
+  while (parent[idx] != idx) {
+    parent[idx] = parent[parent[idx]];
+    idx = parent[idx];
+  }
+  
+  return idx;
+}
 
-  if ((shape = malloc(sizeof(*shape))) == NULL) {
-    fprintf(stderr, "Could not allocate shape for plane cut");
+/* Appends the pieces of one slab to *tail, split into parts connected
+ * across edges, in order of their first face */
+static int Cut_Pieces(struct cut *cut, const struct tri_buf *tb, unsigned *remap, struct lp_vl_list ***tail) {
+  struct edge_table et;
+  struct lp_vertex_list *vl;
+  unsigned *parent, *comp, *start, *order, *slot, a, b, ra, rb, added, num_comp = 0;
+  size_t num_tri = tb->num / 3, count, corner, cc;
+  const unsigned *tri;
+  int found;
+  
+  if (num_tri == 0)
+    return 0;
+  
+  if ((parent = malloc(num_tri * 4 * sizeof(*parent) + sizeof(*parent))) == NULL) {
+    Log_Error("Error: Could not allocate memory for cut pieces\n");
     goto err;
   }
-  
-  if ((shape->verts = Hash_NewFixed(3 * sizeof(float), NULL, NULL, Vert_Free_Func, NULL)) == NULL)
+  comp = parent + num_tri;
+  order = comp + num_tri;
+  start = order + num_tri;
+  if (EdgeTable_Init(&et, tb->num) < 0)
     goto err2;
   
-  if ((shape->edges = Hash_NewPtr(NULL, Edge_Free_Func, NULL, NULL, NULL)) == NULL)
-    goto err3;
-
-  if ((shape->faces = Hash_NewPtr(NULL, Face_Free_Func, NULL, NULL, NULL)) == NULL)
-    goto err4;
+  for (count = 0; count < num_tri; count++)
+    parent[count] = count;
+  for (count = 0; count < num_tri; count++) {
+    tri = &tb->ind[3 * count];
+    for (corner = 0; corner < 3; corner++) {
+      a = tri[corner];
+      b = tri[(corner + 1) % 3];
+      if ((slot = EdgeTable_Find(&et, a < b ? a : b, a < b ? b : a, &found)) == NULL)
+	goto err3;
+      if (!found) {
+	*slot = count;
+	continue;
+      }
+      ra = Find(parent, *slot);
+      rb = Find(parent, count);
+      if (ra != rb)
+	parent[ra > rb ? ra : rb] = ra < rb ? ra : rb;
+    }
+  }
+  EdgeTable_Free(&et);
   
-  if ((shape->pt2d = Hash_NewFixed(2 * sizeof(float), NULL, NULL, NULL, NULL)) == NULL)
-    goto err5;
-
-  if ((shape->edge2d = Hash_NewPtr(NULL, NULL, NULL, NULL, NULL)) == NULL)
-    goto err6;
+  /* Roots are the lowest face of each part, so parts number in order */
+  for (count = 0; count < num_tri; count++) {
+    if (Find(parent, count) == count)
+      comp[count] = num_comp++;
+    else
+      comp[count] = comp[Find(parent, count)];
+  }
+  memset(start, 0, (num_comp + 1) * sizeof(*start));
+  for (count = 0; count < num_tri; count++)
+    start[comp[count] + 1]++;
+  for (cc = 0; cc < num_comp; cc++)
+    start[cc + 1] += start[cc];
+  for (count = 0; count < num_tri; count++)
+    order[start[comp[count]]++] = count;
+  
+  
+  /* start[cc] is now the end of part cc */
+  for (cc = 0; cc < num_comp; cc++) {
+    if ((vl = LP_VertexList_New(3, lp_pt_triangle)) == NULL)
+      goto err2;
+    for (count = cc > 0 ? start[cc - 1] : 0; count < start[cc]; count++) {
+      tri = &tb->ind[3 * order[count]];
+      for (corner = 0; corner < 3; corner++) {
+	a = tri[corner];
+	if (remap[a] == UINT_MAX)
+	  added = remap[a] = LP_VertexList_Add(vl, &cut->pts[3 * a]);
+	else
+	  added = LP_VertexList_AddIndex(vl, remap[a]);
+	if (added == UINT_MAX) {
+	  LP_VertexList_Free(vl);
+	  goto err2;
+	}
+      }
+    }
+    for (count = cc > 0 ? start[cc - 1] : 0; count < start[cc]; count++)
+      for (corner = 0; corner < 3; corner++)
+	remap[tb->ind[3 * order[count] + corner]] = UINT_MAX;
+    
+    if ((**tail = LP_VertexList_ListAppend(NULL, vl)) == NULL) {
+      LP_VertexList_Free(vl);
+      goto err2;
+    }
+    *tail = &(**tail)->next;
+  }
   
-  if ((shape->poly2d = LP_VertexList_New(2, lp_pt_line)) == NULL)
-    goto err7;
+  free(parent);
+  return 0;
   
-  return shape;
-
- err7:
-  Hash_Free(shape->edge2d);
- err6:
-  Hash_Free(shape->pt2d);
- err5:
-  Hash_Free(shape->faces);
- err4:
-  Hash_Free(shape->edges);
  err3:
-  Hash_Free(shape->verts);
+  EdgeTable_Free(&et);
  err2:
-  free(shape);
+  free(parent);
  err:
-  return NULL;
+  return -1;
 }
 
-static void Shape_Free(struct shape *shape) {
-  if (shape == NULL)
-    return;
-  
-  LP_VertexList_Free(shape->poly2d);
-  Hash_Free(shape->edge2d);
-  Hash_Free(shape->pt2d);
-  Hash_Free(shape->faces);
-  Hash_Free(shape->edges);
-  Hash_Free(shape->verts);
-  free(shape);
+static void Cut_Free(struct cut *cut) {
+  size_t count;
+  
+  if (cut->tris)
+    for (count = 0; count < cut->num_slabs; count++)
+      free(cut->tris[count].ind);
+  free(cut->tris);
+  free(cut->bound);
+  free(cut->segs);
+  EdgeTable_Free(&cut->seg_idx);
+  EdgeTable_Free(&cut->cross);
+  free(cut->code);
+  free(cut->pts);
 }
 
-struct lp_vl_list *LP_PlaneCut(const struct lp_vertex_list *in, const float *norm, float dist) {
-  struct plane plane;
-  struct shape *shape[3];
-  struct lp_vertex_list *tri, *poly3d;
-  struct lp_vl_list *out = NULL, *temp;
-  struct hash_iterator *hi;
-  struct face *face;
-  size_t count, num;
-  int s_count;
-  int valid = 1;
-  
-  plane.norm[0] = norm[0];
-  plane.norm[1] = norm[1];
-  plane.norm[2] = norm[2];
-  plane.dist    = dist;
-  Normalize(plane.norm);
-  
-  BasisVectors(plane.x_axis, plane.y_axis, plane.norm);
+/* dists must be increasing */
+static struct lp_vl_list *Cut_Run(const struct lp_vertex_list *in, const float *norm, const float *dists, size_t num) {
+  struct cut cut;
+  struct lp_vl_list *out = NULL, **tail = &out;
+  const struct seg **segs;
+  size_t count, num_ind, num_vert, num_welded, *start;
+  unsigned *id, tri[3], cap;
+  lp_index_t *ind;
+  int corner;
   
   if (LP_VertexList_FloatsPerVert(in) < 3) {
-    fprintf(stderr, "Error: Insufficent floats per vert for plane cut: %zu\n", LP_VertexList_FloatsPerVert(in));
+    Log_Error("Error: Insufficent floats per vert for plane cut: %zu\n", LP_VertexList_FloatsPerVert(in));
     goto err;
   }
   
   if (LP_VertexList_PrimativeType(in) != lp_pt_triangle) {
-    fprintf(stderr, "Error: Can only plane cut triangular shapes\n");
+    Log_Error("Error: Can only plane cut triangular shapes\n");
     goto err;
   }
   
-  /* Shape 0 is side 0 (dist < 0) */
-  if ((shape[0] = Shape_New()) == NULL)
+  memset(&cut, 0, sizeof(cut));
+  memcpy(cut.plane.norm, norm, sizeof(cut.plane.norm));
+  Normalize(cut.plane.norm);
+  BasisVectors(cut.plane.x_axis, cut.plane.y_axis, cut.plane.norm);
+  cut.dists = dists;
+  cut.num_planes = num;
+  cut.num_slabs = num + 1;
+  
+  num_vert = LP_VertexList_NumVert(in);
+  num_ind = LP_VertexList_NumInd(in);
+  if ((id = malloc(num_vert * sizeof(*id) + 1)) == NULL) {
+    Log_Error("Error: Could not allocate memory for plane cut\n");
     goto err;
-  /* Shape 1 is side 1 (dist > 0) */
-  if ((shape[1] = Shape_New()) == NULL)
+  }
+  if (Cut_Weld(&cut, in, id) < 0)
     goto err2;
-  /* Shape 2 holds orginal vertices and edges for determining
-   * sides and intersections
-   */
-  if ((shape[2] = Shape_New()) == NULL)
-    goto err3;
-
-  num = LP_VertexList_NumInd(in);
-#ifdef DEBUG
-  printf("Making %zu faces\n", num / 3);
-#endif
-  for (count = 0; count < num; count += 3) {
-    if (Make_Faces(LP_VertexList_LookupVert(in, count),
-		   LP_VertexList_LookupVert(in, count + 1),
-		   LP_VertexList_LookupVert(in, count + 2),
-		   &plane, shape) < 0)
-      goto err4;
-  }
-  
-  for (s_count = 0; s_count < 2; s_count++)
-    if (AddEdge2d(shape[s_count], &plane) < 0)
-      goto err4;
-
-#ifdef DEBUG
-  struct lp_vl_list list;
-  list.vl = shape[0]->poly2d;
-  list.next = NULL;
-  LP_VertexList_Write("test0.svg", &list, 1000);
-  list.vl = shape[1]->poly2d;
-  list.next = NULL;
-  LP_VertexList_Write("test1.svg", &list, 1000);
-#endif
-  
-  for (s_count = 0; s_count < 2; s_count++) {
-#ifdef DEBUG
-    printf("Triangulating\n");
-#endif
-    if ((tri = LP_Triangulate2D(shape[s_count]->poly2d)) == NULL) {
-      valid = 0;
-    } else {
-      num = LP_VertexList_NumInd(tri);
-#ifdef DEBUG
-      printf("Adding %zu triangles\n", num / 3);
-      list.vl = tri;
-      list.next = NULL;
-      LP_VertexList_Write(s_count == 0 ? "tri0.svg" : "tri1.svg", &list, 1000);
-#endif
-      for (count = 0; count < num; count += 3) {
-	if (Make_Face_From_2d(LP_VertexList_LookupVert(tri, count),
-			      LP_VertexList_LookupVert(tri, count + 1),
-			      LP_VertexList_LookupVert(tri, count + 2),
-			      shape[s_count],
-			      s_count) < 0)
-	  goto err5;
-      }
-    }
-    
-    if ((hi = Hash_IteratorNew(shape[s_count]->faces)) == NULL)
-      goto err5;
-    while (Hash_IteratorNext(hi)) {
-      face = Hash_IteratorGetKey(hi);
-      if (face->visited)
-	continue;
-      if ((poly3d = LP_VertexList_New(3, lp_pt_triangle)) == NULL)
-	goto err6;
-      if (Build_Poly3d(poly3d, face) < 0)
-	goto err7;
-      if ((temp = LP_VertexList_ListAppend(out, poly3d)) == NULL)
-	goto err7;
-      out = temp;
+  num_welded = cut.num_pts;
+  
+  /* One sweep for the side of every point */
+  for (count = 0; count < num_welded; count++)
+    cut.code[count] = Slab_Code(&cut, &cut.pts[3 * count], Dot(&cut.pts[3 * count], cut.plane.norm));
+  
+  /* Each plane crosses the outline of a triangle at most twice */
+  if ((cut.bound = malloc(2 * (3 + 2 * num) * sizeof(*cut.bound))) == NULL ||
+      (cut.tris = calloc(cut.num_slabs, sizeof(*cut.tris))) == NULL) {
+    Log_Error("Error: Could not allocate memory for plane cut\n");
+    goto err2;
+  }
+  cut.piece = cut.bound + 3 + 2 * num;
+  if (EdgeTable_Init(&cut.cross, num_ind / 2) < 0 ||
+      EdgeTable_Init(&cut.seg_idx, 16) < 0)
+    goto err2;
+  
+  ind = LP_VertexList_GetInd(in);
+  for (count = 0; count + 3 <= num_ind; count += 3) {
+    for (corner = 0; corner < 3; corner++)
+      tri[corner] = id[ind[count + corner]];
+    if (Cut_Face(&cut, tri) < 0)
+      goto err2;
+  }
+  free(id);
+  id = NULL;
+  
+  /* Group the cap outlines by cap */
+  if ((start = calloc(2 * cut.num_slabs + 1, sizeof(*start))) == NULL ||
+      (segs = malloc(cut.num_segs * sizeof(*segs) + 1)) == NULL) {
+    free(start);
+    Log_Error("Error: Could not allocate memory for cap outlines\n");
+    goto err2;
+  }
+  for (count = 0; count < cut.num_segs; count++)
+    if (cut.segs[count].odd)
+      start[cut.segs[count].cap + 1]++;
+  for (cap = 0; cap < 2 * cut.num_slabs; cap++)
+    start[cap + 1] += start[cap];
+  for (count = 0; count < cut.num_segs; count++)
+    if (cut.segs[count].odd)
+      segs[start[cut.segs[count].cap]++] = &cut.segs[count];
+  
+  /* start[cap] is now the end of the outline of cap */
+  for (cap = 0; cap < 2 * cut.num_slabs; cap++) {
+    if (Cut_Cap(&cut, segs + (cap > 0 ? start[cap - 1] : 0), start[cap] - (cap > 0 ? start[cap - 1] : 0), cap) < 0) {
+      free(segs);
+      free(start);
+      goto err2;
     }
-    Hash_IteratorFree(hi);
-    LP_VertexList_Free(tri);
   }
+  free(segs);
+  free(start);
   
-  if (!valid) {
-#ifdef DEBUG
-    LP_VertexList_Write("plane_cut.obj", out, 1);
-#endif
-    goto err4;
+  /* Reused for the merged id, then the output index of each point */
+  if ((id = malloc(cut.num_pts * sizeof(*id) + 1)) == NULL) {
+    Log_Error("Error: Could not allocate memory for plane cut\n");
+    goto err2;
   }
+  if (Cut_Canon(&cut, id) < 0)
+    goto err2;
+  for (count = 0; count < cut.num_slabs; count++)
+    Cut_DropCollapsed(&cut.tris[count], id);
+  memset(id, 0xff, cut.num_pts * sizeof(*id));
+  for (count = 0; count < cut.num_slabs; count++)
+    if (Cut_Pieces(&cut, &cut.tris[count], id, &tail) < 0)
+      goto err2;
   
-  Shape_Free(shape[2]);
-  Shape_Free(shape[1]);
-  Shape_Free(shape[0]);
-#ifdef DEBUG
-  printf("Returning with %zu polyhedrons\n", LP_VertexList_ListLength(out));
-#endif
+  free(id);
+  Cut_Free(&cut);
   return out;
   
- err7:
-  LP_VertexList_Free(poly3d);
- err6:
-  Hash_IteratorFree(hi);
- err5:
-  LP_VertexList_Free(tri);
- err4:
-  Shape_Free(shape[2]);
- err3:
-  Shape_Free(shape[1]);
  err2:
-  Shape_Free(shape[0]);
+  free(id);
+  Cut_Free(&cut);
  err:
   LP_VertexList_ListFree(out);
-  fprintf(stderr, "Error: Could not cut polyhedron with a plane\n");
   return NULL;
 }
+
+struct lp_vl_list *LP_PlaneCut(const struct lp_vertex_list *in, const float *norm, float dist) {
+  struct lp_vl_list *out;
+  
+  if ((out = Cut_Run(in, norm, &dist, 1)) == NULL)
+    Log_Error("Error: Could not cut polyhedron with a plane\n");
+  
+  return out;
+}
+
+static int FloatCmp(const void *a, const void *b) {
+  float fa = *(const float *) a, fb = *(const float *) b;
+  
+  return fa < fb ? -1 : fa > fb;
+}
+
+struct lp_vl_list *LP_PlaneCutMulti(const struct lp_vertex_list *in, const float *norm, const float *dists, size_t num) {
+  struct lp_vl_list *out;
+  float *sorted;
+  size_t count, num_planes = 0;
+  
+  /* Planes in increasing order, repeats would only give empty slabs */
+  if ((sorted = malloc(num * sizeof(*sorted) + 1)) == NULL) {
+    Log_Error("Error: Could not allocate memory for cut planes\n");
+    return NULL;
+  }
+  memcpy(sorted, dists, num * sizeof(*sorted));
+  qsort(sorted, num, sizeof(*sorted), FloatCmp);
+  for (count = 0; count < num; count++)
+    if (num_planes == 0 || sorted[count] != sorted[num_planes - 1])
+      sorted[num_planes++] = sorted[count];
+  
+  if ((out = Cut_Run(in, norm, sorted, num_planes)) == NULL)
+    Log_Error("Error: Could not cut polyhedron with planes\n");
+  free(sorted);
+  
+  return out;
+}
@@ -34,19 +34,19 @@
 
 #include <string.h>
 
+#include "log.h"
 #include "queue.h"
 
-struct elem {
-  void *value;
-  struct elem *next;
-};
-
+/* Ring buffer, alloc is zero or a power of two */
 struct queue {
-  struct elem *head;
-  struct elem *tail;
+  void **elem;
+  size_t alloc;
+  size_t head;
   size_t len;
 };
 
+#define QUEUE_MIN 16
+
 struct queue *Queue_New(void) {
   struct queue *queue;
 
@@ -64,93 +64,90 @@ void Queue_Free(struct queue *queue) {
   if (queue == NULL)
     return;
 
-  Queue_Clear(queue);
+  free(queue->elem);
   free(queue);
 }
 
 void Queue_Clear(struct queue *queue) {
-  struct elem *cur, *next;
-  
-  cur = queue->head;
-  while (cur) {
-    next = cur->next;
-    free(cur);
-    cur = next;
-  }
-  
-  memset(queue, 0, sizeof(*queue));
+  queue->head = 0;
+  queue->len = 0;
 }
 
 size_t Queue_Length(const struct queue *queue) {
   return queue->len;
 }
 
-int Queue_Push(struct queue *queue, void *value) {
-  struct elem *elem;
-
-  if ((elem = malloc(sizeof(*elem))) == NULL)
-    goto err;
-  memset(elem, 0, sizeof(*elem));
+/* Doubles the buffer, unwrapping the contents to start at 0 */
+static int Queue_Grow(struct queue *queue) {
+  size_t new_alloc, first;
+  void **new_elem;
   
-  elem->value = value;
-  elem->next = queue->head;
-  queue->head = elem;
-  if (queue->len++ == 0)
-    queue->tail = elem;
+  new_alloc = queue->alloc ? queue->alloc << 1 : QUEUE_MIN;
+  if (new_alloc > SIZE_MAX / sizeof(*new_elem) || (new_elem = malloc(new_alloc * sizeof(*new_elem))) == NULL) {
+    Log_Error("Error: Could not grow queue\n");
+    return -1;
+  }
+  
+  first = queue->alloc - queue->head;
+  if (first > queue->len)
+    first = queue->len;
+  if (queue->len > 0) {
+    memcpy(new_elem, queue->elem + queue->head, first * sizeof(*new_elem));
+    memcpy(new_elem + first, queue->elem, (queue->len - first) * sizeof(*new_elem));
+  }
+  
+  free(queue->elem);
+  queue->elem = new_elem;
+  queue->alloc = new_alloc;
+  queue->head = 0;
   
   return 0;
+}
+
+int Queue_Push(struct queue *queue, void *value) {
+  if (queue->len == queue->alloc && Queue_Grow(queue) < 0)
+    return -1;
   
- err:
-  return -1;
+  queue->head = (queue->head - 1) & (queue->alloc - 1);
+  queue->elem[queue->head] = value;
+  queue->len++;
+  
+  return 0;
 }
 
 int Queue_PushBack(struct queue *queue, void *value) {
-  struct elem *elem;
+  if (queue->len == queue->alloc && Queue_Grow(queue) < 0)
+    return -1;
   
-  if ((elem = malloc(sizeof(*elem))) == NULL)
-    goto err;
-  memset(elem, 0, sizeof(*elem));
-
-  elem->value = value;
-  if (queue->tail)
-    queue->tail->next = elem;
-  else
-    queue->head = elem;
-  queue->tail = elem;
+  queue->elem[(queue->head + queue->len) & (queue->alloc - 1)] = value;
   queue->len++;
   
   return 0;
-  
- err:
-  return -1;
 }
 
 void *Queue_Pop(struct queue *queue) {
-  struct elem *elem;
   void *value;
   
-  if ((elem = queue->head) == NULL)
+  if (queue->len == 0)
     return NULL;
   
-  value = elem->value;
-  queue->head = elem->next;
-  free(elem);
-  if (--queue->len == 0)
-    queue->tail = NULL;
+  value = queue->elem[queue->head];
+  queue->head = (queue->head + 1) & (queue->alloc - 1);
+  queue->len--;
   
   return value;
 }
 
 void *Queue_Peak(struct queue *queue) {
-  if (queue->head == NULL)
+  if (queue->len == 0)
     return NULL;
   
-  return queue->head->value;
+  return queue->elem[queue->head];
 }
 
 void *Queue_PeakBack(struct queue *queue) {
-  if (queue->tail == NULL)
+  if (queue->len == 0)
     return NULL;
   
-  return queue->tail->value;
+  return queue->elem[(queue->head + queue->len - 1) & (queue->alloc - 1)];
 }
@@ -58,114 +58,160 @@
 #define MUTEX_INIT NULL
 #endif
 
+#include "log.h"
 #include "random.h"
 #include "SipHash/siphash.h"
 
+/* SipHash of a counter under a secret key, 8 bytes per step */
+struct rand_state {
+  unsigned char key[16];
+  uint64_t counter;
+};
+
 static MUTEX mutex = MUTEX_INIT;
-static unsigned char key[16];
-static uint64_t counter = -1;
+static struct rand_state shared;
+static int shared_seeded;
 
 void Random_Init(void) {
 #ifdef HAVE_PTHREADS
 #else
 #ifdef HAVE_CREATEMUTEXA
   if ((mutex = CreateMutexA(NULL, FALSE, NULL)) == NULL) {
-    fprintf(stderr, "Could not create mutex for random number generator\n");
+    Log_Error("Could not create mutex for random number generator\n");
     exit(1);
   }
 #endif
 #endif
 }
 
-static void Random_Seed(void) {
+static void Random_Seed(struct rand_state *rs) {
 #ifdef HAVE_GETENTROPY
-  if (getentropy(key, sizeof(key)) < 0) {
-    fprintf(stderr, "Could not get entropy to seed random number generator\n");
+  if (getentropy(rs->key, sizeof(rs->key)) < 0) {
+    Log_Error("Could not get entropy to seed random number generator\n");
     exit(1);
   }
 #else
 #ifdef HAVE_BCRYPTGENRANDOM
-  if (BCryptGenRandom(NULL, key, sizeof(key), BCRYPT_USE_SYSTEM_PREFERRED_RNG) != STATUS_SUCCESS) {
-    fprintf(stderr, "Could not get bcrypt seed for random number generator\n");
+  if (BCryptGenRandom(NULL, rs->key, sizeof(rs->key), BCRYPT_USE_SYSTEM_PREFERRED_RNG) != STATUS_SUCCESS) {
+    Log_Error("Could not get bcrypt seed for random number generator\n");
     exit(1);
   }
 #else
   FILE *in;
   
   if ((in = fopen("/dev/random", "rb")) == NULL) {
-    fprintf(stderr, "Could not open /dev/random to seed random number generator\n");
+    Log_Error("Could not open /dev/random to seed random number generator\n");
     exit(1);
   }
-  if (fread(key, sizeof(key), 1, in) <= 0) {
-    fprintf(stderr, "Could not read from /dev/random to seed random number generator\n");
+  if (fread(rs->key, sizeof(rs->key), 1, in) <= 0) {
+    Log_Error("Could not read from /dev/random to seed random number generator\n");
     exit(1);
   }
   fclose(in);
 #endif
 #endif
   
-  counter = 0;
+  rs->counter = 0;
 }
 
 #ifdef HAVE_PTHREADS
-static void Mutex_Lock(MUTEX mutex) {
-  pthread_mutex_lock(&mutex);
+static void Mutex_Lock(MUTEX *mutex) {
+  pthread_mutex_lock(mutex);
 }
-static void Mutex_Unlock(MUTEX mutex) {
-  pthread_mutex_unlock(&mutex);
+static void Mutex_Unlock(MUTEX *mutex) {
+  pthread_mutex_unlock(mutex);
 }
 #else
 #ifdef HAVE_CREATEMUTEXA
-static void Mutex_Lock(MUTEX mutex) {
-  WaitForSingleObject(mutex, INFINITE);
+static void Mutex_Lock(MUTEX *mutex) {
+  WaitForSingleObject(*mutex, INFINITE);
 }
-static void Mutex_Unlock(MUTEX mutex) {
-  ReleaseMutex(mutex);
+static void Mutex_Unlock(MUTEX *mutex) {
+  ReleaseMutex(*mutex);
 }
 #endif
 #endif
 
-uint64_t Random_Integer(void) {
-  uint64_t data;
+#ifdef HAVE_PTHREADS
+/* Each thread seeds its own state on first use, so no lock is taken */
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_key_t state_key;
+static int have_key;
 
-  Random(&data, sizeof(data));
-  
-  return data;
+static void MakeKey(void) {
+  have_key = pthread_key_create(&state_key, free) == 0;
 }
 
-static inline uint8_t RandByte(void) {
-  uint64_t hash;
+static struct rand_state *ThreadState(void) {
+  struct rand_state *rs;
+  
+  pthread_once(&once, MakeKey);
+  if (!have_key)
+    return NULL;
+  
+  if ((rs = pthread_getspecific(state_key)) != NULL)
+    return rs;
+  
+  if ((rs = malloc(sizeof(*rs))) == NULL)
+    return NULL;
+  
+  Random_Seed(rs);
+  if (pthread_setspecific(state_key, rs) != 0) {
+    free(rs);
+    return NULL;
+  }
+  
+  return rs;
+}
+#endif
 
-  hash = siphash(key, (unsigned char *) &counter, sizeof(counter));
-  counter++;
+static void Generate(struct rand_state *rs, unsigned char *data, size_t len) {
+  uint64_t block;
+  size_t num;
   
-  hash ^= hash >> 32;
-  hash ^= hash >> 16;
-  hash ^= hash >> 8;
+  while (len) {
+    block = siphash(rs->key, (unsigned char *) &rs->counter, sizeof(rs->counter));
+    rs->counter++;
+    
+    num = len < sizeof(block) ? len : sizeof(block);
+    memcpy(data, &block, num);
+    data += num;
+    len  -= num;
+  }
+}
+
+uint64_t Random_Integer(void) {
+  uint64_t data;
+
+  Random(&data, sizeof(data));
   
-  return hash;
+  return data;
 }
 
 int Random(void *data, size_t len) {
-  void *end = data + len;
+#ifdef HAVE_PTHREADS
+  struct rand_state *rs;
   
-#ifndef HAVE_PTHREADS
+  if ((rs = ThreadState()) != NULL) {
+    Generate(rs, (unsigned char *) data, len);
+    return 0;
+  }
+#else
   if (mutex == MUTEX_INIT) {
-    fprintf(stderr, "Warning: random number generator not initialzied properly\n");
+    Log_Warning("Warning: random number generator not initialzied properly\n");
     Random_Init();
   }
 #endif
   
-  Mutex_Lock(mutex);
-  
-  if (counter == -1)
-    Random_Seed();
+  Mutex_Lock(&mutex);
   
-  while (data < end) {
-    *((uint8_t *) data) = RandByte();
-    data++;
+  if (!shared_seeded) {
+    Random_Seed(&shared);
+    shared_seeded = 1;
   }
-  Mutex_Unlock(mutex);
+  
+  Generate(&shared, (unsigned char *) data, len);
+  Mutex_Unlock(&mutex);
   
   return 0;
 }
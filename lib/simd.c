@@ -0,0 +1,444 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <math.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "simd.h"
+
+/* Multiplies and adds are kept separate so every path rounds the same way */
+void Simd_PlaneDist(float *dist, const float *x, const float *y, const float *z, size_t num,
+		    const float *pt, const float *norm) {
+  size_t count = 0;
+  float sx, sy, sz;
+  
+#if defined(__AVX__)
+  __m256 px = _mm256_set1_ps(pt[0]), py = _mm256_set1_ps(pt[1]), pz = _mm256_set1_ps(pt[2]);
+  __m256 nx = _mm256_set1_ps(norm[0]), ny = _mm256_set1_ps(norm[1]), nz = _mm256_set1_ps(norm[2]);
+  __m256 dx, dy, dz;
+  
+  for (; count + 8 <= num; count += 8) {
+    dx = _mm256_mul_ps(_mm256_sub_ps(px, _mm256_loadu_ps(x + count)), nx);
+    dy = _mm256_mul_ps(_mm256_sub_ps(py, _mm256_loadu_ps(y + count)), ny);
+    dz = _mm256_mul_ps(_mm256_sub_ps(pz, _mm256_loadu_ps(z + count)), nz);
+    _mm256_storeu_ps(dist + count, _mm256_add_ps(_mm256_add_ps(dx, dy), dz));
+  }
+#elif defined(__SSE__)
+  __m128 px = _mm_set1_ps(pt[0]), py = _mm_set1_ps(pt[1]), pz = _mm_set1_ps(pt[2]);
+  __m128 nx = _mm_set1_ps(norm[0]), ny = _mm_set1_ps(norm[1]), nz = _mm_set1_ps(norm[2]);
+  __m128 dx, dy, dz;
+  
+  for (; count + 4 <= num; count += 4) {
+    dx = _mm_mul_ps(_mm_sub_ps(px, _mm_loadu_ps(x + count)), nx);
+    dy = _mm_mul_ps(_mm_sub_ps(py, _mm_loadu_ps(y + count)), ny);
+    dz = _mm_mul_ps(_mm_sub_ps(pz, _mm_loadu_ps(z + count)), nz);
+    _mm_storeu_ps(dist + count, _mm_add_ps(_mm_add_ps(dx, dy), dz));
+  }
+#elif defined(__ARM_NEON)
+  float32x4_t px = vdupq_n_f32(pt[0]), py = vdupq_n_f32(pt[1]), pz = vdupq_n_f32(pt[2]);
+  float32x4_t nx = vdupq_n_f32(norm[0]), ny = vdupq_n_f32(norm[1]), nz = vdupq_n_f32(norm[2]);
+  float32x4_t dx, dy, dz;
+  
+  for (; count + 4 <= num; count += 4) {
+    dx = vmulq_f32(vsubq_f32(px, vld1q_f32(x + count)), nx);
+    dy = vmulq_f32(vsubq_f32(py, vld1q_f32(y + count)), ny);
+    dz = vmulq_f32(vsubq_f32(pz, vld1q_f32(z + count)), nz);
+    vst1q_f32(dist + count, vaddq_f32(vaddq_f32(dx, dy), dz));
+  }
+#endif
+  
+  for (; count < num; count++) {
+    sx = (pt[0] - x[count]) * norm[0];
+    sy = (pt[1] - y[count]) * norm[1];
+    sz = (pt[2] - z[count]) * norm[2];
+    dist[count] = sx + sy + sz;
+  }
+}
+
+/* Horizontal minimum of the lanes stored in lane */
+static float Lane_Min(const float *lane, size_t num) {
+  float min = INFINITY;
+  size_t count;
+  
+  for (count = 0; count < num; count++)
+    if (lane[count] < min)
+      min = lane[count];
+  
+  return min;
+}
+
+float Simd_RayExit(const float *nx, const float *ny, const float *nz, const float *d, size_t num,
+		   const float *pt, const float *dir) {
+  size_t count = 0;
+  float min = INFINITY, dot, div, tt;
+  
+#if defined(__AVX__)
+  __m256 px = _mm256_set1_ps(pt[0]), py = _mm256_set1_ps(pt[1]), pz = _mm256_set1_ps(pt[2]);
+  __m256 dx = _mm256_set1_ps(dir[0]), dy = _mm256_set1_ps(dir[1]), dz = _mm256_set1_ps(dir[2]);
+  __m256 zero = _mm256_setzero_ps(), inf = _mm256_set1_ps(INFINITY), best = inf;
+  __m256 vx, vy, vz, vdot, vdiv, vt;
+  float lane[8];
+  
+  for (; count + 8 <= num; count += 8) {
+    vx = _mm256_loadu_ps(nx + count);
+    vy = _mm256_loadu_ps(ny + count);
+    vz = _mm256_loadu_ps(nz + count);
+    vdot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, px), _mm256_mul_ps(vy, py)), _mm256_mul_ps(vz, pz));
+    vdiv = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, dx), _mm256_mul_ps(vy, dy)), _mm256_mul_ps(vz, dz));
+    vt = _mm256_div_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(d + count), vdot), zero), vdiv);
+    vt = _mm256_blendv_ps(inf, vt, _mm256_cmp_ps(vdiv, zero, _CMP_GT_OQ));
+    best = _mm256_min_ps(best, vt);
+  }
+  _mm256_storeu_ps(lane, best);
+  min = Lane_Min(lane, 8);
+#elif defined(__SSE__)
+  __m128 px = _mm_set1_ps(pt[0]), py = _mm_set1_ps(pt[1]), pz = _mm_set1_ps(pt[2]);
+  __m128 dx = _mm_set1_ps(dir[0]), dy = _mm_set1_ps(dir[1]), dz = _mm_set1_ps(dir[2]);
+  __m128 zero = _mm_setzero_ps(), inf = _mm_set1_ps(INFINITY), best = inf;
+  __m128 vx, vy, vz, vdot, vdiv, vt, mask;
+  float lane[4];
+  
+  for (; count + 4 <= num; count += 4) {
+    vx = _mm_loadu_ps(nx + count);
+    vy = _mm_loadu_ps(ny + count);
+    vz = _mm_loadu_ps(nz + count);
+    vdot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, px), _mm_mul_ps(vy, py)), _mm_mul_ps(vz, pz));
+    vdiv = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, dx), _mm_mul_ps(vy, dy)), _mm_mul_ps(vz, dz));
+    vt = _mm_div_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(d + count), vdot), zero), vdiv);
+    mask = _mm_cmpgt_ps(vdiv, zero);
+    vt = _mm_or_ps(_mm_and_ps(mask, vt), _mm_andnot_ps(mask, inf));
+    best = _mm_min_ps(best, vt);
+  }
+  _mm_storeu_ps(lane, best);
+  min = Lane_Min(lane, 4);
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  float32x4_t px = vdupq_n_f32(pt[0]), py = vdupq_n_f32(pt[1]), pz = vdupq_n_f32(pt[2]);
+  float32x4_t dx = vdupq_n_f32(dir[0]), dy = vdupq_n_f32(dir[1]), dz = vdupq_n_f32(dir[2]);
+  float32x4_t zero = vdupq_n_f32(0), inf = vdupq_n_f32(INFINITY), best = inf;
+  float32x4_t vx, vy, vz, vdot, vdiv, vt;
+  float lane[4];
+  
+  for (; count + 4 <= num; count += 4) {
+    vx = vld1q_f32(nx + count);
+    vy = vld1q_f32(ny + count);
+    vz = vld1q_f32(nz + count);
+    vdot = vaddq_f32(vaddq_f32(vmulq_f32(vx, px), vmulq_f32(vy, py)), vmulq_f32(vz, pz));
+    vdiv = vaddq_f32(vaddq_f32(vmulq_f32(vx, dx), vmulq_f32(vy, dy)), vmulq_f32(vz, dz));
+    vt = vdivq_f32(vmaxq_f32(vsubq_f32(vld1q_f32(d + count), vdot), zero), vdiv);
+    vt = vbslq_f32(vcgtq_f32(vdiv, zero), vt, inf);
+    best = vminq_f32(best, vt);
+  }
+  vst1q_f32(lane, best);
+  min = Lane_Min(lane, 4);
+#endif
+  
+  for (; count < num; count++) {
+    dot = nx[count] * pt[0] + ny[count] * pt[1] + nz[count] * pt[2];
+    div = nx[count] * dir[0] + ny[count] * dir[1] + nz[count] * dir[2];
+    if (!(div > 0))
+      continue;
+    tt = d[count] - dot;
+    tt = (tt > 0 ? tt : 0) / div;
+    if (tt < min)
+      min = tt;
+  }
+  
+  return min;
+}
+
+float Simd_PlaneMin(const float *nx, const float *ny, const float *nz, const float *d, size_t num,
+		    const float *pt) {
+  size_t count = 0;
+  float min = INFINITY, dist;
+  
+#if defined(__AVX__)
+  __m256 px = _mm256_set1_ps(pt[0]), py = _mm256_set1_ps(pt[1]), pz = _mm256_set1_ps(pt[2]);
+  __m256 best = _mm256_set1_ps(INFINITY), vdot;
+  float lane[8];
+  
+  for (; count + 8 <= num; count += 8) {
+    vdot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(nx + count), px),
+				       _mm256_mul_ps(_mm256_loadu_ps(ny + count), py)),
+			 _mm256_mul_ps(_mm256_loadu_ps(nz + count), pz));
+    best = _mm256_min_ps(best, _mm256_sub_ps(_mm256_loadu_ps(d + count), vdot));
+  }
+  _mm256_storeu_ps(lane, best);
+  min = Lane_Min(lane, 8);
+#elif defined(__SSE__)
+  __m128 px = _mm_set1_ps(pt[0]), py = _mm_set1_ps(pt[1]), pz = _mm_set1_ps(pt[2]);
+  __m128 best = _mm_set1_ps(INFINITY), vdot;
+  float lane[4];
+  
+  for (; count + 4 <= num; count += 4) {
+    vdot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(nx + count), px),
+				 _mm_mul_ps(_mm_loadu_ps(ny + count), py)),
+		      _mm_mul_ps(_mm_loadu_ps(nz + count), pz));
+    best = _mm_min_ps(best, _mm_sub_ps(_mm_loadu_ps(d + count), vdot));
+  }
+  _mm_storeu_ps(lane, best);
+  min = Lane_Min(lane, 4);
+#elif defined(__ARM_NEON)
+  float32x4_t px = vdupq_n_f32(pt[0]), py = vdupq_n_f32(pt[1]), pz = vdupq_n_f32(pt[2]);
+  float32x4_t best = vdupq_n_f32(INFINITY), vdot;
+  float lane[4];
+  
+  for (; count + 4 <= num; count += 4) {
+    vdot = vaddq_f32(vaddq_f32(vmulq_f32(vld1q_f32(nx + count), px),
+			       vmulq_f32(vld1q_f32(ny + count), py)),
+		     vmulq_f32(vld1q_f32(nz + count), pz));
+    best = vminq_f32(best, vsubq_f32(vld1q_f32(d + count), vdot));
+  }
+  vst1q_f32(lane, best);
+  min = Lane_Min(lane, 4);
+#endif
+  
+  for (; count < num; count++) {
+    dist = d[count] - (nx[count] * pt[0] + ny[count] * pt[1] + nz[count] * pt[2]);
+    if (dist < min)
+      min = dist;
+  }
+  
+  return min;
+}
+
+/* Double lanes for the mass kernels, which need more than float precision */
+#if defined(__AVX__)
+#define DLANES 4
+typedef __m256d vdouble;
+#define VD_ZERO     _mm256_setzero_pd()
+#define VD_LOAD     _mm256_loadu_pd
+#define VD_STORE    _mm256_storeu_pd
+#define VD_ADD      _mm256_add_pd
+#define VD_SUB      _mm256_sub_pd
+#define VD_MUL      _mm256_mul_pd
+#elif defined(__SSE2__)
+#define DLANES 2
+typedef __m128d vdouble;
+#define VD_ZERO     _mm_setzero_pd()
+#define VD_LOAD     _mm_loadu_pd
+#define VD_STORE    _mm_storeu_pd
+#define VD_ADD      _mm_add_pd
+#define VD_SUB      _mm_sub_pd
+#define VD_MUL      _mm_mul_pd
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define DLANES 2
+typedef float64x2_t vdouble;
+#define VD_ZERO     vdupq_n_f64(0)
+#define VD_LOAD     vld1q_f64
+#define VD_STORE    vst1q_f64
+#define VD_ADD      vaddq_f64
+#define VD_SUB      vsubq_f64
+#define VD_MUL      vmulq_f64
+#endif
+
+#ifdef DLANES
+/* Adds the lanes of v to *sum in lane order */
+static void Lane_Sum(double *sum, vdouble v) {
+  double lane[DLANES];
+  size_t count;
+  
+  VD_STORE(lane, v);
+  for (count = 0; count < DLANES; count++)
+    *sum += lane[count];
+}
+#endif
+
+void Simd_TetMoments(double *sums, const double *tri, size_t num) {
+  const double *ax = tri, *ay = ax + num, *az = ay + num;
+  const double *bx = az + num, *by = bx + num, *bz = by + num;
+  const double *cx = bz + num, *cy = cx + num, *cz = cy + num;
+  double det, sx, sy, sz;
+  size_t count = 0, sum;
+  
+#ifdef DLANES
+  vdouble acc[10], va[3], vb[3], vc[3], vs[3], vdet;
+  
+  for (sum = 0; sum < 10; sum++)
+    acc[sum] = VD_ZERO;
+  
+  for (; count + DLANES <= num; count += DLANES) {
+    va[0] = VD_LOAD(ax + count); va[1] = VD_LOAD(ay + count); va[2] = VD_LOAD(az + count);
+    vb[0] = VD_LOAD(bx + count); vb[1] = VD_LOAD(by + count); vb[2] = VD_LOAD(bz + count);
+    vc[0] = VD_LOAD(cx + count); vc[1] = VD_LOAD(cy + count); vc[2] = VD_LOAD(cz + count);
+    
+    vdet = VD_ADD(VD_ADD(VD_MUL(va[0], VD_SUB(VD_MUL(vb[1], vc[2]), VD_MUL(vb[2], vc[1]))),
+			 VD_MUL(va[1], VD_SUB(VD_MUL(vb[2], vc[0]), VD_MUL(vb[0], vc[2])))),
+		  VD_MUL(va[2], VD_SUB(VD_MUL(vb[0], vc[1]), VD_MUL(vb[1], vc[0]))));
+    for (sum = 0; sum < 3; sum++)
+      vs[sum] = VD_ADD(VD_ADD(va[sum], vb[sum]), vc[sum]);
+    
+    acc[0] = VD_ADD(acc[0], vdet);
+    for (sum = 0; sum < 3; sum++) {
+      acc[1 + sum] = VD_ADD(acc[1 + sum], VD_MUL(vdet, vs[sum]));
+      acc[4 + sum] = VD_ADD(acc[4 + sum],
+			    VD_MUL(vdet, VD_ADD(VD_ADD(VD_MUL(va[sum], va[sum]), VD_MUL(vb[sum], vb[sum])),
+						VD_ADD(VD_MUL(vc[sum], vc[sum]), VD_MUL(vs[sum], vs[sum])))));
+      acc[7 + sum] = VD_ADD(acc[7 + sum],
+			    VD_MUL(vdet, VD_ADD(VD_ADD(VD_MUL(va[sum], va[(sum + 1) % 3]),
+						       VD_MUL(vb[sum], vb[(sum + 1) % 3])),
+						VD_ADD(VD_MUL(vc[sum], vc[(sum + 1) % 3]),
+						       VD_MUL(vs[sum], vs[(sum + 1) % 3])))));
+    }
+  }
+  
+  for (sum = 0; sum < 10; sum++)
+    Lane_Sum(sums + sum, acc[sum]);
+#endif
+  
+  for (; count < num; count++) {
+    det =
+      ax[count] * (by[count] * cz[count] - bz[count] * cy[count]) +
+      ay[count] * (bz[count] * cx[count] - bx[count] * cz[count]) +
+      az[count] * (bx[count] * cy[count] - by[count] * cx[count]);
+    sx = ax[count] + bx[count] + cx[count];
+    sy = ay[count] + by[count] + cy[count];
+    sz = az[count] + bz[count] + cz[count];
+    
+    sums[0] += det;
+    sums[1] += det * sx;
+    sums[2] += det * sy;
+    sums[3] += det * sz;
+    sums[4] += det * (ax[count] * ax[count] + bx[count] * bx[count] + cx[count] * cx[count] + sx * sx);
+    sums[5] += det * (ay[count] * ay[count] + by[count] * by[count] + cy[count] * cy[count] + sy * sy);
+    sums[6] += det * (az[count] * az[count] + bz[count] * bz[count] + cz[count] * cz[count] + sz * sz);
+    sums[7] += det * (ax[count] * ay[count] + bx[count] * by[count] + cx[count] * cy[count] + sx * sy);
+    sums[8] += det * (ay[count] * az[count] + by[count] * bz[count] + cy[count] * cz[count] + sy * sz);
+    sums[9] += det * (az[count] * ax[count] + bz[count] * bx[count] + cz[count] * cx[count] + sz * sx);
+  }
+}
+
+double Simd_TetVolume(const double *tri, size_t num) {
+  const double *ax = tri, *ay = ax + num, *az = ay + num;
+  const double *bx = az + num, *by = bx + num, *bz = by + num;
+  const double *cx = bz + num, *cy = cx + num, *cz = cy + num;
+  double sum = 0;
+  size_t count = 0;
+  
+#ifdef DLANES
+  vdouble acc = VD_ZERO;
+  
+  for (; count + DLANES <= num; count += DLANES) {
+    acc = VD_ADD(acc, VD_MUL(VD_LOAD(ax + count), VD_SUB(VD_MUL(VD_LOAD(by + count), VD_LOAD(cz + count)),
+							VD_MUL(VD_LOAD(bz + count), VD_LOAD(cy + count)))));
+    acc = VD_ADD(acc, VD_MUL(VD_LOAD(ay + count), VD_SUB(VD_MUL(VD_LOAD(bz + count), VD_LOAD(cx + count)),
+							VD_MUL(VD_LOAD(bx + count), VD_LOAD(cz + count)))));
+    acc = VD_ADD(acc, VD_MUL(VD_LOAD(az + count), VD_SUB(VD_MUL(VD_LOAD(bx + count), VD_LOAD(cy + count)),
+							VD_MUL(VD_LOAD(by + count), VD_LOAD(cx + count)))));
+  }
+  Lane_Sum(&sum, acc);
+#endif
+  
+  for (; count < num; count++)
+    sum +=
+      ax[count] * (by[count] * cz[count] - bz[count] * cy[count]) +
+      ay[count] * (bz[count] * cx[count] - bx[count] * cz[count]) +
+      az[count] * (bx[count] * cy[count] - by[count] * cx[count]);
+  
+  return sum;
+}
+
+/* Float lanes for the transform kernel */
+#if defined(__AVX__)
+#define FLANES 8
+typedef __m256 vfloat;
+#define VF_SET1     _mm256_set1_ps
+#define VF_LOAD     _mm256_loadu_ps
+#define VF_STORE    _mm256_storeu_ps
+#define VF_ADD      _mm256_add_ps
+#define VF_SUB      _mm256_sub_ps
+#define VF_MUL      _mm256_mul_ps
+#elif defined(__SSE__)
+#define FLANES 4
+typedef __m128 vfloat;
+#define VF_SET1     _mm_set1_ps
+#define VF_LOAD     _mm_loadu_ps
+#define VF_STORE    _mm_storeu_ps
+#define VF_ADD      _mm_add_ps
+#define VF_SUB      _mm_sub_ps
+#define VF_MUL      _mm_mul_ps
+#elif defined(__ARM_NEON)
+#define FLANES 4
+typedef float32x4_t vfloat;
+#define VF_SET1     vdupq_n_f32
+#define VF_LOAD     vld1q_f32
+#define VF_STORE    vst1q_f32
+#define VF_ADD      vaddq_f32
+#define VF_SUB      vsubq_f32
+#define VF_MUL      vmulq_f32
+#endif
+
+/* Same operation order as LP_Transform_Point, so both round alike */
+void Simd_Transform(float *x, float *y, float *z, size_t num, const float *mat, const float *pre, const float *post) {
+  float dx, dy, dz;
+  size_t count = 0;
+  
+#ifdef FLANES
+  vfloat m0 = VF_SET1(mat[0]), m1 = VF_SET1(mat[1]), m2 = VF_SET1(mat[2]);
+  vfloat m3 = VF_SET1(mat[3]), m4 = VF_SET1(mat[4]), m5 = VF_SET1(mat[5]);
+  vfloat m6 = VF_SET1(mat[6]), m7 = VF_SET1(mat[7]), m8 = VF_SET1(mat[8]);
+  vfloat ax = VF_SET1(pre[0]), ay = VF_SET1(pre[1]), az = VF_SET1(pre[2]);
+  vfloat bx = VF_SET1(post[0]), by = VF_SET1(post[1]), bz = VF_SET1(post[2]);
+  vfloat vx, vy, vz;
+  
+  for (; count + FLANES <= num; count += FLANES) {
+    vx = VF_SUB(VF_LOAD(x + count), ax);
+    vy = VF_SUB(VF_LOAD(y + count), ay);
+    vz = VF_SUB(VF_LOAD(z + count), az);
+    VF_STORE(x + count, VF_ADD(VF_ADD(VF_ADD(VF_MUL(m0, vx), VF_MUL(m1, vy)), VF_MUL(m2, vz)), bx));
+    VF_STORE(y + count, VF_ADD(VF_ADD(VF_ADD(VF_MUL(m3, vx), VF_MUL(m4, vy)), VF_MUL(m5, vz)), by));
+    VF_STORE(z + count, VF_ADD(VF_ADD(VF_ADD(VF_MUL(m6, vx), VF_MUL(m7, vy)), VF_MUL(m8, vz)), bz));
+  }
+#endif
+  
+  for (; count < num; count++) {
+    dx = x[count] - pre[0];
+    dy = y[count] - pre[1];
+    dz = z[count] - pre[2];
+    x[count] = mat[0] * dx + mat[1] * dy + mat[2] * dz + post[0];
+    y[count] = mat[3] * dx + mat[4] * dy + mat[5] * dz + post[1];
+    z[count] = mat[6] * dx + mat[7] * dy + mat[8] * dz + post[2];
+  }
+}
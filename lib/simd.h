@@ -0,0 +1,65 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef LP_SIMD_H
+#define LP_SIMD_H
+
+/* Vector kernels, selected at compile time from the target's SSE, AVX or
+ * NEON support with a scalar fallback. */
+
+/* dist[i] = Dot(pt - (x[i], y[i], z[i]), norm) */
+void Simd_PlaneDist(float *dist, const float *x, const float *y, const float *z, size_t num,
+		    const float *pt, const float *norm);
+
+/* Planes are Dot(n[i], x) = d[i] with n[i] = (nx[i], ny[i], nz[i]).
+ * Returns the smallest t >= 0 where pt + t * dir crosses a plane it is
+ * heading out of, INFINITY if there is none. */
+float Simd_RayExit(const float *nx, const float *ny, const float *nz, const float *d, size_t num,
+		   const float *pt, const float *dir);
+
+/* Returns the smallest d[i] - Dot(n[i], pt), INFINITY if num is 0 */
+float Simd_PlaneMin(const float *nx, const float *ny, const float *nz, const float *d, size_t num,
+		    const float *pt);
+
+/* tri holds nine rows of num doubles: x, y and z of every triangle's first
+ * vertex a, then of b, then of c.  With det = Dot(a, Cross(b, c)) and
+ * s = a + b + c, adds to sums[0] the sum of det, to sums[1..3] det * s and
+ * to sums[4..9] det * (a_i a_j + b_i b_j + c_i c_j + s_i s_j) for the
+ * xx, yy, zz, xy, yz and zx pairs */
+void Simd_TetMoments(double *sums, const double *tri, size_t num);
+
+/* Returns the sum of det over the same layout */
+double Simd_TetVolume(const double *tri, size_t num);
+
+/* In place, (x[i], y[i], z[i]) = mat * ((x[i], y[i], z[i]) - pre) + post
+ * with mat a row major 3x3 matrix */
+void Simd_Transform(float *x, float *y, float *z, size_t num, const float *mat, const float *pre, const float *post);
+
+#endif
@@ -38,11 +38,16 @@
 
 #include "libpolyhedra.h"
 
+#include "arena.h"
 #include "array.h"
 #include "bvh_vl.h"
-#include "ftree.h"
+#include "cache.h"
 #include "hash.h"
+#include "heap.h"
+#include "log.h"
+#include "parallel.h"
 #include "SipHash/siphash.h"
+#include "stats.h"
 #include "util.h"
 
 /* Reference: Surface Simplification Using Quadratic Error Metrics
@@ -61,7 +66,7 @@ struct vert {
 struct pair {
   struct vert *vert[2];
   float vbar[3];
-  struct ftree_node *node;
+  size_t heap_pos;
 };
 
 struct face {
@@ -181,11 +186,11 @@ static float CalcLowestCost(struct pair *pair) {
   }
 }
 
-static struct pair *Pair_New(struct ftree *pairs, struct vert *a, struct vert *b) {
+/* Links a new pair into the pair hashes of its vertices */
+static struct pair *Pair_Link(struct arena *arena, struct vert *a, struct vert *b) {
   struct pair *pair;
-  float cost;
   
-  if ((pair = malloc(sizeof(*pair))) == NULL)
+  if ((pair = Arena_Alloc(arena, sizeof(*pair))) == NULL)
     goto err;
   memset(pair, 0, sizeof(*pair));
   
@@ -193,36 +198,37 @@ static struct pair *Pair_New(struct ftree *pairs, struct vert *a, struct vert *b
   pair->vert[1] = b;
   
   if (Hash_Insert(a->pair_hash, b, pair, NULL) < 0)
-    goto err2;
+    goto err;
   
   if (Hash_Insert(b->pair_hash, a, pair, NULL) < 0)
-    goto err3;
-  
-  cost = CalcLowestCost(pair);
-  if ((pair->node = FTree_Insert(pairs, cost, pair, NULL)) == NULL)
-    goto err4;
+    goto err2;
   
   return pair;
 
- err4:
-  Hash_Remove(b->pair_hash, a);
- err3:
-  Hash_Remove(a->pair_hash, b);
  err2:
-  free(pair);
+  Hash_Remove(a->pair_hash, b);
  err:
   return NULL;
 }
 
-static void Pair_Free(struct pair *pair) {
-  if (pair == NULL)
-    return;
+static struct pair *Pair_New(struct arena *arena, struct heap *pairs, struct vert *a, struct vert *b) {
+  struct pair *pair;
+  float cost;
   
-  free(pair);
-}
+  if ((pair = Pair_Link(arena, a, b)) == NULL)
+    goto err;
+  
+  cost = CalcLowestCost(pair);
+  if (Heap_Insert(pairs, cost, pair, &pair->heap_pos) < 0)
+    goto err2;
+  
+  return pair;
 
-static void Pair_Free_Func(void *data) {
-  Pair_Free((struct pair *) data);
+ err2:
+  Hash_Remove(b->pair_hash, a);
+  Hash_Remove(a->pair_hash, b);
+ err:
+  return NULL;
 }
 
 static void Face_Cannonize(struct face *face) {
@@ -244,12 +250,11 @@ static void Face_Cannonize(struct face *face) {
   face->vert[1] = temp;
 }
 
-static struct face *Face_New(struct hash *faces, struct vert *a, struct vert *b, struct vert *c) {
+static struct face *Face_New(struct arena *arena, struct hash *faces, struct vert *a, struct vert *b, struct vert *c) {
   struct face *face;
-  float Kp[10];
-  int count, idx;
+  int count;
   
-  if ((face = malloc(sizeof(*face))) == NULL)
+  if ((face = Arena_Alloc(arena, sizeof(*face))) == NULL)
     goto err;
   memset(face, 0, sizeof(*face));
   face->vert[0] = a;
@@ -257,10 +262,7 @@ static struct face *Face_New(struct hash *faces, struct vert *a, struct vert *b,
   face->vert[2] = c;
   Face_Cannonize(face);
   
-  CalcKp(Kp, face->vert);
   for (count = 0; count < 3; count++) {
-    for (idx = 0; idx < 10; idx++)
-      face->vert[count]->Q[idx] += Kp[idx];
     if (Array_Add(face->vert[count]->face_arr, face) < 0)
       goto err2;
   }
@@ -273,26 +275,14 @@ static struct face *Face_New(struct hash *faces, struct vert *a, struct vert *b,
  err2:
   while (count-- > 0)
     Array_Remove(face->vert[count]->face_arr, -1);
-  free(face);
  err:
   return NULL;
 }
 
-static void Face_Free(struct face *face) {
-  if (face == NULL)
-    return;
-  
-  free(face);
-}
-
-static void Face_Free_Func(void *user, void *data) {
-  Face_Free((struct face *) data);
-}
-
-static struct vert *Vert_New(struct hash *verts, const float *v) {
+static struct vert *Vert_New(struct arena *arena, struct hash *verts, const float *v) {
   struct vert *vv;
   
-  if ((vv = malloc(sizeof(*vv))) == NULL)
+  if ((vv = Arena_Alloc(arena, sizeof(*vv))) == NULL)
     goto err;
   memset(vv, 0, sizeof(*vv));
   vv->v[0] = v[0];
@@ -300,39 +290,96 @@ static struct vert *Vert_New(struct hash *verts, const float *v) {
   vv->v[2] = v[2];
   
   if ((vv->face_arr = Array_New(8, NULL)) == NULL)
-    goto err2;
+    goto err;
   
   if ((vv->pair_hash = Hash_NewPtr(NULL, NULL, NULL, NULL, NULL)) == NULL)
-    goto err3;
+    goto err2;
   
   if (Hash_Insert(verts, vv, PRESENT, NULL) < 0)
-    goto err4;
+    goto err3;
   
   return vv;
   
- err4:
-  Hash_Free(vv->pair_hash);
  err3:
-  Array_Free(vv->face_arr);
+  Hash_Free(vv->pair_hash);
  err2:
-  free(vv);
+  Array_Free(vv->face_arr);
  err:
   return NULL;
 }
 
+/* The vertex itself belongs to the arena */
 static void Vert_Free(struct vert *vert) {
   Hash_Free(vert->pair_hash);
   Array_Free(vert->face_arr);
-  free(vert);
 }
 
 static void Vert_Free_Func(void *user, void *data) {
   Vert_Free((struct vert *) data);
 }
 
-static int Add_Pairs(struct ftree *pairs, struct hash *faces) {
+/* Setup work is split into chunks of SETUP_CHUNK vertices or pairs */
+#define SETUP_CHUNK 1024
+
+struct setup {
+  struct vert **vert_arr;
+  size_t num_verts;
+  struct pair **pair_arr;
+  size_t num_pairs;
+  float *cost;
+};
+
+/* Sums the plane quadrics of the faces around each vertex */
+static int Setup_Quadrics(void *user, size_t chunk, size_t thread) {
+  struct setup *setup = (struct setup *) user;
+  struct face **face_arr;
+  struct vert *vert;
+  size_t idx, end, fcount, flen;
+  float Kp[10];
+  int count;
+  
+  idx = chunk * SETUP_CHUNK;
+  end = idx + SETUP_CHUNK < setup->num_verts ? idx + SETUP_CHUNK : setup->num_verts;
+  for (; idx < end; idx++) {
+    vert = setup->vert_arr[idx];
+    face_arr = (struct face **) Array_Data(vert->face_arr);
+    flen = Array_Length(vert->face_arr);
+    for (fcount = 0; fcount < flen; fcount++) {
+      CalcKp(Kp, face_arr[fcount]->vert);
+      for (count = 0; count < 10; count++)
+	vert->Q[count] += Kp[count];
+    }
+  }
+  
+  return 0;
+}
+
+static int Setup_Costs(void *user, size_t chunk, size_t thread) {
+  struct setup *setup = (struct setup *) user;
+  size_t idx, end;
+  
+  idx = chunk * SETUP_CHUNK;
+  end = idx + SETUP_CHUNK < setup->num_pairs ? idx + SETUP_CHUNK : setup->num_pairs;
+  for (; idx < end; idx++)
+    setup->cost[idx] = CalcLowestCost(setup->pair_arr[idx]);
+  
+  return 0;
+}
+
+static int Add_Quadrics(struct vert **vert_arr, size_t num_verts) {
+  struct setup setup;
+  
+  memset(&setup, 0, sizeof(setup));
+  setup.vert_arr  = vert_arr;
+  setup.num_verts = num_verts;
+  
+  return Parallel_For((num_verts + SETUP_CHUNK - 1) / SETUP_CHUNK, Setup_Quadrics, &setup);
+}
+
+static int Link_Pairs(struct arena *arena, struct hash *faces, struct array *arr) {
   struct hash_iterator *hi;
   struct face *face;
+  struct pair *pair;
   int count, cp1;
   
   if ((hi = Hash_IteratorNew(faces)) == NULL)
@@ -343,9 +390,12 @@ static int Add_Pairs(struct ftree *pairs, struct hash *faces) {
     
     for (count = 0; count < 3; count++) {
       cp1 = (count + 1) % 3;
-      if (Hash_Lookup(face->vert[count]->pair_hash, face->vert[cp1], NULL) == NULL)
-	if (Pair_New(pairs, face->vert[count], face->vert[cp1]) == NULL)
+      if (Hash_Lookup(face->vert[count]->pair_hash, face->vert[cp1], NULL) == NULL) {
+	if ((pair = Pair_Link(arena, face->vert[count], face->vert[cp1])) == NULL)
+	  goto err2;
+	if (Array_Add(arr, pair) < 0)
 	  goto err2;
+      }
     }
   }
   
@@ -358,8 +408,51 @@ static int Add_Pairs(struct ftree *pairs, struct hash *faces) {
   return -1;
 }
 
+/* Pairs are linked serially, then costed in parallel and heapified at once */
+static int Add_Pairs(struct arena *arena, struct heap *pairs, struct hash *faces) {
+  struct array *arr;
+  struct pair *pair;
+  struct setup setup;
+  size_t idx;
+  
+  if ((arr = Array_New(Hash_NumEntries(faces) * 3 / 2 + 1, NULL)) == NULL)
+    goto err;
+  
+  if (Link_Pairs(arena, faces, arr) < 0)
+    goto err2;
+  
+  memset(&setup, 0, sizeof(setup));
+  setup.pair_arr  = (struct pair **) Array_Data(arr);
+  setup.num_pairs = Array_Length(arr);
+  if (setup.num_pairs && (setup.cost = malloc(setup.num_pairs * sizeof(*setup.cost))) == NULL) {
+    Log_Error("Error: Could not allocate memory for pair costs\n");
+    goto err2;
+  }
+  if (Parallel_For((setup.num_pairs + SETUP_CHUNK - 1) / SETUP_CHUNK, Setup_Costs, &setup) < 0)
+    goto err3;
+  
+  for (idx = 0; idx < setup.num_pairs; idx++) {
+    pair = setup.pair_arr[idx];
+    if (Heap_Append(pairs, setup.cost[idx], pair, &pair->heap_pos) < 0)
+      goto err3;
+  }
+  Heap_Heapify(pairs);
+  
+  free(setup.cost);
+  Array_Free(arr);
+  return 0;
+  
+ err3:
+  free(setup.cost);
+ err2:
+  Array_Free(arr);
+ err:
+  return -1;
+}
+
 struct agg_bvh_pair {
-  struct ftree *pairs;
+  struct arena *arena;
+  struct heap *pairs;
   struct vert **vert_arr;
   int err;
 };
@@ -378,27 +471,27 @@ static void Agg_Bvh_Pair(void *user, struct lp_vertex_list *vl, float *fa, float
   if (Hash_Lookup(a->pair_hash, b, NULL))
     return;
   
-  if (Pair_New(abp->pairs, a, b) == NULL) {
-    fprintf(stderr, "Could not create agg pair\n");
+  if (Pair_New(abp->arena, abp->pairs, a, b) == NULL) {
+    Log_Error("Could not create agg pair\n");
     abp->err = 1;
   }
 }
 
-static int Add_Agg_Pairs(struct ftree *pairs, struct vert **vert_arr, struct lp_vertex_list *vl, float aggregation_thresh) {
+static int Add_Agg_Pairs(struct arena *arena, struct heap *pairs, struct vert **vert_arr, struct lp_vertex_list *vl, float aggregation_thresh) {
   struct bvh_vl *bvh;
   struct agg_bvh_pair abp;
 
   if ((bvh = BvhVl_New(vl, aggregation_thresh)) == NULL) {
-    fprintf(stderr, "Could not create aggregation boundary volume hierarchy\n");
+    Log_Error("Could not create aggregation boundary volume hierarchy\n");
     goto err;
   }
 
   memset(&abp, 0, sizeof(abp));
+  abp.arena    = arena;
   abp.pairs    = pairs;
   abp.vert_arr = vert_arr;
   
-  BvhVl_Pairs(bvh, aggregation_thresh, Agg_Bvh_Pair, &abp);
-  if (abp.err)
+  if (BvhVl_Pairs(bvh, aggregation_thresh, Agg_Bvh_Pair, &abp) < 0 || abp.err)
     goto err2;
   
   BvhVl_Free(bvh);
@@ -440,7 +533,7 @@ static int AllowedContraction(const struct pair *pair) {
       } else if (face->vert[2] == a) {
 	PlaneNorm(nnew, face->vert[0]->v, face->vert[1]->v, pair->vbar);
       } else {
-	printf("Warning: vertex not in face\n");
+	Log_Warning("Warning: vertex not in face\n");
 	continue;
       }
       if (Dot(nnew, orig) < 0)
@@ -451,9 +544,8 @@ static int AllowedContraction(const struct pair *pair) {
   return 1;
 }
 
-static int Contract_Pair(struct ftree *pairs, struct hash *verts, struct hash *faces) {
+static int Contract_Pair(struct heap *pairs, struct hash *verts, struct hash *faces) {
   struct pair *pair, *pp;
-  struct ftree_node *node;
   struct vert *a, *b, *c, *vv;
   struct hash_iterator *hi;
   struct face *face, **face_arr, **arr2;
@@ -462,19 +554,18 @@ static int Contract_Pair(struct ftree *pairs, struct hash *verts, struct hash *f
   size_t fcount, flen, fcount2, flen2;
 
   while (1) {
-    if ((node = FTree_Lowest(pairs)) == NULL)
+    if ((pair = Heap_Lowest(pairs, &cost)) == NULL)
       return -1;
     
-    pair = FTree_GetData(node);
-    if (isinf(FTree_GetKey(node))) {
-      fprintf(stderr, "Failure: All remianing pairs are disallowed\n");
+    if (isinf(cost)) {
+      Log_Error("Failure: All remianing pairs are disallowed\n");
       return -1;
     }
     
     if (AllowedContraction(pair))
       break;
     
-    FTree_Rekey(pairs, node, INFINITY, NULL);
+    Heap_Rekey(pairs, pair->heap_pos, INFINITY);
   }
   
   //printf("Contracting (%f, %f, %f) and (%f, %f, %f) to (%f, %f, %f)\n",
@@ -497,7 +588,7 @@ static int Contract_Pair(struct ftree *pairs, struct hash *verts, struct hash *f
   while (Hash_IteratorNext(hi)) {
     pp = Hash_IteratorGetData(hi);
     cost = CalcLowestCost(pp);
-    FTree_Rekey(pairs, pp->node, cost, NULL);
+    Heap_Rekey(pairs, pp->heap_pos, cost);
   }
   Hash_IteratorFree(hi);
   
@@ -508,14 +599,14 @@ static int Contract_Pair(struct ftree *pairs, struct hash *verts, struct hash *f
     vv = Hash_IteratorGetKey(hi);
     Hash_Remove(vv->pair_hash, b);
     if (Hash_Lookup(a->pair_hash, vv, NULL)) {
-      FTree_Delete(pairs, pp->node);
+      Heap_Delete(pairs, pp->heap_pos);
       continue;
     }
     pp->vert[pp->vert[0] == b ? 0 : 1] = a;
     Hash_Insert(a->pair_hash, vv, pp, NULL);
     Hash_Insert(vv->pair_hash, a, pp, NULL);
     cost = CalcLowestCost(pp);
-    FTree_Rekey(pairs, pp->node, cost, NULL);
+    Heap_Rekey(pairs, pp->heap_pos, cost);
   }
   Hash_IteratorFree(hi);
   
@@ -567,49 +658,98 @@ static int Contract_Pair(struct ftree *pairs, struct hash *verts, struct hash *f
     }
   }
   
-  FTree_Delete(pairs, node);
+  Heap_Delete(pairs, pair->heap_pos);
   Hash_Remove(verts, b);
   
   return 0;
 }
 
-struct lp_vertex_list *LP_Simplify(const struct lp_vertex_list *in, size_t num_faces_out, float aggregation_thresh) {
-  struct hash *faces, *verts;
-  struct ftree *pairs;
-  struct lp_vertex_list *vl, *out;
+static struct lp_vertex_list *Faces_ToVl(struct hash *faces) {
+  struct lp_vertex_list *out;
   struct hash_iterator *hi;
   struct face *face;
+  int count;
+  
+  if ((out = LP_VertexList_New(3, lp_pt_triangle)) == NULL)
+    goto err;
+  
+  if ((hi = Hash_IteratorNew(faces)) == NULL)
+    goto err2;
+  
+  while (Hash_IteratorNext(hi)) {
+    face = (struct face *) Hash_IteratorGetKey(hi);
+    for (count = 0; count < 3; count++) {
+      if (LP_VertexList_Add(out, face->vert[count]->v) == LP_INDEX_MAX)
+	goto err3;
+    }
+  }
+  Hash_IteratorFree(hi);
+  
+  return out;
+  
+ err3:
+  Hash_IteratorFree(hi);
+ err2:
+  LP_VertexList_Free(out);
+ err:
+  return NULL;
+}
+
+/* Runs one contraction sequence, storing a copy in out[idx] once the face
+ * count reaches targets[idx] */
+static int Simplify(const struct lp_vertex_list *in, const size_t *targets, size_t num_targets, float aggregation_thresh, struct lp_vertex_list **out) {
+  struct arena *arena;
+  struct hash *faces, *verts;
+  struct heap *pairs;
+  struct lp_vertex_list *vl;
   struct vert **vert_arr, *vert[3];
   float *vv, *ii;
-  int count;
-  size_t cc, num, fpv;
-  unsigned int idx, *arr;
+  int count, failed = 0;
+  size_t cc, num, fpv, target, *order;
+  lp_index_t idx, *arr;
+  uint64_t start = 0, contractions = 0;
+  
+  memset(out, 0, num_targets * sizeof(*out));
   
   if (LP_VertexList_FloatsPerVert(in) < 3) {
-    fprintf(stderr, "Error: Too few floats per vert to simplify\n");
+    Log_Error("Error: Too few floats per vert to simplify\n");
     goto err;
   }
   
   if (LP_VertexList_PrimativeType(in) != lp_pt_triangle) {
-    fprintf(stderr, "Error: Can only simplify triangular polyhedra\n");
+    Log_Error("Error: Can only simplify triangular polyhedra\n");
     goto err;
   }
   
-  if ((faces = Hash_NewPtr(NULL, Face_Free_Func, NULL, NULL, NULL)) == NULL)
+  /* Largest target first, ties in input order */
+  if ((order = malloc(num_targets * sizeof(*order))) == NULL) {
+    Log_Error("Error: Could not allocate memory for simplification targets\n");
     goto err;
+  }
+  for (cc = 0; cc < num_targets; cc++) {
+    for (num = cc; num > 0 && targets[order[num - 1]] < targets[cc]; num--)
+      order[num] = order[num - 1];
+    order[num] = cc;
+  }
   
-  if ((verts = Hash_NewPtr(NULL, Vert_Free_Func, NULL, NULL, NULL)) == NULL)
+  if ((arena = Arena_New(0)) == NULL)
     goto err2;
   
-  if ((pairs = FTree_New(NULL, Pair_Free_Func, NULL)) == NULL)
+  if ((faces = Hash_NewPtr(NULL, NULL, NULL, NULL, NULL)) == NULL)
     goto err3;
   
-  if ((vert_arr = calloc(sizeof(*vert_arr), LP_VertexList_NumVert(in))) == NULL)
+  if ((verts = Hash_NewPtr(NULL, Vert_Free_Func, NULL, NULL, NULL)) == NULL)
     goto err4;
   
-  if ((vl = LP_VertexList_New(3, lp_pt_triangle)) == NULL)
+  if ((pairs = Heap_New()) == NULL)
     goto err5;
   
+  if ((vert_arr = calloc(sizeof(*vert_arr), LP_VertexList_NumVert(in))) == NULL)
+    goto err6;
+  
+  if ((vl = LP_VertexList_New(3, lp_pt_triangle)) == NULL)
+    goto err7;
+  
   fpv = LP_VertexList_FloatsPerVert(in);
   vv  = LP_VertexList_GetVert(in);
   arr = LP_VertexList_GetInd(in);
@@ -617,68 +757,143 @@ struct lp_vertex_list *LP_Simplify(const struct lp_vertex_list *in, size_t num_f
   for (cc = 0; cc < num; cc++) {
     for (count = 0; count < 3; count++) {
       ii = &vv[fpv * arr[3 * cc + count]];
-      if ((idx = LP_VertexList_Add(vl, ii)) == UINT_MAX)
-	goto err6;
+      if ((idx = LP_VertexList_Add(vl, ii)) == LP_INDEX_MAX)
+	goto err8;
       if ((vert[count] = vert_arr[idx]) == NULL) {
-	if ((vert[count] = Vert_New(verts, ii)) == NULL)
-	  goto err6;
+	if ((vert[count] = Vert_New(arena, verts, ii)) == NULL)
+	  goto err8;
 	vert_arr[idx] = vert[count];
       }
     }
     
-    if (Face_New(faces, vert[0], vert[1], vert[2]) == NULL)
-      goto err6;
+    if (Face_New(arena, faces, vert[0], vert[1], vert[2]) == NULL)
+      goto err8;
   }
   
-  if (Add_Pairs(pairs, faces) < 0)
-    goto err6;
+  if (Add_Quadrics(vert_arr, LP_VertexList_NumVert(vl)) < 0)
+    goto err8;
   
-  if (aggregation_thresh > 0 && Add_Agg_Pairs(pairs, vert_arr, vl, aggregation_thresh) < 0) {
-    fprintf(stderr, "Aggregation failed\n");
-    goto err6;
-  }
+  if (Add_Pairs(arena, pairs, faces) < 0)
+    goto err8;
   
-  printf("Simplifing polyhedron with %zu faces\n", Hash_NumEntries(faces));
-  while (Hash_NumEntries(faces) > num_faces_out) {
-    if (Contract_Pair(pairs, verts, faces) < 0) {
-      fprintf(stderr, "Error: Unable to contract pair with %zu faces remaining\n", Hash_NumEntries(faces));
-      break;
-    }
+  if (aggregation_thresh > 0 && Add_Agg_Pairs(arena, pairs, vert_arr, vl, aggregation_thresh) < 0) {
+    Log_Error("Aggregation failed\n");
+    goto err8;
   }
   
-  if ((out = LP_VertexList_New(3, lp_pt_triangle)) == NULL)
-    goto err6;
-  
-  if ((hi = Hash_IteratorNew(faces)) == NULL)
-    goto err7;
-  
-  while (Hash_IteratorNext(hi)) {
-    face = (struct face *) Hash_IteratorGetKey(hi);
-    for (count = 0; count < 3; count++) {
-      LP_VertexList_Add(out, face->vert[count]->v);
+  Log_Info("Simplifing polyhedron with %zu faces\n", Hash_NumEntries(faces));
+  if (stats_enabled)
+    start = Stats_Now();
+  for (cc = 0; cc < num_targets; cc++) {
+    target = targets[order[cc]];
+    while (!failed && Hash_NumEntries(faces) > target) {
+      if (Contract_Pair(pairs, verts, faces) < 0) {
+	Log_Error("Error: Unable to contract pair with %zu faces remaining\n", Hash_NumEntries(faces));
+	failed = 1;
+	break;
+      }
+      contractions++;
     }
+    
+    if ((out[order[cc]] = Faces_ToVl(faces)) == NULL)
+      goto err9;
   }
-  Hash_IteratorFree(hi);
+  if (stats_enabled)
+    Stats_Add(STAT_PAIR_CONTRACTIONS, contractions, Stats_Now() - start);
   
   LP_VertexList_Free(vl);
   free(vert_arr);
-  FTree_Free(pairs);
+  Heap_Free(pairs);
   Hash_Free(verts);
   Hash_Free(faces);
-  return out;
+  Arena_Free(arena);
+  free(order);
+  return 0;
   
+ err9:
+  for (cc = 0; cc < num_targets; cc++) {
+    LP_VertexList_Free(out[cc]);
+    out[cc] = NULL;
+  }
+ err8:
+  LP_VertexList_Free(vl);
  err7:
-  LP_VertexList_Free(out);
+  free(vert_arr);
  err6:
-  LP_VertexList_Free(vl);
+  Heap_Free(pairs);
  err5:
-  free(vert_arr);
+  Hash_Free(verts);
  err4:
-  FTree_Free(pairs);
+  Hash_Free(faces);
  err3:
-  Hash_Free(verts);
+  Arena_Free(arena);
  err2:
-  Hash_Free(faces);
+  free(order);
+ err:
+  return -1;
+}
+
+struct simplify_params {
+  uint64_t num_faces_out;
+  float aggregation_thresh;
+};
+
+struct lp_vertex_list *LP_Simplify(const struct lp_vertex_list *in, size_t num_faces_out, float aggregation_thresh) {
+  struct simplify_params params;
+  struct lp_vertex_list *out;
+  struct cache_key key;
+  
+  memset(&params, 0, sizeof(params));
+  params.num_faces_out = num_faces_out;
+  params.aggregation_thresh = aggregation_thresh;
+  Cache_Key(&key, cache_simplify, in, &params, sizeof(params));
+  if ((out = Cache_LookupVl(&key)) != NULL)
+    return out;
+  
+  if (Simplify(in, &num_faces_out, 1, aggregation_thresh, &out) < 0)
+    return NULL;
+  
+  Cache_StoreVl(&key, out);
+  return out;
+}
+
+struct lp_vl_list *LP_SimplifyLOD(const struct lp_vertex_list *in, const size_t *targets, size_t num_targets, float aggregation_thresh) {
+  struct lp_vertex_list **out;
+  struct lp_vl_list *list = NULL, **tail = &list;
+  size_t count;
+  
+  if (num_targets == 0) {
+    Log_Error("Error: No simplification targets\n");
+    goto err;
+  }
+  
+  if ((out = malloc(num_targets * sizeof(*out))) == NULL) {
+    Log_Error("Error: Could not allocate memory for levels of detail\n");
+    goto err;
+  }
+  
+  if (Simplify(in, targets, num_targets, aggregation_thresh, out) < 0)
+    goto err2;
+  
+  for (count = 0; count < num_targets; count++) {
+    if ((*tail = malloc(sizeof(**tail))) == NULL) {
+      Log_Error("Error: Could not allocate memory for levels of detail\n");
+      goto err3;
+    }
+    (*tail)->vl = out[count];
+    (*tail)->next = NULL;
+    tail = &(*tail)->next;
+  }
+  
+  free(out);
+  return list;
+  
+ err3:
+  LP_VertexList_ListFree(list);
+  for (; count < num_targets; count++)
+    LP_VertexList_Free(out[count]);
+ err2:
+  free(out);
  err:
   return NULL;
 }
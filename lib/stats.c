@@ -0,0 +1,139 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#include "libpolyhedra.h"
+#include "stats.h"
+
+int stats_enabled;
+
+static uint64_t counts[STAT_NUM];
+static uint64_t times[STAT_NUM];
+
+#if !defined(HAVE_ATOMIC_BUILTINS) && defined(HAVE_PTHREADS)
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+uint64_t Stats_Now(void) {
+#ifdef HAVE_CLOCK_GETTIME
+  struct timespec ts;
+  
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+  return (uint64_t) clock() * (1000000000 / CLOCKS_PER_SEC);
+#endif
+}
+
+static void Add(uint64_t *dest, uint64_t val) {
+#ifdef HAVE_ATOMIC_BUILTINS
+  __atomic_fetch_add(dest, val, __ATOMIC_RELAXED);
+#else
+  *dest += val;
+#endif
+}
+
+static uint64_t Load(const uint64_t *src) {
+#ifdef HAVE_ATOMIC_BUILTINS
+  return __atomic_load_n(src, __ATOMIC_RELAXED);
+#else
+  return *src;
+#endif
+}
+
+void Stats_Add(enum stat_id id, uint64_t count, uint64_t nsec) {
+#if !defined(HAVE_ATOMIC_BUILTINS) && defined(HAVE_PTHREADS)
+  pthread_mutex_lock(&mutex);
+#endif
+  Add(&counts[id], count);
+  if (nsec)
+    Add(&times[id], nsec);
+#if !defined(HAVE_ATOMIC_BUILTINS) && defined(HAVE_PTHREADS)
+  pthread_mutex_unlock(&mutex);
+#endif
+}
+
+void LP_Stats_Enable(int enable) {
+  stats_enabled = enable != 0;
+}
+
+void LP_Stats_Reset(void) {
+  int count;
+  
+#if !defined(HAVE_ATOMIC_BUILTINS) && defined(HAVE_PTHREADS)
+  pthread_mutex_lock(&mutex);
+#endif
+  for (count = 0; count < STAT_NUM; count++) {
+#ifdef HAVE_ATOMIC_BUILTINS
+    __atomic_store_n(&counts[count], 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&times[count], 0, __ATOMIC_RELAXED);
+#else
+    counts[count] = 0;
+    times[count] = 0;
+#endif
+  }
+#if !defined(HAVE_ATOMIC_BUILTINS) && defined(HAVE_PTHREADS)
+  pthread_mutex_unlock(&mutex);
+#endif
+}
+
+static void Get(struct lp_stat *dest, enum stat_id id) {
+  dest->count = Load(&counts[id]);
+  dest->seconds = Load(&times[id]) * 1e-9;
+}
+
+void LP_Stats_Get(struct lp_stats *stats) {
+#if !defined(HAVE_ATOMIC_BUILTINS) && defined(HAVE_PTHREADS)
+  pthread_mutex_lock(&mutex);
+#endif
+  Get(&stats->hull_iterations,    STAT_HULL_ITERATIONS);
+  Get(&stats->points_categorized, STAT_POINTS_CATEGORIZED);
+  Get(&stats->pair_contractions,  STAT_PAIR_CONTRACTIONS);
+  Get(&stats->cuts_tried,         STAT_CUTS_TRIED);
+  Get(&stats->rehashes,           STAT_REHASHES);
+  Get(&stats->cache_hits,         STAT_CACHE_HITS);
+  Get(&stats->cache_misses,       STAT_CACHE_MISSES);
+#if !defined(HAVE_ATOMIC_BUILTINS) && defined(HAVE_PTHREADS)
+  pthread_mutex_unlock(&mutex);
+#endif
+}
@@ -37,7 +37,10 @@
 #include <string.h>
 
 #include "libpolyhedra.h"
+#include "log.h"
+#include "simd.h"
 #include "util.h"
+#include "vertex_list.h"
 
 struct lp_transform {
   float wxyz[4];
@@ -324,14 +327,82 @@ void LP_Transform_Point(const struct lp_transform *trans, float *dest, const flo
   }
 }
 
+#define TRANSFORM_BATCH 256
+
+void LP_Transform_Points(const struct lp_transform *trans, float *xyz, size_t stride, size_t num, int options) {
+  float x[TRANSFORM_BATCH], y[TRANSFORM_BATCH], z[TRANSFORM_BATCH];
+  float mat[9], pre[3], post[3], *pt;
+  size_t start, len, count;
+  
+  if (!trans->mat_valid)
+    BuildMat((struct lp_transform *) trans);
+  
+  memset(pre, 0, sizeof(pre));
+  memset(post, 0, sizeof(post));
+  if (options & LP_TRANSFORM_INVERT) {
+    for (count = 0; count < 3; count++) {
+      mat[3*count + 0] = trans->mat[3*0 + count];
+      mat[3*count + 1] = trans->mat[3*1 + count];
+      mat[3*count + 2] = trans->mat[3*2 + count];
+    }
+    if (!(options & LP_TRANSFORM_NO_OFFSET))
+      memcpy(pre, trans->trans, sizeof(pre));
+  } else {
+    memcpy(mat, trans->mat, sizeof(mat));
+    if (!(options & LP_TRANSFORM_NO_OFFSET))
+      memcpy(post, trans->trans, sizeof(post));
+  }
+  
+  /* Gather into columns so the kernel runs on whole vectors */
+  for (start = 0; start < num; start += len) {
+    len = num - start < TRANSFORM_BATCH ? num - start : TRANSFORM_BATCH;
+    
+    pt = xyz + start * stride;
+    for (count = 0; count < len; count++, pt += stride) {
+      x[count] = pt[0];
+      y[count] = pt[1];
+      z[count] = pt[2];
+    }
+    
+    Simd_Transform(x, y, z, len, mat, pre, post);
+    
+    pt = xyz + start * stride;
+    for (count = 0; count < len; count++, pt += stride) {
+      pt[0] = x[count];
+      pt[1] = y[count];
+      pt[2] = z[count];
+    }
+  }
+}
+
+int LP_Transform_VertexListInPlace(const struct lp_transform *trans, struct lp_vertex_list *vl, int options) {
+  size_t fpv, num_vert;
+  float *vert;
+  
+  if ((fpv = LP_VertexList_FloatsPerVert(vl)) < 3) {
+    Log_Error("Too few floats per vertext to transform\n");
+    return -1;
+  }
+  num_vert = LP_VertexList_NumVert(vl);
+  vert = LP_VertexList_GetVert(vl);
+  
+  LP_Transform_Points(trans, vert, fpv, num_vert, options);
+  if (fpv >= 6)
+    /* Normals follow the position and only rotate */
+    LP_Transform_Points(trans, vert + 3, fpv, num_vert, options | LP_TRANSFORM_NO_OFFSET);
+  
+  VertexList_Modified(vl);
+  return 0;
+}
+
 struct lp_vertex_list *LP_Transform_VertexList(const struct lp_transform *trans, const struct lp_vertex_list *src, int options) {
   struct lp_vertex_list *vl;
   size_t fpv, num_vert, num_ind, count;
   float *ff, *vert;
-  unsigned int *ind;
+  lp_index_t *ind;
 
   if ((fpv = LP_VertexList_FloatsPerVert(src)) < 3) {
-    fprintf(stderr, "Too few floats per vertext to transform\n");
+    Log_Error("Too few floats per vertext to transform\n");
     goto err;
   }
   num_vert = LP_VertexList_NumVert(src);
@@ -345,11 +416,12 @@ struct lp_vertex_list *LP_Transform_VertexList(const struct lp_transform *trans,
   
   vert = LP_VertexList_GetVert(src);
   for (count = 0; count < num_vert; count++)
-    LP_Transform_Point(trans, &ff[3 * count], &vert[fpv * count], options);
+    memcpy(&ff[3 * count], &vert[fpv * count], 3 * sizeof(float));
+  LP_Transform_Points(trans, ff, 3, num_vert, options);
 
   ind = LP_VertexList_GetInd(src);
   for (count = 0; count < num_ind; count++)
-    if (LP_VertexList_Add(vl, &ff[3 * ind[count]]) == UINT_MAX)
+    if (LP_VertexList_Add(vl, &ff[3 * ind[count]]) == LP_INDEX_MAX)
       goto err3;
   
   free(ff);
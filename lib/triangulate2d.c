@@ -38,9 +38,7 @@
 
 #include "libpolyhedra.h"
 
-#include "array.h"
-#include "ftree.h"
-#include "hash.h"
+#include "log.h"
 #include "queue.h"
 #include "util.h"
 
@@ -58,8 +56,8 @@ struct mono_poly;
 
 struct vert {
   float point[2];
-  struct hash *edges;
-  struct ftree_node *node;
+  struct edge **edges;
+  size_t num_edges;
 };
 
 struct edge {
@@ -71,19 +69,39 @@ struct mono_poly {
   struct queue *stack[2];
   struct vert *top;
   struct edge *active_edge[2];
-  struct ftree_node *node;
   int top_side;
 #ifdef DEBUG
   size_t count;
 #endif
 };
 
+#define STATUS_BLOCK 256
+
+struct status_block {
+  size_t num;
+  struct mono_poly *mps[STATUS_BLOCK];
+};
+
+/* Monotone polygons crossing the sweep line, ordered left to right */
+struct status {
+  struct status_block **blocks;
+  size_t num_blocks;
+  size_t alloc_blocks;
+};
+
+struct fan {
+  struct edge *edge;
+  float ang;
+};
+
 struct poly {
-  struct ftree *mtree;
-  struct array *edges;
-  struct ftree *vtree;
+  struct status status;
+  struct edge *edges;
+  struct edge **adj;
   struct vert *verts;
+  uint32_t *order;
   size_t num_verts;
+  size_t max_edges;
 };
 
 #define HAS_CUSP(mp) ((mp)->stack[1] != NULL)
@@ -92,72 +110,58 @@ static size_t Vert_GetIdx(struct vert *vert, struct vert *verts) {
   return vert - verts;
 }
 
-static int Vert_Init(struct vert *vert, const float *point, struct ftree *vtree) {
-  memset(vert, 0, sizeof(*vert));
-
-  vert->point[X] = point[X];
-  vert->point[Y] = point[Y];
-  
-  if ((vert->edges = Hash_NewPtr(NULL, NULL, NULL, NULL, NULL)) == NULL)
-    goto err;
-  
-  if ((vert->node = FTree_Insert(vtree, point[Y], vert, NULL)) == NULL)
-    goto err2;
-  
-  return 0;
-
- err2:
-  Hash_Free(vert->edges);
- err:
-  return -1;
+static uint32_t Float_Key(float val) {
+  union {
+    float f;
+    uint32_t u;
+  } conv;
+  
+  /* Fold -0 into +0 so both compare equal */
+  conv.f = val + 0.0f;
+  if (conv.u & 0x80000000)
+    return ~conv.u;
+  return conv.u | 0x80000000;
 }
 
-static void Vert_Destroy(struct vert *vert) {
-  if (vert == NULL)
-    return;
+/* Stable LSD radix sort on the upper 32 bits of each item */
+static int Radix_Sort(uint64_t *items, size_t num) {
+  uint64_t *tmp, *src, *dst, *swap;
+  size_t counts[256], count, total, hold;
+  int shift;
   
-  Hash_Free(vert->edges);
-}
-
-static int Edge_New(struct vert *v1, struct vert *v2, struct array *edges) {
-  struct edge *edge;
-  
-  if (v1 == v2)
-    /* Degenerate edge */
-    return 0;
-  
-  if (Hash_Lookup(v1->edges, v2, NULL)) {
-    /* Duplicate edge, remove */
-    Hash_Remove(v1->edges, v2);
-    Hash_Remove(v2->edges, v1);
+  if (num < 2)
     return 0;
-  }
-  
-  if ((edge = malloc(sizeof(*edge))) == NULL)
-    goto err;
-  memset(edge, 0, sizeof(*edge));
   
-  edge->verts[0] = v1;
-  edge->verts[1] = v2;
-  
-  if (Hash_Insert(v1->edges, v2, edge, NULL) < 0)
-    goto err2;
-  if (Hash_Insert(v2->edges, v1, edge, NULL) < 0)
-    goto err2;
+  if ((tmp = malloc(num * sizeof(*tmp))) == NULL)
+    return -1;
   
-  if (Array_Add(edges, edge) < 0)
-    goto err2;
+  src = items;
+  dst = tmp;
+  for (shift = 32; shift < 64; shift += 8) {
+    memset(counts, 0, sizeof(counts));
+    for (count = 0; count < num; count++)
+      counts[(src[count] >> shift) & 0xff]++;
+    if (counts[(src[0] >> shift) & 0xff] == num)
+      continue;
+    
+    total = 0;
+    for (count = 0; count < 256; count++) {
+      hold = counts[count];
+      counts[count] = total;
+      total += hold;
+    }
+    for (count = 0; count < num; count++)
+      dst[counts[(src[count] >> shift) & 0xff]++] = src[count];
+    
+    swap = src;
+    src = dst;
+    dst = swap;
+  }
   
+  if (src != items)
+    memcpy(items, src, num * sizeof(*items));
+  free(tmp);
   return 0;
-
- err2:
-  free(edge);
- err:
-  return -1;
-}
-
-static void Edge_Free_Func(void *data) {
-  free(data);
 }
 
 static float Edge_Ang(struct edge *edge, struct vert *ref) {
@@ -169,7 +173,7 @@ static float Edge_Ang(struct edge *edge, struct vert *ref) {
   } else if (edge->verts[1] == ref) {
     p2 = edge->verts[0]->point;
   } else {
-    fprintf(stderr, "Internal Error: triangulate2d.c: Could not find reference on edge\n");
+    Log_Error("Internal Error: triangulate2d.c: Could not find reference on edge\n");
     return 0;
   }
   
@@ -189,18 +193,14 @@ static float Edge_Pos(struct edge *edge, float yy) {
   return (bb[X] - aa[X]) * (yy - aa[Y]) / (bb[Y] - aa[Y]) + aa[X];
 }
 
-static float MonoPoly_Key(struct mono_poly *mp, float *yy) {
-  return Edge_Pos(mp->active_edge[LEFT], *yy);
-}
-
-static float MonoPoly_Key_Func(void *data, void *user) {
-  return MonoPoly_Key((struct mono_poly *) data, (float *) user);
+static float MonoPoly_Key(struct mono_poly *mp, float yy) {
+  return Edge_Pos(mp->active_edge[LEFT], yy);
 }
 
 static int Edge_Orient(struct edge *edge, struct vert *top) {
   if (edge->verts[0] != top) {
     if (edge->verts[1] != top) {
-      fprintf(stderr, "Internal Error: triangulate2d.c: Edge does not contain top vertex\n");
+      Log_Error("Internal Error: triangulate2d.c: Edge does not contain top vertex\n");
       return -1;
     }
     edge->verts[1] = edge->verts[0];
@@ -210,7 +210,161 @@ static int Edge_Orient(struct edge *edge, struct vert *top) {
   return 0;
 }
 
-static struct mono_poly *MonoPoly_New(struct edge *left, struct edge *right, struct vert *start, struct ftree *mtree) {
+static void MonoPoly_Free(struct mono_poly *mp) {
+  if (mp == NULL)
+    return;
+
+  Queue_Free(mp->stack[0]);
+  Queue_Free(mp->stack[1]);
+  free(mp);
+}
+
+/* First position whose key at yy is above key, matching the old tree placement of ties */
+/* Chunk the status so inserts and deletes only shift one small block */
+static size_t Status_Bound(struct status *status, float key, float yy, size_t *idx) {
+  struct status_block *block;
+  size_t lo, hi, mid;
+  
+  lo = 0;
+  hi = status->num_blocks;
+  while (lo < hi) {
+    mid = lo + ((hi - lo) >> 1);
+    if (key < MonoPoly_Key(status->blocks[mid]->mps[0], yy))
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  if (lo == 0) {
+    *idx = 0;
+    return 0;
+  }
+  
+  /* Ties land after equal keys, matching the old tree placement */
+  block = status->blocks[lo - 1];
+  *idx = 1;
+  hi = block->num;
+  while (*idx < hi) {
+    mid = *idx + ((hi - *idx) >> 1);
+    if (key < MonoPoly_Key(block->mps[mid], yy))
+      hi = mid;
+    else
+      *idx = mid + 1;
+  }
+  return lo - 1;
+}
+
+static struct mono_poly *Status_Prev(struct status *status, size_t blk, size_t idx) {
+  if (idx > 0)
+    return status->blocks[blk]->mps[idx - 1];
+  if (blk > 0)
+    return status->blocks[blk - 1]->mps[status->blocks[blk - 1]->num - 1];
+  return NULL;
+}
+
+static int Status_AddBlock(struct status *status, size_t blk) {
+  struct status_block **blocks, *block;
+  size_t alloc;
+  
+  if (status->num_blocks >= status->alloc_blocks) {
+    alloc = status->alloc_blocks ? status->alloc_blocks << 1 : 16;
+    if ((blocks = realloc(status->blocks, alloc * sizeof(*blocks))) == NULL)
+      return -1;
+    status->blocks = blocks;
+    status->alloc_blocks = alloc;
+  }
+  
+  if ((block = malloc(sizeof(*block))) == NULL)
+    return -1;
+  block->num = 0;
+  
+  memmove(&status->blocks[blk + 1], &status->blocks[blk], (status->num_blocks - blk) * sizeof(*status->blocks));
+  status->blocks[blk] = block;
+  status->num_blocks++;
+  
+  return 0;
+}
+
+static int Status_Insert(struct status *status, struct mono_poly *mp, size_t blk, size_t idx) {
+  struct status_block *block, *next;
+  
+  if (status->num_blocks == 0 && Status_AddBlock(status, 0) < 0)
+    return -1;
+  
+  block = status->blocks[blk];
+  if (block->num == STATUS_BLOCK) {
+    if (Status_AddBlock(status, blk + 1) < 0)
+      return -1;
+    next = status->blocks[blk + 1];
+    next->num = STATUS_BLOCK >> 1;
+    block->num = STATUS_BLOCK - next->num;
+    memcpy(next->mps, &block->mps[block->num], next->num * sizeof(*next->mps));
+    if (idx > block->num) {
+      idx -= block->num;
+      block = next;
+    }
+  }
+  
+  memmove(&block->mps[idx + 1], &block->mps[idx], (block->num - idx) * sizeof(*block->mps));
+  block->mps[idx] = mp;
+  block->num++;
+  
+  return 0;
+}
+
+static int Status_Find(struct status *status, struct mono_poly *mp, size_t blk, size_t idx, size_t *found) {
+  struct status_block *block;
+  
+  for (block = status->blocks[blk]; idx > 0; idx--)
+    if (block->mps[idx - 1] == mp) {
+      *found = idx - 1;
+      return 1;
+    }
+  return 0;
+}
+
+static void Status_Delete(struct status *status, struct mono_poly *mp, float yy) {
+  struct status_block *block;
+  size_t blk, idx;
+  
+  /* Search back from where the key lands, then everywhere in case the order has drifted */
+  if (status->num_blocks == 0)
+    goto err;
+  blk = Status_Bound(status, MonoPoly_Key(mp, yy), yy, &idx);
+  if (!Status_Find(status, mp, blk, idx, &idx)) {
+    for (blk = 0; blk < status->num_blocks; blk++)
+      if (Status_Find(status, mp, blk, status->blocks[blk]->num, &idx))
+	break;
+    if (blk == status->num_blocks)
+      goto err;
+  }
+  
+  block = status->blocks[blk];
+  block->num--;
+  memmove(&block->mps[idx], &block->mps[idx + 1], (block->num - idx) * sizeof(*block->mps));
+  if (block->num == 0) {
+    free(block);
+    status->num_blocks--;
+    memmove(&status->blocks[blk], &status->blocks[blk + 1], (status->num_blocks - blk) * sizeof(*status->blocks));
+  }
+  MonoPoly_Free(mp);
+  return;
+
+ err:
+  Log_Error("Internal Error: triangulate2d.c: Monotone polygon not in sweep status\n");
+}
+
+static void Status_Destroy(struct status *status) {
+  size_t blk, count;
+  
+  for (blk = 0; blk < status->num_blocks; blk++) {
+    for (count = 0; count < status->blocks[blk]->num; count++)
+      MonoPoly_Free(status->blocks[blk]->mps[count]);
+    free(status->blocks[blk]);
+  }
+  free(status->blocks);
+}
+
+static struct mono_poly *MonoPoly_New(struct edge *left, struct edge *right, struct vert *start, struct status *status, size_t blk, size_t idx) {
   struct mono_poly *mp;
   int count;
   
@@ -231,7 +385,7 @@ static struct mono_poly *MonoPoly_New(struct edge *left, struct edge *right, str
   
   mp->top = start;
   
-  if ((mp->node = FTree_Insert(mtree, 0, mp, &start->point[Y])) == NULL)
+  if (Status_Insert(status, mp, blk, idx) < 0)
     goto err2;
   
   left->mp = mp;
@@ -245,19 +399,6 @@ static struct mono_poly *MonoPoly_New(struct edge *left, struct edge *right, str
   return NULL;
 }
 
-static void MonoPoly_Free(struct mono_poly *mp) {
-  if (mp == NULL)
-    return;
-
-  Queue_Free(mp->stack[0]);
-  Queue_Free(mp->stack[1]);
-  free(mp);
-}
-
-static void MonoPoly_Free_Func(void *data) {
-  MonoPoly_Free((struct mono_poly *) data);
-}
-
 static int MonoPoly_AddTriangle(struct lp_vertex_list *out, struct vert *p1, struct vert *p2, struct vert *p3, int is_opp) {
   float v1[2], v2[2], det, d1, d2, d3, temp, tol;
   
@@ -302,11 +443,11 @@ static int MonoPoly_AddTriangle(struct lp_vertex_list *out, struct vert *p1, str
     }
   }
   
-  if (LP_VertexList_Add(out, p1->point) == UINT_MAX)
+  if (LP_VertexList_Add(out, p1->point) == LP_INDEX_MAX)
     return -1;
-  if (LP_VertexList_Add(out, p2->point) == UINT_MAX)
+  if (LP_VertexList_Add(out, p2->point) == LP_INDEX_MAX)
     return -1;
-  if (LP_VertexList_Add(out, p3->point) == UINT_MAX)
+  if (LP_VertexList_Add(out, p3->point) == LP_INDEX_MAX)
     return -1;
   
 #ifdef DEBUG
@@ -416,7 +557,7 @@ static int MonoPoly_AdvEdge(struct lp_vertex_list *out, struct mono_poly *mp, st
   else if (mp->active_edge[1]->verts[1] == vert)
     side = 1;
   else {
-    fprintf(stderr, "Internal Error: triangulate2d.c: Vertex not found when advancing edge\n");
+    Log_Error("Internal Error: triangulate2d.c: Vertex not found when advancing edge\n");
     return -1;
   }
   
@@ -431,7 +572,7 @@ static int MonoPoly_AdvEdge(struct lp_vertex_list *out, struct mono_poly *mp, st
   return 0;
 }
 
-static int MonoPoly_Merge(struct lp_vertex_list *out, struct ftree *mtree, struct mono_poly *left, struct mono_poly *right, struct vert *vert) {
+static int MonoPoly_Merge(struct lp_vertex_list *out, struct status *status, struct mono_poly *left, struct mono_poly *right, struct vert *vert) {
   struct edge *edge;
   
 #ifdef DEBUG
@@ -444,13 +585,13 @@ static int MonoPoly_Merge(struct lp_vertex_list *out, struct ftree *mtree, struc
     /* Check for swapped left and right */
     if (left->active_edge[LEFT]->verts[1] == vert &&
 	right->active_edge[RIGHT]->verts[1] == vert) {
-      fprintf(stderr, "Warning: swapped left and right in merge\n");
-      return MonoPoly_Merge(out, mtree, right, left, vert);
+      Log_Warning("Warning: swapped left and right in merge\n");
+      return MonoPoly_Merge(out, status, right, left, vert);
     }
     
     /* Check for backwards left */
     if (left->active_edge[LEFT]->verts[1] == vert) {
-      fprintf(stderr, "Warning: polynominal crossing detected\n");
+      Log_Warning("Warning: polynominal crossing detected\n");
       edge = left->active_edge[LEFT];
       left->active_edge[LEFT] = left->active_edge[RIGHT];
       left->active_edge[RIGHT] = edge;
@@ -458,7 +599,7 @@ static int MonoPoly_Merge(struct lp_vertex_list *out, struct ftree *mtree, struc
     
     /* Check for backwards right */
     if (right->active_edge[RIGHT]->verts[1] == vert) {
-      fprintf(stderr, "Warning: polynominal crossing detected\n");
+      Log_Warning("Warning: polynominal crossing detected\n");
       edge = right->active_edge[LEFT];
       right->active_edge[LEFT] = right->active_edge[RIGHT];
       right->active_edge[RIGHT] = edge;
@@ -467,7 +608,7 @@ static int MonoPoly_Merge(struct lp_vertex_list *out, struct ftree *mtree, struc
     /* Check orginal test again */
     if (left->active_edge[RIGHT]->verts[1] != vert ||
 	right->active_edge[LEFT]->verts[1] != vert) {
-      fprintf(stderr, "Internal Error: triangulate2d.c: Incorrect vertex when merging\n");
+      Log_Error("Internal Error: triangulate2d.c: Incorrect vertex when merging\n");
       return -1;
     }
   }
@@ -480,12 +621,12 @@ static int MonoPoly_Merge(struct lp_vertex_list *out, struct ftree *mtree, struc
   right->stack[0] = NULL;
   left->active_edge[RIGHT] = right->active_edge[RIGHT];
   left->active_edge[RIGHT]->mp = left;
-  FTree_Delete(mtree, right->node);
+  Status_Delete(status, right, vert->point[Y]);
   
   return 0;
 }
 
-static int MonoPoly_Split(struct lp_vertex_list *out, struct ftree *mtree, struct mono_poly *mp, struct mono_poly *mp_new) {
+static int MonoPoly_Split(struct lp_vertex_list *out, struct status *status, struct mono_poly *mp, struct mono_poly *mp_new) {
   struct edge *left, *right;
   struct vert *vert;
   
@@ -523,11 +664,15 @@ static int MonoPoly_Split(struct lp_vertex_list *out, struct ftree *mtree, struc
   return 0;
 }
 
-static int MonoPoly_NewSmart(struct lp_vertex_list *out, struct edge *left, struct edge *right, struct vert *start, struct ftree *mtree) {
+static int MonoPoly_NewSmart(struct lp_vertex_list *out, struct edge *left, struct edge *right, struct vert *start, struct status *status) {
   struct mono_poly *mp, *mp_new;
-  struct ftree_node *prev;
+  size_t blk, idx;
   
-  if ((mp_new = MonoPoly_New(left, right, start, mtree)) == NULL)
+  if (Edge_Orient(left, start) < 0)
+    goto err;
+  blk = Status_Bound(status, Edge_Pos(left, start->point[Y]), start->point[Y], &idx);
+  mp = Status_Prev(status, blk, idx);
+  if ((mp_new = MonoPoly_New(left, right, start, status, blk, idx)) == NULL)
     goto err;
 #ifdef DEBUG
   printf("NewSmart: %g,%g L=%g,%g R=%g,%g ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^\n",
@@ -539,12 +684,10 @@ static int MonoPoly_NewSmart(struct lp_vertex_list *out, struct edge *left, stru
 	 right->verts[1]->point[Y]);
 #endif
   
-  prev = FTree_Prev(mtree, mp_new->node);
-  if (prev == NULL)
+  if (mp == NULL)
     return 0;
-  mp = FTree_GetData(prev);
   if (Edge_Pos(mp->active_edge[RIGHT], start->point[Y]) > start->point[X])
-    return MonoPoly_Split(out, mtree, mp, mp_new);
+    return MonoPoly_Split(out, status, mp, mp_new);
   
   return 0;
   
@@ -572,29 +715,20 @@ static struct poly *Poly_New(size_t num_verts) {
 
   if ((poly = malloc(sizeof(*poly))) == NULL)
     goto err;
+  memset(poly, 0, sizeof(*poly));
 
   poly->num_verts = num_verts;
   
-  if ((poly->mtree = FTree_New(NULL, MonoPoly_Free_Func, MonoPoly_Key_Func)) == NULL)
+  if ((poly->verts = calloc(num_verts, sizeof(*poly->verts))) == NULL)
     goto err2;
   
-  if ((poly->edges = Array_New(num_verts + (num_verts >> 2), Edge_Free_Func)) == NULL)
+  if ((poly->order = malloc(num_verts * sizeof(*poly->order))) == NULL)
     goto err3;
   
-  if ((poly->vtree = FTree_New(NULL, NULL, NULL)) == NULL)
-    goto err4;
-  
-  if ((poly->verts = calloc(num_verts, sizeof(*poly->verts))) == NULL)
-    goto err5;
-  
   return poly;
 
- err5:
-  FTree_Free(poly->vtree);
- err4:
-  Array_Free(poly->edges);
  err3:
-  FTree_Free(poly->mtree);
+  free(poly->verts);
  err2:
   free(poly);
  err:
@@ -602,58 +736,164 @@ static struct poly *Poly_New(size_t num_verts) {
 }
 
 static void Poly_Free(struct poly *poly) {
-  size_t count;
-  
   if (poly == NULL)
     return;
   
-  for (count = 0; count < poly->num_verts; count++)
-    Vert_Destroy(&poly->verts[count]);
+  Status_Destroy(&poly->status);
+  free(poly->order);
   free(poly->verts);
-  FTree_Free(poly->vtree);
-  Array_Free(poly->edges);
-  FTree_Free(poly->mtree);
+  free(poly->adj);
+  free(poly->edges);
   free(poly);
 }
 
+static int Poly_SortVerts(struct poly *poly) {
+  uint64_t *items;
+  size_t count;
+  
+  if ((items = malloc(poly->num_verts * sizeof(*items))) == NULL)
+    return -1;
+  
+  for (count = 0; count < poly->num_verts; count++)
+    items[count] = (uint64_t) Float_Key(poly->verts[count].point[Y]) << 32 | count;
+  if (Radix_Sort(items, poly->num_verts) < 0)
+    goto err;
+  
+  for (count = 0; count < poly->num_verts; count++)
+    poly->order[count] = (uint32_t) items[count];
+  
+  free(items);
+  return 0;
+
+ err:
+  free(items);
+  return -1;
+}
+
+static uint32_t Pair_Lo(const lp_index_t *ind, uint32_t pair) {
+  return ind[2 * pair] < ind[2 * pair + 1] ? ind[2 * pair] : ind[2 * pair + 1];
+}
+
+static uint32_t Pair_Hi(const lp_index_t *ind, uint32_t pair) {
+  return ind[2 * pair] > ind[2 * pair + 1] ? ind[2 * pair] : ind[2 * pair + 1];
+}
+
+static int Poly_SetupEdges(struct poly *poly, const lp_index_t *ind, size_t num_pairs) {
+  uint64_t *items;
+  struct edge *edge;
+  struct vert *vert;
+  size_t count, run, num, total;
+  uint32_t pair;
+  
+  if ((items = malloc((num_pairs + 1) * sizeof(*items))) == NULL)
+    goto err;
+  
+  /* Sort the pairs by low then high vertex index */
+  num = 0;
+  for (count = 0; count < num_pairs; count++)
+    if (ind[2 * count] != ind[2 * count + 1])
+      items[num++] = (uint64_t) Pair_Hi(ind, count) << 32 | count;
+  if (Radix_Sort(items, num) < 0)
+    goto err2;
+  for (count = 0; count < num; count++) {
+    pair = (uint32_t) items[count];
+    items[count] = (uint64_t) Pair_Lo(ind, pair) << 32 | pair;
+  }
+  if (Radix_Sort(items, num) < 0)
+    goto err2;
+  
+  if ((poly->edges = malloc((num + 1) * sizeof(*poly->edges))) == NULL)
+    goto err2;
+  
+  /* Duplicate edges cancel, so keep one edge of each odd run */
+  edge = poly->edges;
+  for (count = 0; count < num; count = run) {
+    pair = (uint32_t) items[count];
+    for (run = count + 1; run < num; run++)
+      if (Pair_Lo(ind, items[run]) != Pair_Lo(ind, pair) ||
+	  Pair_Hi(ind, items[run]) != Pair_Hi(ind, pair))
+	break;
+    if (((run - count) & 1) == 0)
+      continue;
+    
+    pair = (uint32_t) items[run - 1];
+    edge->verts[0] = &poly->verts[ind[2 * pair]];
+    edge->verts[1] = &poly->verts[ind[2 * pair + 1]];
+    edge->mp = NULL;
+    edge->verts[0]->num_edges++;
+    edge->verts[1]->num_edges++;
+    edge++;
+  }
+  num = edge - poly->edges;
+  free(items);
+  
+  if ((poly->adj = malloc((2 * num + 1) * sizeof(*poly->adj))) == NULL)
+    goto err;
+  
+  total = 0;
+  for (count = 0; count < poly->num_verts; count++) {
+    vert = &poly->verts[count];
+    vert->edges = poly->adj + total;
+    total += vert->num_edges;
+    if (vert->num_edges > poly->max_edges)
+      poly->max_edges = vert->num_edges;
+    vert->num_edges = 0;
+  }
+  
+  for (count = 0; count < num; count++) {
+    edge = &poly->edges[count];
+    edge->verts[0]->edges[edge->verts[0]->num_edges++] = edge;
+    edge->verts[1]->edges[edge->verts[1]->num_edges++] = edge;
+  }
+  
+  return 0;
+
+ err2:
+  free(items);
+ err:
+  return -1;
+}
+
 static int Poly_Setup(struct poly *poly, const struct lp_vertex_list *in) {
-  size_t count, num;
+  size_t count;
   float *data;
-  unsigned int *ind;
 
-  num = LP_VertexList_NumVert(in);
   data = LP_VertexList_GetVert(in);
-  for (count = 0; count < num; count++)
-    if (Vert_Init(&poly->verts[count], data + 2 * count, poly->vtree) < 0)
-      return -1;
+  for (count = 0; count < poly->num_verts; count++) {
+    poly->verts[count].point[X] = data[2 * count + X];
+    poly->verts[count].point[Y] = data[2 * count + Y];
+  }
   
-  num = LP_VertexList_NumInd(in) & -2;
-  ind = LP_VertexList_GetInd(in);
-  for (count = 0; count < num; count += 2)
-    if (Edge_New(&poly->verts[ind[count]], &poly->verts[ind[count + 1]], poly->edges) < 0)
-      return -1;
+  if (Poly_SortVerts(poly) < 0)
+    return -1;
   
-  return 0;
+  return Poly_SetupEdges(poly, LP_VertexList_GetInd(in), LP_VertexList_NumInd(in) >> 1);
+}
+
+/* Insertion sort by angle; ties keep their arrival order */
+static void Fan_Add(struct fan *fan, size_t num, struct edge *edge, float ang) {
+  while (num > 0 && fan[num - 1].ang > ang) {
+    fan[num] = fan[num - 1];
+    num--;
+  }
+  fan[num].edge = edge;
+  fan[num].ang = ang;
 }
 
 static int Poly_Triangulate(struct lp_vertex_list *out, struct poly *poly) {
-  struct ftree_node *node;
   struct vert *vert;
   struct edge *edge;
-  size_t num_edges;
-  struct hash_iterator *hi;
-  struct ftree *top, *bot;
-  struct ftree_node *top_node, *next_node, *bot_node;
+  size_t num_edges, count, num_top, num_bot, top_idx, bot_idx;
+  struct fan *top, *bot;
   float ang;
   
-  if ((top = FTree_New(NULL, NULL, NULL)) == NULL)
+  if ((top = malloc((2 * poly->max_edges + 1) * sizeof(*top))) == NULL)
     goto err;
-  if ((bot = FTree_New(NULL, NULL, NULL)) == NULL)
-    goto err2;
+  bot = top + poly->max_edges;
   
-  for (node = FTree_Highest(poly->vtree); node; node = FTree_Prev(poly->vtree, node)) {
-    vert = FTree_GetData(node);
-    num_edges = Hash_NumEntries(vert->edges);
+  for (count = poly->num_verts; count > 0; count--) {
+    vert = &poly->verts[poly->order[count - 1]];
+    num_edges = vert->num_edges;
 #ifdef DEBUG
     printf("\nProcessing vert %g,%g with %zu edges\n", vert->point[X], vert->point[Y], num_edges);
 #endif
@@ -662,65 +902,54 @@ static int Poly_Triangulate(struct lp_vertex_list *out, struct poly *poly) {
       continue;
     
     if (num_edges & 1) {
-      fprintf(stderr, "Error: Vertex %zu has odd number of edges: %zu\n", Vert_GetIdx(vert, poly->verts), num_edges);
-      goto err3;
+      Log_Error("Error: Vertex %zu has odd number of edges: %zu\n", Vert_GetIdx(vert, poly->verts), num_edges);
+      goto err2;
     }
     
-    if ((hi = Hash_IteratorNew(vert->edges)) == NULL)
-      goto err3;
-    while (Hash_IteratorNext(hi)) {
-      edge = Hash_IteratorGetData(hi);
+    num_top = 0;
+    num_bot = 0;
+    for (top_idx = 0; top_idx < num_edges; top_idx++) {
+      edge = vert->edges[top_idx];
       ang = Edge_Ang(edge, vert);
-      if (FTree_Insert(edge->mp ? top : bot, ang, edge, NULL) == NULL)
-	goto err4;
+      if (edge->mp)
+	Fan_Add(top, num_top++, edge, ang);
+      else
+	Fan_Add(bot, num_bot++, edge, ang);
     }
-    Hash_IteratorFree(hi);
     
-    bot_node = FTree_Lowest(bot);
-    for (top_node = FTree_Highest(top); top_node; top_node = next_node) {
-      next_node = FTree_Prev(top, top_node);
-      edge = (struct edge *) FTree_GetData(top_node);
-      if (next_node && ((struct edge *) FTree_GetData(next_node))->mp == edge->mp) {
+    bot_idx = 0;
+    top_idx = num_top;
+    while (top_idx > 0) {
+      edge = top[--top_idx].edge;
+      if (top_idx > 0 && top[top_idx - 1].edge->mp == edge->mp) {
 	if (MonoPoly_Finish(out, edge->mp, vert) < 0)
-	  goto err3;
-	FTree_Delete(poly->mtree, edge->mp->node);
-	next_node = FTree_Prev(top, next_node);
+	  goto err2;
+	Status_Delete(&poly->status, edge->mp, vert->point[Y]);
+	top_idx--;
 	continue;
       }
       
-      if (bot_node) {
-	if (MonoPoly_AdvEdge(out, edge->mp, (struct edge *) FTree_GetData(bot_node), vert) < 0)
-	  goto err3;
-	bot_node = FTree_Next(bot, bot_node);
+      if (bot_idx < num_bot) {
+	if (MonoPoly_AdvEdge(out, edge->mp, bot[bot_idx++].edge, vert) < 0)
+	  goto err2;
 	continue;
       }
       
-      if (MonoPoly_Merge(out, poly->mtree, edge->mp, ((struct edge *) FTree_GetData(next_node))->mp, vert) < 0)
-	goto err3;
-      next_node = FTree_Prev(top, next_node);
+      if (MonoPoly_Merge(out, &poly->status, edge->mp, top[top_idx - 1].edge->mp, vert) < 0)
+	goto err2;
+      top_idx--;
     }
     
-    for (; bot_node; bot_node = FTree_Next(bot, next_node)) {
-      next_node = FTree_Next(bot, bot_node);
-      edge = (struct edge *) FTree_GetData(bot_node);
-      if (MonoPoly_NewSmart(out, edge, (struct edge *) FTree_GetData(next_node), vert, poly->mtree) < 0)
-	goto err3;
-    }
-
-    FTree_Clear(top);
-    FTree_Clear(bot);
+    for (; bot_idx < num_bot; bot_idx += 2)
+      if (MonoPoly_NewSmart(out, bot[bot_idx].edge, bot[bot_idx + 1].edge, vert, &poly->status) < 0)
+	goto err2;
   }
   
-  FTree_Free(bot);
-  FTree_Free(top);
+  free(top);
   return 0;
 
- err4:
-  Hash_IteratorFree(hi);
- err3:
-  FTree_Free(bot);
  err2:
-  FTree_Free(top);
+  free(top);
  err:
   return -1;
 }
@@ -731,12 +960,12 @@ struct lp_vertex_list *LP_Triangulate2D(const struct lp_vertex_list *in) {
   size_t num_verts;
   
   if (LP_VertexList_FloatsPerVert(in) != 2) {
-    fprintf(stderr, "Error: Incorrect number of floats per vert for triangulate 2D\n");
+    Log_Error("Error: Incorrect number of floats per vert for triangulate 2D\n");
     goto err;
   }
   
   if (LP_VertexList_PrimativeType(in) != lp_pt_line) {
-    fprintf(stderr, "Error: Incorrect primative type for triangulate 2D\n");
+    Log_Error("Error: Incorrect primative type for triangulate 2D\n");
     goto err;
   }
 
@@ -38,23 +38,22 @@
 
 #include "libpolyhedra.h"
 
-static int AddVert(struct lp_vertex_list *vl, float x, float y, float z) {
-  float vert[3];
+#include "log.h"
+#include "vertex_list.h"
 
-  vert[0] = x;
-  vert[1] = y;
-  vert[2] = z;
-
-  if (LP_VertexList_Add(vl, vert) == UINT_MAX)
-    return -1;
-  
-  return 0;
-}
+#define ADD_TRI(aa, bb, cc)	\
+  do {				\
+    *ind++ = (aa);		\
+    *ind++ = (bb);		\
+    *ind++ = (cc);		\
+  } while (0)
 
+/* Poles first, then the rings from the bottom up */
 struct lp_vertex_list *LP_UVSphere(float radius, int segs, int rings) {
-  struct lp_vertex_list *pts, *hull;
+  struct lp_vertex_list *out;
+  lp_index_t *ind, lower, upper, next;
   int ang_count, azi_count;
-  float ang, azi, ang_incr, azi_incr, rr, xx, yy, zz;
+  float *vert, ang_incr, azi_incr, azi, rr, zz;
 
   if (segs < 3)
     segs = 3;
@@ -62,32 +61,45 @@ struct lp_vertex_list *LP_UVSphere(float radius, int segs, int rings) {
   if (rings < 2)
     rings = 2;
   
-  if ((pts = LP_VertexList_New(3, lp_pt_point)) == NULL)
-    goto err;
+  if ((size_t) segs * (size_t) (rings - 1) > (LP_INDEX_MAX - 2) / 2) {
+    Log_Error("Error: Too many segments for a UV sphere: %d x %d\n", segs, rings);
+    return NULL;
+  }
+  
+  if ((out = VertexList_NewMesh((lp_index_t) (2 + (size_t) segs * (size_t) (rings - 1)),
+				6 * (size_t) segs * (size_t) (rings - 1), &vert, &ind)) == NULL)
+    return NULL;
   
-  AddVert(pts, 0, 0,  radius);
-  AddVert(pts, 0, 0, -radius);
+  *vert++ = 0;
+  *vert++ = 0;
+  *vert++ = radius;
+  *vert++ = 0;
+  *vert++ = 0;
+  *vert++ = -radius;
   ang_incr = 2 * M_PI / segs;
   azi_incr = M_PI / rings;
-  ang = 0;
-  azi = azi_incr - M_PI_2;
-  for (azi_count = 1; azi_count < rings; azi_count++, azi += azi_incr) {
+  for (azi_count = 1; azi_count < rings; azi_count++) {
+    azi = (float) azi_count * azi_incr - M_PI_2;
     rr = radius * cos(azi);
     zz = radius * sin(azi);
-    for (ang_count = 0; ang_count < segs; ang_count++, ang += ang_incr) {
-      xx = rr * cos(ang);
-      yy = rr * sin(ang);
-      AddVert(pts, xx, yy, zz);
+    for (ang_count = 0; ang_count < segs; ang_count++) {
+      *vert++ = rr * cos((float) ang_count * ang_incr);
+      *vert++ = rr * sin((float) ang_count * ang_incr);
+      *vert++ = zz;
     }
   }
   
-  if ((hull = LP_ConvexHull(pts)) == NULL)
-    goto err2;
+  for (ang_count = 0; ang_count < segs; ang_count++) {
+    next = (ang_count + 1) % segs;
+    lower = 2;
+    ADD_TRI(1, lower + next, lower + ang_count);
+    for (azi_count = 2; azi_count < rings; azi_count++, lower = upper) {
+      upper = lower + segs;
+      ADD_TRI(lower + ang_count, lower + next, upper + next);
+      ADD_TRI(lower + ang_count, upper + next, upper + ang_count);
+    }
+    ADD_TRI(lower + ang_count, lower + next, 0);
+  }
   
-  return hull;
-
- err2:
-  LP_VertexList_Free(pts);
- err:
-  return NULL;
+  return out;
 }
@@ -33,18 +33,12 @@
 
 #include "libpolyhedra.h"
 
-#include "hash.h"
-
-struct face;
-
-struct vert {
-  float point[3];
-  struct hash *edges;
-};
+/* Array backed vertex / edge / face mesh, everything is referenced by
+ * index.  UINT_MAX marks a missing face on an open edge. */
 
 struct edge {
-  struct vert *vert[2];
-  struct face *face[2];
+  unsigned vert[2];
+  unsigned face[2];
 
   int info_vld;
   float  x_vec[3];
@@ -53,24 +47,21 @@ struct edge {
 };
 
 struct face {
-  struct vert *vert[3];
-  struct edge *edge[3];
+  unsigned vert[3];
+  unsigned edge[3]; /* Edge k goes from vert[k] to vert[k + 1] */
   float norm[3];
   float dist;
-  
-  int basis_vld;
-  float basis_x[3];
-  float basis_y[3];
-
-  int coord_2d_vld;
-  float v1_x_len;
-  float v2_pos[2];
 };
 
 struct vef {
-  struct hash *verts;
-  struct hash *edges;
-  struct hash *faces;
+  size_t num_verts;
+  size_t num_edges;
+  size_t num_faces;
+  float *points;          /* 3 per vertex, sorted by position */
+  struct edge *edges;
+  struct face *faces;
+  unsigned *vert_edge_idx; /* Edges of vertex v are vert_edges[vert_edge_idx[v]] */
+  unsigned *vert_edges;    /* up to vert_edges[vert_edge_idx[v + 1]] */
   float min[3];
   float max[3];
 };
@@ -78,18 +69,9 @@ struct vef {
 struct vef *Vef_New(const struct lp_vertex_list *vl);
 void Vef_Free(struct vef *vef);
 
-void Vef_CalcInfo(struct edge *edge);
-void Vef_CalcBasis(struct face *face);
-void Vef_CalcCoord2D(struct face *face);
-
-/* vef must be convex, pt must be interior */
-/* returns -INFINITY on error */
-/* start can be used to speed up queries for nearby points */
-float Vef_ConvexInteriorDist(const struct vef *vef, const float *pt, struct face **start);
+unsigned Vef_FaceAdj(const struct vef *vef, unsigned face, int count);
 
-/* vef must be convex */
-/* returns -INFINITY on error */
-/* start can be used to speed up queries for nearby points */
-float Vef_ConvexRayDist(const struct vef *vef, const float *pt, const float *dir, struct face **start);
+/* Orientation of the edge and the angle between its faces, edge must be closed */
+void Vef_CalcInfo(struct vef *vef, struct edge *edge);
 
 #endif
@@ -28,21 +28,43 @@
   POSSIBILITY OF SUCH DAMAGE.
 */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/* For mremap */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
 
 #include <limits.h>
+#include <math.h>
 #include <stddef.h>
 #include <string.h>
 
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP) && defined(HAVE_MREMAP)
+#include <sys/mman.h>
+#define USE_MREMAP
+#endif
+
 #include "libpolyhedra.h"
 
+#include "file_lpm.h"
+#include "file_map.h"
 #include "file_obj.h"
+#include "file_ply.h"
 #include "file_stl.h"
 #include "file_svg.h"
 #include "hash.h"
-#include "SipHash/siphash.h"
+#include "log.h"
+#include "parallel.h"
+#include "random.h"
+#include "vertex_list.h"
+#include "write_buf.h"
 
 #define PRESENT ((void *) 1)
 
@@ -51,28 +73,87 @@ struct lp_vertex_list {
   size_t vert_size;
   enum primative_type primative_type;
 
-  unsigned int vert_alloc;
-  unsigned int vert_used;
+  lp_index_t vert_alloc;
+  lp_index_t vert_used;
   float *vert;
+  int vert_mapped;
 
   size_t ind_alloc;
   size_t ind_used;
-  unsigned int *ind;
+  lp_index_t *ind;
+  int ind_mapped;
 
   struct hash *vert_hash;
+  int hash_stale;  /* Vertices may repeat, merge them before the next add */
+  int hash_empty;  /* Vertices are distinct but not in vert_hash yet */
+
+  struct file_map *backing;  /* Holds blocks that are BLOCK_BORROWED */
 };
 
+/* Blocks at least this large are mapped directly, so growing them moves
+ * pages instead of copying the data */
+#define MAP_MIN_SIZE ((size_t) 64 << 20)
+
+/* The value of *_mapped for a block inside vl->backing */
+#define BLOCK_BORROWED 2
+
+static void *Block_Resize(void *mem, size_t old_size, size_t new_size, int *mapped) {
+  void *new_mem;
+  int new_mapped = 0;
+  
+  /* Copied out the first time it changes size */
+  if (*mapped == BLOCK_BORROWED) {
+    if ((new_mem = Block_Resize(NULL, 0, new_size, &new_mapped)) == NULL)
+      return NULL;
+    memcpy(new_mem, mem, old_size < new_size ? old_size : new_size);
+    *mapped = new_mapped;
+    return new_mem;
+  }
+  
+#ifdef USE_MREMAP
+  if (*mapped) {
+    if ((new_mem = mremap(mem, old_size, new_size, MREMAP_MAYMOVE)) == MAP_FAILED)
+      return NULL;
+    return new_mem;
+  }
+  
+  if (new_size >= MAP_MIN_SIZE) {
+    new_mem = mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (new_mem == MAP_FAILED)
+      return NULL;
+    memcpy(new_mem, mem, old_size < new_size ? old_size : new_size);
+    free(mem);
+    *mapped = 1;
+    return new_mem;
+  }
+#endif
+  
+  return realloc(mem, new_size);
+}
+
+static void Block_Free(void *mem, size_t size, int mapped) {
+  if (mapped == BLOCK_BORROWED)
+    return;
+#ifdef USE_MREMAP
+  if (mapped) {
+    munmap(mem, size);
+    return;
+  }
+#endif
+  free(mem);
+}
+
 /* Key stored in hash is (void *) index + 1 */
 /* Note that index cannot be used because it can be zero, which is NULL */
 static uint64_t VlHash(const void *user, const unsigned char secret[16], const void *key) {
   struct lp_vertex_list *vl = (struct lp_vertex_list *) user;
   
-  return siphash(secret, (const unsigned char *) key, vl->vert_size);
+  return Hash_Bytes(secret, key, vl->vert_size);
 }
 
 static int VlCmp(const void *user, const void *key_a, const void *key_b) {
   struct lp_vertex_list *vl = (struct lp_vertex_list *) user;
-  float *kk = vl->vert + (((unsigned int) (ptrdiff_t) key_a) - 1) * vl->floats_per_vert;
+  float *kk = vl->vert + (size_t) (((lp_index_t) (ptrdiff_t) key_a) - 1) * vl->floats_per_vert;
 
   return memcmp(kk, key_b, vl->vert_size);
 }
@@ -83,23 +164,23 @@ static void *VlCopy(void *user, const void *key) {
   float *new_mem, *vv;
   
   if (vl->vert_used >= vl->vert_alloc) {
-    if (vl->vert_alloc == UINT_MAX) {
-      fprintf(stderr, "Error: Too many vertices in a single vertex list\n");
+    if (vl->vert_alloc == LP_INDEX_MAX) {
+      Log_Error("Error: Too many vertices in a single vertex list\n");
       goto err;
     }
 
-    if (vl->vert_alloc > (UINT_MAX >> 1))
-      new_alloc = UINT_MAX;
+    if (vl->vert_alloc > (LP_INDEX_MAX >> 1))
+      new_alloc = LP_INDEX_MAX;
     else
       new_alloc = vl->vert_alloc << 1;
     
     if (SIZE_MAX / vl->vert_size <= new_alloc) {
-      fprintf(stderr, "Error: Out of memory adding vertex\n");
+      Log_Error("Error: Out of memory adding vertex\n");
       goto err;
     }
 
-    if ((new_mem = realloc(vl->vert, new_alloc * vl->vert_size)) == NULL) {
-      fprintf(stderr, "Error: Out of memory adding vertex\n");
+    if ((new_mem = Block_Resize(vl->vert, vl->vert_alloc * vl->vert_size, new_alloc * vl->vert_size, &vl->vert_mapped)) == NULL) {
+      Log_Error("Error: Out of memory adding vertex\n");
       goto err;
     }
     
@@ -108,7 +189,7 @@ static void *VlCopy(void *user, const void *key) {
   }
 
   vv = vl->vert + vl->vert_used * vl->floats_per_vert;
-  memcpy(vv, key, vl->vert_size);
+  memmove(vv, key, vl->vert_size);
   return (void *) (ptrdiff_t) ++vl->vert_used;
 
  err:
@@ -116,15 +197,19 @@ static void *VlCopy(void *user, const void *key) {
 }
 
 struct lp_vertex_list *LP_VertexList_New(size_t floats_per_vert, enum primative_type pt) {
+  return LP_VertexList_NewEx(floats_per_vert, pt, 0);
+}
+
+struct lp_vertex_list *LP_VertexList_NewEx(size_t floats_per_vert, enum primative_type pt, int flags) {
   struct lp_vertex_list *vl;
 
   if (SIZE_MAX / sizeof(float) < floats_per_vert) {
-    fprintf(stderr, "Error: Too many floats in a vertex\n");
+    Log_Error("Error: Too many floats in a vertex\n");
     goto err;
   }
   
   if ((vl = malloc(sizeof(*vl))) == NULL) {
-    perror("Error: Could not allocate vertex list");
+    Log_Perror("Error: Could not allocate vertex list");
     goto err;
   }
   memset(vl, 0, sizeof(*vl));
@@ -136,16 +221,17 @@ struct lp_vertex_list *LP_VertexList_New(size_t floats_per_vert, enum primative_
   vl->ind_alloc  = 64;
 
   if ((vl->vert = calloc(vl->vert_alloc, vl->vert_size)) == NULL) {
-    perror("Error: Could not allocate vertexes");
+    Log_Perror("Error: Could not allocate vertexes");
     goto err2;
   }
 
-  if ((vl->ind = calloc(vl->ind_alloc, sizeof(unsigned int))) == NULL) {
-    perror("Error: Could not allocate vertex indices");
+  if ((vl->ind = calloc(vl->ind_alloc, sizeof(lp_index_t))) == NULL) {
+    Log_Perror("Error: Could not allocate vertex indices");
     goto err3;
   }
 
-  if ((vl->vert_hash = Hash_New(vl, VlHash, VlCmp, VlCopy, NULL, NULL, NULL, NULL)) == NULL)
+  if (!(flags & LP_VERTEX_LIST_NO_DEDUP) &&
+      (vl->vert_hash = Hash_New(vl, VlHash, VlCmp, VlCopy, NULL, NULL, NULL, NULL)) == NULL)
     goto err4;
   
   return vl;
@@ -157,7 +243,7 @@ struct lp_vertex_list *LP_VertexList_New(size_t floats_per_vert, enum primative_
  err2:
   free(vl);
  err:
-  fprintf(stderr, "Error: Could not allocate memory for vertex list\n");
+  Log_Error("Error: Could not allocate memory for vertex list\n");
   return NULL;
 }
 
@@ -166,8 +252,9 @@ void LP_VertexList_Free(struct lp_vertex_list *vl) {
     return;
 
   Hash_Free(vl->vert_hash);
-  free(vl->ind);
-  free(vl->vert);
+  Block_Free(vl->ind, vl->ind_alloc * sizeof(*vl->ind), vl->ind_mapped);
+  Block_Free(vl->vert, vl->vert_alloc * vl->vert_size, vl->vert_mapped);
+  FileMap_Release(vl->backing);
   free(vl);
 }
 
@@ -175,7 +262,10 @@ void LP_VertexList_Clear(struct lp_vertex_list *vl) {
   vl->vert_used = 0;
   vl->ind_used = 0;
   
-  Hash_Clear(vl->vert_hash);
+  if (vl->vert_hash)
+    Hash_Clear(vl->vert_hash);
+  vl->hash_stale = 0;
+  vl->hash_empty = 0;
 }
 
 struct lp_vertex_list *LP_VertexList_Copy(const struct lp_vertex_list *vl, size_t new_floats_per_vert) {
@@ -183,7 +273,7 @@ struct lp_vertex_list *LP_VertexList_Copy(const struct lp_vertex_list *vl, size_
   size_t count, num, fpv;
   
   if ((fpv = LP_VertexList_FloatsPerVert(vl)) < new_floats_per_vert) {
-    fprintf(stderr, "Error too few vertices to copy\n");
+    Log_Error("Error too few vertices to copy\n");
     goto err;
   }
   
@@ -195,7 +285,7 @@ struct lp_vertex_list *LP_VertexList_Copy(const struct lp_vertex_list *vl, size_
   
   num = LP_VertexList_NumInd(vl);
   for (count = 0; count < num; count++)
-    if (LP_VertexList_Add(out, LP_VertexList_LookupVert(vl, count)) == UINT_MAX)
+    if (LP_VertexList_Add(out, LP_VertexList_LookupVert(vl, count)) == LP_INDEX_MAX)
       goto err2;
   
   return out;
@@ -206,30 +296,110 @@ struct lp_vertex_list *LP_VertexList_Copy(const struct lp_vertex_list *vl, size_
   return NULL;
 }
 
-static unsigned int AddVert(struct lp_vertex_list *vl, const float *vert) {
+struct lp_vertex_list *VertexList_Clone(const struct lp_vertex_list *vl) {
+  struct lp_vertex_list *out;
+  
+  if ((out = LP_VertexList_NewEx(vl->floats_per_vert, vl->primative_type, vl->vert_hash ? 0 : LP_VERTEX_LIST_NO_DEDUP)) == NULL)
+    goto err;
+  
+  if (LP_VertexList_Reserve(out, vl->vert_used, vl->ind_used) < 0)
+    goto err2;
+  
+  memcpy(out->vert, vl->vert, vl->vert_used * vl->vert_size);
+  memcpy(out->ind, vl->ind, vl->ind_used * sizeof(*vl->ind));
+  out->vert_used = vl->vert_used;
+  out->ind_used = vl->ind_used;
+  
+  if (out->vert_hash && out->vert_used > 0)
+    out->hash_stale = 1;
+  
+  return out;
+  
+ err2:
+  LP_VertexList_Free(out);
+ err:
+  return NULL;
+}
+
+struct lp_vertex_list *VertexList_NewMesh(lp_index_t num_vert, size_t num_ind, float **vert, lp_index_t **ind) {
+  struct lp_vertex_list *out;
+  
+  if ((out = LP_VertexList_New(3, lp_pt_triangle)) == NULL)
+    goto err;
+  
+  if (LP_VertexList_Reserve(out, num_vert, num_ind) < 0)
+    goto err2;
+  
+  *vert = out->vert;
+  *ind = out->ind;
+  out->vert_used = num_vert;
+  out->ind_used = num_ind;
+  
+  if (num_vert > 0)
+    out->hash_stale = 1;
+  
+  return out;
+  
+ err2:
+  LP_VertexList_Free(out);
+ err:
+  return NULL;
+}
+
+static int Rehash(struct lp_vertex_list *vl) {
+  lp_index_t num = vl->vert_used, count;
   void *key_out;
   
+  Hash_Clear(vl->vert_hash);
+  vl->vert_used = 0;
+  for (count = 0; count < num; count++)
+    if (Hash_Insert(vl->vert_hash, vl->vert + (size_t) count * vl->floats_per_vert, PRESENT, &key_out) < 0) {
+      Log_Error("Error: Could not add vertex to hash\n");
+      return -1;
+    }
+  vl->hash_empty = 0;
+  
+  return 0;
+}
+
+static lp_index_t AddVert(struct lp_vertex_list *vl, const float *vert) {
+  lp_index_t first;
+  void *key_out;
+  float *vv;
+  
+  if (vl->vert_hash == NULL) {
+    if ((vv = VertexList_AppendVerts(vl, 1, &first)) == NULL)
+      return LP_INDEX_MAX;
+    memcpy(vv, vert, vl->vert_size);
+    return first;
+  }
+  
+  if (vl->hash_stale && VertexList_Dedup(vl) < 0)
+    return LP_INDEX_MAX;
+  if (vl->hash_empty && Rehash(vl) < 0)
+    return LP_INDEX_MAX;
+  
   if (Hash_Insert(vl->vert_hash, vert, PRESENT, &key_out) < 0) {
-    fprintf(stderr, "Error: Could not add vertex to hash\n");
-    return UINT_MAX;
+    Log_Error("Error: Could not add vertex to hash\n");
+    return LP_INDEX_MAX;
   }
   
   return ((ptrdiff_t) key_out) - 1;
 }
 
-static unsigned int AddInd(struct lp_vertex_list *vl, unsigned int ind) {
+static lp_index_t AddInd(struct lp_vertex_list *vl, lp_index_t ind) {
   size_t new_alloc;
-  unsigned int *new_mem;
+  lp_index_t *new_mem;
   
   if (vl->ind_used >= vl->ind_alloc) {
-    if (((SIZE_MAX / sizeof(unsigned int)) >> 1) < vl->ind_alloc) {
-      fprintf(stderr, "Error: Too many indices in a single vertex list\n");
+    if (((SIZE_MAX / sizeof(lp_index_t)) >> 1) < vl->ind_alloc) {
+      Log_Error("Error: Too many indices in a single vertex list\n");
       goto err;
     }
     
     new_alloc = vl->ind_alloc << 1;
-    if ((new_mem = realloc(vl->ind, new_alloc * sizeof(unsigned int))) == NULL) {
-      fprintf(stderr, "Error: Out of memory adding vertex index\n");
+    if ((new_mem = Block_Resize(vl->ind, vl->ind_alloc * sizeof(lp_index_t), new_alloc * sizeof(lp_index_t), &vl->ind_mapped)) == NULL) {
+      Log_Error("Error: Out of memory adding vertex index\n");
       goto err;
     }
     
@@ -242,30 +412,113 @@ static unsigned int AddInd(struct lp_vertex_list *vl, unsigned int ind) {
   return ind;
   
  err:
-  return UINT_MAX;
+  return LP_INDEX_MAX;
 }
 
-unsigned int LP_VertexList_Add(struct lp_vertex_list *vl, const float *vert) {
-  unsigned int ind;
+lp_index_t LP_VertexList_Add(struct lp_vertex_list *vl, const float *vert) {
+  lp_index_t ind;
   
-  if ((ind = AddVert(vl, vert)) == UINT_MAX)
-    return UINT_MAX;
+  if ((ind = AddVert(vl, vert)) == LP_INDEX_MAX)
+    return LP_INDEX_MAX;
   
   return LP_VertexList_AddIndex(vl, ind);
 }
 
-unsigned int LP_VertexList_AddIndex(struct lp_vertex_list *vl, unsigned int index) {
+lp_index_t LP_VertexList_AddIndex(struct lp_vertex_list *vl, lp_index_t index) {
   if (index > vl->vert_used) {
-    printf("Error: Vertex index is out of range: %u, %u\n", index, vl->vert_used);
-    return UINT_MAX;
+    Log_Error("Error: Vertex index is out of range: %llu, %llu\n", (unsigned long long) index, (unsigned long long) vl->vert_used);
+    return LP_INDEX_MAX;
   }
   
   return AddInd(vl, index);
 }
 
+int LP_VertexList_AddMany(struct lp_vertex_list *vl, const float *verts, size_t num) {
+  lp_index_t first, *ii;
+  size_t count;
+  float *vv;
+  
+  if (num > LP_INDEX_MAX) {
+    Log_Error("Error: Too many vertices in a single vertex list\n");
+    return -1;
+  }
+  
+  /* A batch at least as large as the list is cheaper to merge in one pass */
+  if (vl->vert_hash == NULL || num >= vl->vert_used) {
+    if (LP_VertexList_Reserve(vl, num, num) < 0)
+      return -1;
+    vv = VertexList_AppendVerts(vl, num, &first);
+    ii = VertexList_AppendInd(vl, num);
+    memcpy(vv, verts, num * vl->vert_size);
+    for (count = 0; count < num; count++)
+      ii[count] = first + count;
+    return vl->vert_hash ? VertexList_Dedup(vl) : 0;
+  }
+  
+  if (LP_VertexList_Reserve(vl, 0, num) < 0)
+    return -1;
+  for (count = 0; count < num; count++)
+    if (LP_VertexList_Add(vl, verts + count * vl->floats_per_vert) == LP_INDEX_MAX)
+      return -1;
+  
+  return 0;
+}
+
+int LP_VertexList_AddIndexed(struct lp_vertex_list *vl, const float *verts, lp_index_t num_vert,
+			     const lp_index_t *ind, size_t num_ind) {
+  lp_index_t first, *map, *ii;
+  size_t count;
+  float *vv;
+  
+  for (count = 0; count < num_ind; count++)
+    if (ind[count] >= num_vert) {
+      Log_Error("Error: Vertex index is out of range: %llu, %llu\n", (unsigned long long) ind[count], (unsigned long long) num_vert);
+      return -1;
+    }
+  
+  if (vl->vert_hash == NULL) {
+    if (LP_VertexList_Reserve(vl, num_vert, num_ind) < 0)
+      return -1;
+    vv = VertexList_AppendVerts(vl, num_vert, &first);
+    ii = VertexList_AppendInd(vl, num_ind);
+    memcpy(vv, verts, (size_t) num_vert * vl->vert_size);
+    for (count = 0; count < num_ind; count++)
+      ii[count] = first + ind[count];
+    return 0;
+  }
+  
+  /* Vertices go in on first use, as they would through LP_VertexList_Add */
+  if ((map = malloc((num_vert + (size_t) 1) * sizeof(*map))) == NULL) {
+    Log_Error("Error: Could not allocate vertex map\n");
+    goto err;
+  }
+  for (count = 0; count < num_vert; count++)
+    map[count] = LP_INDEX_MAX;
+  
+  if (LP_VertexList_Reserve(vl, 0, num_ind) < 0)
+    goto err2;
+  for (count = 0; count < num_ind; count++) {
+    if (map[ind[count]] == LP_INDEX_MAX &&
+	(map[ind[count]] = AddVert(vl, verts + (size_t) ind[count] * vl->floats_per_vert)) == LP_INDEX_MAX)
+      goto err2;
+    if (AddInd(vl, map[ind[count]]) == LP_INDEX_MAX)
+      goto err2;
+  }
+  
+  free(map);
+  return 0;
+
+ err2:
+  free(map);
+ err:
+  return -1;
+}
+
 void LP_VertexList_Finalize(struct lp_vertex_list *vl) {
   Hash_Free(vl->vert_hash);
   vl->vert_hash = NULL;
+  vl->hash_stale = 0;
+  vl->hash_empty = 0;
 }
 
 size_t LP_VertexList_FloatsPerVert(const struct lp_vertex_list *vl) {
@@ -276,7 +529,7 @@ enum primative_type LP_VertexList_PrimativeType(const struct lp_vertex_list *vl)
   return vl->primative_type;
 }
 
-unsigned int LP_VertexList_NumVert(const struct lp_vertex_list *vl) {
+lp_index_t LP_VertexList_NumVert(const struct lp_vertex_list *vl) {
   return vl->vert_used;
 }
 
@@ -288,14 +541,613 @@ float *LP_VertexList_GetVert(const struct lp_vertex_list *vl) {
   return vl->vert;
 }
 
-unsigned int *LP_VertexList_GetInd(const struct lp_vertex_list *vl) {
+lp_index_t *LP_VertexList_GetInd(const struct lp_vertex_list *vl) {
   return vl->ind;
 }
 
-float *LP_VertexList_LookupVert(const struct lp_vertex_list *vl, unsigned int index) {
+float *LP_VertexList_LookupVert(const struct lp_vertex_list *vl, size_t index) {
   return vl->vert + vl->floats_per_vert * vl->ind[index];
 }
 
+/********************** Bulk helpers *******************************/
+int LP_VertexList_Reserve(struct lp_vertex_list *vl, lp_index_t num_vert, size_t num_ind) {
+  float *new_vert;
+  lp_index_t *new_ind;
+  
+  if (num_vert > LP_INDEX_MAX - vl->vert_used || num_ind > SIZE_MAX - vl->ind_used) {
+    Log_Error("Error: Too many vertices in a single vertex list\n");
+    return -1;
+  }
+  
+  num_vert += vl->vert_used;
+  num_ind  += vl->ind_used;
+  
+  if (num_vert > vl->vert_alloc) {
+    if (SIZE_MAX / vl->vert_size <= num_vert) {
+      Log_Error("Error: Out of memory reserving vertices\n");
+      return -1;
+    }
+    
+    if ((new_vert = Block_Resize(vl->vert, vl->vert_alloc * vl->vert_size, num_vert * vl->vert_size, &vl->vert_mapped)) == NULL) {
+      Log_Error("Error: Out of memory reserving vertices\n");
+      return -1;
+    }
+    
+    vl->vert = new_vert;
+    vl->vert_alloc = num_vert;
+  }
+  
+  if (num_ind > vl->ind_alloc) {
+    if (SIZE_MAX / sizeof(lp_index_t) <= num_ind) {
+      Log_Error("Error: Out of memory reserving vertex indices\n");
+      return -1;
+    }
+    
+    if ((new_ind = Block_Resize(vl->ind, vl->ind_alloc * sizeof(lp_index_t), num_ind * sizeof(lp_index_t), &vl->ind_mapped)) == NULL) {
+      Log_Error("Error: Out of memory reserving vertex indices\n");
+      return -1;
+    }
+    
+    vl->ind = new_ind;
+    vl->ind_alloc = num_ind;
+  }
+  
+  return 0;
+}
+
+float *VertexList_AppendVerts(struct lp_vertex_list *vl, lp_index_t num, lp_index_t *first) {
+  lp_index_t grow;
+  float *vv;
+  
+  if (num > vl->vert_alloc - vl->vert_used) {
+    grow = num > vl->vert_used ? num : vl->vert_used;
+    if (grow > LP_INDEX_MAX - vl->vert_used)
+      grow = num;
+    
+    if (LP_VertexList_Reserve(vl, grow, 0) < 0)
+      return NULL;
+  }
+  
+  vv = vl->vert + (size_t) vl->vert_used * vl->floats_per_vert;
+  if (first)
+    *first = vl->vert_used;
+  vl->vert_used += num;
+  
+  return vv;
+}
+
+lp_index_t *VertexList_AppendInd(struct lp_vertex_list *vl, size_t num) {
+  lp_index_t *ii;
+  size_t grow;
+  
+  if (num > vl->ind_alloc - vl->ind_used) {
+    grow = num > vl->ind_used ? num : vl->ind_used;
+    if (grow > SIZE_MAX - vl->ind_used)
+      grow = num;
+    
+    if (LP_VertexList_Reserve(vl, 0, grow) < 0)
+      return NULL;
+  }
+  
+  ii = vl->ind + vl->ind_used;
+  vl->ind_used += num;
+  
+  return ii;
+}
+
+/* Dedup keys pair the top bits of the vertex hash with the vertex index.  The
+ * hash part is as wide as an index, so a key packs into 8 or 16 bytes. */
+struct sort_key {
+  lp_index_t hash;
+  lp_index_t idx;
+};
+
+#define SORT_HASH(hash) ((lp_index_t) ((hash) >> (64 - 8 * sizeof(lp_index_t))))
+
+struct dedup_hash {
+  const struct lp_vertex_list *vl;
+  struct sort_key *key;
+  unsigned char secret[16];
+};
+
+#define DEDUP_CHUNK 65536
+
+static int DedupHashChunk(void *user, size_t chunk, size_t thread) {
+  struct dedup_hash *dh = (struct dedup_hash *) user;
+  const struct lp_vertex_list *vl = dh->vl;
+  size_t count, end;
+  uint64_t hash;
+  
+  end = (chunk + 1) * DEDUP_CHUNK;
+  if (end > vl->vert_used)
+    end = vl->vert_used;
+  
+  for (count = chunk * DEDUP_CHUNK; count < end; count++) {
+    hash = Hash_Bytes(dh->secret, vl->vert + count * vl->floats_per_vert, vl->vert_size);
+    dh->key[count].hash = SORT_HASH(hash);
+    dh->key[count].idx  = count;
+  }
+  
+  return 0;
+}
+
+/* Stable LSD radix sort on the hash bytes, so equal hashes stay in index order */
+static struct sort_key *RadixSort(struct sort_key *key, struct sort_key *tmp, size_t num) {
+  size_t (*hist)[256], count, pos, sum, next;
+  struct sort_key *swap;
+  int pass, shift;
+  
+  if ((hist = calloc(sizeof(lp_index_t), sizeof(*hist))) == NULL) {
+    Log_Error("Error: Could not allocate radix histogram\n");
+    return NULL;
+  }
+  
+  for (count = 0; count < num; count++)
+    for (pass = 0; pass < (int) sizeof(lp_index_t); pass++)
+      hist[pass][(key[count].hash >> (8 * pass)) & 0xFF]++;
+  
+  for (pass = 0; pass < (int) sizeof(lp_index_t); pass++) {
+    shift = 8 * pass;
+    if (hist[pass][(key[0].hash >> shift) & 0xFF] == num)
+      continue;
+    
+    for (sum = 0, pos = 0; pos < 256; pos++) {
+      next = sum + hist[pass][pos];
+      hist[pass][pos] = sum;
+      sum = next;
+    }
+    
+    for (count = 0; count < num; count++)
+      tmp[hist[pass][(key[count].hash >> shift) & 0xFF]++] = key[count];
+    
+    swap = key;
+    key = tmp;
+    tmp = swap;
+  }
+  
+  free(hist);
+  return key;
+}
+
+void VertexList_Modified(struct lp_vertex_list *vl) {
+  if (vl->vert_hash)
+    vl->hash_stale = 1;
+}
+
+void VertexList_ReleaseHash(struct lp_vertex_list *vl) {
+  struct hash *hash;
+  
+  if (vl->vert_hash == NULL || Hash_NumEntries(vl->vert_hash) == 0)
+    return;
+  
+  /* The full hash still works if a fresh one cannot be had */
+  if ((hash = Hash_New(vl, VlHash, VlCmp, VlCopy, NULL, NULL, NULL, NULL)) == NULL)
+    return;
+  Hash_Free(vl->vert_hash);
+  vl->vert_hash = hash;
+  if (!vl->hash_stale)
+    vl->hash_empty = vl->vert_used > 0;
+}
+
+void VertexList_Borrow(struct lp_vertex_list *vl, struct file_map *map, float *vert, lp_index_t num_vert, lp_index_t *ind, size_t num_ind) {
+  if (num_vert > 0) {
+    Block_Free(vl->vert, vl->vert_alloc * vl->vert_size, vl->vert_mapped);
+    vl->vert = vert;
+    vl->vert_alloc = num_vert;
+    vl->vert_mapped = BLOCK_BORROWED;
+  }
+  vl->vert_used = num_vert;
+  
+  if (num_ind > 0) {
+    Block_Free(vl->ind, vl->ind_alloc * sizeof(*vl->ind), vl->ind_mapped);
+    vl->ind = ind;
+    vl->ind_alloc = num_ind;
+    vl->ind_mapped = BLOCK_BORROWED;
+  }
+  vl->ind_used = num_ind;
+  
+  if (vl->vert_hash)
+    vl->hash_stale = 1;
+  
+  FileMap_Ref(map);
+  FileMap_Release(vl->backing);
+  vl->backing = map;
+}
+
+int VertexList_Dedup(struct lp_vertex_list *vl) {
+  struct sort_key *key, *sorted;
+  struct dedup_hash dh;
+  size_t num, start, end, count, other;
+  lp_index_t *map, rep, next;
+  
+  if ((num = vl->vert_used) == 0) {
+    vl->hash_stale = 0;
+    vl->hash_empty = 0;
+    return 0;
+  }
+  
+  if ((key = malloc(2 * num * sizeof(*key))) == NULL) {
+    Log_Error("Error: Could not allocate vertex dedup keys\n");
+    goto err;
+  }
+  
+  if ((map = malloc(num * sizeof(*map))) == NULL) {
+    Log_Error("Error: Could not allocate vertex dedup map\n");
+    goto err2;
+  }
+  
+  memset(&dh, 0, sizeof(dh));
+  dh.vl  = vl;
+  dh.key = key;
+#ifndef USE_FAST_HASH
+  Random(dh.secret, sizeof(dh.secret));
+#endif
+  
+  if (Parallel_For((num + DEDUP_CHUNK - 1) / DEDUP_CHUNK, DedupHashChunk, &dh) < 0)
+    goto err3;
+  
+  if ((sorted = RadixSort(key, key + num, num)) == NULL)
+    goto err3;
+  
+  for (count = 0; count < num; count++)
+    map[count] = LP_INDEX_MAX;
+  
+  /* Within each run of equal hashes, the first unmatched index is the representative */
+  for (start = 0; start < num; start = end) {
+    for (end = start + 1; end < num && sorted[end].hash == sorted[start].hash; end++)
+      ;
+    
+    for (count = start; count < end; count++) {
+      if (map[sorted[count].idx] != LP_INDEX_MAX)
+	continue;
+      
+      rep = sorted[count].idx;
+      map[rep] = rep;
+      for (other = count + 1; other < end; other++)
+	if (map[sorted[other].idx] == LP_INDEX_MAX &&
+	    memcmp(vl->vert + (size_t) rep * vl->floats_per_vert,
+		   vl->vert + (size_t) sorted[other].idx * vl->floats_per_vert, vl->vert_size) == 0)
+	  map[sorted[other].idx] = rep;
+    }
+  }
+  
+  /* Representatives come before their duplicates, so they are renumbered first */
+  for (next = 0, count = 0; count < num; count++) {
+    if (map[count] == count) {
+      if (next != count)
+	memcpy(vl->vert + (size_t) next * vl->floats_per_vert, vl->vert + count * vl->floats_per_vert, vl->vert_size);
+      map[count] = next++;
+    } else {
+      map[count] = map[map[count]];
+    }
+  }
+  
+  for (count = 0; count < vl->ind_used; count++)
+    vl->ind[count] = map[vl->ind[count]];
+  
+  vl->vert_used = next;
+  
+  /* Filled by the next add, a list that is only read never needs it */
+  if (vl->vert_hash) {
+    Hash_Clear(vl->vert_hash);
+    vl->hash_empty = 1;
+  }
+  vl->hash_stale = 0;
+  
+  free(map);
+  free(key);
+  return 0;
+  
+ err3:
+  free(map);
+ err2:
+  free(key);
+ err:
+  return -1;
+}
+
+/********************** Welding ************************************/
+#define WELD_CHUNK 16384
+#define WELD_MIX   UINT64_C(0x9e3779b97f4a7c15)
+
+struct weld_pairs {
+  lp_index_t *pair;  /* 2 per pair */
+  size_t num;
+  size_t alloc;
+};
+
+struct weld_slot {
+  lp_index_t hash;
+  size_t start;        /* First sorted position of the cell hash, SIZE_MAX if empty */
+};
+
+struct weld {
+  const struct lp_vertex_list *vl;
+  size_t num_cmp;
+  float tol;
+  int reach;
+  int64_t *cell;       /* 3 per vertex */
+  struct sort_key *sorted;  /* Cell hashes, as for dedup */
+  struct weld_slot *table;
+  size_t table_mask;
+  struct weld_pairs *pairs;
+};
+
+static uint64_t CellHash(const int64_t *cell) {
+  uint64_t hash;
+  
+  hash = ((uint64_t) cell[0] * WELD_MIX) ^ (uint64_t) cell[1];
+  hash = (hash * WELD_MIX) ^ (uint64_t) cell[2];
+  
+  return hash * WELD_MIX;
+}
+
+static int WeldCellChunk(void *user, size_t chunk, size_t thread) {
+  struct weld *w = (struct weld *) user;
+  const struct lp_vertex_list *vl = w->vl;
+  size_t count, end, axis;
+  int64_t *cell;
+  float *vv;
+  union {
+    float f;
+    uint32_t u;
+  } conv;
+  
+  end = (chunk + 1) * WELD_CHUNK;
+  if (end > vl->vert_used)
+    end = vl->vert_used;
+  
+  for (count = chunk * WELD_CHUNK; count < end; count++) {
+    vv = vl->vert + count * vl->floats_per_vert;
+    cell = &w->cell[3 * count];
+    for (axis = 0; axis < 3; axis++) {
+      if (w->reach) {
+	cell[axis] = (int64_t) floor((double) vv[axis] / (2.0 * w->tol));
+      } else {
+	/* +0 and -0 are the same point */
+	conv.f = vv[axis] + 0.0f;
+	cell[axis] = conv.u;
+      }
+    }
+    w->sorted[count].hash = SORT_HASH(CellHash(cell));
+    w->sorted[count].idx  = count;
+  }
+  
+  return 0;
+}
+
+static size_t WeldLookup(const struct weld *w, lp_index_t hash) {
+  size_t slot;
+  
+  for (slot = hash & w->table_mask; w->table[slot].start != SIZE_MAX; slot = (slot + 1) & w->table_mask)
+    if (w->table[slot].hash == hash)
+      return w->table[slot].start;
+  
+  return SIZE_MAX;
+}
+
+static int WeldMatch(const struct weld *w, lp_index_t a, lp_index_t b) {
+  const float *va = w->vl->vert + (size_t) a * w->vl->floats_per_vert;
+  const float *vb = w->vl->vert + (size_t) b * w->vl->floats_per_vert;
+  size_t count;
+  
+  for (count = 0; count < w->num_cmp; count++)
+    if (!(fabsf(va[count] - vb[count]) <= w->tol))
+      return 0;
+  
+  return 1;
+}
+
+static int WeldAddPair(struct weld_pairs *wp, lp_index_t a, lp_index_t b) {
+  lp_index_t *new_pair;
+  size_t new_alloc;
+  
+  if (wp->num >= wp->alloc) {
+    new_alloc = wp->alloc ? wp->alloc << 1 : 1024;
+    if ((new_pair = realloc(wp->pair, 2 * new_alloc * sizeof(*new_pair))) == NULL) {
+      Log_Error("Error: Could not allocate weld pairs\n");
+      return -1;
+    }
+    wp->pair = new_pair;
+    wp->alloc = new_alloc;
+  }
+  
+  wp->pair[2 * wp->num] = a;
+  wp->pair[2 * wp->num + 1] = b;
+  wp->num++;
+  
+  return 0;
+}
+
+/* Pairs every vertex with the earlier vertices it matches.  Cells are two
+ * tolerances wide, so a match is in the vertex's own cell or the neighbour
+ * on the side of each axis the vertex is nearer to. */
+static int WeldPairChunk(void *user, size_t chunk, size_t thread) {
+  struct weld *w = (struct weld *) user;
+  size_t pos, end, other, axis;
+  int64_t near[3], side[3];
+  lp_index_t idx, cand, hash;
+  int cc;
+  double tt;
+  float *vv;
+  
+  end = (chunk + 1) * WELD_CHUNK;
+  if (end > w->vl->vert_used)
+    end = w->vl->vert_used;
+  
+  for (pos = chunk * WELD_CHUNK; pos < end; pos++) {
+    idx = w->sorted[pos].idx;
+    vv = w->vl->vert + (size_t) idx * w->vl->floats_per_vert;
+    for (axis = 0; axis < 3; axis++) {
+      side[axis] = 0;
+      if (w->reach) {
+	tt = (double) vv[axis] / (2.0 * w->tol);
+	side[axis] = tt - floor(tt) < 0.5 ? -1 : 1;
+      }
+    }
+    
+    for (cc = 0; cc < (w->reach ? 8 : 1); cc++) {
+      for (axis = 0; axis < 3; axis++)
+	near[axis] = w->cell[3 * (size_t) idx + axis] + ((cc >> axis) & 1) * side[axis];
+      hash = SORT_HASH(CellHash(near));
+      if ((other = WeldLookup(w, hash)) == SIZE_MAX)
+	continue;
+      
+      /* Indices rise within a run, so stop at the vertex itself */
+      for (; other < w->vl->vert_used && w->sorted[other].hash == hash; other++) {
+	if ((cand = w->sorted[other].idx) >= idx)
+	  break;
+	if (WeldMatch(w, idx, cand) && WeldAddPair(&w->pairs[chunk], idx, cand) < 0)
+	  return -1;
+      }
+    }
+  }
+  
+  return 0;
+}
+
+static lp_index_t WeldFind(lp_index_t *parent, lp_index_t idx) {
+  while (parent[idx] != idx) {
+    parent[idx] = parent[parent[idx]];
+    idx = parent[idx];
+  }
+  
+  return idx;
+}
+
+struct lp_vertex_list *LP_VertexList_Weld(const struct lp_vertex_list *vl, float tol, int options) {
+  struct lp_vertex_list *out;
+  struct weld w;
+  size_t num, num_chunks, count, pair, slot, fpv_out, size;
+  lp_index_t *parent, *map, aa, bb, root, num_out, *ii;
+  struct sort_key *key;
+  float *vv;
+  
+  if (tol < 0) {
+    Log_Error("Error: Weld tolerance must not be negative\n");
+    goto err;
+  }
+  if (vl->floats_per_vert < 3) {
+    Log_Error("Error: Too few floats per vertex to weld\n");
+    goto err;
+  }
+  
+  memset(&w, 0, sizeof(w));
+  w.vl = vl;
+  w.tol = tol;
+  w.reach = tol > 0;
+  w.num_cmp = (options & LP_WELD_POSITION) ? 3 : vl->floats_per_vert;
+  fpv_out = w.num_cmp;
+  num = vl->vert_used;
+  num_chunks = (num + WELD_CHUNK - 1) / WELD_CHUNK;
+  
+  for (size = 16; size < 2 * num; size <<= 1)
+    ;
+  w.table_mask = size - 1;
+  
+  if ((w.cell = malloc((3 * num + 1) * sizeof(*w.cell))) == NULL) {
+    Log_Error("Error: Could not allocate weld grid\n");
+    goto err;
+  }
+  if ((key = malloc((2 * num + 1) * sizeof(*key))) == NULL) {
+    Log_Error("Error: Could not allocate weld grid\n");
+    goto err2;
+  }
+  w.sorted = key;
+  if ((w.table = malloc(size * sizeof(*w.table))) == NULL) {
+    Log_Error("Error: Could not allocate weld grid\n");
+    goto err3;
+  }
+  if ((w.pairs = calloc(num_chunks + 1, sizeof(*w.pairs))) == NULL) {
+    Log_Error("Error: Could not allocate weld pairs\n");
+    goto err4;
+  }
+  if ((parent = malloc((2 * (size_t) num + 1) * sizeof(*parent))) == NULL) {
+    Log_Error("Error: Could not allocate weld map\n");
+    goto err5;
+  }
+  map = parent + num;
+  
+  if (Parallel_For(num_chunks, WeldCellChunk, &w) < 0)
+    goto err6;
+  if (num > 0 && (w.sorted = RadixSort(key, key + num, num)) == NULL)
+    goto err6;
+  
+  for (slot = 0; slot < size; slot++)
+    w.table[slot].start = SIZE_MAX;
+  for (count = 0; count < num; count++) {
+    if (count > 0 && w.sorted[count].hash == w.sorted[count - 1].hash)
+      continue;
+    for (slot = w.sorted[count].hash & w.table_mask; w.table[slot].start != SIZE_MAX; slot = (slot + 1) & w.table_mask)
+      ;
+    w.table[slot].hash = w.sorted[count].hash;
+    w.table[slot].start = count;
+  }
+  
+  if (Parallel_For(num_chunks, WeldPairChunk, &w) < 0)
+    goto err6;
+  
+  /* Roots are the lowest index in each group, so welded vertices keep their order */
+  for (count = 0; count < num; count++)
+    parent[count] = count;
+  for (count = 0; count < num_chunks; count++)
+    for (pair = 0; pair < w.pairs[count].num; pair++) {
+      aa = WeldFind(parent, w.pairs[count].pair[2 * pair]);
+      bb = WeldFind(parent, w.pairs[count].pair[2 * pair + 1]);
+      if (aa < bb)
+	parent[bb] = aa;
+      else if (bb < aa)
+	parent[aa] = bb;
+    }
+  
+  num_out = 0;
+  for (count = 0; count < num; count++) {
+    root = WeldFind(parent, count);
+    map[count] = root == count ? num_out++ : map[root];
+  }
+  
+  if ((out = LP_VertexList_New(fpv_out, vl->primative_type)) == NULL)
+    goto err6;
+  if (LP_VertexList_Reserve(out, num_out, vl->ind_used) < 0)
+    goto err7;
+  
+  vv = VertexList_AppendVerts(out, num_out, NULL);
+  for (count = 0; count < num; count++)
+    if (parent[count] == count)
+      memcpy(vv + (size_t) map[count] * fpv_out, vl->vert + count * vl->floats_per_vert, fpv_out * sizeof(float));
+  
+  ii = VertexList_AppendInd(out, vl->ind_used);
+  for (count = 0; count < vl->ind_used; count++)
+    ii[count] = map[vl->ind[count]];
+  VertexList_Modified(out);
+  
+  free(parent);
+  for (count = 0; count < num_chunks; count++)
+    free(w.pairs[count].pair);
+  free(w.pairs);
+  free(w.table);
+  free(key);
+  free(w.cell);
+  return out;
+
+ err7:
+  LP_VertexList_Free(out);
+ err6:
+  free(parent);
+ err5:
+  for (count = 0; count < num_chunks; count++)
+    free(w.pairs[count].pair);
+  free(w.pairs);
+ err4:
+  free(w.table);
+ err3:
+  free(key);
+ err2:
+  free(w.cell);
+ err:
+  return NULL;
+}
+
 /********************** VertexList lists ***************************/
 struct lp_vl_list *LP_VertexList_ListAppend(struct lp_vl_list *list, struct lp_vertex_list *vl) {
   struct lp_vl_list **end, *new;
@@ -353,7 +1205,9 @@ void LP_VertexList_ListFree(struct lp_vl_list *list) {
 /********************** Read & Write *******************************/
 
 enum file_type {
+  ft_lpm,
   ft_obj,
+  ft_ply,
   ft_stl,
   ft_svg
 };
@@ -363,9 +1217,15 @@ static enum file_type FileType(const char *filename) {
 
   len = strlen(filename);
   
+  if (len > 4 && strcasecmp(filename + len - 4, ".lpm") == 0)
+    return ft_lpm;
+
   if (len > 4 && strcasecmp(filename + len - 4, ".obj") == 0)
     return ft_obj;
 
+  if (len > 4 && strcasecmp(filename + len - 4, ".ply") == 0)
+    return ft_ply;
+
   if (len > 4 && strcasecmp(filename + len - 4, ".stl") == 0)
     return ft_stl;
 
@@ -381,30 +1241,32 @@ struct lp_vl_list *LP_VertexList_Read(const char *filename, float scale) {
   enum file_type ft;
 
   if ((ft = FileType(filename)) == UINT_MAX) {
-    fprintf(stderr, "Error: Unkown mesh format '%s', must be .obj, .stl, or .svg\n", filename);
+    Log_Error("Error: Unkown mesh format '%s', must be .lpm, .obj, .ply, .stl, or .svg\n", filename);
     goto err;
   }
   
-  printf("Reading mesh(es) from '%s'\n", filename);
+  Log_Info("Reading mesh(es) from '%s'\n", filename);
   if ((in = fopen(filename, "r")) == NULL) {
-    perror("Error: Could not open file for reading");
+    Log_Perror("Error: Could not open file for reading");
     goto err;
   }
 
   switch (ft) {
+  case ft_lpm: list = FileLpm_Read(in, scale); break;
   case ft_obj: list = FileObj_Read(in, scale); break;
+  case ft_ply: list = FilePly_Read(in, scale); break;
   case ft_stl: list = FileStl_Read(in, scale); break;
   case ft_svg: list = FileSvg_Read(in, scale); break;
   }
   
   if (list == NULL) {
-    fprintf(stderr, "Error: No polyhedra returned from file read\n");
+    Log_Error("Error: No polyhedra returned from file read\n");
     goto err2;
   }
   
   fclose(in);
   for (cur = list; cur != NULL; cur = cur->next)
-    LP_VertexList_Finalize(cur->vl);
+    VertexList_ReleaseHash(cur->vl);
   return list;
 
  err2:
@@ -413,30 +1275,39 @@ struct lp_vl_list *LP_VertexList_Read(const char *filename, float scale) {
   return NULL;
 }
 
-int LP_VertexList_Write(const char *filename, struct lp_vl_list *list, float scale) {
+static int WriteFile(const char *filename, struct lp_vl_list *list, float scale, void *buf, size_t buf_size) {
+  struct write_buf wb;
   FILE *out;
   enum file_type ft;
   int ret;
 
   if ((ft = FileType(filename)) == UINT_MAX) {
-    fprintf(stderr, "Error: Unkown mesh format '%s', must be .obj or .stl\n", filename);
+    Log_Error("Error: Unkown mesh format '%s', must be .lpm, .obj, .ply, .stl, or .svg\n", filename);
     goto err;
   }
   
-  printf("Writing %zu mesh(es) to '%s'\n", LP_VertexList_ListLength(list), filename);
+  Log_Info("Writing %zu mesh(es) to '%s'\n", LP_VertexList_ListLength(list), filename);
   if ((out = fopen(filename, "w")) == NULL) {
-    perror("Error: Could not open file for writing");
+    Log_Perror("Error: Could not open file for writing");
     goto err;
   }
   
+  if (ft != ft_svg && WriteBuf_Init(&wb, out, buf, buf_size) < 0)
+    goto err2;
+  
   switch (ft) {
-  case ft_obj: ret = FileObj_Write(out, list, scale); break;
-  case ft_stl: ret = FileStl_Write(out, list, scale); break;
+  case ft_lpm: ret = FileLpm_Write(&wb, list, scale); break;
+  case ft_obj: ret = FileObj_Write(&wb, list, scale); break;
+  case ft_ply: ret = FilePly_Write(&wb, list, scale); break;
+  case ft_stl: ret = FileStl_Write(&wb, list, scale); break;
   case ft_svg: ret = FileSvg_Write(out, list, scale); break;
   }
   
+  if (ft != ft_svg && WriteBuf_Finish(&wb) < 0)
+    ret = -1;
+  
   if (ret < 0) {
-    fprintf(stderr, "Error: Could not write polyhedra to file\n");
+    Log_Error("Error: Could not write polyhedra to file\n");
     goto err2;
   }
   
@@ -448,3 +1319,11 @@ int LP_VertexList_Write(const char *filename, struct lp_vl_list *list, float sca
  err:
   return -1;
 }
+
+int LP_VertexList_Write(const char *filename, struct lp_vl_list *list, float scale) {
+  return WriteFile(filename, list, scale, NULL, 0);
+}
+
+int LP_VertexList_WriteBuffered(const char *filename, struct lp_vl_list *list, float scale, void *buf, size_t buf_size) {
+  return WriteFile(filename, list, scale, buf, buf_size);
+}
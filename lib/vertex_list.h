@@ -0,0 +1,68 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef LP_VERTEX_LIST_H
+#define LP_VERTEX_LIST_H
+
+#include "libpolyhedra.h"
+
+struct file_map;
+
+/* Bulk helpers for the file readers.  Vertices appended with
+ * VertexList_AppendVerts bypass the dedup hash until VertexList_Dedup runs.
+ * Appending past the space set aside by LP_VertexList_Reserve at least
+ * doubles the allocation. */
+float *VertexList_AppendVerts(struct lp_vertex_list *vl, lp_index_t num, lp_index_t *first);
+lp_index_t *VertexList_AppendInd(struct lp_vertex_list *vl, size_t num);
+
+/* Merges identical vertices, keeping them in order of first appearance.
+ * The dedup hash is left empty and filled by the next add. */
+int VertexList_Dedup(struct lp_vertex_list *vl);
+
+/* Vertices were rewritten in place; the next add rebuilds the dedup hash */
+void VertexList_Modified(struct lp_vertex_list *vl);
+
+/* Frees the entries of the dedup hash once a list is built.  Unlike
+ * LP_VertexList_Finalize the list still dedups, the next add refills it. */
+void VertexList_ReleaseHash(struct lp_vertex_list *vl);
+
+/* Same vertices and indices in the same order, unlike LP_VertexList_Copy */
+struct lp_vertex_list *VertexList_Clone(const struct lp_vertex_list *vl);
+
+/* Triangle list holding num_vert vertices and num_ind indices for the caller
+ * to fill in through vert and ind.  The vertices must already be distinct. */
+struct lp_vertex_list *VertexList_NewMesh(lp_index_t num_vert, size_t num_ind, float **vert, lp_index_t **ind);
+
+/* Points vl at vertices and indices inside map instead of copying them.
+ * Each block is copied out the first time it has to change size.  The list
+ * holds a reference on map until it is freed. */
+void VertexList_Borrow(struct lp_vertex_list *vl, struct file_map *map, float *vert, lp_index_t num_vert, lp_index_t *ind, size_t num_ind);
+
+#endif
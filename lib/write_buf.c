@@ -0,0 +1,196 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include <math.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "log.h"
+#include "write_buf.h"
+
+#define DEFAULT_SIZE (1 << 20)
+
+int WriteBuf_Init(struct write_buf *wb, FILE *out, void *buf, size_t size) {
+  memset(wb, 0, sizeof(*wb));
+  
+  if (buf == NULL) {
+    if (size == 0)
+      size = DEFAULT_SIZE;
+    
+    if ((buf = malloc(size)) == NULL) {
+      Log_Error("Error: Could not allocate write buffer\n");
+      return -1;
+    }
+    wb->own = 1;
+  }
+  
+  if (size < WRITE_BUF_FLOAT_LEN) {
+    Log_Error("Error: Write buffer too small: %zu bytes\n", size);
+    if (wb->own)
+      free(buf);
+    return -1;
+  }
+  
+  wb->out  = out;
+  wb->buf  = buf;
+  wb->size = size;
+  
+  setvbuf(out, NULL, _IONBF, 0);
+  return 0;
+}
+
+int WriteBuf_Flush(struct write_buf *wb) {
+  if (wb->used && !wb->err && fwrite(wb->buf, wb->used, 1, wb->out) != 1) {
+    Log_Perror("Error: Could not write to file");
+    wb->err = 1;
+  }
+  
+  wb->used = 0;
+  return wb->err ? -1 : 0;
+}
+
+int WriteBuf_Finish(struct write_buf *wb) {
+  WriteBuf_Flush(wb);
+  
+  if (wb->own)
+    free(wb->buf);
+  wb->buf = NULL;
+  
+  return wb->err ? -1 : 0;
+}
+
+char *WriteBuf_Space(struct write_buf *wb, size_t len) {
+  if (len > wb->size)
+    return NULL;
+  
+  if (len > wb->size - wb->used && WriteBuf_Flush(wb) < 0)
+    return NULL;
+  
+  return wb->buf + wb->used;
+}
+
+void WriteBuf_Commit(struct write_buf *wb, size_t len) {
+  wb->used += len;
+}
+
+int WriteBuf_Add(struct write_buf *wb, const void *data, size_t len) {
+  char *dest;
+  
+  if (len > wb->size) {
+    if (WriteBuf_Flush(wb) < 0)
+      return -1;
+    
+    if (fwrite(data, len, 1, wb->out) != 1) {
+      Log_Perror("Error: Could not write to file");
+      wb->err = 1;
+      return -1;
+    }
+    
+    return 0;
+  }
+  
+  if ((dest = WriteBuf_Space(wb, len)) == NULL)
+    return -1;
+  
+  memcpy(dest, data, len);
+  WriteBuf_Commit(wb, len);
+  return 0;
+}
+
+int WriteBuf_Printf(struct write_buf *wb, const char *format, ...) {
+  va_list ap;
+  char *dest;
+  int len;
+  
+  if ((dest = WriteBuf_Space(wb, WRITE_BUF_FLOAT_LEN)) == NULL)
+    return -1;
+  
+  va_start(ap, format);
+  len = vsnprintf(dest, wb->size - wb->used, format, ap);
+  va_end(ap);
+  
+  if (len < 0 || (size_t) len >= wb->size - wb->used) {
+    Log_Error("Error: Formatted output does not fit in the write buffer\n");
+    return -1;
+  }
+  
+  WriteBuf_Commit(wb, len);
+  return 0;
+}
+
+char *WriteBuf_FormatSize(char *dest, size_t val) {
+  char digits[24], *cur = digits;
+  
+  do {
+    *cur++ = '0' + val % 10;
+    val /= 10;
+  } while (val);
+  
+  while (cur > digits)
+    *dest++ = *--cur;
+  
+  return dest;
+}
+
+char *WriteBuf_FormatFloat(char *dest, float val) {
+  uint64_t fixed;
+  double mag;
+  int count;
+  
+  /* A float times 10^6 is exact in a double, so rounding it to an integer
+   * in the current rounding mode gives what printf would print */
+  mag = fabs((double) val);
+  if (!(mag < 1e12))
+    return dest + snprintf(dest, WRITE_BUF_FLOAT_LEN, "%f", val);
+  
+  fixed = nearbyint(mag * 1e6);
+  
+  if (signbit(val))
+    *dest++ = '-';
+  
+  dest = WriteBuf_FormatSize(dest, fixed / 1000000);
+  *dest++ = '.';
+  
+  fixed %= 1000000;
+  for (count = 5; count >= 0; count--) {
+    dest[count] = '0' + fixed % 10;
+    fixed /= 10;
+  }
+  
+  return dest + 6;
+}
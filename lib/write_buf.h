@@ -0,0 +1,66 @@
+/*
+  Copyright (C) 2026 Paul Maurer
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  
+  1. Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+  
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  
+  3. Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from this
+  software without specific prior written permission.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef LP_WRITE_BUF_H
+#define LP_WRITE_BUF_H
+
+#include <stdio.h>
+
+/* Batches file output into one large buffer that goes to the OS with a
+ * single fwrite per batch.  The FILE is switched to unbuffered so stdio
+ * does not copy the data a second time. */
+struct write_buf {
+  FILE *out;
+  char *buf;
+  size_t size;
+  size_t used;
+  int own;
+  int err;
+};
+
+/* buf is owned by the caller, NULL to allocate size bytes (0 for the default) */
+int WriteBuf_Init(struct write_buf *wb, FILE *out, void *buf, size_t size);
+int WriteBuf_Finish(struct write_buf *wb); /* Flushes and frees, -1 if any write failed */
+
+int WriteBuf_Flush(struct write_buf *wb);
+
+/* Returns room for len bytes at the end of the buffer, used with WriteBuf_Commit */
+char *WriteBuf_Space(struct write_buf *wb, size_t len);
+void WriteBuf_Commit(struct write_buf *wb, size_t len);
+
+int WriteBuf_Add(struct write_buf *wb, const void *data, size_t len);
+int WriteBuf_Printf(struct write_buf *wb, const char *format, ...);
+
+/* Same text as printf("%f") and printf("%zu"), returns the end of the text */
+#define WRITE_BUF_FLOAT_LEN 64
+char *WriteBuf_FormatFloat(char *dest, float val);
+char *WriteBuf_FormatSize(char *dest, size_t val);
+
+#endif
@@ -44,16 +44,26 @@
 #include <locale.h>
 #endif
 
+#ifdef HAVE_PTHREADS
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#endif
+
 #include <limits.h>
+#include <stdarg.h>
 #include <math.h>
 #include <string.h>
 
 #include "libpolyhedra.h"
 
+/* Memory for the result cache enabled by -C */
+#define CACHE_SIZE ((size_t) 256 << 20)
+
 void help(FILE *out) {
   fprintf(out, "%s: convert and operate on polyhedra with triangular faces\n", PACKAGE_STRING);
-  fprintf(out, "  polyhedra [-c] [-d t] [-h] [-m] [-o <outfile>] [-p <x,y,z,d>]\n");
-  fprintf(out, "    [-q] [-s <faces>] [-x <scale>] <infile>...\n\n");
+  fprintf(out, "  polyhedra [-c] [-C <dir>] [-d t] [-h] [-j <threads>] [-m] [-o <outfile>]\n");
+  fprintf(out, "    [-O <dir>] [-p <x,y,z,d>] [-q] [-s <faces>] [-x <scale>] <infile>...\n\n");
   fprintf(out, "  Reads in the polyhedra contained in input files and optionally performs\n");
   fprintf(out, "  operations on them.  The operations, when selected, are always performed\n");
   fprintf(out, "  this order, regardless of the order of the options in the command:\n");
@@ -64,10 +74,17 @@ void help(FILE *out) {
   fprintf(out, "    5. Mass properities (enabled with -m)\n\n");
   fprintf(out, "  -c\n");
   fprintf(out, "    Calculate the convex hull\n\n");
+  fprintf(out, "  -C <dir>\n");
+  fprintf(out, "    Reuse simplify, convex hull and decomposition results for identical\n");
+  fprintf(out, "    polyhedra.  Results are also kept in <dir> for later runs; pass an empty\n");
+  fprintf(out, "    string to keep them in memory only.\n\n");
   fprintf(out, "  -d threshold\n");
   fprintf(out, "    Perform approximate surface decomposition into convex polyhedra\n\n");
   fprintf(out, "  -h\n");
   fprintf(out, "    Print this help screen and exit\n\n");
+  fprintf(out, "  -j <threads>\n");
+  fprintf(out, "    Use up to <threads> threads, processing several input files at once when\n");
+  fprintf(out, "    more than one is given.  Pass 0 to use one per processor.  Default: 1\n\n");
   fprintf(out, "  -m\n");
   fprintf(out, "    Calculate mass properties of each polyhedra individually:\n");
   fprintf(out, "      * volume,\n");
@@ -76,6 +93,10 @@ void help(FILE *out) {
   fprintf(out, "  -o <outfile>\n");
   fprintf(out, "    Save resulting polyhedra to <outfile>.  Default: out.obj\n");
   fprintf(out, "    To omit saving output pass an empty string as <outfile>\n\n");
+  fprintf(out, "  -O <dir>\n");
+  fprintf(out, "    Process and save each input file on its own, to <dir>/<infile> with the\n");
+  fprintf(out, "    extension of <outfile>, instead of joining them into <outfile>.  Fails\n");
+  fprintf(out, "    before processing anything if two inputs would get the same output\n\n");
   fprintf(out, "  -p <x,y,z,d>\n");
   fprintf(out, "    Cut the polyhedra along a plane define by the normal: (x, y, z) and is\n");
   fprintf(out, "    d units from the origin.\n\n");
@@ -104,59 +125,361 @@ void Parse_Floats(float *out, size_t num, const char *str) {
   }
 }
 
+/* Status messages go to stdout along with the rest of the output */
+void Log(void *user, enum lp_log_level level, const char *msg) {
+  fprintf(level <= lp_log_warning ? stderr : stdout, "%s\n", msg);
+}
+
+/* Operations selected on the command line */
+struct ops {
+  unsigned long long simplify;
+  int convex;
+  int plane;
+  int decomp;
+  int mass_prop;
+  int verbose;
+  float scale, dval[1], pval[4];
+  const char *outdir;
+};
+
+/* One input file, processed independently of the others */
+struct job {
+  const char *infile;
+  const char *prefix;
+  char *outfile;
+  struct lp_vl_list *data;
+};
+
+struct batch {
+  const struct ops *ops;
+  struct job *jobs;
+  size_t num, next;
+  int err;
+#ifdef HAVE_PTHREADS
+  pthread_mutex_t mutex;
+#endif
+};
+
+#ifdef HAVE_PTHREADS
+static pthread_mutex_t print_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void Section(const struct ops *ops, const struct job *job, const char *title) {
+  if (!ops->verbose)
+    return;
+  if (job->prefix)
+    printf("%s: %s\n", job->prefix, title);
+  else
+    printf("\n%s\n", title);
+}
+
+static void Status(const struct ops *ops, const struct job *job, const char *fmt, ...) {
+  char buf[256];
+  va_list ap;
+  
+  if (!ops->verbose)
+    return;
+  va_start(ap, fmt);
+  vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  if (job->prefix)
+    printf("%s: %s\n", job->prefix, buf);
+  else
+    printf("%s\n", buf);
+}
+
+static int PrintMass(const struct ops *ops, const struct job *job, struct lp_vl_list *data) {
+  struct lp_mass_properties *mp = NULL;
+  struct lp_vl_list *list;
+  size_t count;
+  
+  Section(ops, job, "Calculating mass properies");
+  count = LP_VertexList_ListLength(data);
+  if (count && (mp = malloc(count * sizeof(*mp))) == NULL)
+    return -1;
+  if (LP_MassProperties_List(data, mp, 0) < 0) {
+    free(mp);
+    return -1;
+  }
+  
+#ifdef HAVE_PTHREADS
+  pthread_mutex_lock(&print_mutex);
+#endif
+  for (count = 0, list = data; list != NULL; list = list->next, count++) {
+    if (job->prefix)
+      printf("Properties for %s polyhedra %zu:\n", job->prefix, count);
+    else
+      printf("Properties for polyhedra %zu:\n", count);
+    printf("  Vertices: %llu, Indices: %zu\n",
+	   (unsigned long long) LP_VertexList_NumVert(list->vl),
+	   LP_VertexList_NumInd(list->vl));
+    printf("  Volume:         %g\n", mp[count].volume);
+    printf("  Center of mass: (%g, %g, %g)\n", mp[count].center_of_mass[0], mp[count].center_of_mass[1], mp[count].center_of_mass[2]);
+    printf("  Inertia Tensor:\n");
+    printf("    [%20g, %20g, %20g]\n", mp[count].inertia_tensor[0], mp[count].inertia_tensor[1], mp[count].inertia_tensor[2]);
+    printf("    [%20g, %20g, %20g]\n", mp[count].inertia_tensor[3], mp[count].inertia_tensor[4], mp[count].inertia_tensor[5]);
+    printf("    [%20g, %20g, %20g]\n\n", mp[count].inertia_tensor[6], mp[count].inertia_tensor[7], mp[count].inertia_tensor[8]);
+  }
+#ifdef HAVE_PTHREADS
+  pthread_mutex_unlock(&print_mutex);
+#endif
+  free(mp);
+  return 0;
+}
+
+/* Output name for -O: <dir>/<input name> with the extension of <outfile> */
+static char *Out_Name(const char *dir, const char *infile, const char *outfile) {
+  const char *base, *dot, *ext;
+  size_t len_dir, len_base;
+  char *name;
+  
+  ext = strrchr(outfile, '.');
+  if (ext == NULL || strchr(ext, '/'))
+    ext = ".obj";
+  if ((base = strrchr(infile, '/')) != NULL)
+    base++;
+  else
+    base = infile;
+  if ((dot = strrchr(base, '.')) != NULL && dot != base)
+    len_base = dot - base;
+  else
+    len_base = strlen(base);
+  len_dir = strlen(dir);
+  
+  if ((name = malloc(len_dir + len_base + strlen(ext) + 2)) == NULL)
+    return NULL;
+  memcpy(name, dir, len_dir);
+  if (len_dir > 0 && dir[len_dir - 1] != '/')
+    name[len_dir++] = '/';
+  memcpy(name + len_dir, base, len_base);
+  strcpy(name + len_dir + len_base, ext);
+  return name;
+}
+
+static int OutNameCmp(const void *a, const void *b) {
+  const struct job *ja = *(const struct job * const *) a, *jb = *(const struct job * const *) b;
+  
+  return strcmp(ja->outfile, jb->outfile);
+}
+
+/* Two jobs writing one file would race and lose one of the results */
+static int Check_OutNames(const struct batch *batch) {
+  const struct job **sorted;
+  size_t count;
+  int ret = 0;
+  
+  if ((sorted = malloc(batch->num * sizeof(*sorted))) == NULL) {
+    fprintf(stderr, "Error: Could not allocate memory for output names\n");
+    return -1;
+  }
+  for (count = 0; count < batch->num; count++)
+    sorted[count] = &batch->jobs[count];
+  qsort(sorted, batch->num, sizeof(*sorted), OutNameCmp);
+  
+  for (count = 1; count < batch->num; count++) {
+    if (strcmp(sorted[count - 1]->outfile, sorted[count]->outfile) == 0) {
+      fprintf(stderr, "Error: '%s' and '%s' would both be saved to '%s'\n",
+	      sorted[count - 1]->infile, sorted[count]->infile, sorted[count]->outfile);
+      ret = -1;
+    }
+  }
+  
+  free(sorted);
+  return ret;
+}
+
+static int Process(const struct ops *ops, struct job *job) {
+  struct lp_vl_list *list, *list2, *out;
+  size_t count;
+  
+  if ((job->data = LP_VertexList_Read(job->infile, ops->scale)) == NULL)
+    return -1;
+  
+  if (ops->simplify > 0) {
+    Section(ops, job, "Simplifying");
+    if ((list = LP_Simplify_List(job->data, ops->simplify, 0, 0)) == NULL)
+      return -1;
+    LP_VertexList_ListFree(job->data);
+    job->data = list;
+  }
+  
+  if (ops->convex) {
+    Section(ops, job, "Calculating convex hulls");
+    if ((list = LP_ConvexHull_List(job->data, 0)) == NULL)
+      return -1;
+    LP_VertexList_ListFree(job->data);
+    job->data = list;
+  }
+  
+  if (ops->plane) {
+    out = NULL;
+    for (count = 0, list = job->data; list != NULL; list = list->next, count++) {
+      Status(ops, job, "Cutting polyhedra %zu along plane", count);
+      if ((list2 = LP_PlaneCut(list->vl, ops->pval, ops->pval[3])) == NULL)
+	goto err;
+      Status(ops, job, "  -> Split into %zu polyhedra", LP_VertexList_ListLength(list2));
+      if ((out = LP_VertexList_ListJoin(out, list2)) == NULL)
+	goto err;
+    }
+    LP_VertexList_ListFree(job->data);
+    job->data = out;
+  }
+  
+  if (ops->decomp) {
+    out = NULL;
+    for (count = 0, list = job->data; list != NULL; list = list->next, count++) {
+      Status(ops, job, "Decomposing polyhedra %zu", count);
+      if ((list2 = LP_ConvexDecomp(list->vl, ops->dval[0])) == NULL)
+	goto err;
+      Status(ops, job, "  -> Split into %zu convex polyhedra", LP_VertexList_ListLength(list2));
+      if ((out = LP_VertexList_ListJoin(out, list2)) == NULL)
+	goto err;
+    }
+    LP_VertexList_ListFree(job->data);
+    job->data = out;
+  }
+  
+  if (ops->outdir) {
+    if (ops->mass_prop && PrintMass(ops, job, job->data) < 0)
+      return -1;
+    if (LP_VertexList_Write(job->outfile, job->data, 1.0) < 0)
+      return -1;
+    LP_VertexList_ListFree(job->data);
+    job->data = NULL;
+  }
+  return 0;
+  
+ err:
+  LP_VertexList_ListFree(out);
+  return -1;
+}
+
+static int Batch_Next(struct batch *batch, size_t *idx) {
+  int ret = 0;
+  
+#ifdef HAVE_PTHREADS
+  pthread_mutex_lock(&batch->mutex);
+#endif
+  if (batch->next < batch->num && (!batch->err || batch->ops->outdir)) {
+    *idx = batch->next++;
+    ret = 1;
+  }
+#ifdef HAVE_PTHREADS
+  pthread_mutex_unlock(&batch->mutex);
+#endif
+  return ret;
+}
+
+/* Takes input files in order until none are left */
+static void *Batch_Worker(void *user) {
+  struct batch *batch = user;
+  size_t idx;
+  
+  while (Batch_Next(batch, &idx)) {
+    if (Process(batch->ops, &batch->jobs[idx]) < 0) {
+      fprintf(stderr, "Error: Could not process '%s'\n", batch->jobs[idx].infile);
+#ifdef HAVE_PTHREADS
+      pthread_mutex_lock(&batch->mutex);
+#endif
+      batch->err = 1;
+#ifdef HAVE_PTHREADS
+      pthread_mutex_unlock(&batch->mutex);
+#endif
+    }
+  }
+  return NULL;
+}
+
+static int Batch_Run(struct batch *batch, size_t workers) {
+#ifdef HAVE_PTHREADS
+  pthread_t *threads = NULL;
+  size_t count, started = 0;
+  
+  pthread_mutex_init(&batch->mutex, NULL);
+  if (workers > 1 && (threads = malloc((workers - 1) * sizeof(*threads))) != NULL)
+    for (; started < workers - 1; started++)
+      if (pthread_create(&threads[started], NULL, Batch_Worker, batch) != 0)
+	break;
+  Batch_Worker(batch);
+  for (count = 0; count < started; count++)
+    pthread_join(threads[count], NULL);
+  free(threads);
+  pthread_mutex_destroy(&batch->mutex);
+#else
+  Batch_Worker(batch);
+#endif
+  return batch->err ? -1 : 0;
+}
+
 int main(int argc, char *argv[]) {
-  int mass_prop = 0;
-  unsigned long long simplify = 0;
-  int convex = 0;
-  int decomp = 0;
-  int verbose = 1;
-  int plane = 0;
-  float scale = 1.0, dval[1], pval[4];
+  struct ops ops = {0};
   const char *outfile = "out.obj";
+  const char *cache_dir = NULL;
   char *end;
-  struct lp_vl_list *data = NULL, *list, *list2, *out;
-  struct lp_mass_properties mp;
-  size_t count;
+  struct lp_vl_list *data = NULL;
+  struct batch batch = {0};
+  struct job *job;
+  unsigned long threads = 1;
+  size_t workers, count;
   int opt;
 
 #ifdef HAVE_SETLOCALE
   setlocale(LC_NUMERIC, "C");
 #endif
   
-  while ((opt = getopt(argc, argv, "cd:hmo:p:qs:x:")) >= 0) {
+  ops.verbose = 1;
+  ops.scale = 1.0;
+  while ((opt = getopt(argc, argv, "cC:d:hj:mo:O:p:qs:x:")) >= 0) {
     switch (opt) {
     case 'c':
-      convex = 1;
+      ops.convex = 1;
+      break;
+
+    case 'C':
+      cache_dir = optarg;
       break;
 
     case 'd':
-      decomp = 1;
-      Parse_Floats(dval, 1, optarg);
+      ops.decomp = 1;
+      Parse_Floats(ops.dval, 1, optarg);
       break;
       
     case 'h':
       help(stdout);
       exit(0);
       
+    case 'j':
+      threads = strtoul(optarg, &end, 0);
+      if (*end != '\0') {
+	fprintf(stderr, "Error: expected non-negative integer for -j argument: %s\n", optarg);
+	help(stderr);
+	exit(1);
+      }
+      break;
+      
     case 'm':
-      mass_prop = 1;
+      ops.mass_prop = 1;
       break;
       
     case 'o':
       outfile = strdup(optarg);
       break;
       
+    case 'O':
+      ops.outdir = optarg;
+      break;
+      
     case 'p':
-      plane = 1;
-      Parse_Floats(pval, 4, optarg);
+      ops.plane = 1;
+      Parse_Floats(ops.pval, 4, optarg);
       break;
       
     case 'q':
-      verbose = 0;
+      ops.verbose = 0;
       break;
       
     case 's':
-      simplify = strtoull(optarg, &end, 0);
+      ops.simplify = strtoull(optarg, &end, 0);
       if (*end != '\0') {
 	fprintf(stderr, "Error: expected non-negative integer for -s argument: %s\n", optarg);
 	help(stderr);
@@ -165,7 +488,7 @@ int main(int argc, char *argv[]) {
       break;
 
     case 'x':
-      scale = strtof(optarg, &end);
+      ops.scale = strtof(optarg, &end);
       if (*end != '\0') {
 	fprintf(stderr, "Error: expected floating point number for -x argument: %s\n", optarg);
 	help(stderr);
@@ -180,86 +503,57 @@ int main(int argc, char *argv[]) {
     }
   }
   
+  LP_SetLogCallback(Log, NULL);
+  if (ops.verbose)
+    LP_SetLogLevel(lp_log_info);
+  
+  if (cache_dir && LP_Cache_Enable(CACHE_SIZE, cache_dir) < 0)
+    exit(1);
+  
   if (optind >= argc) {
     fprintf(stderr, "Error: At least one input file expected\n");
     help(stderr);
     exit(1);
   }
   
-  while (optind < argc) {
-    if ((list = LP_VertexList_Read(argv[optind], scale)) == NULL)
-      exit(1);
-    if ((data = LP_VertexList_ListJoin(data, list)) == NULL)
+  batch.ops = &ops;
+  batch.num = argc - optind;
+  if ((batch.jobs = calloc(batch.num, sizeof(*batch.jobs))) == NULL)
+    exit(1);
+  for (count = 0; count < batch.num; count++) {
+    job = &batch.jobs[count];
+    job->infile = argv[optind + count];
+    if (batch.num > 1)
+      job->prefix = job->infile;
+    if (ops.outdir && (job->outfile = Out_Name(ops.outdir, job->infile, outfile)) == NULL)
       exit(1);
-    optind++;
   }
+  if (ops.outdir && Check_OutNames(&batch) < 0)
+    exit(1);
   
-  if (simplify > 0) {
-    if (verbose)
-      printf("\nSimplifying\n");
-    for (count = 0, list = data; list != NULL; list = list->next, count++) {
-      if ((list->vl = LP_Simplify(list->vl, simplify, 0)) == NULL)
-	exit(1);
-    }
+  /* Files run side by side and split the threads between their library calls */
+  if (threads == 0) {
+    LP_SetNumThreads(0);
+    threads = LP_GetNumThreads();
   }
+  workers = threads < batch.num ? threads : batch.num;
+  LP_SetNumThreads(threads / workers);
   
-  if (convex) {
-    if (verbose)
-      printf("\nCalculating convex hulls\n");
-    for (list = data; list != NULL; list = list->next) {
-      if ((list->vl = LP_ConvexHull(list->vl)) == NULL)
-	exit(1);
-    }    
-  }
+  if (Batch_Run(&batch, workers) < 0 && !ops.outdir)
+    exit(1);
   
-  if (plane) {
-    out = NULL;
-    for (count = 0, list = data; list != NULL; list = list->next, count++) {
-      if (verbose)
-	printf("Cutting polyhedra %zu along plane\n", count);
-      if ((list2 = LP_PlaneCut(list->vl, pval, pval[3])) == NULL)
-	exit(1);
-      if (verbose)
-	printf("  -> Split into %zu polyhedra\n", LP_VertexList_ListLength(list2));
-      if ((out = LP_VertexList_ListJoin(out, list2)) == NULL)
-	exit(1);
-    }
-    LP_VertexList_ListFree(data);
-    data = out;
-  }
+  if (ops.outdir)
+    exit(batch.err);
   
-  if (decomp) {
-    out = NULL;
-    for (count = 0, list = data; list != NULL; list = list->next, count++) {
-      if (verbose)
-	printf("Decomposing polyhedra %zu\n", count);
-      if ((list2 = LP_ConvexDecomp(list->vl, dval[0])) == NULL)
-	exit(1);
-      if (verbose)
-	printf("  -> Split into %zu convex polyhedra\n", LP_VertexList_ListLength(list2));
-      if ((out = LP_VertexList_ListJoin(out, list2)) == NULL)
-	exit(1);
-    }
-    LP_VertexList_ListFree(data);
-    data = out;
-  }
+  for (count = 0; count < batch.num; count++)
+    if ((data = LP_VertexList_ListJoin(data, batch.jobs[count].data)) == NULL)
+      exit(1);
   
-  if (mass_prop) {
-    if (verbose)
-      printf("\nCalculating mass properies\n");
-    for (count = 0, list = data; list != NULL; list = list->next, count++) {
-      LP_MassProperties(list->vl, &mp);
-      printf("Properties for polyhedra %zu:\n", count);
-      printf("  Vertices: %u, Indices: %zu\n",
-	     LP_VertexList_NumVert(list->vl),
-	     LP_VertexList_NumInd(list->vl));
-      printf("  Volume:         %g\n", mp.volume);
-      printf("  Center of mass: (%g, %g, %g)\n", mp.center_of_mass[0], mp.center_of_mass[1], mp.center_of_mass[2]);
-      printf("  Inertia Tensor:\n");
-      printf("    [%20g, %20g, %20g]\n", mp.inertia_tensor[0], mp.inertia_tensor[1], mp.inertia_tensor[2]);
-      printf("    [%20g, %20g, %20g]\n", mp.inertia_tensor[3], mp.inertia_tensor[4], mp.inertia_tensor[5]);
-      printf("    [%20g, %20g, %20g]\n\n", mp.inertia_tensor[6], mp.inertia_tensor[7], mp.inertia_tensor[8]);
-    }
+  if (ops.mass_prop) {
+    job = &batch.jobs[0];
+    job->prefix = NULL;
+    if (PrintMass(&ops, job, data) < 0)
+      exit(1);
   }
   
   if (*outfile != '\0') {